@@ -25,6 +25,30 @@
 #define NVME_SQ_ENTRY_SIZE 64
 #define NVME_CQ_ENTRY_SIZE 16
 
+/* The I/O queue pair may be smaller if the controller doesn't support this many entries. */
+#define NVME_IO_QUEUE_SIZE 32
+/* Read commands in flight at the same time, each with its own PRP list page. */
+#define NVME_IO_SLOTS 16
+/* Reads started with nvme_read_blocks512_async() and not yet waited for. */
+#define NVME_IO_REQUESTS 16
+/* Request used by the synchronous read path, so it works with all handles taken. */
+#define NVME_SYNC_REQUEST NVME_IO_REQUESTS
+/* One PRP list page covers 512 pages, so 512 blocks always fit. */
+#define NVME_MAX_READ_BLOCKS 512
+
+struct nvme_slot {
+	uint64_t *prp_list;
+	int request;	// -1 if free
+	size_t offset;	// first block of the command within its request
+};
+
+struct nvme_request {
+	bool used;
+	unsigned int pending;
+	size_t count;
+	size_t good;	// blocks read before the first failed command
+};
+
 struct nvme_dev {
 	storage_dev_t storage_dev;
 
@@ -37,7 +61,10 @@ struct nvme_dev {
 		uint16_t round; // bool round 0 or 1+0xd
 	} queue[4];
 
-	uint64_t *prp_list;
+	uint16_t io_queue_size;
+	unsigned int io_slots;
+	struct nvme_slot slots[NVME_IO_SLOTS];
+	struct nvme_request requests[NVME_IO_REQUESTS + 1];
 };
 
 
@@ -84,6 +111,42 @@ static int nvme_cmd(
 	return c_entry->dw[3] >> 17;
 }
 
+/* Process all new entries on the I/O completion queue. */
+static void nvme_reap_io(struct nvme_dev *nvme)
+{
+	struct nvme_c_queue_entry *c_entry;
+	struct nvme_request *req;
+	struct nvme_slot *slot;
+	bool reaped = false;
+	uint32_t dw3;
+
+	while (1) {
+		c_entry = nvme->queue[ioc].base + (nvme->queue[ioc].idx * NVME_CQ_ENTRY_SIZE);
+		dw3 = read32(&c_entry->dw[3]);
+		if (((dw3 >> 16) & 0x1) == nvme->queue[ioc].round)
+			break;
+
+		nvme->queue[ioc].idx = (nvme->queue[ioc].idx + 1) % nvme->io_queue_size;
+		if (nvme->queue[ioc].idx == 0)
+			nvme->queue[ioc].round = (nvme->queue[ioc].round + 1) & 1;
+		reaped = true;
+
+		if ((dw3 & 0xffff) >= nvme->io_slots) {
+			printf("NVMe ERROR: Completion for unknown command %u\n", dw3 & 0xffff);
+			continue;
+		}
+		slot = &nvme->slots[dw3 & 0xffff];
+		req = &nvme->requests[slot->request];
+		if (dw3 >> 17)
+			req->good = MIN(req->good, slot->offset);
+		req->pending--;
+		slot->request = -1;
+	}
+
+	if (reaped)
+		write32(nvme->queue[ioc].bell, nvme->queue[ioc].idx);
+}
+
 static int delete_io_submission_queue(struct nvme_dev *nvme)
 {
 	const struct nvme_s_queue_entry e = {
@@ -136,10 +199,21 @@ static int delete_admin_queues(struct nvme_dev *nvme)
 	return 0;
 }
 
+static bool nvme_io_busy(struct nvme_dev *nvme)
+{
+	for (unsigned int i = 0; i < nvme->io_slots; ++i)
+		if (nvme->slots[i].request >= 0)
+			return true;
+	return false;
+}
+
 static void nvme_detach_device(struct storage_dev *dev)
 {
 	struct nvme_dev *nvme = (struct nvme_dev *)dev;
 
+	while (nvme_io_busy(nvme))
+		nvme_reap_io(nvme);
+
 	if (delete_io_submission_queue(nvme))
 		printf("NVMe ERROR: Failed to delete io submission queue\n");
 	if (delete_io_completion_queue(nvme))
@@ -167,16 +241,32 @@ static void nvme_detach_device(struct storage_dev *dev)
 	uint16_t command = pci_read_config16(nvme->pci_dev, PCI_COMMAND);
 	pci_write_config16(nvme->pci_dev, PCI_COMMAND, command & ~PCI_COMMAND_MASTER);
 
-	free(nvme->prp_list);
+	for (unsigned int i = 0; i < nvme->io_slots; ++i)
+		free(nvme->slots[i].prp_list);
 }
 
-static int nvme_read(struct nvme_dev *nvme, unsigned char *buffer, uint64_t base, uint16_t count)
+static struct nvme_slot *nvme_get_slot(struct nvme_dev *nvme)
 {
-	if (count == 0 || count > 512)
+	while (1) {
+		for (unsigned int i = 0; i < nvme->io_slots; ++i)
+			if (nvme->slots[i].request < 0)
+				return &nvme->slots[i];
+		nvme_reap_io(nvme);
+	}
+}
+
+/* Submit a read command for part of a request without waiting for it. */
+static int nvme_submit_read(struct nvme_dev *nvme, int request, size_t offset,
+			    unsigned char *buffer, uint64_t base, uint16_t count)
+{
+	if (count == 0 || count > NVME_MAX_READ_BLOCKS)
 		return -1;
 
+	struct nvme_slot *const slot = nvme_get_slot(nvme);
+	const unsigned int cid = slot - nvme->slots;
+
 	struct nvme_s_queue_entry e = {
-		.dw[0] = 0x02,
+		.dw[0] = 0x02 | cid << 16,
 		.dw[1] = 0x1,
 		.dw[6] = virt_to_phys(buffer),
 		.dw[10] = base,
@@ -192,45 +282,112 @@ static int nvme_read(struct nvme_dev *nvme, unsigned char *buffer, uint64_t base
 		/* Crossing exactly one page boundary, PRP2 is second page */
 		e.dw[8] = virt_to_phys(buffer + 0x1000) & ~0xfff;
 	} else {
-		/* Use a single page as PRP list, PRP2 points to the list */
+		/* Use the slot's page as PRP list, PRP2 points to the list */
 		unsigned int i;
 		for (i = 0; i < end_page - start_page; ++i) {
 			buffer += 0x1000;
-			nvme->prp_list[i] = virt_to_phys(buffer) & ~0xfff;
+			slot->prp_list[i] = virt_to_phys(buffer) & ~0xfff;
 		}
-		e.dw[8] = virt_to_phys(nvme->prp_list);
+		e.dw[8] = virt_to_phys(slot->prp_list);
 	}
 
-	return nvme_cmd(nvme, ios, &e);
+	slot->request = request;
+	slot->offset = offset;
+	nvme->requests[request].pending++;
+
+	/* Slots never outnumber the queue entries, so the queue can't be full. */
+	void *s_entry = nvme->queue[ios].base + (nvme->queue[ios].idx * NVME_SQ_ENTRY_SIZE);
+	memcpy(s_entry, &e, NVME_SQ_ENTRY_SIZE);
+	nvme->queue[ios].idx = (nvme->queue[ios].idx + 1) % nvme->io_queue_size;
+	write32(nvme->queue[ios].bell, nvme->queue[ios].idx);
+
+	return 0;
 }
 
-static ssize_t nvme_read_blocks512(
-		struct storage_dev *const dev,
-		const lba_t start, const size_t count, unsigned char *const buf)
+static void nvme_start_read(struct nvme_dev *nvme, int request,
+			    const lba_t start, const size_t count, unsigned char *const buf)
 {
-	unsigned int off = 0;
+	struct nvme_request *const req = &nvme->requests[request];
+
+	req->used = true;
+	req->pending = 0;
+	req->count = count;
+	req->good = count;
+
+	size_t off = 0;
 	while (off < count) {
-		const unsigned int blocks = MIN(count - off, 512);
-		if (nvme_read((struct nvme_dev *)dev, buf + (off * 512), start + off, blocks))
-			return off;
+		const unsigned int blocks = MIN(count - off, NVME_MAX_READ_BLOCKS);
+		if (nvme_submit_read(nvme, request, off, buf + (off * 512), start + off, blocks)) {
+			req->good = MIN(req->good, off);
+			break;
+		}
 		off += blocks;
 	}
-	return count;
+}
+
+static ssize_t nvme_finish_read(struct nvme_dev *nvme, int request)
+{
+	struct nvme_request *const req = &nvme->requests[request];
+
+	while (req->pending)
+		nvme_reap_io(nvme);
+
+	req->used = false;
+	return req->good;
+}
+
+static storage_handle_t nvme_read_blocks512_async(
+		struct storage_dev *const dev,
+		const lba_t start, const size_t count, unsigned char *const buf)
+{
+	struct nvme_dev *const nvme = (struct nvme_dev *)dev;
+	int request;
+
+	for (request = 0; request < NVME_IO_REQUESTS; ++request)
+		if (!nvme->requests[request].used)
+			break;
+	if (request == NVME_IO_REQUESTS)
+		return -1;
+
+	nvme_start_read(nvme, request, start, count, buf);
+	return request;
+}
+
+static ssize_t nvme_wait(struct storage_dev *const dev, const storage_handle_t handle)
+{
+	struct nvme_dev *const nvme = (struct nvme_dev *)dev;
+
+	if (handle < 0 || handle >= NVME_IO_REQUESTS || !nvme->requests[handle].used)
+		return -1;
+
+	const ssize_t good = nvme_finish_read(nvme, handle);
+	return good == nvme->requests[handle].count ? good : -1;
+}
+
+static ssize_t nvme_read_blocks512(
+		struct storage_dev *const dev,
+		const lba_t start, const size_t count, unsigned char *const buf)
+{
+	struct nvme_dev *const nvme = (struct nvme_dev *)dev;
+
+	/* Large reads are split into several commands which run in parallel. */
+	nvme_start_read(nvme, NVME_SYNC_REQUEST, start, count, buf);
+	return nvme_finish_read(nvme, NVME_SYNC_REQUEST);
 }
 
 static int create_io_submission_queue(struct nvme_dev *nvme)
 {
-	void *sq_buffer = memalign(0x1000, NVME_SQ_ENTRY_SIZE * NVME_QUEUE_SIZE);
+	void *sq_buffer = memalign(0x1000, NVME_SQ_ENTRY_SIZE * nvme->io_queue_size);
 	if (!sq_buffer) {
 		printf("NVMe ERROR: Failed to allocate memory for io submission queue.\n");
 		return -1;
 	}
-	memset(sq_buffer, 0, NVME_SQ_ENTRY_SIZE * NVME_QUEUE_SIZE);
+	memset(sq_buffer, 0, NVME_SQ_ENTRY_SIZE * nvme->io_queue_size);
 
 	struct nvme_s_queue_entry e = {
 		.dw[0]  = 0x01,
 		.dw[6]  = virt_to_phys(sq_buffer),
-		.dw[10] = ((NVME_QUEUE_SIZE - 1) << 16) | ios >> 1,
+		.dw[10] = ((nvme->io_queue_size - 1) << 16) | ios >> 1,
 		.dw[11] = (1 << 16) | 1,
 	};
 
@@ -250,17 +407,17 @@ static int create_io_submission_queue(struct nvme_dev *nvme)
 
 static int create_io_completion_queue(struct nvme_dev *nvme)
 {
-	void *const cq_buffer = memalign(0x1000, NVME_CQ_ENTRY_SIZE * NVME_QUEUE_SIZE);
+	void *const cq_buffer = memalign(0x1000, NVME_CQ_ENTRY_SIZE * nvme->io_queue_size);
 	if (!cq_buffer) {
 		printf("NVMe ERROR: Failed to allocate memory for io completion queue.\n");
 		return -1;
 	}
-	memset(cq_buffer, 0, NVME_CQ_ENTRY_SIZE * NVME_QUEUE_SIZE);
+	memset(cq_buffer, 0, NVME_CQ_ENTRY_SIZE * nvme->io_queue_size);
 
 	const struct nvme_s_queue_entry e = {
 		.dw[0]  = 0x05,
 		.dw[6]  = virt_to_phys(cq_buffer),
-		.dw[10] = ((NVME_QUEUE_SIZE - 1) << 16) | ioc >> 1,
+		.dw[10] = ((nvme->io_queue_size - 1) << 16) | ioc >> 1,
 		.dw[11] = 1,
 	};
 
@@ -334,14 +491,24 @@ static void nvme_init(pcidev_t dev)
 	nvme->storage_dev.poll			= nvme_poll;
 	nvme->storage_dev.read_blocks512	= nvme_read_blocks512;
 	nvme->storage_dev.write_blocks512	= NULL;
+	nvme->storage_dev.read_blocks512_async	= nvme_read_blocks512_async;
+	nvme->storage_dev.wait			= nvme_wait;
 	nvme->storage_dev.detach_device		= nvme_detach_device;
 	nvme->pci_dev				= dev;
 	nvme->config				= pci_bar0;
-	nvme->prp_list				= memalign(0x1000, 0x1000);
 
-	if (!nvme->prp_list) {
-		printf("NVMe ERROR: Failed to allocate buffer for PRP list\n");
-		goto _free_abort;
+	/* CAP.MQES is the zero-based maximum queue size. */
+	nvme->io_queue_size = MIN(NVME_IO_QUEUE_SIZE, (read64(pci_bar0) & 0xffff) + 1);
+	nvme->io_slots = MIN(NVME_IO_SLOTS, nvme->io_queue_size - 1);
+	memset(nvme->slots, 0, sizeof(nvme->slots));
+	memset(nvme->requests, 0, sizeof(nvme->requests));
+	for (unsigned int i = 0; i < nvme->io_slots; ++i) {
+		nvme->slots[i].request = -1;
+		nvme->slots[i].prp_list = memalign(0x1000, 0x1000);
+		if (!nvme->slots[i].prp_list) {
+			printf("NVMe ERROR: Failed to allocate buffer for PRP list\n");
+			goto _free_abort;
+		}
 	}
 
 	const uint32_t cc = NVME_CC_EN | NVME_CC_CSS | NVME_CC_MPS | NVME_CC_AMS | NVME_CC_SHN
@@ -393,7 +560,8 @@ _delete_completion_abort:
 _delete_admin_abort:
 	delete_admin_queues(nvme);
 _free_abort:
-	free(nvme->prp_list);
+	for (unsigned int i = 0; i < nvme->io_slots; ++i)
+		free(nvme->slots[i].prp_list);
 	free(nvme);
 	printf("NVMe init failed.\n");
 }
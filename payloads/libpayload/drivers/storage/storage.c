@@ -100,6 +100,46 @@ ssize_t storage_read_blocks512(const size_t dev_num,
 		return -1;
 }
 
+/**
+ * Start reading 512-byte blocks
+ *
+ * Like storage_read_blocks512() but returns as soon as the read was
+ * started. Several reads may be in flight at the same time. The data
+ * in buf is only valid after storage_wait() returned for the handle.
+ *
+ * @dev_num device number counted from 0
+ * @start number of first block to read from
+ * @count number of blocks to read
+ * @buf buffer where the read data should be written
+ * @return handle to pass to storage_wait(), negative on error or if the
+ *	   device doesn't support asynchronous reads
+ */
+storage_handle_t storage_read_blocks512_async(const size_t dev_num,
+					      const lba_t start, const size_t count,
+					      unsigned char *const buf)
+{
+	if ((dev_num < dev_count) && devices[dev_num]->read_blocks512_async)
+		return devices[dev_num]->read_blocks512_async(
+				devices[dev_num], start, count, buf);
+	else
+		return -1;
+}
+
+/**
+ * Wait for a read started with storage_read_blocks512_async()
+ *
+ * @dev_num device number counted from 0
+ * @handle handle returned by storage_read_blocks512_async()
+ * @return number of blocks read, -1 on error
+ */
+ssize_t storage_wait(const size_t dev_num, const storage_handle_t handle)
+{
+	if ((dev_num < dev_count) && devices[dev_num]->wait && handle >= 0)
+		return devices[dev_num]->wait(devices[dev_num], handle);
+	else
+		return -1;
+}
+
 /**
  * Initializes storage controllers
  *
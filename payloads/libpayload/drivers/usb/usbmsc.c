@@ -97,8 +97,14 @@ usb_msc_destroy(usbdev_t *dev)
 const int DEV_RESET = 0xff;
 const int GET_MAX_LUN = 0xfe;
 /* Many USB3 devices do not work with large transfer requests.
- * Limit the request size to 64KB chunks to ensure maximum compatibility. */
-const int MAX_CHUNK_BYTES = 1024 * 64;
+ * Start with 64KB chunks, which all devices handle, and only grow them
+ * up to MAX_CHUNK_BYTES while the device keeps up. A failing large chunk
+ * limits the device to MIN_CHUNK_BYTES from then on. */
+const int MIN_CHUNK_BYTES = 1024 * 64;
+const int MAX_CHUNK_BYTES = 1024 * 1024;
+/* Buffers outside of DMA memory are bounced through the controller's
+ * 64KB DMA buffer, so their data stage is split into pieces that fit. */
+const int BOUNCE_CHUNK_BYTES = 1024 * 64;
 
 const unsigned int cbw_signature = 0x43425355;
 const unsigned int csw_signature = 0x53425355;
@@ -245,6 +251,31 @@ get_csw(endpoint_t *ep, csw_t *csw)
 	return MSC_COMMAND_OK;
 }
 
+/* The data stage ends early on errors and short transfers, the CSW
+   residue then tells how much was actually transferred. */
+static void
+transfer_data(usbdev_t *dev, cbw_direction dir, u8 *buf, int buflen)
+{
+	endpoint_t *ep = (dir == cbw_direction_data_in)
+		? MSC_INST(dev)->bulk_in : MSC_INST(dev)->bulk_out;
+	/* Buffers in DMA memory are transferred in place, in one go. */
+	const int piece = dma_coherent(buf) ? buflen : BOUNCE_CHUNK_BYTES;
+	int len, ret;
+
+	while (buflen > 0) {
+		len = MIN(buflen, piece);
+		ret = dev->controller->bulk(ep, len, buf, 0);
+		if (ret < 0) {
+			clear_stall(ep);
+			return;
+		}
+		if (ret < len)
+			return;
+		buf += len;
+		buflen -= len;
+	}
+}
+
 static int
 execute_command(usbdev_t *dev, cbw_direction dir, const u8 *cb, int cblen,
 		 u8 *buf, int buflen, int residue_ok)
@@ -261,17 +292,8 @@ execute_command(usbdev_t *dev, cbw_direction dir, const u8 *cb, int cblen,
 	    bulk(MSC_INST(dev)->bulk_out, sizeof(cbw), (u8 *) &cbw, 0) < 0) {
 		return reset_transport(dev);
 	}
-	if (buflen > 0) {
-		if (dir == cbw_direction_data_in) {
-			if (dev->controller->
-			    bulk(MSC_INST(dev)->bulk_in, buflen, buf, 0) < 0)
-				clear_stall(MSC_INST(dev)->bulk_in);
-		} else {
-			if (dev->controller->
-			    bulk(MSC_INST(dev)->bulk_out, buflen, buf, 0) < 0)
-				clear_stall(MSC_INST(dev)->bulk_out);
-		}
-	}
+	if (buflen > 0)
+		transfer_data(dev, dir, buf, buflen);
 	int ret = get_csw(MSC_INST(dev)->bulk_in, &csw);
 	if (ret) {
 		return ret;
@@ -313,6 +335,15 @@ typedef struct {
 	unsigned char control;	//9 - the block is 10 bytes long
 } __packed cmdblock_t;
 
+typedef struct {
+	unsigned char command;	//0
+	unsigned char res1;	//1 - service action for READ CAPACITY(16)
+	unsigned long long block;	//2-9
+	unsigned int numblocks;	//10-13 - allocation length for READ CAPACITY(16)
+	unsigned char res2;	//14
+	unsigned char control;	//15 - the block is 16 bytes long
+} __packed cmdblock16_t;
+
 typedef struct {
 	unsigned char command;	//0
 	unsigned char res1;	//1
@@ -342,7 +373,7 @@ typedef struct {
  * @return 0 on success, 1 on failure
  */
 int
-readwrite_blocks_512(usbdev_t *dev, int start, int n,
+readwrite_blocks_512(usbdev_t *dev, u64 start, int n,
 	cbw_direction dir, u8 *buf)
 {
 	int blocksize_divider = MSC_INST(dev)->blocksize / 512;
@@ -352,19 +383,32 @@ readwrite_blocks_512(usbdev_t *dev, int start, int n,
 
 /**
  * Reads or writes a number of sequential blocks on a USB storage device.
- * As it uses the READ(10) SCSI-2 command, it's limited to storage devices
- * of at most 2TB. It assumes sectors of 512 bytes.
+ * It uses the READ(10) SCSI-2 command where possible and switches to
+ * READ(16) for blocks beyond the 2TB (in 512 byte sectors) it can address.
  *
  * @param dev device to access
  * @param start first sector to access
  * @param n number of sectors to access
  * @param dir direction of access: cbw_direction_data_in == read, cbw_direction_data_out == write
  * @param buf buffer to read into or write from. Must be at least n*sectorsize bytes
- * @return 0 on success, 1 on failure
+ * @return one of the MSC_COMMAND_* values
  */
 static int
-readwrite_chunk(usbdev_t *dev, int start, int n, cbw_direction dir, u8 *buf)
+readwrite_chunk(usbdev_t *dev, u64 start, int n, cbw_direction dir, u8 *buf)
 {
+	const int buflen = n * MSC_INST(dev)->blocksize;
+
+	if (start + n - 1 > 0xffffffff) {
+		cmdblock16_t cb;
+		memset(&cb, 0, sizeof(cb));
+		// read or write
+		cb.command = (dir == cbw_direction_data_in) ? 0x88 : 0x8a;
+		cb.block = htonll(start);
+		cb.numblocks = htonl(n);
+		return execute_command(dev, dir, (u8 *) &cb, sizeof(cb), buf,
+					buflen, 0);
+	}
+
 	cmdblock_t cb;
 	memset(&cb, 0, sizeof(cb));
 	if (dir == cbw_direction_data_in) {
@@ -378,16 +422,12 @@ readwrite_chunk(usbdev_t *dev, int start, int n, cbw_direction dir, u8 *buf)
 	cb.numblocks = htonw(n);
 
 	return execute_command(dev, dir, (u8 *) &cb, sizeof(cb), buf,
-				n * MSC_INST(dev)->blocksize, 0)
-		!= MSC_COMMAND_OK ? 1 : 0;
+				buflen, 0);
 }
 
 /**
  * Reads or writes a number of sequential blocks on a USB storage device
- * that is split into MAX_CHUNK_BYTES size requests.
- *
- * As it uses the READ(10) SCSI-2 command, it's limited to storage devices
- * of at most 2TB. It assumes sectors of 512 bytes.
+ * that is split into requests of at most MAX_CHUNK_BYTES size.
  *
  * @param dev device to access
  * @param start first sector to access
@@ -399,27 +439,36 @@ readwrite_chunk(usbdev_t *dev, int start, int n, cbw_direction dir, u8 *buf)
  * @return 0 on success, 1 on failure
  */
 int
-readwrite_blocks(usbdev_t *dev, int start, int n, cbw_direction dir, u8 *buf)
+readwrite_blocks(usbdev_t *dev, u64 start, int n, cbw_direction dir, u8 *buf)
 {
-	int chunk_size = MAX_CHUNK_BYTES / MSC_INST(dev)->blocksize;
-	int chunk;
-
-	/* Read as many full chunks as needed. */
-	for (chunk = 0; chunk < (n / chunk_size); chunk++) {
-		if (readwrite_chunk(dev, start + (chunk * chunk_size),
-				     chunk_size, dir,
-				     buf + (chunk * MAX_CHUNK_BYTES))
-		    != MSC_COMMAND_OK)
-			return 1;
-	}
+	usbmsc_inst_t *msc = MSC_INST(dev);
+	const int blocksize = msc->blocksize;
+	int count, ret;
 
-	/* Read any remaining partial chunk at the end. */
-	if (n % chunk_size) {
-		if (readwrite_chunk(dev, start + (chunk * chunk_size),
-				     n % chunk_size, dir,
-				     buf + (chunk * MAX_CHUNK_BYTES))
-		    != MSC_COMMAND_OK)
+	while (n > 0) {
+		count = MIN(n, MAX(msc->chunk_bytes / blocksize, 1));
+		ret = readwrite_chunk(dev, start, count, dir, buf);
+		if (ret == MSC_COMMAND_DETACHED)
 			return 1;
+		if (ret != MSC_COMMAND_OK) {
+			if (count * blocksize <= MIN_CHUNK_BYTES ||
+			    msc->chunk_bytes <= MIN_CHUNK_BYTES)
+				return 1;
+			/* Retry the chunk in pieces the device can handle. */
+			usb_debug("usbmsc: %d byte transfer failed, "
+				  "limiting to %d bytes\n",
+				  count * blocksize, MIN_CHUNK_BYTES);
+			msc->chunk_bytes = MIN_CHUNK_BYTES;
+			msc->max_chunk_bytes = MIN_CHUNK_BYTES;
+			continue;
+		}
+
+		start += count;
+		n -= count;
+		buf += count * blocksize;
+
+		if (msc->chunk_bytes < msc->max_chunk_bytes)
+			msc->chunk_bytes *= 2;
 	}
 
 	return 0;
@@ -491,6 +540,28 @@ spin_up(usbdev_t *dev)
 				sizeof(cb), 0, 0, 0);
 }
 
+/* Devices with more than 2^32 blocks only report their size through
+   READ CAPACITY(16). */
+static int
+read_capacity_16(usbdev_t *dev)
+{
+	cmdblock16_t cb;
+	memset(&cb, 0, sizeof(cb));
+	cb.command = 0x9e;	// service action in
+	cb.res1 = 0x10;		// read capacity
+	u32 buf[8];
+	cb.numblocks = htonl(sizeof(buf));
+
+	int ret = execute_command(dev, cbw_direction_data_in, (u8 *) &cb,
+				  sizeof(cb), (u8 *)buf, sizeof(buf), 1);
+	if (ret)
+		return ret;
+
+	MSC_INST(dev)->numblocks = ((u64)ntohl(buf[0]) << 32 | ntohl(buf[1])) + 1;
+	MSC_INST(dev)->blocksize = ntohl(buf[2]);
+	return MSC_COMMAND_OK;
+}
+
 static int
 read_capacity(usbdev_t *dev)
 {
@@ -519,11 +590,20 @@ read_capacity(usbdev_t *dev)
 		usb_debug("  assuming 2 TB with 512-byte sectors as READ CAPACITY didn't answer.\n");
 		MSC_INST(dev)->numblocks = 0xffffffff;
 		MSC_INST(dev)->blocksize = 512;
+	} else if (buf[0] == 0xffffffff) {
+		MSC_INST(dev)->numblocks = 0xffffffff;
+		MSC_INST(dev)->blocksize = ntohl(buf[1]);
+		ret = read_capacity_16(dev);
+		if (ret == MSC_COMMAND_DETACHED)
+			return ret;
+		if (ret)
+			usb_debug("  READ CAPACITY(16) failed, using the first 2^32 blocks.\n");
 	} else {
 		MSC_INST(dev)->numblocks = ntohl(buf[0]) + 1;
 		MSC_INST(dev)->blocksize = ntohl(buf[1]);
 	}
-	usb_debug("  %d %d-byte sectors (%d MB)\n", MSC_INST(dev)->numblocks,
+	usb_debug("  %llu %d-byte sectors (%llu MB)\n",
+		MSC_INST(dev)->numblocks,
 		MSC_INST(dev)->blocksize,
 		/* round down high block counts to avoid integer overflow */
 		MSC_INST(dev)->numblocks > 1000000
@@ -651,6 +731,8 @@ void usb_msc_force_init(usbdev_t *dev, u32 quirks)
 	MSC_INST(dev)->bulk_out = 0;
 	MSC_INST(dev)->usbdisk_created = 0;
 	MSC_INST(dev)->quirks = quirks;
+	MSC_INST(dev)->chunk_bytes = MIN_CHUNK_BYTES;
+	MSC_INST(dev)->max_chunk_bytes = MAX_CHUNK_BYTES;
 
 	for (i = 1; i <= dev->num_endp; i++) {
 		if (dev->endpoints[i].endpoint == 0)
@@ -61,48 +61,111 @@ static const u32 vga_colors[] = {
 };
 
 static struct cb_framebuffer fbinfo;
+
+/*
+ * The text on the screen. Its rows are a ring buffer, so scrolling only moves
+ * first_row instead of copying all the text.
+ */
 static unsigned short *chars;
+static unsigned int first_row;
+
+/*
+ * What is currently drawn in each text cell, indexed by screen position. Rows
+ * from dirty_first to dirty_last (exclusive) may differ from chars, and are
+ * compared and redrawn by corebootfb_flush().
+ */
+static unsigned short *shown;
+static unsigned int dirty_first, dirty_last;
+
+/* Framebuffer values of the 16 standard colors. */
+static u32 fb_colors[16];
+
+/*
+ * Every possible line of a glyph (one font byte), expanded to font_width
+ * pixels in the framebuffer format, for the last few color combinations.
+ */
+#define GLYPH_CACHE_SIZE 4
+#define GLYPH_CACHE_UNUSED 0xffff
+static struct {
+	unsigned short colors;
+	unsigned char *rows;
+} glyph_cache[GLYPH_CACHE_SIZE];
+static unsigned int glyph_cache_next;
 
 /* Shorthand for up-to-date virtual framebuffer address */
 #define FB ((unsigned char *)phys_to_virt(fbinfo.physical_address))
 
-static void corebootfb_scroll_up(void)
+static size_t glyph_row_bytes(void)
 {
-	unsigned char *dst = FB;
-	unsigned char *src = FB + (fbinfo.bytes_per_line * font_height);
-	int y;
+	return font_width * (fbinfo.bits_per_pixel >> 3);
+}
 
-	/* Scroll all lines up */
-	for (y = 0; y < fbinfo.y_resolution - font_height; y++) {
-		memcpy(dst, src, fbinfo.x_resolution * (fbinfo.bits_per_pixel >> 3));
+static const unsigned char *get_glyph_rows(unsigned int ch)
+{
+	const unsigned short colors = (ch >> 8) & 0xff;
+	const int bytes = fbinfo.bits_per_pixel >> 3;
+	unsigned char *rows, *dst;
+	unsigned int i, bits;
+	u32 color;
+	int x;
+
+	for (i = 0; i < GLYPH_CACHE_SIZE; i++) {
+		if (glyph_cache[i].colors == colors)
+			return glyph_cache[i].rows;
+	}
 
-		dst += fbinfo.bytes_per_line;
-		src += fbinfo.bytes_per_line;
+	i = glyph_cache_next++ % GLYPH_CACHE_SIZE;
+	glyph_cache[i].colors = colors;
+	rows = dst = glyph_cache[i].rows;
+	for (bits = 0; bits < 256; bits++) {
+		for (x = 0; x < font_width; x++) {
+			if (bits & (0x80 >> (x / font_scale)))
+				color = fb_colors[colors & 0xf];
+			else
+				color = fb_colors[colors >> 4];
+			for (i = 0; i < bytes; i++)
+				*dst++ = color >> (i * 8);
+		}
 	}
 
-	/* Erase last line */
-	dst = FB + (fbinfo.y_resolution - font_height) * fbinfo.bytes_per_line;
+	return rows;
+}
+
+static unsigned short *text_row(unsigned int row)
+{
+	return chars + (first_row + row) % coreboot_video_console.rows *
+		coreboot_video_console.columns;
+}
 
-	for (; y < fbinfo.y_resolution; y++) {
-		memset(dst, 0, fbinfo.x_resolution * (fbinfo.bits_per_pixel >> 3));
-		dst += fbinfo.bytes_per_line;
-	}
+static void mark_dirty(unsigned int row)
+{
+	if (row >= coreboot_video_console.rows)
+		return;
 
-	/* And update the char buffer */
-	dst = (unsigned char *)chars;
-	src = (unsigned char *)(chars + coreboot_video_console.columns);
-	memcpy(dst, src, coreboot_video_console.columns *
-			(coreboot_video_console.rows - 1) * 2);
+	dirty_first = MIN(dirty_first, row);
+	dirty_last = MAX(dirty_last, row + 1);
+}
+
+static void corebootfb_scroll_up(void)
+{
+	unsigned short *last;
 	int column;
+
+	first_row = (first_row + 1) % coreboot_video_console.rows;
+
+	last = text_row(coreboot_video_console.rows - 1);
 	for (column = 0; column < coreboot_video_console.columns; column++)
-		chars[(coreboot_video_console.rows - 1) * coreboot_video_console.columns + column] = (VGA_COLOR_DEFAULT << 8);
+		last[column] = (VGA_COLOR_DEFAULT << 8);
+
+	dirty_first = 0;
+	dirty_last = coreboot_video_console.rows;
 
 	cursor_y--;
 }
 
 static void corebootfb_clear(void)
 {
-	int row, column;
+	int row, i;
 	unsigned char *ptr = FB;
 
 	/* Clear the screen */
@@ -111,93 +174,67 @@ static void corebootfb_clear(void)
 		ptr += fbinfo.bytes_per_line;
 	}
 
-	/* And update the char buffer */
-	for(row = 0; row < coreboot_video_console.rows; row++)
-		for (column = 0; column < coreboot_video_console.columns; column++)
-			chars[row * coreboot_video_console.columns + column] = (VGA_COLOR_DEFAULT << 8);
+	/* And update the char buffer. The blank screen matches empty cells. */
+	first_row = 0;
+	for (i = 0; i < coreboot_video_console.rows * coreboot_video_console.columns; i++)
+		chars[i] = shown[i] = (VGA_COLOR_DEFAULT << 8);
+
+	/* The cursor may have to be drawn again. */
+	mark_dirty(cursor_y);
 }
 
 static void corebootfb_putchar(u8 row, u8 col, unsigned int ch)
 {
+	const unsigned char *rows = get_glyph_rows(ch);
+	const size_t row_bytes = glyph_row_bytes();
 	unsigned char *dst;
-
-	unsigned char bg = (ch >> 12) & 0xF;
-	unsigned char fg = (ch >> 8) & 0xF;
-	u32 fgval = 0, bgval = 0;
-	u16 *dst16;
-	u32 *dst32;
-
-	int x, y;
-
-	if (fbinfo.bits_per_pixel > 8) {
-		bgval = ((((vga_colors[bg] >> 0) & 0xff) >> (8 - fbinfo.blue_mask_size)) << fbinfo.blue_mask_pos) |
-			((((vga_colors[bg] >> 8) & 0xff) >> (8 - fbinfo.green_mask_size)) << fbinfo.green_mask_pos) |
-			((((vga_colors[bg] >> 16) & 0xff) >> (8 - fbinfo.red_mask_size)) << fbinfo.red_mask_pos);
-		fgval = ((((vga_colors[fg] >> 0) & 0xff) >> (8 - fbinfo.blue_mask_size)) << fbinfo.blue_mask_pos) |
-			((((vga_colors[fg] >> 8) & 0xff) >> (8 - fbinfo.green_mask_size)) << fbinfo.green_mask_pos) |
-			((((vga_colors[fg] >> 16) & 0xff) >> (8 - fbinfo.red_mask_size)) << fbinfo.red_mask_pos);
-	}
+	int y;
 
 	dst = FB + ((row * font_height) * fbinfo.bytes_per_line);
-	dst += (col * font_width * (fbinfo.bits_per_pixel >> 3));
-
-	for(y = 0; y < font_height; y++) {
-		for(x = font_width - 1; x >= 0; x--) {
-
-			switch (fbinfo.bits_per_pixel) {
-			case 8: /* Indexed */
-				dst[(font_width - x) * (fbinfo.bits_per_pixel >> 3)] = font_glyph_filled(ch, x, y) ?  fg : bg;
-				break;
-			case 16: /* 16 bpp */
-				dst16 = (u16 *)(dst + (font_width - x) * (fbinfo.bits_per_pixel >> 3));
-				*dst16 = font_glyph_filled(ch, x, y) ? fgval : bgval;
-				break;
-			case 24: /* 24 bpp */
-				if (font_glyph_filled(ch, x, y)) {
-					dst[(font_width - x) * (fbinfo.bits_per_pixel >> 3) + 0] = fgval & 0xff;
-					dst[(font_width - x) * (fbinfo.bits_per_pixel >> 3) + 1] = (fgval >> 8) & 0xff;
-					dst[(font_width - x) * (fbinfo.bits_per_pixel >> 3) + 2] = (fgval >> 16) & 0xff;
-				} else {
-					dst[(font_width - x) * (fbinfo.bits_per_pixel >> 3) + 0] = bgval & 0xff;
-					dst[(font_width - x) * (fbinfo.bits_per_pixel >> 3) + 1] = (bgval >> 8) & 0xff;
-					dst[(font_width - x) * (fbinfo.bits_per_pixel >> 3) + 2] = (bgval >> 16) & 0xff;
-				}
-				break;
-			case 32: /* 32 bpp */
-				dst32 = (u32 *)(dst + (font_width - x) * (fbinfo.bits_per_pixel >> 3));
-				*dst32 = font_glyph_filled(ch, x, y) ? fgval : bgval;
-				break;
-			}
-		}
+	dst += col * row_bytes;
 
+	for (y = 0; y < font_height; y++) {
+		memcpy(dst, rows + font_glyph_row(ch, y) * row_bytes, row_bytes);
 		dst += fbinfo.bytes_per_line;
 	}
 }
 
 static void corebootfb_putc(u8 row, u8 col, unsigned int ch)
 {
-	chars[row * coreboot_video_console.columns + col] = ch;
-	corebootfb_putchar(row, col, ch);
+	text_row(row)[col] = ch;
+	mark_dirty(row);
 }
 
-static void corebootfb_update_cursor(void)
+/* Draw the text cells which changed since the last flush. */
+static void corebootfb_flush(void)
 {
-	int ch, paint;
-	if(cursor_en) {
-		ch = chars[cursor_y * coreboot_video_console.columns + cursor_x];
-		paint = (ch & 0xff) | ((ch << 4) & 0xf000) | ((ch >> 4) & 0x0f00);
-	} else {
-		paint = chars[cursor_y * coreboot_video_console.columns + cursor_x];
+	const unsigned int columns = coreboot_video_console.columns;
+	unsigned int row, col, ch;
+	unsigned short *text;
+
+	for (row = dirty_first; row < dirty_last; row++) {
+		text = text_row(row);
+		for (col = 0; col < columns; col++) {
+			ch = text[col];
+			if (cursor_en && row == cursor_y && col == cursor_x)
+				ch = (ch & 0xff) | ((ch << 4) & 0xf000) | ((ch >> 4) & 0x0f00);
+
+			if (shown[row * columns + col] == ch)
+				continue;
+
+			shown[row * columns + col] = ch;
+			corebootfb_putchar(row, col, ch);
+		}
 	}
 
-	if (cursor_y < coreboot_video_console.rows)
-		corebootfb_putchar(cursor_y, cursor_x, paint);
+	dirty_first = coreboot_video_console.rows;
+	dirty_last = 0;
 }
 
 static void corebootfb_enable_cursor(int state)
 {
 	cursor_en = state;
-	corebootfb_update_cursor();
+	mark_dirty(cursor_y);
 }
 
 static void corebootfb_get_cursor(unsigned int *x, unsigned int *y, unsigned int *en)
@@ -209,15 +246,30 @@ static void corebootfb_get_cursor(unsigned int *x, unsigned int *y, unsigned int
 
 static void corebootfb_set_cursor(unsigned int x, unsigned int y)
 {
-	int cursor_remember = cursor_en;
-	if (cursor_remember)
-		corebootfb_enable_cursor(0);
+	mark_dirty(cursor_y);
 
 	cursor_x = x;
 	cursor_y = y;
 
-	if (cursor_remember)
-		corebootfb_enable_cursor(1);
+	mark_dirty(cursor_y);
+}
+
+static void init_colors(void)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(fb_colors); i++) {
+		if (fbinfo.bits_per_pixel <= 8) {
+			/* Indexed */
+			fb_colors[i] = i;
+			continue;
+		}
+
+		fb_colors[i] =
+			((((vga_colors[i] >> 0) & 0xff) >> (8 - fbinfo.blue_mask_size)) << fbinfo.blue_mask_pos) |
+			((((vga_colors[i] >> 8) & 0xff) >> (8 - fbinfo.green_mask_size)) << fbinfo.green_mask_pos) |
+			((((vga_colors[i] >> 16) & 0xff) >> (8 - fbinfo.red_mask_size)) << fbinfo.red_mask_pos);
+	}
 }
 
 static int corebootfb_init(void)
@@ -240,11 +292,22 @@ static int corebootfb_init(void)
 		coreboot_video_console.rows = fbinfo.y_resolution / font_height;
 	}
 
-	chars = malloc(coreboot_video_console.rows *
-		       coreboot_video_console.columns * 2);
-	if (!chars)
+	const size_t cells = coreboot_video_console.rows * coreboot_video_console.columns;
+	unsigned char *rows;
+	int i;
+
+	chars = malloc(cells * sizeof(*chars));
+	shown = malloc(cells * sizeof(*shown));
+	rows = malloc(GLYPH_CACHE_SIZE * 256 * glyph_row_bytes());
+	if (!chars || !shown || !rows)
 		return -1;
 
+	init_colors();
+	for (i = 0; i < GLYPH_CACHE_SIZE; i++) {
+		glyph_cache[i].colors = GLYPH_CACHE_UNUSED;
+		glyph_cache[i].rows = rows + i * 256 * glyph_row_bytes();
+	}
+
 	// clear boot splash screen if there is one.
 	corebootfb_clear();
 
@@ -266,6 +329,7 @@ struct video_console coreboot_video_console = {
 	.putc = corebootfb_putc,
 	.clear = corebootfb_clear,
 	.scroll_up = corebootfb_scroll_up,
+	.flush = corebootfb_flush,
 
 	.get_cursor = corebootfb_get_cursor,
 	.set_cursor = corebootfb_set_cursor,
@@ -41,6 +41,12 @@ static inline int font_glyph_filled(unsigned int ch, int x, int y)
 	return glyph[y/font_scale] & (1 << x/font_scale);
 }
 
+/* Bits of line y of a glyph, the most significant one is the leftmost. */
+static inline unsigned char font_glyph_row(unsigned int ch, int y)
+{
+	return font8x16[(ch & 0xFF) * FONT_HEIGHT + y / font_scale];
+}
+
 void font_init(int width);
 
 #endif
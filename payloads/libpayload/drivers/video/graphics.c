@@ -43,6 +43,15 @@ static struct rect screen;
 
 static uint8_t *gfx_buffer;
 
+/*
+ * Part of gfx_buffer that was drawn to since the last flush, in bytes within
+ * a line and in lines.
+ */
+static struct {
+	size_t start, end;
+	int first_line, last_line;
+} dirty;
+
 /*
  * Framebuffer is assumed to assign a higher coordinate (larger x, y) to
  * a higher address
@@ -53,6 +62,15 @@ static const struct cb_framebuffer *fbinfo;
 #define REAL_FB ((unsigned char *)phys_to_virt(fbinfo->physical_address))
 #define FB	(gfx_buffer ? gfx_buffer : REAL_FB)
 
+/*
+ * Offset of screen pixel (0, 0) in the framebuffer, and the distances in bytes
+ * to the pixels right of and below it on the screen. They depend on the
+ * orientation and are set up by cbgfx_init().
+ */
+static intptr_t fb_origin;
+static intptr_t fb_step_x;
+static intptr_t fb_step_y;
+
 #define LOG(x...)	printf("CBGFX: " x)
 #define PIVOT_H_MASK	(PIVOT_H_LEFT|PIVOT_H_CENTER|PIVOT_H_RIGHT)
 #define PIVOT_V_MASK	(PIVOT_V_TOP|PIVOT_V_CENTER|PIVOT_V_BOTTOM)
@@ -269,40 +287,156 @@ static inline uint32_t calculate_color(const struct rgb_color *rgb,
 	return color;
 }
 
+static inline uint8_t *pixel_address(const struct vector *coord)
+{
+	return FB + fb_origin + coord->x * fb_step_x + coord->y * fb_step_y;
+}
+
+static inline void write_pixel(uint8_t *pixel, uint32_t color)
+{
+	int i;
+
+	switch (fbinfo->bits_per_pixel) {
+	case 32:
+		*(uint32_t *)pixel = htole32(color);
+		break;
+	case 16:
+		*(uint16_t *)pixel = htole16(color);
+		break;
+	default:
+		for (i = 0; i < fbinfo->bits_per_pixel / 8; i++)
+			pixel[i] = (color >> (i * 8));
+		break;
+	}
+}
+
 /*
  * Plot a pixel in a framebuffer. This is called from tight loops. Keep it slim
  * and do the validation at callers' site.
  */
 static inline void set_pixel(struct vector *coord, uint32_t color)
 {
-	const int bpp = fbinfo->bits_per_pixel;
-	const int bpl = fbinfo->bytes_per_line;
-	struct vector rcoord;
+	write_pixel(pixel_address(coord), color);
+}
+
+/* Fill 'count' pixels of a framebuffer line, starting at 'pixel'. */
+static void fill_pixels(uint8_t *pixel, int count, uint32_t color)
+{
+	const int bytes = fbinfo->bits_per_pixel / 8;
+	uint32_t *word;
 	int i;
 
-	switch (fbinfo->orientation) {
-	case CB_FB_ORIENTATION_NORMAL:
-	default:
-		rcoord.x = coord->x;
-		rcoord.y = coord->y;
-		break;
-	case CB_FB_ORIENTATION_BOTTOM_UP:
-		rcoord.x = screen.size.width - 1 - coord->x;
-		rcoord.y = screen.size.height - 1 - coord->y;
+	/* Colors made of a single repeated byte, like black and white. */
+	const uint32_t mask = bytes == 4 ? ~0U : (1U << (bytes * 8)) - 1;
+	if ((color & mask) == ((color & 0xff) * 0x01010101 & mask)) {
+		memset(pixel, color & 0xff, count * bytes);
+		return;
+	}
+
+	switch (fbinfo->bits_per_pixel) {
+	case 32:
+		word = (uint32_t *)pixel;
+		color = htole32(color);
+		for (i = 0; i < count; i++)
+			word[i] = color;
 		break;
-	case CB_FB_ORIENTATION_LEFT_UP:
-		rcoord.x = coord->y;
-		rcoord.y = screen.size.width - 1 - coord->x;
+	case 16:
+		/* Store two pixels per word once the line is aligned. */
+		if (count && (uintptr_t)pixel & 2) {
+			write_pixel(pixel, color);
+			pixel += 2;
+			count--;
+		}
+		word = (uint32_t *)pixel;
+		for (i = 0; i < count / 2; i++)
+			word[i] = htole32(color | color << 16);
+		if (count & 1)
+			write_pixel(pixel + count * 2 - 2, color);
 		break;
-	case CB_FB_ORIENTATION_RIGHT_UP:
-		rcoord.x = screen.size.height - 1 - coord->y;
-		rcoord.y = coord->x;
+	default:
+		for (i = 0; i < count; i++, pixel += bytes)
+			write_pixel(pixel, color);
 		break;
 	}
+}
 
-	uint8_t * const pixel = FB + rcoord.y * bpl + rcoord.x * bpp / 8;
-	for (i = 0; i < bpp / 8; i++)
-		pixel[i] = (color >> (i * 8));
+/*
+ * The screen rectangle from top_left to bottom_right (exclusive) is a
+ * rectangle in the framebuffer as well, whichever the orientation. Get its
+ * bytes within a line and its lines.
+ */
+static void get_fb_area(const struct vector *top_left,
+			const struct vector *bottom_right,
+			size_t *start, size_t *end,
+			int *first_line, int *last_line)
+{
+	const int bpl = fbinfo->bytes_per_line;
+	const struct vector last = {
+		.x = bottom_right->x - 1,
+		.y = bottom_right->y - 1,
+	};
+	const size_t a = pixel_address(top_left) - FB;
+	const size_t b = pixel_address(&last) - FB;
+
+	*start = MIN(a % bpl, b % bpl);
+	*end = MAX(a % bpl, b % bpl) + fbinfo->bits_per_pixel / 8;
+	*first_line = MIN(a, b) / bpl;
+	*last_line = MAX(a, b) / bpl + 1;
+}
+
+/* Remember that a part of the graphics buffer needs to be flushed. */
+static void mark_dirty(const struct vector *top_left,
+		       const struct vector *bottom_right)
+{
+	size_t start, end;
+	int first_line, last_line;
+
+	if (!gfx_buffer || bottom_right->x <= top_left->x ||
+	    bottom_right->y <= top_left->y)
+		return;
+
+	get_fb_area(top_left, bottom_right, &start, &end,
+		    &first_line, &last_line);
+
+	if (dirty.first_line == dirty.last_line) {
+		dirty.start = start;
+		dirty.end = end;
+		dirty.first_line = first_line;
+		dirty.last_line = last_line;
+		return;
+	}
+
+	dirty.start = MIN(dirty.start, start);
+	dirty.end = MAX(dirty.end, end);
+	dirty.first_line = MIN(dirty.first_line, first_line);
+	dirty.last_line = MAX(dirty.last_line, last_line);
+}
+
+/*
+ * Fill the screen rectangle from top_left to bottom_right (exclusive). This
+ * writes whole framebuffer lines at a time, rather than going pixel by pixel:
+ * the first line is filled, and copied to the others.
+ */
+static void fill_box(const struct vector *top_left,
+		     const struct vector *bottom_right, uint32_t color)
+{
+	const int bpl = fbinfo->bytes_per_line;
+	const int bytes = fbinfo->bits_per_pixel / 8;
+	size_t start, end;
+	int first_line, last_line, y;
+	uint8_t *line;
+
+	if (bottom_right->x <= top_left->x || bottom_right->y <= top_left->y)
+		return;
+
+	get_fb_area(top_left, bottom_right, &start, &end,
+		    &first_line, &last_line);
+	line = FB + first_line * bpl + start;
+	fill_pixels(line, (end - start) / bytes, color);
+	for (y = first_line + 1; y < last_line; y++)
+		memcpy(FB + y * bpl + start, line, end - start);
+
+	mark_dirty(top_left, bottom_right);
 }
 
 /*
@@ -333,6 +467,33 @@ static int cbgfx_init(void)
 	screen.offset.x = 0;
 	screen.offset.y = 0;
 
+	const int bytes = fbinfo->bits_per_pixel / 8;
+	const int bpl = fbinfo->bytes_per_line;
+	switch (fbinfo->orientation) {
+	case CB_FB_ORIENTATION_NORMAL:
+	default:
+		fb_origin = 0;
+		fb_step_x = bytes;
+		fb_step_y = bpl;
+		break;
+	case CB_FB_ORIENTATION_BOTTOM_UP:
+		fb_origin = (screen.size.height - 1) * bpl +
+			    (screen.size.width - 1) * bytes;
+		fb_step_x = -bytes;
+		fb_step_y = -bpl;
+		break;
+	case CB_FB_ORIENTATION_LEFT_UP:
+		fb_origin = (screen.size.width - 1) * bpl;
+		fb_step_x = -bpl;
+		fb_step_y = bytes;
+		break;
+	case CB_FB_ORIENTATION_RIGHT_UP:
+		fb_origin = (screen.size.height - 1) * bytes;
+		fb_step_x = bpl;
+		fb_step_y = -bytes;
+		break;
+	}
+
 	/* Calculate canvas size & offset. Canvas is always square. */
 	if (screen.size.height > screen.size.width) {
 		canvas.size.height = screen.size.width;
@@ -357,7 +518,7 @@ static int cbgfx_init(void)
 int draw_box(const struct rect *box, const struct rgb_color *rgb)
 {
 	struct vector top_left;
-	struct vector p, t;
+	struct vector t;
 
 	if (cbgfx_init())
 		return CBGFX_ERROR_INIT;
@@ -379,9 +540,7 @@ int draw_box(const struct rect *box, const struct rgb_color *rgb)
 		return CBGFX_ERROR_BOUNDARY;
 	}
 
-	for (p.y = top_left.y; p.y < t.y; p.y++)
-		for (p.x = top_left.x; p.x < t.x; p.x++)
-			set_pixel(&p, color);
+	fill_box(&top_left, &t, color);
 
 	return CBGFX_SUCCESS;
 }
@@ -442,38 +601,39 @@ int draw_rounded_box(const struct scale *pos_rel, const struct scale *dim_rel,
 		}
 	}
 
+	mark_dirty(&top_left, &t);
+
 	/* Step 1: Draw edges */
 	int32_t x_begin, x_end;
+	struct vector a, b;
 	if (has_thickness) {
 		/* top */
-		for (p.y = top_left.y; p.y < top_left.y + d.y; p.y++)
-			for (p.x = top_left.x + r.x; p.x < t.x - r.x; p.x++)
-				set_pixel(&p, color);
+		a = (struct vector){ .x = top_left.x + r.x, .y = top_left.y };
+		b = (struct vector){ .x = t.x - r.x, .y = top_left.y + d.y };
+		fill_box(&a, &b, color);
 		/* bottom */
-		for (p.y = t.y - d.y; p.y < t.y; p.y++)
-			for (p.x = top_left.x + r.x; p.x < t.x - r.x; p.x++)
-				set_pixel(&p, color);
-		for (p.y = top_left.y + r.y; p.y < t.y - r.y; p.y++) {
-			/* left */
-			for (p.x = top_left.x; p.x < top_left.x + d.x; p.x++)
-				set_pixel(&p, color);
-			/* right */
-			for (p.x = t.x - d.x; p.x < t.x; p.x++)
-				set_pixel(&p, color);
-		}
+		a = (struct vector){ .x = top_left.x + r.x, .y = t.y - d.y };
+		b = (struct vector){ .x = t.x - r.x, .y = t.y };
+		fill_box(&a, &b, color);
+		/* left */
+		a = (struct vector){ .x = top_left.x, .y = top_left.y + r.y };
+		b = (struct vector){ .x = top_left.x + d.x, .y = t.y - r.y };
+		fill_box(&a, &b, color);
+		/* right */
+		a = (struct vector){ .x = t.x - d.x, .y = top_left.y + r.y };
+		b = (struct vector){ .x = t.x, .y = t.y - r.y };
+		fill_box(&a, &b, color);
 	} else {
 		/* Fill the regions except circular sectors */
-		for (p.y = top_left.y; p.y < t.y; p.y++) {
-			if (p.y >= top_left.y + r.y && p.y < t.y - r.y) {
-				x_begin = top_left.x;
-				x_end = t.x;
-			} else {
-				x_begin = top_left.x + r.x;
-				x_end = t.x - r.x;
-			}
-			for (p.x = x_begin; p.x < x_end; p.x++)
-				set_pixel(&p, color);
-		}
+		a = (struct vector){ .x = top_left.x + r.x, .y = top_left.y };
+		b = (struct vector){ .x = t.x - r.x, .y = top_left.y + r.y };
+		fill_box(&a, &b, color);
+		a = (struct vector){ .x = top_left.x, .y = top_left.y + r.y };
+		b = (struct vector){ .x = t.x, .y = t.y - r.y };
+		fill_box(&a, &b, color);
+		a = (struct vector){ .x = top_left.x + r.x, .y = t.y - r.y };
+		b = (struct vector){ .x = t.x - r.x, .y = t.y };
+		fill_box(&a, &b, color);
 	}
 
 	if (!has_radius)
@@ -551,7 +711,7 @@ int draw_line(const struct scale *pos1, const struct scale *pos2,
 	struct fraction len;
 	struct vector top_left;
 	struct vector size;
-	struct vector p, t;
+	struct vector t;
 
 	if (cbgfx_init())
 		return CBGFX_ERROR_INIT;
@@ -591,9 +751,7 @@ int draw_line(const struct scale *pos1, const struct scale *pos2,
 		return CBGFX_ERROR_BOUNDARY;
 	}
 
-	for (p.y = top_left.y; p.y < t.y; p.y++)
-		for (p.x = top_left.x; p.x < t.x; p.x++)
-			set_pixel(&p, color);
+	fill_box(&top_left, &t, color);
 
 	return CBGFX_SUCCESS;
 }
@@ -619,25 +777,12 @@ int clear_screen(const struct rgb_color *rgb)
 	if (cbgfx_init())
 		return CBGFX_ERROR_INIT;
 
-	int x, y, i;
-	uint32_t color = calculate_color(rgb, 0);
-	const int bpp = fbinfo->bits_per_pixel;
-	const int bpl = fbinfo->bytes_per_line;
-	uint8_t *line = malloc(bpl);
-
-	if (!line) {
-		LOG("Failed to allocate line buffer (%u bytes)\n", bpl);
-		return CBGFX_ERROR_UNKNOWN;
-	}
-
-	/* Set line buffer pixels, then memcpy to framebuffer */
-	for (x = 0; x < fbinfo->x_resolution; x++)
-		for (i = 0; i < bpp / 8; i++)
-			line[x * bpp / 8 + i] = (color >> (i * 8));
-	for (y = 0; y < fbinfo->y_resolution; y++)
-		memcpy(FB + y * bpl, line, bpl);
+	const struct vector bottom_right = {
+		.width = screen.size.width,
+		.height = screen.size.height,
+	};
 
-	free(line);
+	fill_box(&vzero, &bottom_right, calculate_color(rgb, 0));
 	return CBGFX_SUCCESS;
 }
 
@@ -738,6 +883,89 @@ static fpmath_t lanczos_weight(fpmath_t in, int off)
 	return fpdiv(fpmul(tmp, fpsin1(x2a)), x_times_pi);
 }
 
+/* Horizontally resampled input pixel, in 16.16 fixed point. */
+struct row_sample {
+	int32_t red;
+	int32_t green;
+	int32_t blue;
+};
+
+#define ROW_SAMPLE_SHIFT 16
+
+/*
+ * The Lanczos weights are separable: the weight of a sample pixel is its X
+ * weight times its Y weight. So every input line that is needed is resampled
+ * horizontally once, and each output pixel only combines SSZ of those
+ * resampled lines with the Y weights, instead of going over the whole
+ * SSZ x SSZ sample array. Input pixels outside of the image are replaced by
+ * the closest pixel on the edge.
+ */
+static int resample_row(const uint8_t *line, int32_t width_org, int32_t width,
+			const fpmath_t (*weight_x)[SSZ],
+			const struct bitmap_palette_element_v3 *pal,
+			size_t palcount, struct row_sample *out)
+{
+	int32_t ox, ix;
+	int sx;
+
+	for (ox = 0; ox < width; ox++, out++) {
+		uint8_t index[SSZ];
+		int equal = 1;
+
+		ix = fpfloor(fpfrac(ox * width_org, width));
+		for (sx = 0; sx < SSZ; sx++) {
+			index[sx] = line[MAX(0, MIN(width_org - 1, ix + sx - S0))];
+			if (index[sx] >= palcount) {
+				LOG("Color index %d exceeds palette boundary\n",
+				    index[sx]);
+				return CBGFX_ERROR_BITMAP_DATA;
+			}
+			equal &= index[sx] == index[0];
+		}
+
+		/* If all pixels in the sample are equal, fast path. */
+		if (equal) {
+			out->red = pal[index[0]].red << ROW_SAMPLE_SHIFT;
+			out->green = pal[index[0]].green << ROW_SAMPLE_SHIFT;
+			out->blue = pal[index[0]].blue << ROW_SAMPLE_SHIFT;
+			continue;
+		}
+
+		fpmath_t red = fp(0);
+		fpmath_t green = fp(0);
+		fpmath_t blue = fp(0);
+		for (sx = 0; sx < SSZ; sx++) {
+			const struct bitmap_palette_element_v3 *c = &pal[index[sx]];
+			red = fpadd(red, fpmuli(weight_x[ox][sx], c->red));
+			green = fpadd(green, fpmuli(weight_x[ox][sx], c->green));
+			blue = fpadd(blue, fpmuli(weight_x[ox][sx], c->blue));
+		}
+		out->red = fpfloor(fpmuli(red, 1 << ROW_SAMPLE_SHIFT));
+		out->green = fpfloor(fpmuli(green, 1 << ROW_SAMPLE_SHIFT));
+		out->blue = fpfloor(fpmuli(blue, 1 << ROW_SAMPLE_SHIFT));
+	}
+
+	return CBGFX_SUCCESS;
+}
+
+static uint8_t resample_column(const int32_t *const samples[SSZ],
+			       const fpmath_t weight_y[SSZ])
+{
+	fpmath_t sum = fp(0);
+	int sy;
+
+	for (sy = 0; sy < SSZ; sy++)
+		sum = fpadd(sum, fpmuli(weight_y[sy], *samples[sy]));
+	sum = fpdivi(sum, 1 << ROW_SAMPLE_SHIFT);
+
+	/*
+	 * Weights *should* sum up to 1.0 (making this not necessary) but just
+	 * to hedge against rounding errors we should clamp color values to
+	 * their legal limits.
+	 */
+	return MAX(0, MIN(UINT8_MAX, fpround(sum)));
+}
+
 static int draw_bitmap_v3(const struct vector *top_left,
 			  const struct vector *dim,
 			  const struct vector *dim_org,
@@ -749,8 +977,10 @@ static int draw_bitmap_v3(const struct vector *top_left,
 	int32_t dir;
 	struct vector p;
 	int32_t ox, oy;		/* output (resampled) pixel coordinates */
-	int32_t ix, iy;		/* input (source image) pixel coordinates */
-	int sx, sy;	/* index into |sample| (not ringbuffer adjusted) */
+	int32_t iy;		/* input (source image) pixel coordinates */
+	int sx, sy;	/* index into the sample window */
+	uint8_t *pixel;
+	int rv = CBGFX_SUCCESS;
 
 	if (header->compression) {
 		LOG("Compressed bitmaps are not supported\n");
@@ -783,16 +1013,33 @@ static int draw_bitmap_v3(const struct vector *top_left,
 		dir = -1;
 	}
 
+	const struct vector bottom_right = {
+		.x = top_left->x + dim->width,
+		.y = top_left->y + dim->height,
+	};
+	mark_dirty(top_left, &bottom_right);
+
 	/* Don't waste time resampling when the scale is 1:1. */
 	if (dim_org->width == dim->width && dim_org->height == dim->height) {
+		/* Look up the framebuffer color of each palette entry once. */
+		const size_t palcount = MIN(header->colors_used, 256);
+		uint32_t colors[256];
+		struct rgb_color rgb;
+		size_t i;
+		for (i = 0; i < palcount; i++) {
+			pal_to_rgb(i, pal, palcount, &rgb);
+			colors[i] = calculate_color(&rgb, invert);
+		}
+
 		for (oy = 0; oy < dim->height; oy++, p.y += dir) {
+			const uint8_t *line = &pixel_array[oy * y_stride];
 			p.x = top_left->x;
-			for (ox = 0; ox < dim->width; ox++, p.x++) {
-				struct rgb_color rgb;
-				if (pal_to_rgb(pixel_array[oy * y_stride + ox],
-					       pal, header->colors_used, &rgb))
-					return CBGFX_ERROR_BITMAP_DATA;
-				set_pixel(&p, calculate_color(&rgb, invert));
+			pixel = pixel_address(&p);
+			for (ox = 0; ox < dim->width; ox++, pixel += fb_step_x) {
+				if (line[ox] >= palcount)
+					return pal_to_rgb(line[ox], pal,
+							  palcount, &rgb);
+				write_pixel(pixel, colors[line[ox]]);
 			}
 		}
 		return CBGFX_SUCCESS;
@@ -801,36 +1048,24 @@ static int draw_bitmap_v3(const struct vector *top_left,
 	/* Precalculate the X-weights for every possible ox so that we only have
 	   to multiply weights together in the end. */
 	fpmath_t (*weight_x)[SSZ] = malloc(sizeof(fpmath_t) * SSZ * dim->width);
-	if (!weight_x)
-		return CBGFX_ERROR_UNKNOWN;
+	/* Resampled input lines, indexed by input line number modulo SSZ. */
+	struct row_sample *rows = malloc(sizeof(*rows) * SSZ * dim->width);
+	int32_t row_line[SSZ];
+	if (!weight_x || !rows) {
+		rv = CBGFX_ERROR_UNKNOWN;
+		goto out;
+	}
 	for (ox = 0; ox < dim->width; ox++) {
 		for (sx = 0; sx < SSZ; sx++) {
 			fpmath_t ixfp = fpfrac(ox * dim_org->width, dim->width);
 			weight_x[ox][sx] = lanczos_weight(ixfp, sx);
 		}
 	}
+	for (sy = 0; sy < SSZ; sy++)
+		row_line[sy] = -1;
 
-	/*
-	 * For every sy in the sample array, we directly cache a pointer into
-	 * the .BMP pixel array for the start of the corresponding line. On the
-	 * edges of the image (where we don't have any real pixels to fill all
-	 * lines in the sample array), we just reuse the last valid lines inside
-	 * the image for all lines that would lie outside.
-	 */
-	const uint8_t *ypix[SSZ];
-	for (sy = 0; sy < SSZ; sy++) {
-		if (sy <= S0)
-			ypix[sy] = pixel_array;
-		else if (sy - S0 >= dim_org->height)
-			ypix[sy] = ypix[sy - 1];
-		else
-			ypix[sy] = &pixel_array[y_stride * (sy - S0)];
-	}
-
-	/* iy and ix track the input pixel corresponding to sample[S0][S0]. */
-	iy = 0;
 	for (oy = 0; oy < dim->height; oy++, p.y += dir) {
-		struct rgb_color sample[SSZ][SSZ];
+		const struct row_sample *sample[SSZ];
 
 		/* Like with X weights, we also cache all Y weights. */
 		fpmath_t iyfp = fpfrac(oy * dim_org->height, dim->height);
@@ -839,144 +1074,66 @@ static int draw_bitmap_v3(const struct vector *top_left,
 			weight_y[sy] = lanczos_weight(iyfp, sy);
 
 		/*
-		 * If we have a new input pixel line between the last oy and
-		 * this one, we have to adjust iy forward. When upscaling, this
-		 * is not always the case for each new output line. When
-		 * downscaling, we may even cross more than one line per output
-		 * pixel.
-		 */
-		while (fpfloor(iyfp) > iy) {
-			iy++;
-
-			/* Shift ypix array up to center around next iy line. */
-			for (sy = 0; sy < SSZ - 1; sy++)
-				ypix[sy] = ypix[sy + 1];
-
-			/* Calculate the last ypix that is being shifted in,
-			   but beware of reaching the end of the input image. */
-			if (iy + LNCZ_A < dim_org->height)
-				ypix[SSZ - 1] = &pixel_array[y_stride *
-							     (iy + LNCZ_A)];
-		}
-
-		/*
-		 * Initialize the sample array for this line, and also
-		 * the equals counter, which counts how many of the latest
-		 * pixels were exactly equal.
+		 * Resample the input lines around iy that aren't cached yet.
+		 * When upscaling, consecutive output lines mostly share them.
 		 */
-		int equals = 0;
-		uint8_t last_equal = ypix[0][0];
-		for (sx = 0; sx < SSZ; sx++) {
-			for (sy = 0; sy < SSZ; sy++) {
-				if (sx - S0 >= dim_org->width) {
-					sample[sx][sy] = sample[sx - 1][sy];
-					equals++;
-					continue;
-				}
-				/*
-				 * For pixels to the left of S0 there are no
-				 * corresponding input pixels so just use
-				 * ypix[sy][0].
-				 */
-				uint8_t i = ypix[sy][MAX(0, sx - S0)];
-				if (pal_to_rgb(i, pal, header->colors_used,
-					       &sample[sx][sy]))
-					goto bitmap_error;
-				if (i == last_equal) {
-					equals++;
-				} else {
-					last_equal = i;
-					equals = 1;
-				}
+		iy = fpfloor(iyfp);
+		for (sy = 0; sy < SSZ; sy++) {
+			const int32_t line = MAX(0, MIN(dim_org->height - 1,
+							iy + sy - S0));
+			const int slot = line % SSZ;
+			if (row_line[slot] != line) {
+				rv = resample_row(&pixel_array[line * y_stride],
+						  dim_org->width, dim->width,
+						  weight_x, pal,
+						  header->colors_used,
+						  &rows[slot * dim->width]);
+				if (rv)
+					goto out;
+				row_line[slot] = line;
 			}
+			sample[sy] = &rows[slot * dim->width];
 		}
 
-		ix = 0;
 		p.x = top_left->x;
-		for (ox = 0; ox < dim->width; ox++, p.x++) {
-			/* Adjust ix forward, same as iy above. */
-			fpmath_t ixfp = fpfrac(ox * dim_org->width, dim->width);
-			while (fpfloor(ixfp) > ix) {
-				ix++;
-
-				/*
-				 * We want to reuse the sample columns we
-				 * already have, but we don't want to copy them
-				 * all around for every new column either.
-				 * Instead, treat the X dimension of the sample
-				 * array like a ring buffer indexed by ix. rx is
-				 * the ringbuffer-adjusted offset of the new
-				 * column in sample (the rightmost one) we're
-				 * trying to fill.
-				 */
-				int rx = (SSZ - 1 + ix) % SSZ;
-				for (sy = 0; sy < SSZ; sy++) {
-					if (ix + LNCZ_A >= dim_org->width) {
-						sample[rx][sy] = sample[(SSZ - 2
-							+ ix) % SSZ][sy];
-						equals++;
-						continue;
-					}
-					uint8_t i = ypix[sy][ix + LNCZ_A];
-					if (i == last_equal) {
-						if (equals++ >= (SSZ * SSZ))
-							continue;
-					} else {
-						last_equal = i;
-						equals = 1;
-					}
-					if (pal_to_rgb(i, pal,
-						       header->colors_used,
-						       &sample[rx][sy]))
-						goto bitmap_error;
-				}
-			}
-
-			/* If all pixels in sample are equal, fast path. */
-			if (equals >= (SSZ * SSZ)) {
-				set_pixel(&p, calculate_color(&sample[0][0],
-							      invert));
-				continue;
-			}
+		pixel = pixel_address(&p);
+		for (ox = 0; ox < dim->width; ox++, pixel += fb_step_x) {
+			const int32_t *red[SSZ], *green[SSZ], *blue[SSZ];
+			struct rgb_color rgb;
+			int equal = 1;
 
-			fpmath_t red = fp(0);
-			fpmath_t green = fp(0);
-			fpmath_t blue = fp(0);
 			for (sy = 0; sy < SSZ; sy++) {
-				for (sx = 0; sx < SSZ; sx++) {
-					int rx = (sx + ix) % SSZ;
-					fpmath_t weight = fpmul(weight_x[ox][sx],
-								weight_y[sy]);
-					red = fpadd(red, fpmuli(weight,
-						sample[rx][sy].red));
-					green = fpadd(green, fpmuli(weight,
-						sample[rx][sy].green));
-					blue = fpadd(blue, fpmuli(weight,
-						sample[rx][sy].blue));
-				}
+				red[sy] = &sample[sy][ox].red;
+				green[sy] = &sample[sy][ox].green;
+				blue[sy] = &sample[sy][ox].blue;
+				equal &= *red[sy] == *red[0] &&
+					 *green[sy] == *green[0] &&
+					 *blue[sy] == *blue[0];
 			}
 
-			/*
-			 * Weights *should* sum up to 1.0 (making this not
-			 * necessary) but just to hedge against rounding errors
-			 * we should clamp color values to their legal limits.
-			 */
-			struct rgb_color rgb = {
-				.red = MAX(0, MIN(UINT8_MAX, fpround(red))),
-				.green = MAX(0, MIN(UINT8_MAX, fpround(green))),
-				.blue = MAX(0, MIN(UINT8_MAX, fpround(blue))),
-			};
+			/* Uniform areas don't need to be resampled again. */
+			if (equal) {
+				const int32_t round = 1 << (ROW_SAMPLE_SHIFT - 1);
+				rgb.red = MAX(0, MIN(UINT8_MAX,
+					(*red[0] + round) >> ROW_SAMPLE_SHIFT));
+				rgb.green = MAX(0, MIN(UINT8_MAX,
+					(*green[0] + round) >> ROW_SAMPLE_SHIFT));
+				rgb.blue = MAX(0, MIN(UINT8_MAX,
+					(*blue[0] + round) >> ROW_SAMPLE_SHIFT));
+			} else {
+				rgb.red = resample_column(red, weight_y);
+				rgb.green = resample_column(green, weight_y);
+				rgb.blue = resample_column(blue, weight_y);
+			}
 
-			set_pixel(&p, calculate_color(&rgb, invert));
+			write_pixel(pixel, calculate_color(&rgb, invert));
 		}
 	}
 
+out:
+	free(rows);
 	free(weight_x);
-	return CBGFX_SUCCESS;
-
-bitmap_error:
-	free(weight_x);
-	return CBGFX_ERROR_BITMAP_DATA;
+	return rv;
 }
 
 static int get_bitmap_file_header(const void *bitmap, size_t size,
@@ -1277,6 +1434,7 @@ int enable_graphics_buffer(void)
 		    __func__, buffer_size);
 		return CBGFX_ERROR_GRAPHICS_BUFFER;
 	}
+	memset(&dirty, 0, sizeof(dirty));
 
 	return CBGFX_SUCCESS;
 }
@@ -1286,7 +1444,22 @@ int flush_graphics_buffer(void)
 	if (!gfx_buffer)
 		return CBGFX_ERROR_GRAPHICS_BUFFER;
 
-	memcpy(REAL_FB, gfx_buffer, fbinfo->y_resolution * fbinfo->bytes_per_line);
+	const int bpl = fbinfo->bytes_per_line;
+	int y;
+
+	/* Only copy what was drawn since the last flush. */
+	if (dirty.start == 0 && dirty.end == bpl) {
+		memcpy(REAL_FB + dirty.first_line * bpl,
+		       gfx_buffer + dirty.first_line * bpl,
+		       (dirty.last_line - dirty.first_line) * bpl);
+	} else {
+		for (y = dirty.first_line; y < dirty.last_line; y++)
+			memcpy(REAL_FB + y * bpl + dirty.start,
+			       gfx_buffer + y * bpl + dirty.start,
+			       dirty.end - dirty.start);
+	}
+
+	memset(&dirty, 0, sizeof(dirty));
 	return CBGFX_SUCCESS;
 }
 
@@ -70,6 +70,12 @@ void video_get_rows_cols(unsigned int *rows, unsigned int *cols)
 	}
 }
 
+static void video_console_flush(void)
+{
+	if (console && console->flush)
+		console->flush();
+}
+
 static void video_console_fixup_cursor(void)
 {
 	if (!console)
@@ -102,6 +108,7 @@ void video_console_cursor_enable(int state)
 {
 	if (console && console->enable_cursor)
 		console->enable_cursor(state);
+	video_console_flush();
 }
 
 void video_console_clear(void)
@@ -114,12 +121,14 @@ void video_console_clear(void)
 
 	if (console && console->set_cursor)
 		console->set_cursor(cursorx, cursory);
+	video_console_flush();
 }
 
 void video_console_putc(u8 row, u8 col, unsigned int ch)
 {
 	if (console)
 		console->putc(row, col, ch);
+	video_console_flush();
 }
 
 void video_console_move_cursor(int x, int y)
@@ -127,9 +136,11 @@ void video_console_move_cursor(int x, int y)
 	cursorx += x;
 	cursory += y;
 	video_console_fixup_cursor();
+	video_console_flush();
 }
 
-void video_console_putchar(unsigned int ch)
+/* Output a character, without flushing the console. */
+static void video_console_output(unsigned int ch)
 {
 	if (!console)
 		return;
@@ -171,6 +182,22 @@ void video_console_putchar(unsigned int ch)
 	video_console_fixup_cursor();
 }
 
+void video_console_putchar(unsigned int ch)
+{
+	video_console_output(ch);
+	video_console_flush();
+}
+
+/* Console output comes in whole strings, which are drawn in one go. */
+static void video_console_write(const void *buffer, size_t count)
+{
+	const unsigned char *ptr;
+
+	for (ptr = buffer; (void *)ptr < buffer + count; ptr++)
+		video_console_output(*ptr);
+	video_console_flush();
+}
+
 void video_printf(int foreground, int background, enum video_printf_align align,
 		  const char *fmt, ...)
 {
@@ -213,7 +240,8 @@ void video_printf(int foreground, int background, enum video_printf_align align,
 	background <<= 12;
 
 	while (str[i])
-		video_console_putchar(str[i++] | foreground | background);
+		video_console_output(str[i++] | foreground | background);
+	video_console_flush();
 }
 
 void video_console_get_cursor(unsigned int *x, unsigned int *y, unsigned int *en)
@@ -234,10 +262,12 @@ void video_console_set_cursor(unsigned int x, unsigned int y)
 	cursorx = x;
 	cursory = y;
 	video_console_fixup_cursor();
+	video_console_flush();
 }
 
 static struct console_output_driver cons = {
-	.putchar = video_console_putchar
+	.putchar = video_console_putchar,
+	.write = video_console_write,
 };
 
 int video_init(void)
@@ -262,6 +292,7 @@ int video_init(void)
 		}
 
 		video_console_fixup_cursor();
+		video_console_flush();
 		return 0;
 	}
 	return 1;
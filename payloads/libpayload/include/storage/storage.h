@@ -55,6 +55,9 @@ typedef enum {
 
 struct storage_dev;
 
+/* Identifies a read started with read_blocks512_async(), negative on error. */
+typedef int storage_handle_t;
+
 typedef struct storage_dev {
 	storage_port_t port_type;
 
@@ -62,6 +65,15 @@ typedef struct storage_dev {
 	ssize_t (*read_blocks512)(struct storage_dev *, lba_t start, size_t count, unsigned char *buf);
 	ssize_t (*write_blocks512)(struct storage_dev *, lba_t start, size_t count, const unsigned char *buf);
 
+	/*
+	 * Optional: start a read and return without waiting for it. buf must not be
+	 * touched until wait() returned for the handle, which it has to be called for
+	 * exactly once. wait() returns the number of blocks read or -1 on error.
+	 */
+	storage_handle_t (*read_blocks512_async)(struct storage_dev *, lba_t start, size_t count,
+						 unsigned char *buf);
+	ssize_t (*wait)(struct storage_dev *, storage_handle_t handle);
+
 	void (*detach_device)(struct storage_dev *);
 } storage_dev_t;
 
@@ -70,5 +82,8 @@ int storage_attach_device(storage_dev_t *dev);
 
 storage_poll_t storage_probe(size_t dev_num);
 ssize_t storage_read_blocks512(size_t dev_num, lba_t start, size_t count, unsigned char *buf);
+storage_handle_t storage_read_blocks512_async(size_t dev_num, lba_t start, size_t count,
+					      unsigned char *buf);
+ssize_t storage_wait(size_t dev_num, storage_handle_t handle);
 
 #endif
@@ -30,7 +30,7 @@
 #define __USBMSC_H
 typedef struct {
 	unsigned int blocksize;
-	unsigned int numblocks;
+	u64 numblocks;
 	endpoint_t *bulk_in;
 	endpoint_t *bulk_out;
 	u8 quirks		: 7;
@@ -39,6 +39,9 @@ typedef struct {
 	u8 lun;
 	u8 num_luns;
 	void *data; /* For use by consumers of libpayload. */
+	/* Current READ/WRITE transfer size, grown up to max_chunk_bytes. */
+	unsigned int chunk_bytes;
+	unsigned int max_chunk_bytes;
 } usbmsc_inst_t;
 
 /* Possible values for quirks field. */
@@ -63,8 +66,8 @@ enum {
 typedef enum { cbw_direction_data_in = 0x80, cbw_direction_data_out = 0
 } cbw_direction;
 
-int readwrite_blocks_512 (usbdev_t *dev, int start, int n, cbw_direction dir, u8 *buf);
-int readwrite_blocks (usbdev_t *dev, int start, int n, cbw_direction dir, u8 *buf);
+int readwrite_blocks_512 (usbdev_t *dev, u64 start, int n, cbw_direction dir, u8 *buf);
+int readwrite_blocks (usbdev_t *dev, u64 start, int n, cbw_direction dir, u8 *buf);
 
 /* Force a device to enumerate as MSC, without checking class/protocol types.
    It must still have a bulk endpoint pair and respond to MSC commands. */
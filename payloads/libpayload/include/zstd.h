@@ -0,0 +1,9 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef __ZSTD_H_
+#define __ZSTD_H_
+
+/* The Zstandard decoder is shared with coreboot, see there for uzstdn(). */
+#include <commonlib/bsd/compression.h>
+
+#endif /* __ZSTD_H_ */
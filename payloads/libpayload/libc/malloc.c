@@ -28,10 +28,15 @@
  */
 
 /*
- * This is a classically weak malloc() implementation. We have a relatively
- * small and static heap, so we take the easy route with an O(N) loop
- * through the tree for every malloc() and free(). Obviously, this doesn't
- * scale past a few hundred KB (if that).
+ * Free blocks are kept on segregated free lists (a two-level segregated
+ * fit, as in TLSF), so malloc() and free() take constant time no matter
+ * how many blocks the heap holds. The first level splits block sizes into
+ * power-of-two ranges, the second level splits each range into SL_COUNT
+ * equal steps, and a bitmap per level tracks which lists are non-empty.
+ *
+ * A freed block is merged with its free neighbours right away. The last
+ * word of every free block holds its size, and the block after it has
+ * FLAG_PREV_FREE set, so the block in front can be found as well.
  *
  * We're also susceptible to the usual buffer overrun poisoning, though the
  * risk is within acceptable ranges for this implementation (don't overrun
@@ -42,10 +47,53 @@
 #include <libpayload.h>
 #include <stdint.h>
 
+typedef u64 hdrtype_t;
+#define HDRSIZE (sizeof(hdrtype_t))
+
+#define SIZE_BITS ((HDRSIZE << 3) - 8)
+#define MAGIC     (((hdrtype_t)0x2a) << (SIZE_BITS + 2))
+#define FLAG_PREV_FREE (((hdrtype_t)0x01) << (SIZE_BITS + 1))
+#define FLAG_FREE (((hdrtype_t)0x01) << (SIZE_BITS + 0))
+#define MAX_SIZE  ((((hdrtype_t)0x01) << SIZE_BITS) - 1)
+
+#define SIZE(_h) ((_h) & MAX_SIZE)
+
+#define _HEADER(_s, _f) ((hdrtype_t) (MAGIC | (_f) | ((_s) & MAX_SIZE)))
+
+#define FREE_BLOCK(_s) _HEADER(_s, FLAG_FREE)
+#define USED_BLOCK(_s) _HEADER(_s, 0)
+
+#define IS_FREE(_h) (((_h) & (MAGIC | FLAG_FREE)) == (MAGIC | FLAG_FREE))
+#define HAS_MAGIC(_h) (((_h) & MAGIC) == MAGIC)
+
+/* Sizes below 1 << FL_SHIFT share the first range, in linear steps. */
+#define FL_SHIFT	8
+#define SL_SHIFT	3
+#define SL_COUNT	(1 << SL_SHIFT)
+#define FL_COUNT	(32 - FL_SHIFT + 1)
+
+/* Largest block the free lists track. */
+#define MAX_BLOCK_SIZE	((size_t)0xf0000000)
+
+/* Kept at the start of a free block. */
+struct free_links {
+	hdrtype_t *next;
+	hdrtype_t *prev;
+};
+
+#define LINKS(_p) ((struct free_links *)((uintptr_t)(_p) + HDRSIZE))
+
+/* A free block needs room for its links and its size at the end. */
+#define MIN_BLOCK_SIZE ALIGN_UP(sizeof(struct free_links) + HDRSIZE, HDRSIZE)
+
 struct memory_type {
 	void *start;
 	void *end;
 	struct align_region_t* align_regions;
+	int initialized;
+	u32 fl_bitmap;
+	u32 sl_bitmap[FL_COUNT];
+	hdrtype_t *free_lists[FL_COUNT][SL_COUNT];
 #if CONFIG(LP_DEBUG_MALLOC)
 	int magic_initialized;
 	size_t minimal_free;
@@ -55,33 +103,16 @@ struct memory_type {
 
 extern char _heap, _eheap;	/* Defined in the ldscript. */
 
-static struct memory_type default_type =
-	{ (void *)&_heap, (void *)&_eheap, NULL
+static struct memory_type default_type = {
+	.start = (void *)&_heap,
+	.end = (void *)&_eheap,
 #if CONFIG(LP_DEBUG_MALLOC)
-	, 0, 0, "HEAP"
+	.name = "HEAP",
 #endif
-	};
+};
 static struct memory_type *const heap = &default_type;
 static struct memory_type *dma = &default_type;
 
-typedef u64 hdrtype_t;
-#define HDRSIZE (sizeof(hdrtype_t))
-
-#define SIZE_BITS ((HDRSIZE << 3) - 7)
-#define MAGIC     (((hdrtype_t)0x2a) << (SIZE_BITS + 1))
-#define FLAG_FREE (((hdrtype_t)0x01) << (SIZE_BITS + 0))
-#define MAX_SIZE  ((((hdrtype_t)0x01) << SIZE_BITS) - 1)
-
-#define SIZE(_h) ((_h) & MAX_SIZE)
-
-#define _HEADER(_s, _f) ((hdrtype_t) (MAGIC | (_f) | ((_s) & MAX_SIZE)))
-
-#define FREE_BLOCK(_s) _HEADER(_s, FLAG_FREE)
-#define USED_BLOCK(_s) _HEADER(_s, 0)
-
-#define IS_FREE(_h) (((_h) & (MAGIC | FLAG_FREE)) == (MAGIC | FLAG_FREE))
-#define HAS_MAGIC(_h) (((_h) & MAGIC) == MAGIC)
-
 static int free_aligned(void* addr, struct memory_type *type);
 void print_malloc_map(void);
 
@@ -92,20 +123,12 @@ void init_dma_memory(void *start, u32 size)
 		return;
 	}
 
-	/*
-	 * DMA memory might not be zeroed by coreboot on stage loading, so make
-	 * sure we clear the magic cookie from last boot.
-	 */
-	*(hdrtype_t *)start = 0;
-
 	dma = malloc(sizeof(*dma));
+	memset(dma, 0, sizeof(*dma));
 	dma->start = start;
 	dma->end = start + size;
-	dma->align_regions = NULL;
 
 #if CONFIG(LP_DEBUG_MALLOC)
-	dma->minimal_free = 0;
-	dma->magic_initialized = 0;
 	dma->name = "DMA";
 
 	printf("Initialized cache-coherent DMA memory at [%p:%p]\n", start, start + size);
@@ -123,122 +146,221 @@ int dma_coherent(const void *ptr)
 	return !dma_initialized() || (dma->start <= ptr && dma->end > ptr);
 }
 
-/* Find free block of size >= len */
-static hdrtype_t volatile *find_free_block(int len, struct memory_type *type)
+static void panic(hdrtype_t *ptr)
 {
-	hdrtype_t header;
-	hdrtype_t volatile *ptr = (hdrtype_t volatile *)type->start;
+	printf("memory allocator panic. (bad block at %p)\n", ptr);
+	halt();
+}
 
-	/* Align the size. */
-	len = ALIGN_UP(len, HDRSIZE);
+static hdrtype_t *next_block(hdrtype_t *ptr)
+{
+	return (hdrtype_t *)((uintptr_t)ptr + HDRSIZE + (size_t)SIZE(*ptr));
+}
 
-	if (!len || len > MAX_SIZE)
-		return (void *)NULL;
+/* Get the free list a block of the given size belongs on. */
+static void mapping(size_t size, int *fl, int *sl)
+{
+	if (size < (1 << FL_SHIFT)) {
+		*fl = 0;
+		*sl = size >> (FL_SHIFT - SL_SHIFT);
+	} else {
+		int bit = __fls(size);
 
-	/* Make sure the region is setup correctly. */
-	if (!HAS_MAGIC(*ptr)) {
-		size_t size = (type->end - type->start) - HDRSIZE;
-		*ptr = FREE_BLOCK(size);
-#if CONFIG(LP_DEBUG_MALLOC)
-		type->magic_initialized = 1;
-		type->minimal_free = size;
-#endif
+		*fl = bit - FL_SHIFT + 1;
+		*sl = (size >> (bit - SL_SHIFT)) - SL_COUNT;
 	}
+}
 
-	/* Find some free space. */
-	do {
-		header = *ptr;
-		int size = SIZE(header);
+static void insert_free_block(struct memory_type *type, hdrtype_t *ptr)
+{
+	struct free_links *links = LINKS(ptr);
+	int fl, sl;
 
-		if (!HAS_MAGIC(header) || size == 0) {
-			printf("memory allocator panic. (%s%s)\n",
-			       !HAS_MAGIC(header) ? " no magic " : "",
-				   size == 0 ? " size=0 " : "");
-			halt();
-		}
+	mapping(SIZE(*ptr), &fl, &sl);
 
-		if ((header & FLAG_FREE) && len <= size)
-			return ptr;
+	links->prev = NULL;
+	links->next = type->free_lists[fl][sl];
+	if (links->next)
+		LINKS(links->next)->prev = ptr;
+	type->free_lists[fl][sl] = ptr;
 
-		ptr = (hdrtype_t volatile *)((uintptr_t)ptr + HDRSIZE + size);
+	type->fl_bitmap |= 1U << fl;
+	type->sl_bitmap[fl] |= 1U << sl;
+}
 
-	} while (ptr < (hdrtype_t *) type->end);
+static void remove_free_block(struct memory_type *type, hdrtype_t *ptr)
+{
+	struct free_links *links = LINKS(ptr);
+	int fl, sl;
+
+	mapping(SIZE(*ptr), &fl, &sl);
+
+	if (links->prev)
+		LINKS(links->prev)->next = links->next;
+	else
+		type->free_lists[fl][sl] = links->next;
+	if (links->next)
+		LINKS(links->next)->prev = links->prev;
+
+	if (type->free_lists[fl][sl] == NULL) {
+		type->sl_bitmap[fl] &= ~(1U << sl);
+		if (!type->sl_bitmap[fl])
+			type->fl_bitmap &= ~(1U << fl);
+	}
+}
 
-	/* Nothing available. */
-	return NULL;
+/* Turn the area at ptr into a free block, and put it on its list. */
+static void mark_free(struct memory_type *type, hdrtype_t *ptr, size_t size)
+{
+	hdrtype_t *next;
+
+	*ptr = FREE_BLOCK(size);
+	*(hdrtype_t *)((uintptr_t)ptr + size) = size;
+
+	next = next_block(ptr);
+	if ((void *)next < type->end)
+		*next |= FLAG_PREV_FREE;
+
+	insert_free_block(type, ptr);
 }
 
-/* Mark the block with length 'len' as used */
-static void use_block(hdrtype_t volatile *ptr, int len)
+static void init_heap(struct memory_type *type)
 {
-	/* Align the size. */
-	len = ALIGN_UP(len, HDRSIZE);
+	size_t size = (type->end - type->start) - HDRSIZE;
 
-	hdrtype_t volatile *nptr = (hdrtype_t volatile *)
-		((uintptr_t)ptr + HDRSIZE + len);
-	int size = SIZE(*ptr);
-	int nsize = size - (HDRSIZE + len);
+	/* Anything beyond the largest block we can track stays unused. */
+	size = ALIGN_DOWN(MIN(size, MAX_BLOCK_SIZE), HDRSIZE);
+	type->end = type->start + HDRSIZE + size;
+
+	mark_free(type, type->start, size);
+	type->initialized = 1;
+#if CONFIG(LP_DEBUG_MALLOC)
+	type->magic_initialized = 1;
+	type->minimal_free = size;
+#endif
+}
+
+/* Find free block of size >= len */
+static hdrtype_t *find_free_block(size_t len, struct memory_type *type)
+{
+	hdrtype_t *ptr;
+	size_t rounded = len;
+	u32 map;
+	int fl, sl;
 
 	/*
-	 * If there is still room in this block, then mark it as such otherwise
-	 * account the whole space for that block.
+	 * Round the size up to the next list, so that any block on the lists
+	 * from there on is large enough.
 	 */
-	if (nsize > 0) {
-		/* Mark the block as used. */
-		*ptr = USED_BLOCK(len);
+	mapping(len, &fl, &sl);
+	if (fl > 0)
+		rounded = ALIGN_UP(len, (size_t)1 << (fl + FL_SHIFT - 1 - SL_SHIFT));
+	else
+		rounded = ALIGN_UP(len, 1 << (FL_SHIFT - SL_SHIFT));
+	mapping(rounded, &fl, &sl);
+
+	map = fl < FL_COUNT ? type->sl_bitmap[fl] & (~0U << sl) : 0;
+	if (!map) {
+		map = fl + 1 < FL_COUNT ? type->fl_bitmap & (~0U << (fl + 1)) : 0;
+		if (map) {
+			fl = __ffs(map);
+			map = type->sl_bitmap[fl];
+		}
+	}
+	if (map)
+		return type->free_lists[fl][__ffs(map)];
 
-		/* Create a new free block. */
-		*nptr = FREE_BLOCK(nsize);
-	} else {
-		/* Mark the block as used. */
-		*ptr = USED_BLOCK(size);
+	/* Otherwise a block on the list len itself belongs on may still fit. */
+	mapping(len, &fl, &sl);
+	for (ptr = type->free_lists[fl][sl]; ptr; ptr = LINKS(ptr)->next) {
+		if (SIZE(*ptr) >= len)
+			return ptr;
 	}
+
+	/* Nothing available. */
+	return NULL;
 }
 
-static void *alloc(int len, struct memory_type *type)
+/* Return a block to the free lists, merging it with its free neighbours. */
+static void release_block(struct memory_type *type, hdrtype_t *ptr)
 {
-	hdrtype_t volatile *ptr = find_free_block(len, type);
+	hdrtype_t *next = next_block(ptr);
+	hdrtype_t *prev;
+	size_t size = SIZE(*ptr);
+	size_t prev_size;
+
+	if ((void *)next < type->end && IS_FREE(*next)) {
+		remove_free_block(type, next);
+		size += HDRSIZE + SIZE(*next);
+		*next = 0;
+	}
 
-	if (ptr == NULL)
-		return NULL;
+	if (*ptr & FLAG_PREV_FREE) {
+		prev_size = *(ptr - 1);
+		prev = (hdrtype_t *)((uintptr_t)ptr - HDRSIZE - prev_size);
+		if ((void *)prev < type->start || !IS_FREE(*prev) ||
+		    SIZE(*prev) != prev_size)
+			panic(prev);
+
+		remove_free_block(type, prev);
+		size += HDRSIZE + prev_size;
+		*ptr = 0;
+		ptr = prev;
+	}
 
-	use_block(ptr, len);
-	return (void *)((uintptr_t)ptr + HDRSIZE);
+	mark_free(type, ptr, size);
 }
 
-static void _consolidate(struct memory_type *type)
+/* Mark the block with length 'len' as used */
+static void use_block(struct memory_type *type, hdrtype_t *ptr, size_t len)
 {
-	void *ptr = type->start;
-
-	while (ptr < type->end) {
-		void *nptr;
-		hdrtype_t hdr = *((hdrtype_t *) ptr);
-		unsigned int size = 0;
+	size_t size = SIZE(*ptr);
+	hdrtype_t *next;
 
-		if (!IS_FREE(hdr)) {
-			ptr += HDRSIZE + SIZE(hdr);
-			continue;
-		}
+	/*
+	 * If there is still room in this block, then split off a free block
+	 * otherwise account the whole space for that block.
+	 */
+	if (size >= len + HDRSIZE + MIN_BLOCK_SIZE) {
+		*ptr = USED_BLOCK(len) | (*ptr & FLAG_PREV_FREE);
+		next = next_block(ptr);
+		*next = USED_BLOCK(size - len - HDRSIZE);
+		release_block(type, next);
+	} else {
+		*ptr = USED_BLOCK(size) | (*ptr & FLAG_PREV_FREE);
+		next = next_block(ptr);
+		if ((void *)next < type->end)
+			*next &= ~FLAG_PREV_FREE;
+	}
+}
 
-		size = SIZE(hdr);
-		nptr = ptr + HDRSIZE + SIZE(hdr);
+/* Round a request up to a block size, or return 0 if it's impossible. */
+static size_t block_size(size_t len)
+{
+	if (!len || len > MAX_BLOCK_SIZE)
+		return 0;
 
-		while (nptr < type->end) {
-			hdrtype_t nhdr = *((hdrtype_t *) nptr);
+	return MAX(ALIGN_UP(len, HDRSIZE), MIN_BLOCK_SIZE);
+}
 
-			if (!(IS_FREE(nhdr)))
-				break;
+static void *alloc(size_t len, struct memory_type *type)
+{
+	hdrtype_t *ptr;
 
-			size += SIZE(nhdr) + HDRSIZE;
+	len = block_size(len);
+	if (!len)
+		return NULL;
 
-			*((hdrtype_t *) nptr) = 0;
+	if (!type->initialized)
+		init_heap(type);
 
-			nptr += (HDRSIZE + SIZE(nhdr));
-		}
+	ptr = find_free_block(len, type);
+	if (ptr == NULL)
+		return NULL;
 
-		*((hdrtype_t *) ptr) = FREE_BLOCK(size);
-		ptr = nptr;
-	}
+	remove_free_block(type, ptr);
+	use_block(type, ptr, len);
+	return (void *)((uintptr_t)ptr + HDRSIZE);
 }
 
 void free(void *ptr)
@@ -270,8 +392,7 @@ void free(void *ptr)
 	if (hdr & FLAG_FREE)
 		return;
 
-	*((hdrtype_t *) ptr) = FREE_BLOCK(SIZE(hdr));
-	_consolidate(type);
+	release_block(type, ptr);
 }
 
 void *malloc(size_t size)
@@ -297,48 +418,54 @@ void *calloc(size_t nmemb, size_t size)
 
 void *realloc(void *ptr, size_t size)
 {
-	void *ret, *pptr;
-	hdrtype_t volatile *block;
-	unsigned int osize;
+	void *ret;
+	hdrtype_t *block, *next;
+	size_t osize, len;
 	struct memory_type *type = heap;
 
 	if (ptr == NULL)
 		return alloc(size, type);
 
-	pptr = ptr - HDRSIZE;
+	block = ptr - HDRSIZE;
 
-	if (!HAS_MAGIC(*((hdrtype_t *) pptr)))
+	if (!HAS_MAGIC(*block))
 		return NULL;
 
 	if (ptr < type->start || ptr >= type->end)
 		type = dma;
 
+	len = block_size(size);
+	if (!len) {
+		if (!size)
+			free(ptr);
+		return NULL;
+	}
+
 	/* Get the original size of the block. */
-	osize = SIZE(*((hdrtype_t *) pptr));
+	osize = SIZE(*block);
+
+	/* Try to grow into a free block that follows. */
+	next = next_block(block);
+	if (len > osize && (void *)next < type->end && IS_FREE(*next) &&
+	    osize + HDRSIZE + SIZE(*next) >= len) {
+		remove_free_block(type, next);
+		osize += HDRSIZE + SIZE(*next);
+		*next = 0;
+		*block = USED_BLOCK(osize) | (*block & FLAG_PREV_FREE);
+	}
 
-	/*
-	 * Free the memory to update the tables - this won't touch the actual
-	 * memory, so we can still use it for the copy after we have
-	 * reallocated the new space.
-	 */
-	free(ptr);
+	/* Resize in place, giving back what isn't needed any more. */
+	if (len <= osize) {
+		use_block(type, block, len);
+		return ptr;
+	}
 
-	block = find_free_block(size, type);
-	if (block == NULL)
+	ret = alloc(size, type);
+	if (ret == NULL)
 		return NULL;
 
-	ret = (void *)((uintptr_t)block + HDRSIZE);
-
-	/*
-	 * If ret == ptr, then no copy is needed. Otherwise, move the memory to
-	 * the new location, which might be before the old one and overlap since
-	 * the free() above includes a _consolidate().
-	 */
-	if (ret != ptr)
-		memmove(ret, ptr, osize > size ? size : osize);
-
-	/* Mark the block as used. */
-	use_block(block, size);
+	memcpy(ret, ptr, osize);
+	free(ptr);
 
 	return ret;
 }
@@ -13,6 +13,7 @@
 #include <lzma.h>
 #include <string.h>
 #include <sysinfo.h>
+#include <zstd.h>
 
 
 static const struct cbfs_boot_device *cbfs_get_boot_device(bool force_ro)
@@ -141,6 +142,11 @@ static size_t cbfs_load_and_decompress(size_t offset, size_t in_size, void *buff
 			goto out;
 		out_size = ulzman(load, in_size, buffer, buffer_size);
 		break;
+	case CBFS_COMPRESS_ZSTD:
+		if (!CONFIG(LP_ZSTD))
+			goto out;
+		out_size = uzstdn(load, in_size, buffer, buffer_size);
+		break;
 	default:
 		ERROR("'%s' decompression algo %d not supported\n", mdata->h.filename,
 		      compression);
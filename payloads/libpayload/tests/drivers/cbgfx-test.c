@@ -0,0 +1,394 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#include <libpayload.h>
+
+/* Include source to gain access to private defines */
+#include "../drivers/video/graphics.c"
+
+#include <tests/test.h>
+#include <time.h>
+
+#define FB_MAX_SIZE		((1920 * 4 + 8) * 1080)
+#define BITMAP_SIZE		64
+#define BITMAP_COLORS		4
+#define BENCHMARK_ROUNDS	10
+
+struct sysinfo_t lib_sysinfo;
+unsigned long virtual_offset = 0;
+
+static uint8_t fb_memory[FB_MAX_SIZE] __aligned(16);
+
+static struct {
+	struct bitmap_file_header file_header;
+	struct bitmap_header_v3 header;
+	struct bitmap_palette_element_v3 palette[BITMAP_COLORS];
+	uint8_t pixels[BITMAP_SIZE][BITMAP_SIZE];
+} __packed bitmap;
+
+static const struct rgb_color black = { 0, 0, 0 };
+static const struct rgb_color red = { 0xff, 0, 0 };
+static const struct rgb_color gray = { 0x40, 0x80, 0xc0 };
+
+static void setup_fb(int width, int height, int bits_per_pixel, int orientation)
+{
+	struct cb_framebuffer *fb = &lib_sysinfo.framebuffer;
+
+	disable_graphics_buffer();
+	clear_color_map();
+	clear_blend();
+	initialized = 0;
+
+	memset(fb, 0, sizeof(*fb));
+	fb->physical_address = (uintptr_t)fb_memory;
+	fb->x_resolution = width;
+	fb->y_resolution = height;
+	/* Leave some padding at the end of each line. */
+	fb->bytes_per_line = ALIGN_UP(width * bits_per_pixel / 8 + 1, 8);
+	fb->bits_per_pixel = bits_per_pixel;
+	if (bits_per_pixel == 16) {
+		fb->red_mask_pos = 11;
+		fb->red_mask_size = 5;
+		fb->green_mask_pos = 5;
+		fb->green_mask_size = 6;
+		fb->blue_mask_pos = 0;
+		fb->blue_mask_size = 5;
+	} else {
+		fb->red_mask_pos = 16;
+		fb->red_mask_size = 8;
+		fb->green_mask_pos = 8;
+		fb->green_mask_size = 8;
+		fb->blue_mask_pos = 0;
+		fb->blue_mask_size = 8;
+	}
+	fb->orientation = orientation;
+
+	memset(fb_memory, 0x5a, sizeof(fb_memory));
+	assert_int_equal(0, cbgfx_init());
+}
+
+/* Where a screen pixel is in the framebuffer, worked out the slow way. */
+static uint8_t *reference_pixel(int x, int y)
+{
+	const struct cb_framebuffer *fb = &lib_sysinfo.framebuffer;
+	int rx, ry;
+
+	switch (fb->orientation) {
+	case CB_FB_ORIENTATION_NORMAL:
+	default:
+		rx = x;
+		ry = y;
+		break;
+	case CB_FB_ORIENTATION_BOTTOM_UP:
+		rx = screen.size.width - 1 - x;
+		ry = screen.size.height - 1 - y;
+		break;
+	case CB_FB_ORIENTATION_LEFT_UP:
+		rx = y;
+		ry = screen.size.width - 1 - x;
+		break;
+	case CB_FB_ORIENTATION_RIGHT_UP:
+		rx = screen.size.height - 1 - y;
+		ry = x;
+		break;
+	}
+
+	return fb_memory + ry * fb->bytes_per_line + rx * fb->bits_per_pixel / 8;
+}
+
+static void assert_pixel(int x, int y, uint32_t color)
+{
+	const uint8_t *pixel = reference_pixel(x, y);
+	int i;
+
+	for (i = 0; i < lib_sysinfo.framebuffer.bits_per_pixel / 8; i++) {
+		if (pixel[i] != (uint8_t)(color >> (i * 8)))
+			fail_msg("Pixel (%d, %d) byte %d is 0x%02x, expected 0x%02x",
+				 x, y, i, pixel[i], (uint8_t)(color >> (i * 8)));
+	}
+}
+
+static void test_draw_box(void **state)
+{
+	const int orientations[] = {
+		CB_FB_ORIENTATION_NORMAL, CB_FB_ORIENTATION_BOTTOM_UP,
+		CB_FB_ORIENTATION_LEFT_UP, CB_FB_ORIENTATION_RIGHT_UP,
+	};
+	const int depths[] = { 16, 24, 32 };
+	const struct rect box = {
+		.offset = { .x = 10, .y = 20 },
+		.size = { .width = 30, .height = 50 },
+	};
+	struct vector top_left, bottom_right;
+	int i, j, x, y;
+
+	for (i = 0; i < ARRAY_SIZE(orientations); i++) {
+		for (j = 0; j < ARRAY_SIZE(depths); j++) {
+			setup_fb(80, 61, depths[j], orientations[i]);
+			assert_int_equal(CBGFX_SUCCESS, clear_screen(&black));
+			assert_int_equal(CBGFX_SUCCESS, draw_box(&box, &red));
+
+			top_left.x = canvas.offset.x + canvas.size.width * 10 / 100;
+			top_left.y = canvas.offset.y + canvas.size.height * 20 / 100;
+			bottom_right.x = canvas.offset.x + canvas.size.width * 40 / 100;
+			bottom_right.y = canvas.offset.y + canvas.size.height * 70 / 100;
+
+			for (y = 0; y < screen.size.height; y++) {
+				for (x = 0; x < screen.size.width; x++) {
+					const int inside = x >= top_left.x &&
+						x < bottom_right.x && y >= top_left.y &&
+						y < bottom_right.y;
+					assert_pixel(x, y, calculate_color(inside ?
+							&red : &black, 0));
+				}
+			}
+		}
+	}
+}
+
+static void make_bitmap(void)
+{
+	int x, y;
+
+	memset(&bitmap, 0, sizeof(bitmap));
+	bitmap.file_header.signature[0] = 'B';
+	bitmap.file_header.signature[1] = 'M';
+	bitmap.file_header.file_size = htole32(sizeof(bitmap));
+	bitmap.file_header.bitmap_offset = htole32(offsetof(typeof(bitmap), pixels));
+	bitmap.header.header_size = htole32(sizeof(bitmap.header));
+	bitmap.header.width = htole32(BITMAP_SIZE);
+	bitmap.header.height = htole32(-BITMAP_SIZE);
+	bitmap.header.planes = htole16(1);
+	bitmap.header.bits_per_pixel = htole16(8);
+	bitmap.header.size = htole32(sizeof(bitmap.pixels));
+	bitmap.header.colors_used = htole32(BITMAP_COLORS);
+
+	bitmap.palette[1].red = 0xff;
+	bitmap.palette[2].green = 0xff;
+	bitmap.palette[3].blue = 0x80;
+
+	/* A few flat areas with sharp edges, and a checkerboard. */
+	for (y = 0; y < BITMAP_SIZE; y++) {
+		for (x = 0; x < BITMAP_SIZE; x++) {
+			if (y < BITMAP_SIZE / 2)
+				bitmap.pixels[y][x] = x < BITMAP_SIZE / 3 ? 1 : 2;
+			else
+				bitmap.pixels[y][x] = (x ^ y) & 1 ? 3 : 0;
+		}
+	}
+}
+
+static void test_draw_bitmap_direct(void **state)
+{
+	const struct vector top_left = { .x = 3, .y = 5 };
+	struct rgb_color rgb;
+	int x, y;
+
+	setup_fb(100, 80, 32, CB_FB_ORIENTATION_LEFT_UP);
+	make_bitmap();
+
+	assert_int_equal(CBGFX_SUCCESS,
+			 draw_bitmap_direct(&bitmap, sizeof(bitmap), &top_left));
+
+	for (y = 0; y < BITMAP_SIZE; y++) {
+		for (x = 0; x < BITMAP_SIZE; x++) {
+			pal_to_rgb(bitmap.pixels[y][x], bitmap.palette,
+				   BITMAP_COLORS, &rgb);
+			assert_pixel(top_left.x + x, top_left.y + y,
+				     calculate_color(&rgb, 0));
+		}
+	}
+
+	/* Indices outside of the palette are caught. */
+	bitmap.pixels[7][9] = BITMAP_COLORS;
+	assert_int_equal(CBGFX_ERROR_BITMAP_DATA,
+			 draw_bitmap_direct(&bitmap, sizeof(bitmap), &top_left));
+}
+
+/* Resample one output pixel with the full SSZ x SSZ sample array. */
+static uint8_t reference_resample(int ox, int oy, const struct vector *dim, int channel)
+{
+	fpmath_t ixfp = fpfrac(ox * BITMAP_SIZE, dim->width);
+	fpmath_t iyfp = fpfrac(oy * BITMAP_SIZE, dim->height);
+	fpmath_t sum = fp(0);
+	int sx, sy, ix, iy, equal = 0;
+	uint8_t first = 0;
+
+	for (sy = 0; sy < SSZ; sy++) {
+		iy = MAX(0, MIN(BITMAP_SIZE - 1, fpfloor(iyfp) + sy - S0));
+		for (sx = 0; sx < SSZ; sx++) {
+			ix = MAX(0, MIN(BITMAP_SIZE - 1, fpfloor(ixfp) + sx - S0));
+			const uint8_t index = bitmap.pixels[iy][ix];
+			const struct bitmap_palette_element_v3 *c = &bitmap.palette[index];
+			const uint8_t value = channel == 0 ? c->red :
+					      channel == 1 ? c->green : c->blue;
+			if (sx == 0 && sy == 0)
+				first = value;
+			equal += value == first;
+			sum = fpadd(sum, fpmuli(fpmul(lanczos_weight(ixfp, sx),
+						      lanczos_weight(iyfp, sy)), value));
+		}
+	}
+
+	/* Flat areas are copied, like draw_bitmap() does. */
+	if (equal == SSZ * SSZ)
+		return first;
+
+	return MAX(0, MIN(UINT8_MAX, fpround(sum)));
+}
+
+static void test_draw_bitmap_scaled(void **state)
+{
+	const struct scale pos = {
+		.x = { .n = 0, .d = 1 },
+		.y = { .n = 0, .d = 1 },
+	};
+	const struct scale dim_rel = {
+		.x = { .n = 1, .d = 1 },
+		.y = { .n = 1, .d = 1 },
+	};
+	const struct cb_framebuffer *fb = &lib_sysinfo.framebuffer;
+	struct vector dim;
+	const uint8_t *pixel;
+	int x, y, c;
+
+	setup_fb(200, 150, 32, CB_FB_ORIENTATION_NORMAL);
+	make_bitmap();
+
+	assert_int_equal(CBGFX_SUCCESS,
+			 draw_bitmap(&bitmap, sizeof(bitmap), &pos, &dim_rel,
+				     PIVOT_H_LEFT | PIVOT_V_TOP));
+
+	dim = canvas.size;
+	for (y = 0; y < dim.height; y++) {
+		for (x = 0; x < dim.width; x++) {
+			pixel = reference_pixel(canvas.offset.x + x, canvas.offset.y + y);
+			for (c = 0; c < 3; c++) {
+				/*
+				 * Flat rows and columns are copied as they are,
+				 * so where the weights don't add up to exactly
+				 * 1.0 the result is a little off the 2D filter.
+				 */
+				const int expected = reference_resample(x, y, &dim, c);
+				const int actual = pixel[(fb->red_mask_pos -
+							  c * 8) / 8];
+				if (ABS(expected - actual) > 2)
+					fail_msg("Pixel (%d, %d) channel %d is %d, expected %d",
+						 x, y, c, actual, expected);
+			}
+		}
+	}
+}
+
+static void test_flush_graphics_buffer(void **state)
+{
+	const struct rect box = {
+		.offset = { .x = 50, .y = 50 },
+		.size = { .width = 10, .height = 20 },
+	};
+	const struct cb_framebuffer *fb = &lib_sysinfo.framebuffer;
+	struct vector top_left, bottom_right;
+	int x, y;
+
+	setup_fb(120, 100, 32, CB_FB_ORIENTATION_RIGHT_UP);
+	assert_int_equal(CBGFX_SUCCESS, enable_graphics_buffer());
+
+	assert_int_equal(CBGFX_SUCCESS, draw_box(&box, &gray));
+	for (x = 0; x < fb->y_resolution * fb->bytes_per_line; x++)
+		assert_int_equal(0x5a, fb_memory[x]);
+
+	/* Only the box is copied to the framebuffer. */
+	assert_int_equal(CBGFX_SUCCESS, flush_graphics_buffer());
+	top_left.x = canvas.offset.x + canvas.size.width / 2;
+	top_left.y = canvas.offset.y + canvas.size.height / 2;
+	bottom_right.x = canvas.offset.x + canvas.size.width * 60 / 100;
+	bottom_right.y = canvas.offset.y + canvas.size.height * 70 / 100;
+	for (y = 0; y < screen.size.height; y++) {
+		for (x = 0; x < screen.size.width; x++) {
+			if (x >= top_left.x && x < bottom_right.x &&
+			    y >= top_left.y && y < bottom_right.y)
+				assert_pixel(x, y, calculate_color(&gray, 0));
+			else
+				assert_pixel(x, y, 0x5a5a5a5a);
+		}
+	}
+
+	/* A flush without drawing in between copies nothing. */
+	memset(fb_memory, 0x5a, sizeof(fb_memory));
+	assert_int_equal(CBGFX_SUCCESS, flush_graphics_buffer());
+	for (x = 0; x < fb->y_resolution * fb->bytes_per_line; x++)
+		assert_int_equal(0x5a, fb_memory[x]);
+
+	disable_graphics_buffer();
+}
+
+static long elapsed_usecs(const struct timeval *start)
+{
+	struct timeval end;
+
+	gettimeofday(&end, NULL);
+	return (end.tv_sec - start->tv_sec) * 1000000 + end.tv_usec - start->tv_usec;
+}
+
+static void test_redraw_benchmark(void **state)
+{
+	const struct rect full = {
+		.size = { .width = CANVAS_SCALE, .height = CANVAS_SCALE },
+	};
+	const struct scale pos = {
+		.x = { .n = 0, .d = 1 },
+		.y = { .n = 0, .d = 1 },
+	};
+	const struct scale dim_rel = {
+		.x = { .n = 1, .d = 1 },
+		.y = { .n = 1, .d = 1 },
+	};
+	struct timeval start;
+	int i;
+
+	setup_fb(1920, 1080, 32, CB_FB_ORIENTATION_NORMAL);
+	make_bitmap();
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < BENCHMARK_ROUNDS; i++)
+		clear_screen(&gray);
+	print_message("clear_screen() 1920x1080: %ld us\n",
+		      elapsed_usecs(&start) / BENCHMARK_ROUNDS);
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < BENCHMARK_ROUNDS; i++)
+		draw_box(&full, &red);
+	print_message("draw_box() of the canvas: %ld us\n",
+		      elapsed_usecs(&start) / BENCHMARK_ROUNDS);
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < BENCHMARK_ROUNDS; i++)
+		draw_bitmap(&bitmap, sizeof(bitmap), &pos, &dim_rel,
+			    PIVOT_H_LEFT | PIVOT_V_TOP);
+	print_message("draw_bitmap() %dx%d scaled to the canvas: %ld us\n",
+		      BITMAP_SIZE, BITMAP_SIZE,
+		      elapsed_usecs(&start) / BENCHMARK_ROUNDS);
+
+	assert_int_equal(CBGFX_SUCCESS, enable_graphics_buffer());
+	clear_screen(&black);
+	gettimeofday(&start, NULL);
+	for (i = 0; i < BENCHMARK_ROUNDS; i++) {
+		clear_screen(&gray);
+		flush_graphics_buffer();
+	}
+	print_message("Buffered full screen redraw: %ld us\n",
+		      elapsed_usecs(&start) / BENCHMARK_ROUNDS);
+	disable_graphics_buffer();
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_draw_box),
+		cmocka_unit_test(test_draw_bitmap_direct),
+		cmocka_unit_test(test_draw_bitmap_scaled),
+		cmocka_unit_test(test_flush_graphics_buffer),
+		cmocka_unit_test(test_redraw_benchmark),
+	};
+
+	return lp_run_group_tests(tests, NULL, NULL);
+}
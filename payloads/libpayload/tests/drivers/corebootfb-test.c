@@ -0,0 +1,248 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#include <libpayload.h>
+
+/* Include source to gain access to private defines */
+#include "../drivers/video/corebootfb.c"
+#include "../drivers/video/video.c"
+
+#include <tests/test.h>
+#include <time.h>
+
+#define FB_MAX_SIZE		(3840 * 2160 * 4)
+#define BENCHMARK_LINES		2000
+
+struct sysinfo_t lib_sysinfo;
+unsigned long virtual_offset = 0;
+
+static uint8_t fb_memory[FB_MAX_SIZE] __aligned(16);
+
+void console_add_output_driver(struct console_output_driver *out)
+{
+}
+
+static void setup_console(int width, int height, int bits_per_pixel)
+{
+	struct cb_framebuffer *fb = &lib_sysinfo.framebuffer;
+
+	memset(fb, 0, sizeof(*fb));
+	fb->physical_address = (uintptr_t)fb_memory;
+	fb->x_resolution = width;
+	fb->y_resolution = height;
+	fb->bytes_per_line = width * bits_per_pixel / 8;
+	fb->bits_per_pixel = bits_per_pixel;
+	if (bits_per_pixel == 16) {
+		fb->red_mask_pos = 11;
+		fb->red_mask_size = 5;
+		fb->green_mask_pos = 5;
+		fb->green_mask_size = 6;
+		fb->blue_mask_pos = 0;
+		fb->blue_mask_size = 5;
+	} else if (bits_per_pixel > 16) {
+		fb->red_mask_pos = 16;
+		fb->red_mask_size = 8;
+		fb->green_mask_pos = 8;
+		fb->green_mask_size = 8;
+		fb->blue_mask_pos = 0;
+		fb->blue_mask_size = 8;
+	}
+
+	/* Leftovers of a boot splash screen. */
+	memset(fb_memory, 0x5a, sizeof(fb_memory));
+
+	cursor_x = cursor_y = cursor_en = 0;
+	cursorx = cursory = 0;
+	coreboot_video_console.columns = 80;
+	coreboot_video_console.rows = 25;
+	assert_int_equal(0, video_init());
+}
+
+static void print_text(const char *str)
+{
+	video_console_write(str, strlen(str));
+}
+
+/* Framebuffer value of a standard color, the slow way. */
+static u32 reference_color(unsigned int index)
+{
+	const struct cb_framebuffer *fb = &lib_sysinfo.framebuffer;
+	const u32 rgb = vga_colors[index];
+
+	if (fb->bits_per_pixel == 8)
+		return index;
+
+	return (((rgb >> 16) & 0xff) >> (8 - fb->red_mask_size)) << fb->red_mask_pos |
+	       (((rgb >> 8) & 0xff) >> (8 - fb->green_mask_size)) << fb->green_mask_pos |
+	       ((rgb & 0xff) >> (8 - fb->blue_mask_size)) << fb->blue_mask_pos;
+}
+
+/* Check that a text cell shows the character ch, with the VGA attributes in ch. */
+static void assert_cell(unsigned int row, unsigned int col, unsigned int ch)
+{
+	const struct cb_framebuffer *fb = &lib_sysinfo.framebuffer;
+	const int bytes = fb->bits_per_pixel / 8;
+	const u32 fg = reference_color((ch >> 8) & 0xf);
+	const u32 bg = reference_color((ch >> 12) & 0xf);
+	const uint8_t *pixel;
+	u32 value;
+	int x, y, i;
+
+	for (y = 0; y < font_height; y++) {
+		for (x = 0; x < font_width; x++) {
+			pixel = fb_memory + (row * font_height + y) * fb->bytes_per_line +
+				(col * font_width + x) * bytes;
+			value = 0;
+			for (i = 0; i < bytes; i++)
+				value |= pixel[i] << (i * 8);
+
+			if (value != (font_glyph_filled(ch, font_width - 1 - x, y) ? fg : bg))
+				fail_msg("Cell (%u, %u) pixel (%d, %d) is 0x%x", row, col,
+					 x, y, value);
+		}
+	}
+}
+
+/* Check that a row shows the string, followed by empty cells. */
+static void assert_row(unsigned int row, const char *str)
+{
+	unsigned int col;
+
+	for (col = 0; col < coreboot_video_console.columns; col++) {
+		if (*str)
+			assert_cell(row, col, 0x0700 | *str++);
+		else
+			assert_cell(row, col, ' ');
+	}
+}
+
+static void test_corebootfb_print(void **state)
+{
+	const int depths[] = { 8, 16, 24, 32 };
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(depths); i++) {
+		setup_console(640, 480, depths[i]);
+		assert_int_equal(80, coreboot_video_console.columns);
+		assert_int_equal(30, coreboot_video_console.rows);
+
+		print_text("Hello,\tworld!\nSecond line");
+		assert_row(0, "Hello,  world!");
+		assert_row(1, "Second line");
+		assert_row(29, "");
+
+		video_printf(14, 1, VIDEO_PRINTF_ALIGN_KEEP, "!");
+		assert_cell(1, 11, 0x1e00 | '!');
+	}
+}
+
+static void test_corebootfb_scroll(void **state)
+{
+	char line[32];
+	unsigned int row;
+	int i;
+
+	setup_console(640, 480, 32);
+
+	/* Some lines are longer than a row, and wrap. */
+	for (i = 0; i < 100; i++) {
+		snprintf(line, sizeof(line), "line %d\n", i);
+		print_text(line);
+		if (i == 57)
+			print_text("0123456789012345678901234567890123456789"
+				   "0123456789012345678901234567890123456789"
+				   "wrapped\n");
+	}
+
+	for (row = 0; row < 29; row++) {
+		snprintf(line, sizeof(line), "line %d", 71 + row);
+		assert_row(row, line);
+	}
+	assert_row(29, "");
+
+	/* Scrolling a single line at a time. */
+	print_text("last line");
+	print_text("\n");
+	assert_row(27, "line 99");
+	assert_row(28, "last line");
+	assert_row(29, "");
+}
+
+static void test_corebootfb_cursor(void **state)
+{
+	setup_console(640, 480, 16);
+
+	print_text("abc");
+	video_console_cursor_enable(1);
+	assert_cell(0, 2, 0x0700 | 'c');
+	assert_cell(0, 3, 0x7000);
+
+	video_console_set_cursor(1, 0);
+	assert_cell(0, 1, 0x7000 | 'b');
+	assert_cell(0, 3, ' ');
+
+	video_console_cursor_enable(0);
+	assert_cell(0, 1, 0x0700 | 'b');
+}
+
+static void test_corebootfb_redraw_changed(void **state)
+{
+	const struct cb_framebuffer *fb = &lib_sysinfo.framebuffer;
+	int y;
+
+	setup_console(640, 480, 32);
+	print_text("abc\n");
+
+	/* Poison the first row, only the changed cell may be drawn again. */
+	for (y = 0; y < font_height; y++)
+		memset(fb_memory + y * fb->bytes_per_line, 0x5a, fb->bytes_per_line);
+	video_console_putc(0, 1, 0x0700 | 'x');
+
+	assert_cell(0, 1, 0x0700 | 'x');
+	for (y = 0; y < font_height; y++) {
+		assert_int_equal(0x5a, fb_memory[y * fb->bytes_per_line]);
+		assert_int_equal(0x5a, fb_memory[y * fb->bytes_per_line + 2 * font_width * 4]);
+	}
+
+	video_console_clear();
+	assert_row(0, "");
+}
+
+static long elapsed_usecs(const struct timeval *start)
+{
+	struct timeval end;
+
+	gettimeofday(&end, NULL);
+	return (end.tv_sec - start->tv_sec) * 1000000 + end.tv_usec - start->tv_usec;
+}
+
+static void test_corebootfb_benchmark(void **state)
+{
+	struct timeval start;
+	char line[128];
+	int i;
+
+	setup_console(3840, 2160, 32);
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < BENCHMARK_LINES; i++) {
+		snprintf(line, sizeof(line), "[DEBUG] Benchmark line %d of a verbose "
+			 "payload log\n", i);
+		print_text(line);
+	}
+	print_message("%d lines at %ux%u: %ld us\n", BENCHMARK_LINES,
+		      coreboot_video_console.columns, coreboot_video_console.rows,
+		      elapsed_usecs(&start));
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_corebootfb_print),
+		cmocka_unit_test(test_corebootfb_scroll),
+		cmocka_unit_test(test_corebootfb_cursor),
+		cmocka_unit_test(test_corebootfb_redraw_changed),
+		cmocka_unit_test(test_corebootfb_benchmark),
+	};
+
+	return lp_run_group_tests(tests, NULL, NULL);
+}
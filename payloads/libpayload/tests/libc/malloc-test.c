@@ -0,0 +1,315 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+/* Build the allocator under its own names, so it doesn't replace the host's. */
+#define malloc lp_test_malloc
+#define free lp_test_free
+#define calloc lp_test_calloc
+#define realloc lp_test_realloc
+#define memalign lp_test_memalign
+
+#include "../libc/malloc.c"
+
+#include <libpayload.h>
+#include <tests/test.h>
+#include <time.h>
+
+#define TEST_HEAP_SIZE		(4 * MiB)
+#define TEST_DMA_SIZE		(256 * KiB)
+#define TEST_SLOTS		4096
+#define BENCHMARK_ROUNDS	(1000 * 1000)
+
+/* Only give default_type its initial value, setup_heap() replaces it. */
+char _heap, _eheap;
+
+static u8 test_heap[TEST_HEAP_SIZE] __aligned(16);
+static u8 test_dma[TEST_DMA_SIZE] __aligned(16);
+
+static void *slots[TEST_SLOTS];
+static size_t slot_sizes[TEST_SLOTS];
+
+void halt(void)
+{
+	fail_msg("Memory allocator panic");
+	while (1)
+		;
+}
+
+static u32 rand_state;
+
+static u32 test_rand(void)
+{
+	rand_state ^= rand_state << 13;
+	rand_state ^= rand_state >> 17;
+	rand_state ^= rand_state << 5;
+	return rand_state;
+}
+
+static int setup_heap(void **state)
+{
+	memset(&default_type, 0, sizeof(default_type));
+	default_type.start = test_heap;
+	default_type.end = test_heap + sizeof(test_heap);
+	dma = &default_type;
+
+	memset(slots, 0, sizeof(slots));
+	rand_state = 0x12345678;
+	return 0;
+}
+
+/* Walk a heap and check that its blocks and free lists agree. */
+static void check_heap(struct memory_type *type)
+{
+	hdrtype_t *ptr = type->start;
+	size_t free_blocks = 0, listed_blocks = 0;
+	int prev_free = 0;
+	int fl, sl;
+
+	while ((void *)ptr < type->end) {
+		assert_true(HAS_MAGIC(*ptr));
+		assert_int_equal(prev_free, !!(*ptr & FLAG_PREV_FREE));
+		if (IS_FREE(*ptr)) {
+			/* Free neighbours are always merged. */
+			assert_false(prev_free);
+			assert_int_equal(SIZE(*ptr),
+					 *(hdrtype_t *)((uintptr_t)ptr + SIZE(*ptr)));
+			free_blocks++;
+		}
+		prev_free = IS_FREE(*ptr);
+		ptr = next_block(ptr);
+	}
+	assert_ptr_equal(type->end, ptr);
+
+	for (fl = 0; fl < FL_COUNT; fl++) {
+		for (sl = 0; sl < SL_COUNT; sl++) {
+			assert_int_equal(type->free_lists[fl][sl] != NULL,
+					 !!(type->sl_bitmap[fl] & (1U << sl)));
+			for (ptr = type->free_lists[fl][sl]; ptr; ptr = LINKS(ptr)->next)
+				listed_blocks++;
+		}
+		assert_int_equal(type->sl_bitmap[fl] != 0, !!(type->fl_bitmap & (1U << fl)));
+	}
+	assert_int_equal(free_blocks, listed_blocks);
+}
+
+static void fill_slot(int i, size_t size)
+{
+	slots[i] = malloc(size);
+	slot_sizes[i] = size;
+	if (slots[i])
+		memset(slots[i], i & 0xff, size);
+}
+
+static void free_slot(int i)
+{
+	const u8 *p = slots[i];
+	size_t j;
+
+	for (j = 0; j < slot_sizes[i]; j++) {
+		if (p[j] != (i & 0xff))
+			fail_msg("Slot %d was overwritten at byte %zu", i, j);
+	}
+	free(slots[i]);
+	slots[i] = NULL;
+}
+
+static void test_malloc_fill_heap(void **state)
+{
+	int i, count;
+
+	for (count = 0; count < TEST_SLOTS; count++) {
+		fill_slot(count, 1 + test_rand() % 2048);
+		if (!slots[count])
+			break;
+	}
+	/* The heap runs out before the slots do. */
+	assert_in_range(count, 1, TEST_SLOTS - 1);
+	check_heap(heap);
+
+	/* Free everything in a random order. */
+	for (i = 0; i < count * 4; i++) {
+		int j = test_rand() % count;
+		if (slots[j])
+			free_slot(j);
+	}
+	for (i = 0; i < count; i++) {
+		if (slots[i])
+			free_slot(i);
+	}
+	check_heap(heap);
+
+	/* Everything was merged back into a single block. */
+	slots[0] = malloc(TEST_HEAP_SIZE - HDRSIZE);
+	assert_ptr_equal(test_heap + HDRSIZE, slots[0]);
+	assert_null(malloc(1));
+	free(slots[0]);
+	check_heap(heap);
+}
+
+static void test_malloc_invalid(void **state)
+{
+	void *p = malloc(16);
+
+	assert_null(malloc(0));
+	assert_null(malloc(TEST_HEAP_SIZE));
+	assert_null(malloc((size_t)-1));
+
+	free(p);
+	/* Double frees are ignored. */
+	free(p);
+	free(NULL);
+	check_heap(heap);
+}
+
+static void test_realloc_resize(void **state)
+{
+	u8 *a, *b, *c;
+	int i;
+
+	a = malloc(64);
+	b = malloc(64);
+	for (i = 0; i < 64; i++)
+		a[i] = i;
+
+	/* Shrinking and growing into a following free block stay in place. */
+	assert_ptr_equal(a, realloc(a, 32));
+	check_heap(heap);
+	assert_ptr_equal(a, realloc(a, 64));
+	check_heap(heap);
+	for (i = 0; i < 32; i++)
+		assert_int_equal(i, a[i]);
+	for (i = 32; i < 64; i++)
+		a[i] = i;
+
+	/* b is in the way, so a has to move. */
+	c = realloc(a, 4096);
+	assert_non_null(c);
+	assert_ptr_not_equal(a, c);
+	for (i = 0; i < 64; i++)
+		assert_int_equal(i, c[i]);
+	check_heap(heap);
+
+	/* Growing into the space a left behind merges with it. */
+	free(b);
+	check_heap(heap);
+	assert_null(realloc(c, TEST_HEAP_SIZE));
+	for (i = 0; i < 64; i++)
+		assert_int_equal(i, c[i]);
+	assert_null(realloc(c, 0));
+	check_heap(heap);
+
+	a = realloc(NULL, 100);
+	assert_non_null(a);
+	free(a);
+	check_heap(heap);
+}
+
+static void test_memalign(void **state)
+{
+	const size_t aligns[] = { 8, 16, 64, 512, 4096 };
+	const size_t sizes[] = { 1, 24, 100, 1000, 5000 };
+	int i = 0;
+	size_t j, k;
+
+	for (j = 0; j < ARRAY_SIZE(aligns); j++) {
+		for (k = 0; k < ARRAY_SIZE(sizes); k++) {
+			slots[i] = memalign(aligns[j], sizes[k]);
+			slot_sizes[i] = sizes[k];
+			assert_non_null(slots[i]);
+			assert_int_equal(0, (uintptr_t)slots[i] % aligns[j]);
+			memset(slots[i], i & 0xff, sizes[k]);
+			i++;
+		}
+	}
+	check_heap(heap);
+
+	while (i--)
+		free_slot(i);
+	free(heap->align_regions);
+	check_heap(heap);
+
+	slots[0] = malloc(TEST_HEAP_SIZE - HDRSIZE);
+	assert_non_null(slots[0]);
+	free(slots[0]);
+}
+
+static void test_dma_malloc(void **state)
+{
+	void *p, *q;
+
+	init_dma_memory(test_dma, sizeof(test_dma));
+	assert_true(dma_initialized());
+
+	p = dma_malloc(100);
+	assert_in_range((uintptr_t)p, (uintptr_t)test_dma,
+			(uintptr_t)test_dma + sizeof(test_dma) - 100);
+	assert_true(dma_coherent(p));
+
+	q = malloc(100);
+	assert_in_range((uintptr_t)q, (uintptr_t)test_heap,
+			(uintptr_t)test_heap + sizeof(test_heap) - 100);
+	assert_false(dma_coherent(q));
+	free(q);
+
+	q = dma_memalign(64, 100);
+	assert_true(dma_coherent(q));
+	assert_int_equal(0, (uintptr_t)q % 64);
+	free(q);
+	free(p);
+	free(dma->align_regions);
+
+	check_heap(heap);
+	check_heap(dma);
+}
+
+static void test_malloc_benchmark(void **state)
+{
+	struct timeval start, end;
+	long usecs;
+	size_t size;
+	int i, j;
+
+	/* Fragment the heap with objects of typical payload sizes. */
+	for (i = 0; i < TEST_SLOTS; i++)
+		fill_slot(i, 8 + test_rand() % 256);
+	for (i = 0; i < TEST_SLOTS; i += 2)
+		free_slot(i);
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < BENCHMARK_ROUNDS; i++) {
+		j = test_rand() % TEST_SLOTS;
+		if (slots[j]) {
+			free(slots[j]);
+			slots[j] = NULL;
+		} else {
+			size = test_rand() % 16 ? 8 + test_rand() % 256 : test_rand() % 8192;
+			slots[j] = malloc(size);
+			slot_sizes[j] = 0;
+		}
+	}
+	gettimeofday(&end, NULL);
+
+	usecs = (end.tv_sec - start.tv_sec) * 1000000 + end.tv_usec - start.tv_usec;
+	print_message("%d malloc()/free() calls on %d live objects took %ld us\n",
+		      BENCHMARK_ROUNDS, TEST_SLOTS / 2, usecs);
+
+	check_heap(heap);
+	for (i = 0; i < TEST_SLOTS; i++) {
+		if (slots[i])
+			free_slot(i);
+	}
+	check_heap(heap);
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup(test_malloc_fill_heap, setup_heap),
+		cmocka_unit_test_setup(test_malloc_invalid, setup_heap),
+		cmocka_unit_test_setup(test_realloc_resize, setup_heap),
+		cmocka_unit_test_setup(test_memalign, setup_heap),
+		cmocka_unit_test_setup(test_dma_malloc, setup_heap),
+		cmocka_unit_test_setup(test_malloc_benchmark, setup_heap),
+	};
+
+	return lp_run_group_tests(tests, NULL, NULL);
+}
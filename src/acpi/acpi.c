@@ -15,6 +15,7 @@
 
 #include <acpi/acpi.h>
 #include <acpi/acpi_ivrs.h>
+#include <acpi/acpi_ssdt_cache.h>
 #include <acpi/acpigen.h>
 #include <cbfs.h>
 #include <cbmem.h>
@@ -306,6 +307,7 @@ static void acpi_ssdt_write_cbtable(void)
 static void acpi_create_ssdt_generator(acpi_header_t *ssdt, void *unused)
 {
 	unsigned long current = (unsigned long)ssdt + sizeof(acpi_header_t);
+	size_t cached_size;
 
 	if (acpi_fill_header(ssdt, "SSDT", SSDT, sizeof(acpi_header_t)) != CB_SUCCESS)
 		return;
@@ -315,12 +317,29 @@ static void acpi_create_ssdt_generator(acpi_header_t *ssdt, void *unused)
 	/* Write object to declare coreboot tables */
 	acpi_ssdt_write_cbtable();
 
-	{
+	current = (unsigned long)acpigen_get_current();
+
+	/* The device AML only depends on what the SSDT cache is keyed by. */
+	cached_size = CONFIG(ACPI_SSDT_CACHE) ?
+		acpi_ssdt_cache_load((void *)current, acpigen_get_remaining()) : 0;
+	if (cached_size) {
+		current += cached_size;
+	} else {
+		const unsigned long fill_start = current;
 		struct device *dev;
 		for (dev = all_devices; dev; dev = dev->next)
 			if (dev->enabled && dev->ops && dev->ops->acpi_fill_ssdt)
 				dev->ops->acpi_fill_ssdt(dev);
 		current = (unsigned long)acpigen_get_current();
+
+		/* Truncated AML must not be replayed on the next boot. */
+		if (CONFIG(ACPI_SSDT_CACHE)) {
+			if (acpigen_overflowed())
+				acpi_ssdt_cache_invalidate();
+			else
+				acpi_ssdt_cache_save((void *)fill_start,
+						     current - fill_start);
+		}
 	}
 
 	/* (Re)calculate length and checksum. */
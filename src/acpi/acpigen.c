@@ -21,10 +21,31 @@
 #include <types.h>
 
 static char *gencurrent;
+/* End of the buffer, or NULL if the caller didn't provide one. */
+static char *genlimit;
+static bool genoverflow;
 
 char *len_stack[ACPIGEN_LENSTACK_SIZE];
 int ltop = 0;
 
+/*
+ * Check that size more bytes fit into the buffer. Once it overflowed nothing
+ * else is written, so the AML is truncated but memory past the end is intact.
+ */
+static bool acpigen_reserve(size_t size)
+{
+	if (!genlimit)
+		return true;
+
+	if (!genoverflow && gencurrent <= genlimit && size <= genlimit - gencurrent)
+		return true;
+
+	if (!genoverflow)
+		printk(BIOS_ERR, "ACPI: acpigen buffer overflow at %p\n", gencurrent);
+	genoverflow = true;
+	return false;
+}
+
 void acpigen_write_len_f(void)
 {
 	ASSERT(ltop < (ACPIGEN_LENSTACK_SIZE - 1))
@@ -39,6 +60,8 @@ void acpigen_pop_len(void)
 	int len;
 	ASSERT(ltop > 0)
 	char *p = len_stack[--ltop];
+	if (genoverflow)
+		return;
 	len = gencurrent - p;
 	ASSERT(len <= ACPIGEN_MAXLEN)
 	/* generate store length for 0xfffff max */
@@ -58,38 +81,91 @@ char *acpigen_get_current(void)
 	return gencurrent;
 }
 
+void acpigen_set_limit(char *limit)
+{
+	genlimit = limit;
+	genoverflow = false;
+}
+
+bool acpigen_overflowed(void)
+{
+	return genoverflow;
+}
+
+size_t acpigen_get_remaining(void)
+{
+	if (!genlimit)
+		return SIZE_MAX;
+
+	if (genoverflow || gencurrent > genlimit)
+		return 0;
+
+	return genlimit - gencurrent;
+}
+
 void acpigen_emit_byte(unsigned char b)
 {
-	(*gencurrent++) = b;
+	if (acpigen_reserve(1))
+		(*gencurrent++) = b;
+}
+
+static void acpigen_emit_le(uint64_t data, size_t size)
+{
+	size_t i;
+
+	if (!acpigen_reserve(size))
+		return;
+
+	for (i = 0; i < size; i++)
+		gencurrent[i] = (data >> (8 * i)) & 0xff;
+	gencurrent += size;
 }
 
 void acpigen_emit_ext_op(uint8_t op)
 {
-	acpigen_emit_byte(EXT_OP_PREFIX);
-	acpigen_emit_byte(op);
+	acpigen_emit_le(op << 8 | EXT_OP_PREFIX, 2);
 }
 
 void acpigen_emit_word(unsigned int data)
 {
-	acpigen_emit_byte(data & 0xff);
-	acpigen_emit_byte((data >> 8) & 0xff);
+	acpigen_emit_le(data & 0xffff, 2);
 }
 
 void acpigen_emit_dword(unsigned int data)
 {
-	acpigen_emit_byte(data & 0xff);
-	acpigen_emit_byte((data >> 8) & 0xff);
-	acpigen_emit_byte((data >> 16) & 0xff);
-	acpigen_emit_byte((data >> 24) & 0xff);
+	acpigen_emit_le(data, 4);
+}
+
+void acpigen_emit_template(const struct acpigen_template *tmpl, const uint64_t *values)
+{
+	size_t i;
+	char *base = gencurrent;
+
+	if (!acpigen_reserve(tmpl->size))
+		return;
+
+	memcpy(gencurrent, tmpl->aml, tmpl->size);
+
+	for (i = 0; i < tmpl->num_patches; i++) {
+		gencurrent = base + tmpl->patches[i].offset;
+		acpigen_emit_le(values[i], tmpl->patches[i].size);
+	}
+
+	gencurrent = base + tmpl->size;
 }
 
 char *acpigen_write_package(int nr_el)
 {
+	/* Callers update the element count through the returned pointer. */
+	static char overflow_count;
 	char *p;
 	acpigen_emit_byte(PACKAGE_OP);
 	acpigen_write_len_f();
 	p = acpigen_get_current();
 	acpigen_emit_byte(nr_el);
+	/* The count wasn't emitted, so p may be at or past the limit. */
+	if (genoverflow)
+		return &overflow_count;
 	return p;
 }
 
@@ -114,8 +190,7 @@ void acpigen_write_dword(unsigned int data)
 void acpigen_write_qword(uint64_t data)
 {
 	acpigen_emit_byte(QWORD_PREFIX);
-	acpigen_emit_dword(data & 0xffffffff);
-	acpigen_emit_dword((data >> 32) & 0xffffffff);
+	acpigen_emit_le(data, 8);
 }
 
 void acpigen_write_zero(void)
@@ -196,9 +271,11 @@ void acpigen_write_name_unicode(const char *name, const char *string)
 
 void acpigen_emit_stream(const char *data, int size)
 {
-	int i;
-	for (i = 0; i < size; i++)
-		acpigen_emit_byte(data[i]);
+	if (size <= 0 || !acpigen_reserve(size))
+		return;
+
+	memcpy(gencurrent, data, size);
+	gencurrent += size;
 }
 
 void acpigen_emit_string(const char *string)
@@ -965,19 +1042,53 @@ void acpigen_write_PRW(u32 wake, u32 level)
 	acpigen_pop_len();
 }
 
+/* Package(n) { DWord, ... } with the dwords patched in. */
+#define DWORD_PACKAGE_SIZE(n)	(1 + 3 + 1 + 5 * (n))
+#define DWORD_PACKAGE_AML(n)	PACKAGE_OP, ACPIGEN_LEN_F(DWORD_PACKAGE_SIZE(n) - 1), (n)
+#define DWORD_AML		DWORD_PREFIX, 0, 0, 0, 0
+#define DWORD_PATCH(i)		{ .offset = 5 + 5 * (i) + 1, .size = 4 }
+
+static const uint8_t pss_package_aml[] = {
+	DWORD_PACKAGE_AML(6),
+	DWORD_AML, DWORD_AML, DWORD_AML, DWORD_AML, DWORD_AML, DWORD_AML,
+};
+
+static const struct acpigen_patch pss_package_patches[] = {
+	DWORD_PATCH(0), DWORD_PATCH(1), DWORD_PATCH(2),
+	DWORD_PATCH(3), DWORD_PATCH(4), DWORD_PATCH(5),
+};
+
+static const struct acpigen_template pss_package_template = {
+	.aml = pss_package_aml,
+	.size = sizeof(pss_package_aml),
+	.patches = pss_package_patches,
+	.num_patches = ARRAY_SIZE(pss_package_patches),
+};
+
+static const uint8_t tss_package_aml[] = {
+	DWORD_PACKAGE_AML(5),
+	DWORD_AML, DWORD_AML, DWORD_AML, DWORD_AML, DWORD_AML,
+};
+
+static const struct acpigen_template tss_package_template = {
+	.aml = tss_package_aml,
+	.size = sizeof(tss_package_aml),
+	.patches = pss_package_patches,
+	.num_patches = 5,
+};
+
+_Static_assert(sizeof(pss_package_aml) == DWORD_PACKAGE_SIZE(6), "PSS template size");
+_Static_assert(sizeof(tss_package_aml) == DWORD_PACKAGE_SIZE(5), "TSS template size");
+
 void acpigen_write_PSS_package(u32 coreFreq, u32 power, u32 transLat, u32 busmLat, u32 control,
 			       u32 status)
 {
-	acpigen_write_package(6);
-	acpigen_write_dword(coreFreq);
-	acpigen_write_dword(power);
-	acpigen_write_dword(transLat);
-	acpigen_write_dword(busmLat);
-	acpigen_write_dword(control);
-	acpigen_write_dword(status);
-	acpigen_pop_len();
+	const uint64_t values[] = { coreFreq, power, transLat, busmLat, control, status };
 
-	printk(BIOS_DEBUG, "PSS: %uMHz power %u control 0x%x status 0x%x\n", coreFreq, power,
+	acpigen_emit_template(&pss_package_template, values);
+
+	/* Every CPU gets the same table, so this is noisy on large systems. */
+	printk(BIOS_SPEW, "PSS: %uMHz power %u control 0x%x status 0x%x\n", coreFreq, power,
 	       control, status);
 }
 
@@ -1068,13 +1179,12 @@ void acpigen_write_TSS_package(int entries, acpi_tstate_t *tstate_list)
 	acpigen_write_package(entries);
 
 	for (i = 0; i < entries; i++) {
-		acpigen_write_package(5);
-		acpigen_write_dword(tstate->percent);
-		acpigen_write_dword(tstate->power);
-		acpigen_write_dword(tstate->latency);
-		acpigen_write_dword(tstate->control);
-		acpigen_write_dword(tstate->status);
-		acpigen_pop_len();
+		const uint64_t values[] = {
+			tstate->percent, tstate->power, tstate->latency,
+			tstate->control, tstate->status,
+		};
+
+		acpigen_emit_template(&tss_package_template, values);
 		tstate++;
 	}
 
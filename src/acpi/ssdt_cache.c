@@ -0,0 +1,229 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#include <acpi/acpi_gnvs.h>
+#include <acpi/acpi_ssdt_cache.h>
+#include <boardid.h>
+#include <boot_device.h>
+#include <cbmem.h>
+#include <commonlib/region.h>
+#include <console/console.h>
+#include <device/device.h>
+#include <fmap.h>
+#include <fw_config.h>
+#include <region_file.h>
+#include <string.h>
+#include <version.h>
+#include <xxhash.h>
+
+#define SSDT_CACHE_REGION	"RW_ACPI_CACHE"
+#define SSDT_CACHE_SIGNATURE	(('S'<<0)|('S'<<8)|('D'<<16)|('c'<<24))
+#define SSDT_CACHE_MAX_SIZE	(CONFIG_MAX_ACPI_TABLE_SIZE_KB * KiB)
+
+struct ssdt_cache_header {
+	uint32_t signature;
+	uint32_t size;
+	/* Hash of everything the generated AML depends on. */
+	uint64_t key;
+	/* Hash of the AML following the header. */
+	uint64_t data_hash;
+} __packed;
+
+/* Per-device state which the acpi_fill_ssdt() handlers base their output on. */
+struct ssdt_cache_dev_state {
+	struct device_path path;
+	uint32_t vendor;
+	uint32_t device;
+	uint32_t class;
+	uint16_t subsystem_vendor;
+	uint16_t subsystem_device;
+	uint8_t enabled;
+	uint8_t hidden;
+} __packed;
+
+struct ssdt_cache_res_state {
+	uint64_t base;
+	uint64_t size;
+	uint64_t flags;
+	uint64_t index;
+} __packed;
+
+static struct incoherent_rdev cache_irdev;
+static struct region_file cache_file;
+static uint64_t cache_key;
+
+static const struct region_device *ssdt_cache_rdev(void)
+{
+	static struct region_device read_rdev, write_rdev;
+	struct region region;
+
+	if (fmap_locate_area(SSDT_CACHE_REGION, &region) < 0) {
+		printk(BIOS_DEBUG, "ACPI: No '%s' region, SSDT cache disabled.\n",
+		       SSDT_CACHE_REGION);
+		return NULL;
+	}
+
+	if (boot_device_ro_subregion(&region, &read_rdev) < 0)
+		return NULL;
+
+	if (boot_device_rw_subregion(&region, &write_rdev) < 0)
+		return NULL;
+
+	return incoherent_rdev_init(&cache_irdev, &region, &read_rdev, &write_rdev);
+}
+
+static uint64_t ssdt_cache_compute_key(void)
+{
+	struct xxh64_state state;
+	struct ssdt_cache_dev_state dev_state;
+	struct ssdt_cache_res_state res_state;
+	const struct device *dev;
+	const struct resource *res;
+	uint64_t value;
+
+	xxh64_reset(&state, 0);
+
+	/* A different build may emit different AML for the same devices. */
+	xxh64_update(&state, coreboot_version, strlen(coreboot_version));
+	xxh64_update(&state, coreboot_build, strlen(coreboot_build));
+	xxh64_update(&state, &coreboot_version_timestamp, sizeof(coreboot_version_timestamp));
+
+	value = CONFIG(FW_CONFIG) ? fw_config_get() : 0;
+	xxh64_update(&state, &value, sizeof(value));
+
+	/* Boards may pick the emitted AML by board revision or SKU. */
+	value = (uint64_t)board_id() << 32 | sku_id();
+	xxh64_update(&state, &value, sizeof(value));
+
+	/* CBMEM objects referenced from the AML move with the top of CBMEM. */
+	value = (uintptr_t)cbmem_top();
+	xxh64_update(&state, &value, sizeof(value));
+	value = (uintptr_t)acpi_get_gnvs();
+	xxh64_update(&state, &value, sizeof(value));
+
+	for (dev = all_devices; dev; dev = dev->next) {
+		memset(&dev_state, 0, sizeof(dev_state));
+		dev_state.path = dev->path;
+		dev_state.vendor = dev->vendor;
+		dev_state.device = dev->device;
+		dev_state.class = dev->class;
+		dev_state.subsystem_vendor = dev->subsystem_vendor;
+		dev_state.subsystem_device = dev->subsystem_device;
+		dev_state.enabled = dev->enabled;
+		dev_state.hidden = dev->hidden;
+		xxh64_update(&state, &dev_state, sizeof(dev_state));
+
+		for (res = dev->resource_list; res; res = res->next) {
+			res_state.base = res->base;
+			res_state.size = res->size;
+			res_state.flags = res->flags;
+			res_state.index = res->index;
+			xxh64_update(&state, &res_state, sizeof(res_state));
+		}
+	}
+
+	return xxh64_digest(&state);
+}
+
+size_t acpi_ssdt_cache_load(void *dest, size_t dest_size)
+{
+	const struct region_device *rdev;
+	struct region_device data_rdev;
+	struct ssdt_cache_header header;
+	void *aml;
+	bool valid;
+
+	cache_key = ssdt_cache_compute_key();
+
+	rdev = ssdt_cache_rdev();
+	if (!rdev || region_file_init(&cache_file, rdev) < 0)
+		return 0;
+
+	if (region_file_data(&cache_file, &data_rdev) < 0 ||
+	    rdev_readat(&data_rdev, &header, 0, sizeof(header)) != sizeof(header))
+		return 0;
+
+	if (header.signature != SSDT_CACHE_SIGNATURE || header.key != cache_key) {
+		printk(BIOS_DEBUG, "ACPI: SSDT cache is stale.\n");
+		return 0;
+	}
+
+	if (header.size > MIN(dest_size, SSDT_CACHE_MAX_SIZE) ||
+	    region_device_sz(&data_rdev) < sizeof(header) + header.size) {
+		printk(BIOS_ERR, "ACPI: SSDT cache is corrupted.\n");
+		return 0;
+	}
+
+	/* Check the AML before any of it ends up in the tables. */
+	aml = rdev_mmap(&data_rdev, sizeof(header), header.size);
+	if (!aml)
+		return 0;
+
+	valid = xxh64(aml, header.size, 0) == header.data_hash;
+	if (valid)
+		memcpy(dest, aml, header.size);
+
+	rdev_munmap(&data_rdev, aml);
+
+	if (!valid) {
+		printk(BIOS_ERR, "ACPI: SSDT cache is corrupted.\n");
+		return 0;
+	}
+
+	printk(BIOS_DEBUG, "ACPI: Using %u bytes of cached SSDT AML.\n", header.size);
+
+	return header.size;
+}
+
+void acpi_ssdt_cache_save(const void *aml, size_t size)
+{
+	const struct region_device *rdev;
+	struct ssdt_cache_header header = {
+		.signature = SSDT_CACHE_SIGNATURE,
+		.size = size,
+		.key = cache_key,
+		.data_hash = xxh64(aml, size, 0),
+	};
+	const struct update_region_file_entry entries[] = {
+		{ .size = sizeof(header), .data = &header },
+		{ .size = size, .data = aml },
+	};
+
+	if (size > SSDT_CACHE_MAX_SIZE)
+		return;
+
+	rdev = ssdt_cache_rdev();
+	if (!rdev || region_file_init(&cache_file, rdev) < 0)
+		return;
+
+	if (region_file_update_data_arr(&cache_file, entries, ARRAY_SIZE(entries)) < 0)
+		printk(BIOS_ERR, "ACPI: Failed to update SSDT cache.\n");
+	else
+		printk(BIOS_DEBUG, "ACPI: Updated SSDT cache.\n");
+}
+
+void acpi_ssdt_cache_invalidate(void)
+{
+	const struct region_device *rdev;
+	struct region_device data_rdev;
+	struct ssdt_cache_header header;
+	const struct update_region_file_entry entry = {
+		.size = sizeof(header),
+		.data = &header,
+	};
+
+	rdev = ssdt_cache_rdev();
+	if (!rdev || region_file_init(&cache_file, rdev) < 0)
+		return;
+
+	/* Don't wear out the flash if there is nothing to drop. */
+	if (region_file_data(&cache_file, &data_rdev) < 0 ||
+	    rdev_readat(&data_rdev, &header, 0, sizeof(header)) != sizeof(header) ||
+	    header.signature != SSDT_CACHE_SIGNATURE)
+		return;
+
+	memset(&header, 0, sizeof(header));
+	if (region_file_update_data_arr(&cache_file, &entry, 1) < 0)
+		printk(BIOS_ERR, "ACPI: Failed to invalidate SSDT cache.\n");
+	else
+		printk(BIOS_DEBUG, "ACPI: Invalidated SSDT cache.\n");
+}
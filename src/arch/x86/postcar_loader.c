@@ -7,7 +7,6 @@
 #include <cpu/x86/mtrr.h>
 #include <cpu/x86/smm.h>
 #include <program_loading.h>
-#include <reset.h>
 #include <rmodule.h>
 #include <romstage_handoff.h>
 #include <security/vboot/vboot_common.h>
@@ -130,12 +129,6 @@ void postcar_enable_tseg_cache(struct postcar_frame *pcf)
 				MTRR_TYPE_WRBACK);
 }
 
-static void postcar_cache_invalid(void)
-{
-	printk(BIOS_ERR, "postcar cache invalid.\n");
-	board_reset();
-}
-
 /*
  * POSTCAR will call invd so don't make assumptions on cbmem
  * and external stage cache being UC.
@@ -162,17 +155,24 @@ static void run_postcar_phase(struct postcar_frame *pcf)
 
 	vboot_run_logic();
 
+	timestamp_add_now(TS_COPYPOSTCAR_START);
+
 	if (resume_from_stage_cache()) {
 		stage_cache_load_stage(STAGE_POSTCAR, &prog);
+		if (prog_entry(&prog) == NULL)
+			printk(BIOS_ERR, "postcar cache invalid, loading from CBFS.\n");
+	}
+
+	if (prog_entry(&prog) != NULL) {
 		/* This is here to allow platforms to pass different stack
 		   parameters between S3 resume and normal boot. On the
 		   platforms where the values are the same it's a nop. */
 		finalize_load(prog.arg, (uintptr_t)pcf->mtrr);
-
-		if (prog_entry(&prog) == NULL)
-			postcar_cache_invalid();
-	} else
+	} else {
 		load_postcar_cbfs(&prog, pcf);
+	}
+
+	timestamp_add_now(TS_COPYPOSTCAR_END);
 
 	/* As postcar exist, it's end of romstage here */
 	timestamp_add_now(TS_ROMSTAGE_END);
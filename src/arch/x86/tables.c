@@ -7,6 +7,7 @@
 #include <arch/pirq_routing.h>
 #include <arch/smp/mpspec.h>
 #include <acpi/acpi.h>
+#include <acpi/acpigen.h>
 #include <commonlib/helpers.h>
 #include <string.h>
 #include <cbmem.h>
@@ -99,12 +100,17 @@ static unsigned long write_acpi_table(unsigned long rom_table_end)
 		unsigned long new_high_table_pointer;
 
 		rom_table_end = ALIGN_UP(rom_table_end, 16);
+		acpigen_set_limit((char *)high_table_pointer + max_acpi_size);
 		new_high_table_pointer = write_acpi_tables(high_table_pointer);
 		if (new_high_table_pointer > (high_table_pointer
 			+ max_acpi_size)) {
 			printk(BIOS_CRIT, "ACPI tables overflowed and corrupted CBMEM!\n");
 			printk(BIOS_ERR, "Increase config MAX_ACPI_TABLE_SIZE_KB!\n");
+		} else if (acpigen_overflowed()) {
+			printk(BIOS_CRIT, "Generated ACPI tables were truncated!\n");
+			printk(BIOS_ERR, "Increase config MAX_ACPI_TABLE_SIZE_KB!\n");
 		}
+		acpigen_set_limit(NULL);
 		printk(BIOS_DEBUG, "ACPI tables: %ld bytes.\n",
 				new_high_table_pointer - high_table_pointer);
 
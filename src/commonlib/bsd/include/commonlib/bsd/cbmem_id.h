@@ -26,6 +26,7 @@
 #define CBMEM_ID_FREESPACE	0x46524545
 #define CBMEM_ID_FSP_RESERVED_MEMORY 0x46535052
 #define CBMEM_ID_FSP_RUNTIME	0x52505346
+#define CBMEM_ID_FSP_HOB_INDEX	0x49424f48
 #define CBMEM_ID_FSPM_VERSION	0x56505346
 #define CBMEM_ID_MRC_VERSION	0x5f43524d
 #define CBMEM_ID_GDT		0x4c474454
@@ -43,6 +44,7 @@
 #define CBMEM_ID_IOE_CRASHLOG	0x494f455f
 #define CBMEM_ID_VAR_MRCDATA	0x4d524345
 #define CBMEM_ID_MTC		0xcb31d31c
+#define CBMEM_ID_MTRR_SOLUTION	0x4d545253
 #define CBMEM_ID_NONE		0x00000000
 #define CBMEM_ID_PIRQ		0x49525154
 #define CBMEM_ID_POWER_STATE	0x50535454
@@ -113,6 +115,7 @@
 	{ CBMEM_ID_FREESPACE,		"FREE SPACE " }, \
 	{ CBMEM_ID_FSP_RESERVED_MEMORY, "FSP MEMORY " }, \
 	{ CBMEM_ID_FSP_RUNTIME,		"FSP RUNTIME" }, \
+	{ CBMEM_ID_FSP_HOB_INDEX,	"FSP HOB IDX" }, \
 	{ CBMEM_ID_FSPM_VERSION,	"FSPM VERSION" }, \
 	{ CBMEM_ID_MRC_VERSION,		"MRC VERSION" }, \
 	{ CBMEM_ID_GDT,			"GDT        " }, \
@@ -129,6 +132,7 @@
 	{ CBMEM_ID_PMC_CRASHLOG,	"PMC CRASHLOG"}, \
 	{ CBMEM_ID_VAR_MRCDATA,		"VARMRC DATA" }, \
 	{ CBMEM_ID_MTC,			"MTC        " }, \
+	{ CBMEM_ID_MTRR_SOLUTION,	"MTRR SOLUTION" }, \
 	{ CBMEM_ID_PIRQ,		"IRQ TABLE  " }, \
 	{ CBMEM_ID_POWER_STATE,		"POWER STATE" }, \
 	{ CBMEM_ID_RAM_OOPS,		"RAMOOPS    " }, \
@@ -3,7 +3,9 @@
 #ifndef _COMMONLIB_COMPRESSION_H_
 #define _COMMONLIB_COMPRESSION_H_
 
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 /* Decompresses an LZ4F image (multiple LZ4 blocks with frame header) from src
  * to dst, ensuring that it doesn't read more than srcn bytes and doesn't write
@@ -18,4 +20,63 @@ size_t ulz4fn(const void *src, size_t srcn, void *dst, size_t dstn);
 /* Same as ulz4fn() but does not perform any bounds checks. */
 size_t ulz4f(const void *src, void *dst);
 
+/* ulz4fn() taken apart so that the blocks of a frame can be decompressed
+ * on several CPUs at once. lz4f_frame_init() checks the frame header and where the
+ * blocks are, lz4f_next_block() then hands out one block after the other and
+ * lz4f_decode_block() decompresses them in any order. Once all blocks are done,
+ * lz4f_frame_finish() checks the content size and checksum. Block and content
+ * checksums are verified if the frame has them.
+ *
+ * Each block goes to the offset of its index times the maximum block size, so all
+ * blocks but the last must decompress to exactly that size, which is what the LZ4
+ * frame compressor produces. Other frames and in-place decompression need ulz4fn().
+ */
+struct lz4f_frame {
+	const uint8_t *next;		/* header of the block handed out next */
+	uint8_t *dst;
+	size_t dstn;
+	size_t block_size;
+	size_t blocks;
+	size_t next_block;
+	bool has_block_checksum;
+	bool has_content_checksum;
+	bool has_content_size;
+	uint32_t content_checksum;
+	uint64_t content_size;
+};
+
+struct lz4f_block {
+	const void *src;
+	size_t srcn;
+	void *dst;
+	size_t dstn;
+	bool compressed;
+	bool last;
+	bool has_checksum;
+	uint32_t checksum;
+};
+
+/* Returns 0 if the frame can be decompressed block by block, or -1. */
+int lz4f_frame_init(struct lz4f_frame *frame, const void *src, size_t srcn, void *dst,
+		    size_t dstn);
+
+/* Fills in the next block and returns true, or returns false when there are no more.
+ * Calls for the same frame must not run concurrently. */
+bool lz4f_next_block(struct lz4f_frame *frame, struct lz4f_block *block);
+
+/* Returns the amount of decompressed bytes of the block, or 0 on error. */
+size_t lz4f_decode_block(const struct lz4f_block *block);
+
+/* Takes the sum of what lz4f_decode_block() returned for all blocks and returns it
+ * if the frame is complete and intact, or 0 otherwise. */
+size_t lz4f_frame_finish(const struct lz4f_frame *frame, size_t out_size);
+
+/* Decompresses Zstandard frames from src to dst, reading no more than srcn bytes
+ * and writing no more than dstn. The output buffer serves as the window, so any
+ * window size works without extra memory, but in-place decompression and
+ * dictionaries are not supported. Not reentrant.
+ * Returns amount of decompressed bytes, or 0 on error.
+ */
+size_t uzstdn(const void *src, size_t srcn, void *dst, size_t dstn);
+
 #endif	/* _COMMONLIB_COMPRESSION_H_ */
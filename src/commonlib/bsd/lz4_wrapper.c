@@ -14,16 +14,42 @@ static uint16_t LZ4_readLE16(const void *src)
 {
 	return le16toh(*(const uint16_t *)src);
 }
+
+/* ARMv < 6 doesn't support unaligned accesses at all, and RISC-V
+ * implementations may trap on any unaligned access. They still get to copy
+ * whole words whenever source and destination happen to be aligned, which is
+ * common for the 8-byte strides of LZ4_wildCopy() and for matches at offsets
+ * which are a multiple of the word size. */
+#if (defined(__arm__) && defined(__COREBOOT_ARM_ARCH__) && __COREBOOT_ARM_ARCH__ < 6) \
+	|| defined(__riscv)
+static void LZ4_copy8_aligned(void *dst, const void *src)
+{
+	uintptr_t both = (uintptr_t)dst | (uintptr_t)src;
+	int i;
+
+	if (!(both & 7)) {
+		*(uint64_t *)dst = *(const uint64_t *)src;
+#ifdef __riscv	/* ARM might coalesce this into LDRD/STRD which need 8 bytes. */
+	} else if (!(both & 3)) {
+		((uint32_t *)dst)[0] = ((const uint32_t *)src)[0];
+		((uint32_t *)dst)[1] = ((const uint32_t *)src)[1];
+#endif
+	} else {
+		for (i = 0; i < 8; i++)
+			((uint8_t *)dst)[i] = ((const uint8_t *)src)[i];
+	}
+}
+#define LZ4_ALIGNED_COPY8 1
+#endif
+
 static void LZ4_copy8(void *dst, const void *src)
 {
+#ifdef LZ4_ALIGNED_COPY8
+	LZ4_copy8_aligned(dst, src);
 /* ARM32 needs to be a special snowflake to prevent GCC from coalescing the
  * access into LDRD/STRD (which don't support unaligned accesses). */
-#ifdef __arm__	/* ARMv < 6 doesn't support unaligned accesses at all. */
-	#if defined(__COREBOOT_ARM_ARCH__) && __COREBOOT_ARM_ARCH__ < 6
-		int i;
-		for (i = 0; i < 8; i++)
-			((uint8_t *)dst)[i] = ((uint8_t *)src)[i];
-	#else
+#elif defined(__arm__)
+	{
 		uint32_t x0, x1;
 		__asm__ ("ldr %[x0], [%[src]]"
 			: [x0]"=r"(x0)
@@ -37,12 +63,7 @@ static void LZ4_copy8(void *dst, const void *src)
 		__asm__ ("str %[x1], [%[dst], #4]"
 			: "=m"(*(uint32_t *)(dst + 4))
 			: [x1]"r"(x1), [dst]"r"(dst));
-	#endif
-#elif defined(__riscv)
-	/* RISC-V implementations may trap on any unaligned access. */
-	int i;
-	for (i = 0; i < 8; i++)
-		((uint8_t *)dst)[i] = ((uint8_t *)src)[i];
+	}
 #else
 	*(uint64_t *)dst = *(const uint64_t *)src;
 #endif
@@ -58,7 +79,8 @@ typedef uint64_t U64;
 #define likely(expr) __builtin_expect((expr) != 0, 1)
 #define unlikely(expr) __builtin_expect((expr) != 0, 0)
 
-/* Unaltered (just removed unrelated code) from github.com/Cyan4973/lz4/dev. */
+/* Taken from github.com/Cyan4973/lz4/dev (just removed unrelated code), with the
+ * decoder shortcut for short literal runs and matches backported from v1.8.2. */
 #include "lz4.c.inc"	/* #include for inlining, do not link! */
 
 #define LZ4F_MAGICNUMBER 0x184D2204
@@ -169,3 +191,220 @@ size_t ulz4f(const void *src, void *dst)
 	/* LZ4 uses signed size parameters, so can't just use ((u32)-1) here. */
 	return ulz4fn(src, 1*GiB, dst, 1*GiB);
 }
+
+#define XXH_PRIME32_1	0x9E3779B1U
+#define XXH_PRIME32_2	0x85EBCA77U
+#define XXH_PRIME32_3	0xC2B2AE3DU
+#define XXH_PRIME32_4	0x27D4EB2FU
+#define XXH_PRIME32_5	0x165667B1U
+
+static uint32_t xxh_read32(const uint8_t *p)
+{
+	uint32_t v;
+
+	__builtin_memcpy(&v, p, sizeof(v));
+	return le32toh(v);
+}
+
+static uint32_t xxh_rotl32(uint32_t x, int r)
+{
+	return (x << r) | (x >> (32 - r));
+}
+
+static uint32_t xxh32_round(uint32_t acc, uint32_t input)
+{
+	return xxh_rotl32(acc + input * XXH_PRIME32_2, 13) * XXH_PRIME32_1;
+}
+
+/* XXH32 as used for the LZ4 frame checksums, always with seed 0. */
+static uint32_t xxh32(const void *input, size_t len)
+{
+	const uint8_t *p = input;
+	const uint8_t *const end = p + len;
+	uint32_t h;
+
+	if (len >= 16) {
+		uint32_t v1 = XXH_PRIME32_1 + XXH_PRIME32_2;
+		uint32_t v2 = XXH_PRIME32_2;
+		uint32_t v3 = 0;
+		uint32_t v4 = -XXH_PRIME32_1;
+
+		do {
+			v1 = xxh32_round(v1, xxh_read32(p));
+			v2 = xxh32_round(v2, xxh_read32(p + 4));
+			v3 = xxh32_round(v3, xxh_read32(p + 8));
+			v4 = xxh32_round(v4, xxh_read32(p + 12));
+			p += 16;
+		} while (end - p >= 16);
+
+		h = xxh_rotl32(v1, 1) + xxh_rotl32(v2, 7) + xxh_rotl32(v3, 12) +
+		    xxh_rotl32(v4, 18);
+	} else {
+		h = XXH_PRIME32_5;
+	}
+
+	h += (uint32_t)len;
+
+	for (; end - p >= 4; p += 4)
+		h = xxh_rotl32(h + xxh_read32(p) * XXH_PRIME32_3, 17) * XXH_PRIME32_4;
+	for (; p < end; p++)
+		h = xxh_rotl32(h + *p * XXH_PRIME32_5, 11) * XXH_PRIME32_1;
+
+	h ^= h >> 15;
+	h *= XXH_PRIME32_2;
+	h ^= h >> 13;
+	h *= XXH_PRIME32_3;
+	h ^= h >> 16;
+
+	return h;
+}
+
+int lz4f_frame_init(struct lz4f_frame *frame, const void *src, size_t srcn, void *dst,
+		    size_t dstn)
+{
+	const struct lz4_frame_header *h = src;
+	const uint8_t *in = src;
+	const uint8_t *end = in + srcn;
+	uint32_t raw;
+	size_t size;
+
+	memset(frame, 0, sizeof(*frame));
+
+	/* Blocks get written while others are still being read. */
+	if ((uintptr_t)src < (uintptr_t)dst + dstn && (uintptr_t)dst < (uintptr_t)end)
+		return -1;
+
+	if (srcn < sizeof(*h) + sizeof(uint8_t))
+		return -1;	/* input overrun */
+	if (le32toh(h->magic) != LZ4F_MAGICNUMBER
+	    || (h->flags & VERSION) != (1 << VERSION_SHIFT))
+		return -1;	/* unknown format */
+	if ((h->flags & RESERVED0) || (h->block_descriptor & RESERVED1_2))
+		return -1;	/* reserved must be zero */
+	if (!(h->flags & INDEPENDENT_BLOCKS))
+		return -1;	/* can't decode blocks on their own */
+
+	/* 64 KiB, 256 KiB, 1 MiB or 4 MiB. */
+	size = (h->block_descriptor & MAX_BLOCK_SIZE) >> 4;
+	if (size < 4)
+		return -1;
+	frame->block_size = 1 << (2 * size + 8);
+
+	frame->has_block_checksum = h->flags & HAS_BLOCK_CHECKSUM;
+	frame->has_content_checksum = h->flags & HAS_CONTENT_CHECKSUM;
+	in += sizeof(*h);
+	if (h->flags & HAS_CONTENT_SIZE) {
+		if ((size_t)(end - in) < sizeof(uint64_t) + sizeof(uint8_t))
+			return -1;
+		frame->has_content_size = true;
+		__builtin_memcpy(&frame->content_size, in, sizeof(uint64_t));
+		frame->content_size = le64toh(frame->content_size);
+		in += sizeof(uint64_t);
+	}
+	in += sizeof(uint8_t);
+
+	frame->next = in;
+	frame->dst = dst;
+	frame->dstn = dstn;
+
+	/* Count the blocks and make sure they all lie within the input. */
+	while (1) {
+		if ((size_t)(end - in) < sizeof(uint32_t))
+			return -1;	/* input overrun */
+		raw = xxh_read32(in);
+		in += sizeof(uint32_t);
+		if (!raw)
+			break;		/* end mark */
+
+		size = raw & BH_SIZE;
+		if (size > frame->block_size)
+			return -1;
+		if (frame->has_block_checksum)
+			size += sizeof(uint32_t);
+		if ((size_t)(end - in) < size)
+			return -1;	/* input overrun */
+		in += size;
+
+		if (frame->blocks * frame->block_size >= dstn)
+			return -1;	/* output overrun */
+		frame->blocks++;
+	}
+
+	if (frame->has_content_checksum) {
+		if ((size_t)(end - in) < sizeof(uint32_t))
+			return -1;
+		frame->content_checksum = xxh_read32(in);
+	}
+
+	return 0;
+}
+
+bool lz4f_next_block(struct lz4f_frame *frame, struct lz4f_block *block)
+{
+	const uint8_t *in = frame->next;
+	uint32_t raw;
+	size_t out;
+
+	if (frame->next_block >= frame->blocks)
+		return false;
+
+	raw = xxh_read32(in);
+	in += sizeof(uint32_t);
+	out = frame->next_block * frame->block_size;
+
+	block->src = in;
+	block->srcn = raw & BH_SIZE;
+	block->dst = frame->dst + out;
+	block->dstn = MIN(frame->block_size, frame->dstn - out);
+	block->compressed = !(raw & NOT_COMPRESSED);
+	block->last = ++frame->next_block == frame->blocks;
+	block->has_checksum = frame->has_block_checksum;
+	in += block->srcn;
+	if (block->has_checksum) {
+		block->checksum = xxh_read32(in);
+		in += sizeof(uint32_t);
+	}
+
+	frame->next = in;
+	return true;
+}
+
+size_t lz4f_decode_block(const struct lz4f_block *block)
+{
+	int ret;
+
+	if (block->has_checksum && xxh32(block->src, block->srcn) != block->checksum)
+		return 0;
+
+	if (!block->compressed) {
+		if (block->srcn > block->dstn)
+			return 0;	/* output overrun */
+		memcpy(block->dst, block->src, block->srcn);
+		ret = block->srcn;
+	} else {
+		/* constant folding essential, do not touch params! */
+		ret = LZ4_decompress_generic(block->src, block->dst, block->srcn,
+				block->dstn, endOnInputSize, full, 0, noDict,
+				block->dst, NULL, 0);
+		if (ret < 0)
+			return 0;	/* decompression error */
+	}
+
+	/* Only the last block may be shorter, or the next would be misplaced. */
+	if (!block->last && (size_t)ret != block->dstn)
+		return 0;
+
+	return ret;
+}
+
+size_t lz4f_frame_finish(const struct lz4f_frame *frame, size_t out_size)
+{
+	if (frame->next_block != frame->blocks)
+		return 0;
+	if (frame->has_content_size && frame->content_size != out_size)
+		return 0;
+	if (frame->has_content_checksum && xxh32(frame->dst, out_size) != frame->content_checksum)
+		return 0;
+
+	return out_size;
+}
@@ -0,0 +1,1049 @@
+/* SPDX-License-Identifier: BSD-3-Clause OR GPL-2.0-only */
+
+/*
+ * Zstandard decoder as specified in RFC 8878.
+ *
+ * Frames are decoded in one go into the output buffer, which doubles as the
+ * window, so apart from the static decoding tables below (about 14KiB) no memory
+ * is needed whatever window size the encoder used. This keeps it usable before
+ * RAM is up, but also means that the decoder is not reentrant. Dictionaries are
+ * not supported, and the content checksum isn't checked since CBFS files are
+ * verified by other means.
+ */
+
+#include <commonlib/bsd/compression.h>
+#include <commonlib/bsd/helpers.h>
+#include <commonlib/bsd/sysincludes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define ZSTD_MAGIC		0xFD2FB528
+#define ZSTD_SKIPPABLE_MAGIC	0x184D2A50
+#define ZSTD_SKIPPABLE_MASK	0xFFFFFFF0
+
+/* Frame_Header_Descriptor */
+#define FCS_FLAG_SHIFT		6
+#define SINGLE_SEGMENT		0x20
+#define RESERVED_BIT		0x08
+#define HAS_CHECKSUM		0x04
+#define DICT_ID_FLAG		0x03
+
+#define BLOCK_LAST		0x1
+#define BLOCK_TYPE_SHIFT	1
+#define BLOCK_SIZE_SHIFT	3
+enum { BLOCK_RAW, BLOCK_RLE, BLOCK_COMPRESSED, BLOCK_RESERVED };
+
+enum { LITERALS_RAW, LITERALS_RLE, LITERALS_COMPRESSED, LITERALS_TREELESS };
+enum { MODE_PREDEFINED, MODE_RLE, MODE_FSE, MODE_REPEAT };
+
+#define MAX_HUF_LOG		11
+#define MAX_WEIGHT_LOG		6
+#define MAX_LL_LOG		9
+#define MAX_ML_LOG		9
+#define MAX_OF_LOG		8
+#define MAX_LL_CODE		35
+#define MAX_ML_CODE		52
+#define MAX_OF_CODE		31
+
+/* Copies of literals and matches may write up to this many bytes too much. */
+#define WILDCOPY_OVERLENGTH	16
+
+/* One FSE state. For sequences, value and extra_bits are the baseline and the
+   number of additional bits of the decoded code, for weights value is the symbol. */
+struct fse_entry {
+	uint32_t value;
+	uint16_t next_base;
+	uint8_t nb_bits;
+	uint8_t extra_bits;
+};
+
+struct fse_table {
+	struct fse_entry *entries;
+	unsigned int log;
+	bool valid;
+};
+
+/* Literals_Length, Match_Length and Offset codes. */
+struct seq_code {
+	unsigned int max_log;
+	unsigned int max_code;
+	unsigned int default_log;
+	unsigned int default_max;
+	const int16_t *default_norm;
+	const uint32_t *base;
+	const uint8_t *bits;
+};
+
+static const int16_t ll_default_norm[MAX_LL_CODE + 1] = {
+	4, 3, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1,
+	2, 2, 2, 2, 2, 2, 2, 2, 2, 3, 2, 1, 1, 1, 1, 1,
+	-1, -1, -1, -1,
+};
+
+static const uint32_t ll_base[MAX_LL_CODE + 1] = {
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+	16, 18, 20, 22, 24, 28, 32, 40, 48, 64, 128, 256, 512, 1024, 2048, 4096,
+	8192, 16384, 32768, 65536,
+};
+
+static const uint8_t ll_bits[MAX_LL_CODE + 1] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	1, 1, 1, 1, 2, 2, 3, 3, 4, 6, 7, 8, 9, 10, 11, 12,
+	13, 14, 15, 16,
+};
+
+static const int16_t ml_default_norm[MAX_ML_CODE + 1] = {
+	1, 4, 3, 2, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, -1, -1,
+	-1, -1, -1, -1, -1,
+};
+
+static const uint32_t ml_base[MAX_ML_CODE + 1] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18,
+	19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34,
+	35, 37, 39, 41, 43, 47, 51, 59, 67, 83, 99, 131, 259, 515, 1027, 2051,
+	4099, 8195, 16387, 32771, 65539,
+};
+
+static const uint8_t ml_bits[MAX_ML_CODE + 1] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	1, 1, 1, 1, 2, 2, 3, 3, 4, 4, 5, 7, 8, 9, 10, 11,
+	12, 13, 14, 15, 16,
+};
+
+static const int16_t of_default_norm[29] = {
+	1, 1, 1, 1, 1, 1, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, -1, -1, -1, -1, -1,
+};
+
+/* Offset code N stands for (1 << N) plus N additional bits. */
+static const uint32_t of_base[MAX_OF_CODE + 1] = {
+	1U << 0, 1U << 1, 1U << 2, 1U << 3, 1U << 4, 1U << 5, 1U << 6, 1U << 7,
+	1U << 8, 1U << 9, 1U << 10, 1U << 11, 1U << 12, 1U << 13, 1U << 14, 1U << 15,
+	1U << 16, 1U << 17, 1U << 18, 1U << 19, 1U << 20, 1U << 21, 1U << 22, 1U << 23,
+	1U << 24, 1U << 25, 1U << 26, 1U << 27, 1U << 28, 1U << 29, 1U << 30, 1U << 31,
+};
+
+static const uint8_t of_bits[MAX_OF_CODE + 1] = {
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+	16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31,
+};
+
+static const struct seq_code ll_code = {
+	.max_log = MAX_LL_LOG, .max_code = MAX_LL_CODE,
+	.default_log = 6, .default_max = ARRAY_SIZE(ll_default_norm) - 1,
+	.default_norm = ll_default_norm, .base = ll_base, .bits = ll_bits,
+};
+static const struct seq_code ml_code = {
+	.max_log = MAX_ML_LOG, .max_code = MAX_ML_CODE,
+	.default_log = 6, .default_max = ARRAY_SIZE(ml_default_norm) - 1,
+	.default_norm = ml_default_norm, .base = ml_base, .bits = ml_bits,
+};
+static const struct seq_code of_code = {
+	.max_log = MAX_OF_LOG, .max_code = MAX_OF_CODE,
+	.default_log = 5, .default_max = ARRAY_SIZE(of_default_norm) - 1,
+	.default_norm = of_default_norm, .base = of_base, .bits = of_bits,
+};
+
+/* Decoding tables, which compressed blocks may carry over to the next block. */
+static struct {
+	struct fse_entry ll_entries[1 << MAX_LL_LOG];
+	struct fse_entry ml_entries[1 << MAX_ML_LOG];
+	struct fse_entry of_entries[1 << MAX_OF_LOG];
+	struct fse_table ll, ml, of;
+	/* Symbol << 8 | code length, indexed by the next huf_log bits. */
+	uint16_t huf[1 << MAX_HUF_LOG];
+	unsigned int huf_log;
+	bool huf_valid;
+} zstd;
+
+/* The compiler knows best how to access unaligned words on each architecture. */
+static __always_inline uint64_t read_le64(const void *p)
+{
+	uint64_t v;
+
+	__builtin_memcpy(&v, p, sizeof(v));
+	return le64toh(v);
+}
+
+static __always_inline void copy8(void *dst, const void *src)
+{
+	uint64_t v;
+
+	__builtin_memcpy(&v, src, sizeof(v));
+	__builtin_memcpy(dst, &v, sizeof(v));
+}
+
+static __always_inline uint32_t read_le16(const uint8_t *p)
+{
+	return p[0] | p[1] << 8;
+}
+
+static __always_inline uint32_t read_le24(const uint8_t *p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16;
+}
+
+static __always_inline uint32_t read_le32(const uint8_t *p)
+{
+	return read_le24(p) | (uint32_t)p[3] << 24;
+}
+
+static __always_inline unsigned int highbit(uint32_t x)
+{
+	return 31 - __builtin_clz(x);
+}
+
+/*
+ * Entropy coded data is read backwards, starting at the highest bit of the last
+ * byte below the 1-bit end marker. The 64-bit container holds the bytes around
+ * ptr, of which the top 'consumed' bits are used up.
+ */
+struct bitstream {
+	const uint8_t *start;
+	const uint8_t *ptr;
+	uint64_t container;
+	unsigned int consumed;
+};
+
+static int bits_init(struct bitstream *b, const uint8_t *src, size_t size)
+{
+	size_t i;
+
+	if (size < 1 || !src[size - 1])
+		return -1;
+
+	b->start = src;
+	if (size >= sizeof(b->container)) {
+		b->ptr = src + size - sizeof(b->container);
+		b->container = read_le64(b->ptr);
+		b->consumed = 0;
+	} else {
+		b->ptr = src;
+		b->container = 0;
+		for (i = 0; i < size; i++)
+			b->container |= (uint64_t)src[i] << (8 * i);
+		b->consumed = 8 * (sizeof(b->container) - size);
+	}
+	b->consumed += 8 - highbit(src[size - 1]);
+
+	return 0;
+}
+
+/* Peeking past the start gives garbage, which bits_finished() catches later. */
+static __always_inline uint64_t bits_peek(const struct bitstream *b, unsigned int n)
+{
+	return (b->container << (b->consumed & 63)) >> 1 >> (63 - n);
+}
+
+static __always_inline uint64_t bits_read(struct bitstream *b, unsigned int n)
+{
+	uint64_t v = bits_peek(b, n);
+
+	b->consumed += n;
+	return v;
+}
+
+/* Refills the container. Returns false once more bits were read than there are. */
+static __always_inline bool bits_reload(struct bitstream *b)
+{
+	size_t n;
+
+	if (b->consumed > 64)
+		return false;
+
+	if (b->ptr >= b->start + sizeof(b->container)) {
+		b->ptr -= b->consumed >> 3;
+		b->consumed &= 7;
+	} else if (b->ptr == b->start) {
+		return true;
+	} else {
+		n = MIN((size_t)(b->consumed >> 3), (size_t)(b->ptr - b->start));
+		b->ptr -= n;
+		b->consumed -= n * 8;
+	}
+	b->container = read_le64(b->ptr);
+
+	return true;
+}
+
+static __always_inline bool bits_finished(const struct bitstream *b)
+{
+	return b->ptr == b->start && b->consumed == 64;
+}
+
+/* Table descriptions are read forwards, bytes past the end read as zero. */
+static uint32_t fwd_bits(const uint8_t *src, size_t size, size_t pos, unsigned int n)
+{
+	uint32_t v = 0;
+	size_t i;
+
+	for (i = 0; i < 4 && (pos >> 3) + i < size; i++)
+		v |= (uint32_t)src[(pos >> 3) + i] << (8 * i);
+
+	return (v >> (pos & 7)) & ((1U << n) - 1);
+}
+
+/*
+ * Reads a normalized probability distribution. Returns the number of bytes it
+ * took, or -1 on error.
+ */
+static int fse_read_distribution(int16_t *norm, unsigned int *max_symbol,
+				 unsigned int *log, unsigned int max_log,
+				 const uint8_t *src, size_t size)
+{
+	unsigned int symbol = 0, threshold, nb_bits;
+	int remaining, count;
+	bool previous0 = false;
+	uint32_t v;
+	size_t pos = 4;
+
+	if (size < 1)
+		return -1;
+
+	*log = fwd_bits(src, size, 0, 4) + 5;
+	if (*log > max_log)
+		return -1;
+
+	remaining = (1 << *log) + 1;
+	threshold = 1 << *log;
+	nb_bits = *log + 1;
+
+	while (remaining > 1 && symbol <= *max_symbol) {
+		if (previous0) {
+			unsigned int n0 = symbol;
+
+			while ((v = fwd_bits(src, size, pos, 2)) == 3) {
+				n0 += 3;
+				pos += 2;
+			}
+			n0 += v;
+			pos += 2;
+			if (n0 > *max_symbol)
+				return -1;
+			while (symbol < n0)
+				norm[symbol++] = 0;
+		}
+
+		const int max = (2 * threshold - 1) - remaining;
+		v = fwd_bits(src, size, pos, nb_bits);
+		if ((int)(v & (threshold - 1)) < max) {
+			count = v & (threshold - 1);
+			pos += nb_bits - 1;
+		} else {
+			count = v & (2 * threshold - 1);
+			if (count >= (int)threshold)
+				count -= max;
+			pos += nb_bits;
+		}
+
+		count--;	/* -1 is a "less than 1" probability */
+		remaining -= count < 0 ? -count : count;
+		norm[symbol++] = count;
+		previous0 = !count;
+		if (remaining < 1)
+			return -1;
+		while (remaining < (int)threshold) {
+			nb_bits--;
+			threshold >>= 1;
+		}
+	}
+
+	if (remaining != 1 || (pos + 7) >> 3 > size)
+		return -1;
+	*max_symbol = symbol - 1;
+
+	return (pos + 7) >> 3;
+}
+
+/* Spreads the symbols over the table. Returns 0 on success or -1 on error. */
+static int fse_build(struct fse_entry *t, const int16_t *norm, unsigned int max_symbol,
+		     unsigned int log, const uint32_t *base, const uint8_t *bits)
+{
+	const uint32_t size = 1 << log, mask = size - 1;
+	const uint32_t step = (size >> 1) + (size >> 3) + 3;
+	uint32_t high = size - 1, pos = 0, i;
+	uint16_t next[MAX_ML_CODE + 1];
+	unsigned int s;
+	int j;
+
+	for (s = 0; s <= max_symbol; s++) {
+		if (norm[s] == -1) {
+			t[high--].value = s;
+			next[s] = 1;
+		} else {
+			next[s] = norm[s];
+		}
+	}
+
+	for (s = 0; s <= max_symbol; s++) {
+		for (j = 0; j < norm[s]; j++) {
+			t[pos].value = s;
+			do {
+				pos = (pos + step) & mask;
+			} while (pos > high);
+		}
+	}
+	if (pos != 0)
+		return -1;
+
+	for (i = 0; i < size; i++) {
+		const uint32_t state = next[t[i].value]++;
+
+		s = t[i].value;
+		t[i].nb_bits = log - highbit(state);
+		t[i].next_base = (state << t[i].nb_bits) - size;
+		t[i].value = base ? base[s] : s;
+		t[i].extra_bits = bits ? bits[s] : 0;
+	}
+
+	return 0;
+}
+
+static __always_inline uint32_t fse_decode(const struct fse_entry *t, uint32_t *state,
+				  struct bitstream *b)
+{
+	const struct fse_entry *e = &t[*state];
+
+	*state = e->next_base + bits_read(b, e->nb_bits);
+	return e->value;
+}
+
+/* Reads Huffman code lengths as weights. Returns the bytes taken or -1 on error. */
+static int huf_read_weights(uint8_t *weights, unsigned int *count,
+			    const uint8_t *src, size_t size)
+{
+	struct fse_entry t[1 << MAX_WEIGHT_LOG];
+	int16_t norm[MAX_HUF_LOG + 1];
+	unsigned int max_symbol = MAX_HUF_LOG, log, n = 0;
+	struct bitstream b;
+	uint32_t state1, state2;
+	size_t header;
+	int ret;
+
+	if (size < 1)
+		return -1;
+	header = src[0];
+	src++;
+	size--;
+
+	if (header >= 128) {
+		/* Directly stored 4-bit weights */
+		*count = header - 127;
+		header = (*count + 1) / 2;
+		if (header > size)
+			return -1;
+		for (n = 0; n < *count; n++)
+			weights[n] = n & 1 ? src[n / 2] & 0xf : src[n / 2] >> 4;
+		return header + 1;
+	}
+
+	if (header > size)
+		return -1;
+	ret = fse_read_distribution(norm, &max_symbol, &log, MAX_WEIGHT_LOG, src, header);
+	if (ret < 0 || fse_build(t, norm, max_symbol, log, NULL, NULL) < 0)
+		return -1;
+	if (bits_init(&b, src + ret, header - ret) < 0)
+		return -1;
+
+	/* Two interleaved states, until a state update runs past the start. */
+	state1 = bits_read(&b, log);
+	state2 = bits_read(&b, log);
+	bits_reload(&b);
+	while (1) {
+		if (n > 253)
+			return -1;
+		weights[n++] = fse_decode(t, &state1, &b);
+		if (!bits_reload(&b)) {
+			weights[n++] = t[state2].value;
+			break;
+		}
+		if (n > 253)
+			return -1;
+		weights[n++] = fse_decode(t, &state2, &b);
+		if (!bits_reload(&b)) {
+			weights[n++] = t[state1].value;
+			break;
+		}
+	}
+	*count = n;
+
+	return header + 1;
+}
+
+/* Reads a Huffman tree description. Returns the bytes taken or -1 on error. */
+static int huf_read_table(const uint8_t *src, size_t size)
+{
+	uint8_t weights[256];
+	uint32_t rank_start[MAX_HUF_LOG + 2] = { 0 };
+	uint32_t total = 0, rest, pos, i, j;
+	unsigned int count, log, s;
+	int ret;
+
+	ret = huf_read_weights(weights, &count, src, size);
+	if (ret < 0)
+		return -1;
+
+	for (s = 0; s < count; s++) {
+		if (weights[s] > MAX_HUF_LOG)
+			return -1;
+		rank_start[weights[s]]++;
+		total += (1 << weights[s]) >> 1;
+	}
+	if (!total)
+		return -1;
+
+	/* The weight of the last symbol makes the total a power of 2. */
+	log = highbit(total) + 1;
+	if (log > MAX_HUF_LOG)
+		return -1;
+	rest = (1 << log) - total;
+	if (rest & (rest - 1))
+		return -1;
+	weights[count++] = highbit(rest) + 1;
+	rank_start[weights[count - 1]]++;
+
+	/* Longer codes come first, each symbol takes 2^(weight - 1) entries. */
+	pos = 0;
+	for (i = 1; i <= log; i++) {
+		const uint32_t n = rank_start[i];
+
+		rank_start[i] = pos;
+		pos += n << (i - 1);
+	}
+	for (s = 0; s < count; s++) {
+		const unsigned int w = weights[s];
+
+		if (!w)
+			continue;
+		j = rank_start[w];
+		rank_start[w] += 1 << (w - 1);
+		for (i = j; i < rank_start[w]; i++)
+			zstd.huf[i] = s << 8 | (log + 1 - w);
+	}
+	zstd.huf_log = log;
+	zstd.huf_valid = true;
+
+	return ret;
+}
+
+static __always_inline uint8_t huf_decode_symbol(struct bitstream *b, unsigned int log)
+{
+	const uint16_t e = zstd.huf[bits_peek(b, log)];
+
+	b->consumed += e & 0xff;
+	return e >> 8;
+}
+
+/* Decodes the rest of a stream, which has to end exactly at end. */
+static int huf_decode_tail(struct bitstream *b, uint8_t *dst, uint8_t *end)
+{
+	const unsigned int log = zstd.huf_log;
+
+	/* Four symbols of at most 11 bits fit in the container after a reload. */
+	while (end - dst >= 4 && b->ptr >= b->start + sizeof(b->container)) {
+		dst[0] = huf_decode_symbol(b, log);
+		dst[1] = huf_decode_symbol(b, log);
+		dst[2] = huf_decode_symbol(b, log);
+		dst[3] = huf_decode_symbol(b, log);
+		dst += 4;
+		bits_reload(b);
+	}
+	while (dst < end) {
+		*dst++ = huf_decode_symbol(b, log);
+		if (!bits_reload(b))
+			return -1;
+	}
+
+	return bits_finished(b) ? 0 : -1;
+}
+
+/* Decodes four streams of a quarter each, found through a jump table. */
+static int huf_decode_4streams(uint8_t *dst, size_t n, const uint8_t *src, size_t size)
+{
+	const unsigned int log = zstd.huf_log;
+	const size_t seg = (n + 3) / 4;
+	struct bitstream b[4];
+	uint8_t *op[4], *end[4];
+	size_t sizes[4];
+	int i, j;
+
+	if (size < 6 || n < 6)
+		return -1;
+	sizes[0] = read_le16(src);
+	sizes[1] = read_le16(src + 2);
+	sizes[2] = read_le16(src + 4);
+	if (sizes[0] + sizes[1] + sizes[2] > size - 6)
+		return -1;
+	sizes[3] = size - 6 - sizes[0] - sizes[1] - sizes[2];
+	src += 6;
+
+	for (i = 0; i < 4; i++) {
+		if (bits_init(&b[i], src, sizes[i]) < 0)
+			return -1;
+		src += sizes[i];
+		op[i] = dst + i * seg;
+		end[i] = i < 3 ? op[i] + seg : dst + n;
+	}
+
+	/* Interleaving the streams lets the CPU work on all of them at once. The
+	   last stream is the shortest one. */
+	while (end[3] - op[3] >= 4 && b[0].ptr >= b[0].start + sizeof(b[0].container)
+	       && b[1].ptr >= b[1].start + sizeof(b[1].container)
+	       && b[2].ptr >= b[2].start + sizeof(b[2].container)
+	       && b[3].ptr >= b[3].start + sizeof(b[3].container)) {
+		for (j = 0; j < 4; j++) {
+			for (i = 0; i < 4; i++)
+				op[i][j] = huf_decode_symbol(&b[i], log);
+		}
+		for (i = 0; i < 4; i++) {
+			op[i] += 4;
+			bits_reload(&b[i]);
+		}
+	}
+
+	for (i = 0; i < 4; i++) {
+		if (huf_decode_tail(&b[i], op[i], end[i]) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Decodes the literals section into lit, the last bytes of the output buffer.
+ * Returns the bytes taken or -1 on error.
+ */
+static int decode_literals(const uint8_t *src, size_t size, uint8_t *dst, uint8_t *dst_end,
+			   uint8_t **lit, size_t *lit_size)
+{
+	const unsigned int type = src[0] & 3, size_format = (src[0] >> 2) & 3;
+	size_t header, regen, comp;
+	uint32_t lhc;
+	int ret;
+
+	if (type == LITERALS_RAW || type == LITERALS_RLE) {
+		switch (size_format) {
+		case 1:
+			header = 2;
+			break;
+		case 3:
+			header = 3;
+			break;
+		default:
+			header = 1;
+			break;
+		}
+		if (header > size)
+			return -1;
+		if (header == 1)
+			regen = src[0] >> 3;
+		else if (header == 2)
+			regen = read_le16(src) >> 4;
+		else
+			regen = read_le24(src) >> 4;
+		comp = type == LITERALS_RAW ? regen : 1;
+	} else {
+		header = size_format < 2 ? 3 : size_format + 2;
+		if (header > size)
+			return -1;
+		lhc = header == 3 ? read_le24(src) : read_le32(src);
+		if (header == 3) {
+			regen = (lhc >> 4) & 0x3ff;
+			comp = (lhc >> 14) & 0x3ff;
+		} else if (header == 4) {
+			regen = (lhc >> 4) & 0x3fff;
+			comp = lhc >> 18;
+		} else {
+			regen = (lhc >> 4) & 0x3ffff;
+			comp = (lhc >> 22) | (uint32_t)src[4] << 10;
+		}
+	}
+	src += header;
+	size -= header;
+	if (comp > size || regen > (size_t)(dst_end - dst))
+		return -1;
+
+	*lit = dst_end - regen;
+	*lit_size = regen;
+
+	switch (type) {
+	case LITERALS_RAW:
+		memcpy(*lit, src, regen);
+		return header + comp;
+	case LITERALS_RLE:
+		memset(*lit, src[0], regen);
+		return header + comp;
+	case LITERALS_COMPRESSED:
+		ret = huf_read_table(src, comp);
+		if (ret < 0)
+			return -1;
+		break;
+	default:
+		if (!zstd.huf_valid)
+			return -1;
+		ret = 0;
+		break;
+	}
+
+	if (size_format == 0) {
+		struct bitstream b;
+
+		if (bits_init(&b, src + ret, comp - ret) < 0
+		    || huf_decode_tail(&b, *lit, *lit + regen) < 0)
+			return -1;
+	} else if (huf_decode_4streams(*lit, regen, src + ret, comp - ret) < 0) {
+		return -1;
+	}
+
+	return header + comp;
+}
+
+/* Sets up the decoding table for a sequence code. Returns the bytes taken or -1. */
+static int read_seq_table(struct fse_table *t, const struct seq_code *code, unsigned int mode,
+			  const uint8_t *src, size_t size)
+{
+	int16_t norm[MAX_ML_CODE + 1];
+	unsigned int max_symbol = code->max_code;
+	int ret = 0;
+
+	switch (mode) {
+	case MODE_PREDEFINED:
+		t->log = code->default_log;
+		if (fse_build(t->entries, code->default_norm, code->default_max, t->log,
+			      code->base, code->bits) < 0)
+			return -1;
+		break;
+	case MODE_RLE:
+		if (size < 1 || src[0] > code->max_code)
+			return -1;
+		t->log = 0;
+		t->entries[0] = (struct fse_entry){
+			.value = code->base[src[0]],
+			.extra_bits = code->bits[src[0]],
+		};
+		ret = 1;
+		break;
+	case MODE_FSE:
+		ret = fse_read_distribution(norm, &max_symbol, &t->log, code->max_log,
+					    src, size);
+		if (ret < 0 || fse_build(t->entries, norm, max_symbol, t->log,
+					 code->base, code->bits) < 0)
+			return -1;
+		break;
+	default:
+		if (!t->valid)
+			return -1;
+		break;
+	}
+	t->valid = true;
+
+	return ret;
+}
+
+/* Copies a match of len bytes from offset bytes back. Regions may overlap. */
+static __always_inline void copy_match(uint8_t *op, size_t offset, size_t len, bool wild)
+{
+	const uint8_t *match = op - offset;
+	uint8_t *end = op + len;
+
+	if (wild && offset >= 16) {
+		do {
+			copy8(op, match);
+			copy8(op + 8, match + 8);
+			op += 16;
+			match += 16;
+		} while (op < end);
+	} else if (wild && offset >= 8) {
+		do {
+			copy8(op, match);
+			op += 8;
+			match += 8;
+		} while (op < end);
+	} else {
+		while (op < end)
+			*op++ = *match++;
+	}
+}
+
+static __always_inline void copy_literals(uint8_t *op, const uint8_t *lit, size_t len, bool wild)
+{
+	uint8_t *end = op + len;
+
+	/* The literals are always above op, so copying upwards is safe. */
+	if (wild) {
+		do {
+			copy8(op, lit);
+			copy8(op + 8, lit + 8);
+			op += 16;
+			lit += 16;
+		} while (op < end);
+	} else {
+		while (op < end)
+			*op++ = *lit++;
+	}
+}
+
+/*
+ * Decodes a compressed block to op. The literals are put at the end of the output
+ * buffer, where they don't get overwritten before they are used up as long as
+ * the block fits. Returns the new op or NULL on error.
+ */
+static uint8_t *decode_block(const uint8_t *src, size_t size, uint8_t *frame_start,
+			     uint8_t *op, uint8_t *dst_end, uint32_t *rep)
+{
+	uint8_t *lit, *lit_end;
+	size_t lit_size;
+	unsigned int nb_seq, modes;
+	struct bitstream b;
+	uint32_t ll_state, ml_state, of_state;
+	int ret;
+
+	if (size < 1)
+		return NULL;
+	ret = decode_literals(src, size, op, dst_end, &lit, &lit_size);
+	if (ret < 0)
+		return NULL;
+	src += ret;
+	size -= ret;
+	lit_end = lit + lit_size;
+
+	if (size < 1)
+		return NULL;
+	nb_seq = src[0];
+	if (nb_seq < 128) {
+		src++;
+		size--;
+	} else if (nb_seq < 255) {
+		if (size < 2)
+			return NULL;
+		nb_seq = ((nb_seq - 128) << 8) + src[1];
+		src += 2;
+		size -= 2;
+	} else {
+		if (size < 3)
+			return NULL;
+		nb_seq = read_le16(src + 1) + 0x7f00;
+		src += 3;
+		size -= 3;
+	}
+
+	if (!nb_seq)
+		goto last_literals;
+
+	if (size < 1)
+		return NULL;
+	modes = src[0];
+	if (modes & 3)
+		return NULL;
+	src++;
+	size--;
+
+	ret = read_seq_table(&zstd.ll, &ll_code, modes >> 6, src, size);
+	if (ret < 0)
+		return NULL;
+	src += ret;
+	size -= ret;
+	ret = read_seq_table(&zstd.of, &of_code, (modes >> 4) & 3, src, size);
+	if (ret < 0)
+		return NULL;
+	src += ret;
+	size -= ret;
+	ret = read_seq_table(&zstd.ml, &ml_code, (modes >> 2) & 3, src, size);
+	if (ret < 0)
+		return NULL;
+	src += ret;
+	size -= ret;
+
+	if (bits_init(&b, src, size) < 0)
+		return NULL;
+	ll_state = bits_read(&b, zstd.ll.log);
+	of_state = bits_read(&b, zstd.of.log);
+	ml_state = bits_read(&b, zstd.ml.log);
+	bits_reload(&b);
+
+	while (nb_seq--) {
+		const struct fse_entry *ll = &zstd.ll.entries[ll_state];
+		const struct fse_entry *ml = &zstd.ml.entries[ml_state];
+		const struct fse_entry *of = &zstd.of.entries[of_state];
+		uint32_t offset, ll_len, ml_len;
+
+		offset = of->value + bits_read(&b, of->extra_bits);
+		bits_reload(&b);
+		ml_len = ml->value + bits_read(&b, ml->extra_bits);
+		ll_len = ll->value + bits_read(&b, ll->extra_bits);
+		bits_reload(&b);
+
+		if (offset > 3) {
+			offset -= 3;
+			rep[2] = rep[1];
+			rep[1] = rep[0];
+			rep[0] = offset;
+		} else {
+			const unsigned int idx = offset - 1 + (ll_len == 0);
+
+			if (idx == 0) {
+				offset = rep[0];
+			} else {
+				offset = idx == 3 ? rep[0] - 1 : rep[idx];
+				if (idx > 1)
+					rep[2] = rep[1];
+				rep[1] = rep[0];
+				rep[0] = offset;
+			}
+		}
+
+		if (nb_seq) {
+			ll_state = ll->next_base + bits_read(&b, ll->nb_bits);
+			ml_state = ml->next_base + bits_read(&b, ml->nb_bits);
+			of_state = of->next_base + bits_read(&b, of->nb_bits);
+			bits_reload(&b);
+		}
+
+		/*
+		 * The unused literals start at lit, the output of this sequence must
+		 * stay below where they end up after it took its literals.
+		 */
+		if (ll_len > (size_t)(lit_end - lit) || ml_len > (size_t)(lit - op)
+		    || offset == 0 || offset > (size_t)(op + ll_len - frame_start))
+			return NULL;
+
+		const bool wild = (size_t)(lit - op) >= ml_len + WILDCOPY_OVERLENGTH
+				  && (size_t)(lit_end - lit) >= ll_len + WILDCOPY_OVERLENGTH;
+		copy_literals(op, lit, ll_len, wild);
+		op += ll_len;
+		lit += ll_len;
+		copy_match(op, offset, ml_len, wild);
+		op += ml_len;
+	}
+
+	if (!bits_finished(&b))
+		return NULL;
+
+last_literals:
+	memmove(op, lit, lit_end - lit);
+	return op + (lit_end - lit);
+}
+
+/* Decodes the frame after the magic at *src. Returns the end of the output or NULL. */
+static uint8_t *decode_frame(const uint8_t **src, const uint8_t *src_end, uint8_t *dst,
+			     uint8_t *dst_end)
+{
+	const uint8_t *in = *src;
+	uint8_t *op = dst;
+	uint32_t rep[3] = { 1, 4, 8 };
+	uint64_t content_size = 0;
+	unsigned int fhd, did_size, fcs_size, i;
+	uint32_t header;
+	size_t size;
+
+	if (src_end - in < 1)
+		return NULL;
+	fhd = *in++;
+	if (fhd & RESERVED_BIT)
+		return NULL;
+
+	did_size = (1 << (fhd & DICT_ID_FLAG)) >> 1;
+	if (fhd >> FCS_FLAG_SHIFT)
+		fcs_size = 1 << (fhd >> FCS_FLAG_SHIFT);
+	else
+		fcs_size = fhd & SINGLE_SEGMENT ? 1 : 0;
+	if ((size_t)(src_end - in) < !(fhd & SINGLE_SEGMENT) + did_size + fcs_size)
+		return NULL;
+
+	/* The window size doesn't matter when decoding the whole frame at once. */
+	if (!(fhd & SINGLE_SEGMENT))
+		in++;
+	for (i = 0; i < did_size; i++) {
+		if (*in++)
+			return NULL;	/* dictionaries are not supported */
+	}
+	for (i = 0; i < fcs_size; i++)
+		content_size |= (uint64_t)*in++ << (8 * i);
+	if (fcs_size == 2)
+		content_size += 256;
+	if (fcs_size && content_size > (size_t)(dst_end - dst))
+		return NULL;
+
+	zstd.ll = (struct fse_table){ .entries = zstd.ll_entries };
+	zstd.ml = (struct fse_table){ .entries = zstd.ml_entries };
+	zstd.of = (struct fse_table){ .entries = zstd.of_entries };
+	zstd.huf_valid = false;
+
+	do {
+		if (src_end - in < 3)
+			return NULL;
+		header = read_le24(in);
+		in += 3;
+		size = header >> BLOCK_SIZE_SHIFT;
+
+		switch ((header >> BLOCK_TYPE_SHIFT) & 3) {
+		case BLOCK_RAW:
+			if (size > (size_t)(src_end - in) || size > (size_t)(dst_end - op))
+				return NULL;
+			memcpy(op, in, size);
+			in += size;
+			op += size;
+			break;
+		case BLOCK_RLE:
+			if (src_end - in < 1 || size > (size_t)(dst_end - op))
+				return NULL;
+			memset(op, *in, size);
+			in++;
+			op += size;
+			break;
+		case BLOCK_COMPRESSED:
+			if (size > (size_t)(src_end - in))
+				return NULL;
+			op = decode_block(in, size, dst, op, dst_end, rep);
+			if (!op)
+				return NULL;
+			in += size;
+			break;
+		default:
+			return NULL;
+		}
+	} while (!(header & BLOCK_LAST));
+
+	if (fhd & HAS_CHECKSUM) {
+		if (src_end - in < 4)
+			return NULL;
+		in += 4;
+	}
+	if (fcs_size && content_size != (size_t)(op - dst))
+		return NULL;
+
+	*src = in;
+	return op;
+}
+
+size_t uzstdn(const void *src, size_t srcn, void *dst, size_t dstn)
+{
+	const uint8_t *in = src, *const in_end = in + srcn;
+	uint8_t *op = dst, *const dst_end = op + dstn;
+	uint32_t magic;
+
+	while (in < in_end) {
+		if (in_end - in < 4)
+			return 0;
+		magic = read_le32(in);
+		in += 4;
+
+		if ((magic & ZSTD_SKIPPABLE_MASK) == ZSTD_SKIPPABLE_MAGIC) {
+			if (in_end - in < 4 || read_le32(in) > (size_t)(in_end - in - 4))
+				return 0;
+			in += 4 + read_le32(in);
+		} else if (magic == ZSTD_MAGIC) {
+			op = decode_frame(&in, in_end, op, dst_end);
+			if (!op)
+				return 0;
+		} else {
+			return 0;	/* unknown format */
+		}
+	}
+
+	return op - (uint8_t *)dst;
+}
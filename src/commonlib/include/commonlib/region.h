@@ -6,6 +6,7 @@
 #include <sys/types.h>
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <commonlib/bsd/helpers.h>
 #include <commonlib/mem_pool.h>
 
@@ -307,4 +308,49 @@ const struct region_device *incoherent_rdev_init(struct incoherent_rdev *irdev,
 				const struct region_device *read,
 				const struct region_device *write);
 
+/*
+ * A cached region device sits in front of a slow backing region device (e.g. SPI flash
+ * without memory mapping) and keeps a few aligned blocks of it in caller provided memory.
+ * Small reads are served from these blocks, and every miss reads a full block, which acts
+ * as read-ahead for callers walking the device in small steps. Blocks are replaced in
+ * least recently used order. Reads of at least a full block bypass the cache. Writes and
+ * erases are passed to the backing device and drop the cached blocks they overlap. mmap
+ * requests are passed to the backing device as well.
+ */
+#define CACHED_RDEV_MAX_BLOCKS 8
+
+struct cached_rdev_block {
+	size_t offset;
+	size_t size;	/* 0 if the block holds no data */
+	uint32_t last_use;
+};
+
+struct cached_rdev {
+	struct region_device rdev;
+	const struct region_device *backing;
+	uint8_t *buffer;
+	size_t block_size;
+	size_t block_count;
+	uint32_t use_counter;
+	struct cached_rdev_block blocks[CACHED_RDEV_MAX_BLOCKS];
+	/* Statistics about the read requests served by this device */
+	size_t hits;
+	size_t misses;
+};
+
+/*
+ * Initialize a cached_rdev in front of the backing rdev. The buffer has to provide
+ * block_size * block_count bytes and block_count must not exceed CACHED_RDEV_MAX_BLOCKS.
+ * Returns NULL on invalid parameters, otherwise a pointer to the containing region_device
+ * which covers the backing device from offset 0 to its size. The lifetime of the buffer
+ * and the backing rdev need to match the lifetime of the cached_rdev object.
+ */
+const struct region_device *cached_rdev_init(struct cached_rdev *crdev,
+					     const struct region_device *backing,
+					     void *buffer, size_t block_size,
+					     size_t block_count);
+
+/* Drop all cached data, e.g. after the backing device was modified behind our back. */
+void cached_rdev_invalidate(struct cached_rdev *crdev);
+
 #endif /* _REGION_H_ */
@@ -37,6 +37,8 @@ enum timestamp_id {
 	TS_ULZMA_END = 16,
 	TS_ULZ4F_START = 17,
 	TS_ULZ4F_END = 18,
+	TS_UZSTD_START = 19,
+	TS_UZSTD_END = 20,
 	TS_DEVICE_ENUMERATE = 30,
 	TS_DEVICE_CONFIGURE = 40,
 	TS_DEVICE_ENABLE = 50,
@@ -59,6 +61,12 @@ enum timestamp_id {
 	TS_READ_UCODE_END = 113,
 	TS_ELOG_INIT_START = 114,
 	TS_ELOG_INIT_END = 115,
+	TS_TPM_DEFERRED_EXTEND_START = 116,
+	TS_TPM_DEFERRED_EXTEND_END = 117,
+	TS_MEMFILL_START = 118,
+	TS_MEMFILL_END = 119,
+	TS_COPYPOSTCAR_START = 120,
+	TS_COPYPOSTCAR_END = 121,
 
 	/* 500+ reserved for vendorcode extensions (500-600: google/chromeos) */
 	TS_COPYVER_START = 501,
@@ -212,6 +220,9 @@ static const struct timestamp_id_to_name {
 	TS_NAME_DEF(TS_ULZMA_END, 0, "finished LZMA decompress (ignore for x86)"),
 	TS_NAME_DEF(TS_ULZ4F_START, TS_ULZ4F_END, "starting LZ4 decompress (ignore for x86)"),
 	TS_NAME_DEF(TS_ULZ4F_END, 0, "finished LZ4 decompress (ignore for x86)"),
+	TS_NAME_DEF(TS_UZSTD_START, TS_UZSTD_END,
+		    "starting Zstandard decompress (ignore for x86)"),
+	TS_NAME_DEF(TS_UZSTD_END, 0, "finished Zstandard decompress (ignore for x86)"),
 	TS_NAME_DEF(TS_DEVICE_ENUMERATE, TS_DEVICE_CONFIGURE, "device enumeration"),
 	TS_NAME_DEF(TS_DEVICE_CONFIGURE, TS_DEVICE_ENABLE,  "device configuration"),
 	TS_NAME_DEF(TS_DEVICE_ENABLE, TS_DEVICE_INITIALIZE, "device enable"),
@@ -234,6 +245,13 @@ static const struct timestamp_id_to_name {
 	TS_NAME_DEF(TS_READ_UCODE_END, 0, "finished reading uCode"),
 	TS_NAME_DEF(TS_ELOG_INIT_START, TS_ELOG_INIT_END, "started elog init"),
 	TS_NAME_DEF(TS_ELOG_INIT_END, 0, "finished elog init"),
+	TS_NAME_DEF(TS_TPM_DEFERRED_EXTEND_START, TS_TPM_DEFERRED_EXTEND_END,
+		    "starting deferred TPM PCR extends"),
+	TS_NAME_DEF(TS_TPM_DEFERRED_EXTEND_END, 0, "finished deferred TPM PCR extends"),
+	TS_NAME_DEF(TS_MEMFILL_START, TS_MEMFILL_END, "starting memory fill/verify"),
+	TS_NAME_DEF(TS_MEMFILL_END, 0, "finished memory fill/verify"),
+	TS_NAME_DEF(TS_COPYPOSTCAR_START, TS_COPYPOSTCAR_END, "starting to load postcar"),
+	TS_NAME_DEF(TS_COPYPOSTCAR_END, 0, "finished loading postcar"),
 
 	/* Google related timestamps */
 	TS_NAME_DEF(TS_COPYVER_START, TS_COPYVER_START, "starting to load verstage"),
@@ -536,3 +536,175 @@ const struct region_device *incoherent_rdev_init(struct incoherent_rdev *irdev,
 
 	return &irdev->rdev;
 }
+
+static struct cached_rdev *to_cached_rdev(const struct region_device *rd)
+{
+	return container_of((void *)rd, struct cached_rdev, rdev);
+}
+
+static uint8_t *cached_block_data(struct cached_rdev *crdev,
+				  const struct cached_rdev_block *block)
+{
+	return crdev->buffer + (block - crdev->blocks) * crdev->block_size;
+}
+
+/* Return the cached block holding the data at offset, loading it on a miss. */
+static struct cached_rdev_block *cached_block_get(struct cached_rdev *crdev,
+						  size_t offset)
+{
+	struct cached_rdev_block *block;
+	struct cached_rdev_block *victim = &crdev->blocks[0];
+	const size_t block_offset = ALIGN_DOWN(offset, crdev->block_size);
+	size_t i, len;
+
+	for (i = 0; i < crdev->block_count; i++) {
+		block = &crdev->blocks[i];
+
+		if (block->size && block->offset == block_offset) {
+			crdev->hits++;
+			block->last_use = ++crdev->use_counter;
+			return block;
+		}
+
+		/* Prefer empty blocks, then the least recently used one. */
+		if (!victim->size)
+			continue;
+		if (!block->size || block->last_use < victim->last_use)
+			victim = block;
+	}
+
+	crdev->misses++;
+	victim->size = 0;
+	victim->offset = block_offset;
+	len = MIN(crdev->block_size, region_device_sz(&crdev->rdev) - block_offset);
+	if (rdev_readat(crdev->backing, cached_block_data(crdev, victim), block_offset,
+			len) != len)
+		return NULL;
+
+	victim->size = len;
+	victim->last_use = ++crdev->use_counter;
+	return victim;
+}
+
+static void cached_rdev_invalidate_range(struct cached_rdev *crdev,
+					 size_t offset, size_t size)
+{
+	const struct region req = { .offset = offset, .size = size };
+	size_t i;
+
+	for (i = 0; i < crdev->block_count; i++) {
+		struct cached_rdev_block *block = &crdev->blocks[i];
+		const struct region cached = {
+			.offset = block->offset,
+			.size = block->size,
+		};
+
+		if (block->size && region_overlap(&req, &cached))
+			block->size = 0;
+	}
+}
+
+void cached_rdev_invalidate(struct cached_rdev *crdev)
+{
+	size_t i;
+
+	for (i = 0; i < crdev->block_count; i++)
+		crdev->blocks[i].size = 0;
+}
+
+static void *cached_rdev_mmap(const struct region_device *rd, size_t offset,
+			      size_t size)
+{
+	return rdev_mmap(to_cached_rdev(rd)->backing, offset, size);
+}
+
+static int cached_rdev_munmap(const struct region_device *rd, void *mapping)
+{
+	return rdev_munmap(to_cached_rdev(rd)->backing, mapping);
+}
+
+static ssize_t cached_rdev_readat(const struct region_device *rd, void *b,
+				  size_t offset, size_t size)
+{
+	struct cached_rdev *crdev = to_cached_rdev(rd);
+	uint8_t *dest = b;
+	size_t left = size;
+
+	while (left) {
+		const struct cached_rdev_block *block;
+		size_t block_offset, len;
+
+		/*
+		 * Aligned full blocks are read straight into the caller's buffer.
+		 * Caching them would only evict the small blocks we are here for.
+		 */
+		if (IS_ALIGNED(offset, crdev->block_size) && left >= crdev->block_size) {
+			len = ALIGN_DOWN(left, crdev->block_size);
+			if (rdev_readat(crdev->backing, dest, offset, len) != len)
+				return -1;
+		} else {
+			block = cached_block_get(crdev, offset);
+			if (!block)
+				return -1;
+
+			block_offset = offset - block->offset;
+			len = MIN(left, block->size - block_offset);
+			memcpy(dest, cached_block_data(crdev, block) + block_offset, len);
+		}
+
+		dest += len;
+		offset += len;
+		left -= len;
+	}
+
+	return size;
+}
+
+static ssize_t cached_rdev_writeat(const struct region_device *rd, const void *b,
+				   size_t offset, size_t size)
+{
+	struct cached_rdev *crdev = to_cached_rdev(rd);
+
+	cached_rdev_invalidate_range(crdev, offset, size);
+
+	return rdev_writeat(crdev->backing, b, offset, size);
+}
+
+static ssize_t cached_rdev_eraseat(const struct region_device *rd, size_t offset,
+				   size_t size)
+{
+	struct cached_rdev *crdev = to_cached_rdev(rd);
+
+	cached_rdev_invalidate_range(crdev, offset, size);
+
+	return rdev_eraseat(crdev->backing, offset, size);
+}
+
+static const struct region_device_ops cached_rdev_ops = {
+	.mmap = cached_rdev_mmap,
+	.munmap = cached_rdev_munmap,
+	.readat = cached_rdev_readat,
+	.writeat = cached_rdev_writeat,
+	.eraseat = cached_rdev_eraseat,
+};
+
+const struct region_device *cached_rdev_init(struct cached_rdev *crdev,
+					     const struct region_device *backing,
+					     void *buffer, size_t block_size,
+					     size_t block_count)
+{
+	if (!buffer || !block_size || !block_count ||
+	    block_count > ARRAY_SIZE(crdev->blocks))
+		return NULL;
+
+	memset(crdev, 0, sizeof(*crdev));
+
+	/* Same as incoherent_rdev: offsets start at 0 so no translation is needed. */
+	region_device_init(&crdev->rdev, &cached_rdev_ops, 0, region_device_sz(backing));
+	crdev->backing = backing;
+	crdev->buffer = buffer;
+	crdev->block_size = block_size;
+	crdev->block_count = block_count;
+
+	return &crdev->rdev;
+}
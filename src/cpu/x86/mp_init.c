@@ -203,6 +203,7 @@ static asmlinkage void ap_init(unsigned int index)
 	dev->path.apic.apic_id = lapicid();
 	dev->path.apic.initial_lapicid = initial_lapicid();
 	dev->enabled = 1;
+	dev_index_invalidate();
 
 	set_cpu_topology_from_leaf_b(dev);
 
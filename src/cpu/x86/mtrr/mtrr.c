@@ -10,6 +10,7 @@
 
 #include <assert.h>
 #include <bootstate.h>
+#include <cbmem.h>
 #include <commonlib/helpers.h>
 #include <console/console.h>
 #include <cpu/amd/mtrr.h>
@@ -23,6 +24,7 @@
 #include <memrange.h>
 #include <string.h>
 #include <types.h>
+#include <xxhash.h>
 
 #if CONFIG(X86_AMD_FIXED_MTRRS)
 #define MTRR_FIXED_WRBACK_BITS (MTRR_READ_MEM | MTRR_WRITE_MEM)
@@ -784,19 +786,89 @@ static int commit_var_mtrrs(const struct var_mtrr_solution *sol)
 	return 0;
 }
 
+/*
+ * The variable MTRR solution only depends on the address space and on the parameters it
+ * was computed with. Keep it in CBMEM along with a hash of these, so the solution can be
+ * reused on S3 resume if the address space didn't change.
+ */
+struct var_mtrr_cache {
+	uint64_t hash;
+	struct var_mtrr_solution sol;
+};
+
+static uint64_t hash_var_mtrr_input(const struct memranges *addr_space, int above4gb,
+				    int address_bits)
+{
+	const struct range_entry *r;
+	const uint64_t params[] = {
+		above4gb, address_bits, total_mtrrs, get_os_reserved_mtrrs(),
+	};
+	uint64_t hash;
+
+	hash = xxh64(params, sizeof(params), 0);
+	memranges_each_entry(r, addr_space) {
+		const uint64_t entry[] = {
+			range_entry_base(r), range_entry_size(r), range_entry_tag(r),
+		};
+		hash = xxh64(entry, sizeof(entry), hash);
+	}
+
+	return hash;
+}
+
+static bool load_var_mtrr_solution(uint64_t hash, struct var_mtrr_solution *sol)
+{
+	const struct var_mtrr_cache *cache;
+
+	if (!CONFIG(MTRR_SOLUTION_CACHE))
+		return false;
+
+	cache = cbmem_find(CBMEM_ID_MTRR_SOLUTION);
+	if (!cache || cache->hash != hash)
+		return false;
+
+	if (cache->sol.num_used < 0 || cache->sol.num_used > total_mtrrs)
+		return false;
+
+	memcpy(sol, &cache->sol, sizeof(*sol));
+	printk(BIOS_DEBUG, "MTRR: Using cached solution with %d MTRRs.\n", sol->num_used);
+	return true;
+}
+
+static void save_var_mtrr_solution(uint64_t hash, const struct var_mtrr_solution *sol)
+{
+	struct var_mtrr_cache *cache;
+
+	if (!CONFIG(MTRR_SOLUTION_CACHE))
+		return;
+
+	cache = cbmem_add(CBMEM_ID_MTRR_SOLUTION, sizeof(*cache));
+	if (!cache)
+		return;
+
+	cache->hash = hash;
+	memcpy(&cache->sol, sol, sizeof(*sol));
+}
+
 void x86_setup_var_mtrrs(unsigned int address_bits, unsigned int above4gb)
 {
 	static struct var_mtrr_solution *sol = NULL;
 	struct memranges *addr_space;
+	uint64_t hash;
 
 	addr_space = get_physical_address_space();
 
 	if (sol == NULL) {
 		sol = &mtrr_global_solution;
-		sol->mtrr_default_type =
-			calc_var_mtrrs(addr_space, !!above4gb, address_bits);
-		prepare_var_mtrrs(addr_space, sol->mtrr_default_type,
-				  !!above4gb, address_bits, sol);
+		/* Hash before calc_var_mtrrs() possibly drops the WRCOMB ranges. */
+		hash = hash_var_mtrr_input(addr_space, !!above4gb, address_bits);
+		if (!load_var_mtrr_solution(hash, sol)) {
+			sol->mtrr_default_type =
+				calc_var_mtrrs(addr_space, !!above4gb, address_bits);
+			prepare_var_mtrrs(addr_space, sol->mtrr_default_type,
+					  !!above4gb, address_bits, sol);
+			save_var_mtrr_solution(hash, sol);
+		}
 	}
 
 	commit_var_mtrrs(sol);
@@ -863,6 +935,53 @@ void x86_mtrr_check(void)
 
 static bool put_back_original_solution;
 
+/* Solution in effect while temporary ranges are in use. */
+static struct var_mtrr_solution mtrr_temp_solution;
+
+/*
+ * Add a temporary range to the solution in effect using one more MTRR. This gives the
+ * range the requested type if a single MTRR describes it and no MTRR in use overlaps
+ * it, i.e. the range currently has the default type. Otherwise the solution needs to be
+ * computed again.
+ */
+static bool add_temp_var_mtrr(struct var_mtrr_solution *sol, uintptr_t begin,
+			      size_t size, int type, int address_bits)
+{
+	const uint64_t addr_mask = (1ULL << address_bits) - 1;
+	uint64_t base, mask;
+	int i;
+
+	/* Fixed MTRRs take precedence below 1MiB. */
+	if (begin < 1 * MiB || size < 4 * KiB || !IS_POWER_OF_2(size) ||
+	    !IS_ALIGNED(begin, size))
+		return false;
+
+	if (sol->num_used >= total_mtrrs)
+		return false;
+
+	for (i = 0; i < sol->num_used; i++) {
+		base = ((uint64_t)sol->regs[i].base.hi << 32 | sol->regs[i].base.lo) &
+		       ~(uint64_t)(4 * KiB - 1);
+		mask = ((uint64_t)sol->regs[i].mask.hi << 32 | sol->regs[i].mask.lo) &
+		       ~(uint64_t)(4 * KiB - 1);
+		/* The MTRRs in use all describe a naturally aligned power of 2 range. */
+		if (base < (uint64_t)begin + size && begin <= base + (~mask & addr_mask))
+			return false;
+	}
+
+	printk(BIOS_DEBUG, "MTRR: %d base 0x%016llx size 0x%08llx type %d (temporary)\n",
+	       sol->num_used, (unsigned long long)begin, (unsigned long long)size, type);
+
+	mask = -(uint64_t)size & addr_mask;
+	sol->regs[sol->num_used].base.lo = (uint32_t)begin | type;
+	sol->regs[sol->num_used].base.hi = (uint64_t)begin >> 32;
+	sol->regs[sol->num_used].mask.lo = (uint32_t)mask | MTRR_PHYS_MASK_VALID;
+	sol->regs[sol->num_used].mask.hi = mask >> 32;
+	sol->num_used++;
+
+	return true;
+}
+
 void mtrr_use_temp_range(uintptr_t begin, size_t size, int type)
 {
 	const struct range_entry *r;
@@ -894,6 +1013,19 @@ void mtrr_use_temp_range(uintptr_t begin, size_t size, int type)
 		return;
 	}
 
+	address_bits = cpu_phys_address_size();
+
+	/* Extend the solution in effect if that's possible, as long as there are MTRRs
+	 * left. The global one is empty if x86_setup_var_mtrrs() didn't run. */
+	memcpy(&sol, put_back_original_solution ? &mtrr_temp_solution : &mtrr_global_solution,
+	       sizeof(sol));
+	if (sol.num_used > 0 && add_temp_var_mtrr(&sol, begin, size, type, address_bits) &&
+	    commit_var_mtrrs(&sol) == 0) {
+		memcpy(&mtrr_temp_solution, &sol, sizeof(sol));
+		put_back_original_solution = true;
+		return;
+	}
+
 	/* Make a copy of the original address space and tweak it with the
 	 * provided range. */
 	memranges_init_empty(&addr_space, NULL, 0);
@@ -920,19 +1052,20 @@ void mtrr_use_temp_range(uintptr_t begin, size_t size, int type)
 	print_physical_address_space(&addr_space, "TEMPORARY");
 
 	/* Calculate a new solution with the updated address space. */
-	address_bits = cpu_phys_address_size();
 	memset(&sol, 0, sizeof(sol));
 	sol.mtrr_default_type =
 		calc_var_mtrrs(&addr_space, above4gb, address_bits);
 	prepare_var_mtrrs(&addr_space, sol.mtrr_default_type,
 				above4gb, address_bits, &sol);
 
-	if (commit_var_mtrrs(&sol) < 0)
+	if (commit_var_mtrrs(&sol) < 0) {
 		printk(BIOS_WARNING, "Unable to insert temporary MTRR range: 0x%016llx - 0x%016llx size 0x%08llx type %d\n",
 			(long long)begin, (long long)begin + size - 1,
 			(long long)size, type);
-	else
+	} else {
+		memcpy(&mtrr_temp_solution, &sol, sizeof(sol));
 		put_back_original_solution = true;
+	}
 
 	memranges_teardown(&addr_space);
 }
@@ -113,6 +113,9 @@ static struct device *__alloc_dev(struct bus *parent, struct device_path *path)
 	last_dev->next = dev;
 	last_dev = dev;
 
+	if (CONFIG(DEVICE_LOOKUP_INDEX))
+		dev_index_add(dev);
+
 	return dev;
 }
 
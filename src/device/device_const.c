@@ -12,6 +12,89 @@
 /** Linked list of ALL devices */
 DEVTREE_CONST struct device *DEVTREE_CONST all_devices = &dev_root;
 
+/* The key and hash function need to match the ones used by sconfig. */
+static uint32_t devtree_lookup_hash(uint32_t key, uint32_t seed)
+{
+	key ^= seed * 0x9e3779b9;
+	key ^= key >> 16;
+	key *= 0x85ebca6b;
+	key ^= key >> 13;
+	key *= 0xc2b2ae35;
+	key ^= key >> 16;
+	return key;
+}
+
+static uint32_t devtree_lookup_key(const struct device_path *path)
+{
+	uint32_t a = 0, b = 0;
+
+	switch (path->type) {
+	case DEVICE_PATH_PCI:
+		a = path->pci.devfn;
+		break;
+	case DEVICE_PATH_PNP:
+		a = path->pnp.port;
+		b = path->pnp.device;
+		break;
+	case DEVICE_PATH_I2C:
+		a = path->i2c.device;
+		b = path->i2c.mode_10bit;
+		break;
+	case DEVICE_PATH_APIC:
+		a = path->apic.apic_id;
+		break;
+	case DEVICE_PATH_DOMAIN:
+		a = path->domain.domain;
+		break;
+	case DEVICE_PATH_CPU_CLUSTER:
+		a = path->cpu_cluster.cluster;
+		break;
+	case DEVICE_PATH_CPU:
+		a = path->cpu.id;
+		break;
+	case DEVICE_PATH_GENERIC:
+		a = path->generic.id;
+		b = path->generic.subid;
+		break;
+	case DEVICE_PATH_SPI:
+		a = path->spi.cs;
+		break;
+	case DEVICE_PATH_USB:
+		a = path->usb.port_type;
+		b = path->usb.port_id;
+		break;
+	case DEVICE_PATH_MMIO:
+		a = path->mmio.addr;
+		break;
+	case DEVICE_PATH_GPIO:
+		a = path->gpio.id;
+		break;
+	case DEVICE_PATH_MDIO:
+		a = path->mdio.addr;
+		break;
+	default:
+		break;
+	}
+
+	return a ^ (b << 16 | b >> 16);
+}
+
+/*
+ * Return the NULL terminated list of static devices that may have the given path, in
+ * all_devices order. Devices with other paths can share a key, so callers still compare
+ * the paths.
+ */
+static DEVTREE_CONST struct device *const *devtree_lookup_find(const struct device_path *path)
+{
+	const struct devtree_lookup *table = &devtree_lookup;
+	const struct devtree_lookup_slot *slot;
+	uint32_t key = devtree_lookup_key(path);
+	uint16_t disp = table->disp[devtree_lookup_hash(key, 0) % table->buckets];
+
+	slot = &table->slots[devtree_lookup_hash(key, disp + 1) % table->size];
+	return &table->devs[slot->key == key ? slot->first : 0];
+}
+
 /**
  * Given a PCI bus and a devfn number, find the device structure.
  *
@@ -82,7 +165,7 @@ DEVTREE_CONST struct device *dev_find_next_pci_device(
 	return dev_find_path(previous_dev, DEVICE_PATH_PCI);
 }
 
-static int path_eq(const struct device_path *path1,
+int dev_path_eq(const struct device_path *path1,
 		const struct device_path *path2)
 {
 	int equal = 0;
@@ -171,6 +254,7 @@ DEVTREE_CONST struct device *find_dev_path(
 	const struct bus *parent, const struct device_path *path)
 {
 	DEVTREE_CONST struct device *child;
+	bool indexed;
 
 	if (!parent) {
 		BUG();
@@ -178,8 +262,24 @@ DEVTREE_CONST struct device *find_dev_path(
 		return NULL;
 	}
 
+	if (DEVTREE_EARLY && CONFIG(DEVTREE_LOOKUP_TABLE)) {
+		DEVTREE_CONST struct device *const *devs;
+
+		for (devs = devtree_lookup_find(path); *devs; devs++) {
+			if ((*devs)->bus == parent && dev_path_eq(path, &(*devs)->path))
+				return *devs;
+		}
+		return NULL;
+	}
+
+	if (ENV_RAMSTAGE && CONFIG(DEVICE_LOOKUP_INDEX)) {
+		child = dev_index_find_path(parent, path, &indexed);
+		if (indexed)
+			return child;
+	}
+
 	for (child = parent->children; child; child = child->sibling) {
-		if (path_eq(path, &child->path))
+		if (dev_path_eq(path, &child->path))
 			break;
 	}
 	return child;
@@ -336,6 +436,21 @@ DEVTREE_CONST struct device *dev_find_slot_pnp(u16 port, u16 device)
 {
 	DEVTREE_CONST struct device *dev;
 
+	if (DEVTREE_EARLY && CONFIG(DEVTREE_LOOKUP_TABLE)) {
+		const struct device_path path = {
+			.type = DEVICE_PATH_PNP,
+			.pnp.port = port,
+			.pnp.device = device,
+		};
+		DEVTREE_CONST struct device *const *devs;
+
+		for (devs = devtree_lookup_find(&path); *devs; devs++) {
+			if (dev_path_eq(&path, &(*devs)->path))
+				return *devs;
+		}
+		return NULL;
+	}
+
 	for (dev = all_devices; dev; dev = dev->next) {
 		if ((dev->path.type == DEVICE_PATH_PNP) &&
 		    (dev->path.pnp.port == port) &&
@@ -0,0 +1,393 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#include <console/console.h>
+#include <device/device.h>
+#include <device/path.h>
+#include <smp/spinlock.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Hash index over all ramstage devices. Every hash chain keeps its devices in the order
+ * a walk of the device lists would visit them, so the first match in a chain is what
+ * the walk would have returned. alloc_dev() appends new devices. Code changing the IDs
+ * or the path of a device, or unlinking it from its bus, calls dev_index_invalidate() so
+ * the index is rebuilt on the next lookup.
+ */
+
+#define DEV_INDEX_BITS		8
+#define DEV_INDEX_BUCKETS	(1 << DEV_INDEX_BITS)
+
+enum dev_index_table {
+	DEV_INDEX_LAPIC,
+	DEV_INDEX_ID,
+	DEV_INDEX_CLASS,
+	DEV_INDEX_PATH,
+	DEV_INDEX_TABLES
+};
+
+struct dev_index_entry {
+	struct device *dev;
+	struct dev_index_entry *next;
+};
+
+struct dev_index_chain {
+	struct dev_index_entry *head;
+	struct dev_index_entry *tail;
+};
+
+/*
+ * The ramstage heap can't free or resize allocations, so the entries live in a list of
+ * chunks that only ever grows. A rebuild reuses the chunks from the start.
+ */
+struct dev_index_chunk {
+	struct dev_index_chunk *next;
+	size_t size;
+	struct dev_index_entry entries[];
+};
+
+static struct dev_index_chain dev_index[DEV_INDEX_TABLES][DEV_INDEX_BUCKETS];
+static struct dev_index_chunk *chunks;
+static struct dev_index_chunk *chunk_current;
+static size_t chunk_used;
+static size_t entries_size;
+static size_t entries_used;
+static bool dev_index_valid;
+static bool dev_index_growing;
+static bool dev_index_disabled;
+
+DECLARE_SPIN_LOCK(dev_index_lock)
+
+static unsigned int dev_index_hash(uint32_t key)
+{
+	/* Fibonacci hashing: the top bits of the product are well mixed. */
+	return (uint32_t)(key * 0x9e3779b1) >> (32 - DEV_INDEX_BITS);
+}
+
+static uint32_t dev_id_key(unsigned int vendor, unsigned int device)
+{
+	return vendor << 16 ^ device;
+}
+
+static uint32_t dev_class_key(unsigned int class)
+{
+	return class & 0xffffff00;
+}
+
+/* Paths that compare equal with dev_path_eq() need to produce the same key. */
+static uint32_t dev_path_key(const struct bus *parent, const struct device_path *path)
+{
+	uint32_t key = (uint32_t)(uintptr_t)parent ^ path->type << 24;
+
+	switch (path->type) {
+	case DEVICE_PATH_PCI:
+		key ^= path->pci.devfn;
+		break;
+	case DEVICE_PATH_PNP:
+		key ^= path->pnp.port << 8 ^ path->pnp.device;
+		break;
+	case DEVICE_PATH_I2C:
+		key ^= path->i2c.device;
+		break;
+	case DEVICE_PATH_APIC:
+		key ^= path->apic.apic_id;
+		break;
+	case DEVICE_PATH_DOMAIN:
+		key ^= path->domain.domain;
+		break;
+	case DEVICE_PATH_CPU_CLUSTER:
+		key ^= path->cpu_cluster.cluster;
+		break;
+	case DEVICE_PATH_CPU:
+		key ^= path->cpu.id;
+		break;
+	case DEVICE_PATH_CPU_BUS:
+		key ^= path->cpu_bus.id;
+		break;
+	case DEVICE_PATH_GENERIC:
+		key ^= path->generic.id << 8 ^ path->generic.subid;
+		break;
+	case DEVICE_PATH_SPI:
+		key ^= path->spi.cs;
+		break;
+	case DEVICE_PATH_USB:
+		key ^= path->usb.port_type << 8 ^ path->usb.port_id;
+		break;
+	case DEVICE_PATH_MMIO:
+		key ^= path->mmio.addr;
+		break;
+	case DEVICE_PATH_GPIO:
+		key ^= path->gpio.id;
+		break;
+	case DEVICE_PATH_MDIO:
+		key ^= path->mdio.addr;
+		break;
+	default:
+		break;
+	}
+
+	return key;
+}
+
+static struct dev_index_chain *dev_index_chain(enum dev_index_table table, uint32_t key)
+{
+	return &dev_index[table][dev_index_hash(key)];
+}
+
+static void dev_index_insert(enum dev_index_table table, uint32_t key, struct device *dev)
+{
+	struct dev_index_chain *chain = dev_index_chain(table, key);
+	struct dev_index_entry *entry;
+
+	/* The callers made sure the chunks have room for the entry. */
+	if (chunk_used == chunk_current->size) {
+		chunk_current = chunk_current->next;
+		chunk_used = 0;
+	}
+	entry = &chunk_current->entries[chunk_used++];
+	entries_used++;
+
+	entry->dev = dev;
+	entry->next = NULL;
+
+	if (chain->tail)
+		chain->tail->next = entry;
+	else
+		chain->head = entry;
+	chain->tail = entry;
+}
+
+/* Enter the device into all tables but the path one, which is filled per bus. */
+static void dev_index_insert_ids(struct device *dev)
+{
+	if (dev->path.type == DEVICE_PATH_APIC)
+		dev_index_insert(DEV_INDEX_LAPIC, dev->path.apic.apic_id, dev);
+	dev_index_insert(DEV_INDEX_ID, dev_id_key(dev->vendor, dev->device), dev);
+	dev_index_insert(DEV_INDEX_CLASS, dev_class_key(dev->class), dev);
+}
+
+/* Returns the number of entries missing to build the index, 0 if it was built. */
+static size_t dev_index_build(void)
+{
+	struct device *dev, *child;
+	struct bus *link;
+	size_t needed = 0;
+
+	for (dev = all_devices; dev; dev = dev->next)
+		needed += DEV_INDEX_TABLES;
+
+	if (needed > entries_size)
+		return needed - entries_size;
+
+	memset(dev_index, 0, sizeof(dev_index));
+	chunk_current = chunks;
+	chunk_used = 0;
+	entries_used = 0;
+
+	for (dev = all_devices; dev; dev = dev->next)
+		dev_index_insert_ids(dev);
+
+	/* Index the bus children lists, which need not contain every device. */
+	for (dev = all_devices; dev; dev = dev->next) {
+		for (link = dev->link_list; link; link = link->next) {
+			for (child = link->children; child; child = child->sibling)
+				dev_index_insert(DEV_INDEX_PATH,
+						 dev_path_key(link, &child->path), child);
+		}
+	}
+
+	dev_index_valid = true;
+	return 0;
+}
+
+/* Called without dev_index_lock held, as it allocates and prints. */
+static struct dev_index_chunk *dev_index_chunk_alloc(size_t size)
+{
+	struct dev_index_chunk *chunk;
+
+	chunk = malloc(sizeof(*chunk) + size * sizeof(chunk->entries[0]));
+	if (!chunk) {
+		printk(BIOS_DEBUG, "No memory for the device lookup index, "
+		       "falling back to list walks\n");
+		return NULL;
+	}
+
+	chunk->next = NULL;
+	chunk->size = size;
+	return chunk;
+}
+
+static void dev_index_chunk_append(struct dev_index_chunk *chunk)
+{
+	struct dev_index_chunk **tail = &chunks;
+
+	while (*tail)
+		tail = &(*tail)->next;
+	*tail = chunk;
+	entries_size += chunk->size;
+}
+
+void dev_index_invalidate(void)
+{
+	spin_lock(&dev_index_lock);
+	dev_index_valid = false;
+	spin_unlock(&dev_index_lock);
+}
+
+void dev_index_add(struct device *dev)
+{
+	spin_lock(&dev_index_lock);
+
+	if (dev_index_valid) {
+		if (entries_used + DEV_INDEX_TABLES > entries_size) {
+			dev_index_valid = false;
+		} else {
+			dev_index_insert_ids(dev);
+			dev_index_insert(DEV_INDEX_PATH, dev_path_key(dev->bus, &dev->path),
+					 dev);
+		}
+	}
+
+	spin_unlock(&dev_index_lock);
+}
+
+/* Returns with dev_index_lock held if the index can be used, else unlocked. */
+static bool dev_index_lock_valid(void)
+{
+	struct dev_index_chunk *chunk;
+	size_t missing, needed;
+
+	spin_lock(&dev_index_lock);
+
+	while (!dev_index_valid && !dev_index_disabled) {
+		missing = dev_index_build();
+		/* Another CPU is growing the index, walk the lists meanwhile. */
+		if (!missing || dev_index_growing)
+			break;
+
+		/*
+		 * Devices keep being added during enumeration, so grow to twice what the
+		 * index needs now. Like that lookups before enumeration don't make every
+		 * device added later trigger an allocation.
+		 */
+		needed = entries_size + missing;
+		dev_index_growing = true;
+		spin_unlock(&dev_index_lock);
+		chunk = dev_index_chunk_alloc(2 * needed - entries_size);
+		spin_lock(&dev_index_lock);
+		dev_index_growing = false;
+
+		if (chunk)
+			dev_index_chunk_append(chunk);
+		else
+			dev_index_disabled = true;
+	}
+
+	if (!dev_index_valid)
+		spin_unlock(&dev_index_lock);
+
+	return dev_index_valid;
+}
+
+struct device *dev_index_find_lapic(unsigned int apic_id, bool *indexed)
+{
+	struct dev_index_entry *entry;
+	struct device *result = NULL;
+
+	*indexed = dev_index_lock_valid();
+	if (!*indexed)
+		return NULL;
+
+	for (entry = dev_index_chain(DEV_INDEX_LAPIC, apic_id)->head; entry;
+	     entry = entry->next) {
+		if (entry->dev->path.apic.apic_id == apic_id) {
+			result = entry->dev;
+			break;
+		}
+	}
+
+	spin_unlock(&dev_index_lock);
+	return result;
+}
+
+/*
+ * Continue after 'from' in the chain. If 'from' isn't part of the chain, it doesn't match
+ * the key and the index can't tell where to continue, so *indexed is cleared to make the
+ * caller walk the device list instead.
+ */
+static struct device *dev_index_find_next(enum dev_index_table table, uint32_t key,
+					  struct device *from, bool *indexed,
+					  bool (*match)(const struct device *dev,
+							unsigned int a, unsigned int b),
+					  unsigned int a, unsigned int b)
+{
+	struct dev_index_entry *entry;
+	struct device *result = NULL;
+
+	*indexed = dev_index_lock_valid();
+	if (!*indexed)
+		return NULL;
+
+	for (entry = dev_index_chain(table, key)->head; entry; entry = entry->next) {
+		if (from) {
+			if (entry->dev == from)
+				from = NULL;
+			continue;
+		}
+		if (match(entry->dev, a, b)) {
+			result = entry->dev;
+			break;
+		}
+	}
+
+	if (from)
+		*indexed = false;
+
+	spin_unlock(&dev_index_lock);
+	return result;
+}
+
+static bool dev_id_match(const struct device *dev, unsigned int vendor, unsigned int device)
+{
+	return dev->vendor == vendor && dev->device == device;
+}
+
+static bool dev_class_match(const struct device *dev, unsigned int class, unsigned int unused)
+{
+	return (dev->class & 0xffffff00) == class;
+}
+
+struct device *dev_index_find_device(u16 vendor, u16 device, struct device *from,
+				     bool *indexed)
+{
+	return dev_index_find_next(DEV_INDEX_ID, dev_id_key(vendor, device), from, indexed,
+				   dev_id_match, vendor, device);
+}
+
+struct device *dev_index_find_class(unsigned int class, struct device *from, bool *indexed)
+{
+	return dev_index_find_next(DEV_INDEX_CLASS, dev_class_key(class), from, indexed,
+				   dev_class_match, class, 0);
+}
+
+struct device *dev_index_find_path(const struct bus *parent, const struct device_path *path,
+				   bool *indexed)
+{
+	struct dev_index_entry *entry;
+	struct device *result = NULL;
+
+	*indexed = dev_index_lock_valid();
+	if (!*indexed)
+		return NULL;
+
+	for (entry = dev_index_chain(DEV_INDEX_PATH, dev_path_key(parent, path))->head; entry;
+	     entry = entry->next) {
+		if (entry->dev->bus == parent && dev_path_eq(path, &entry->dev->path)) {
+			result = entry->dev;
+			break;
+		}
+	}
+
+	spin_unlock(&dev_index_lock);
+	return result;
+}
@@ -20,6 +20,13 @@ struct device *dev_find_lapic(unsigned int apic_id)
 {
 	struct device *dev;
 	struct device *result = NULL;
+	bool indexed;
+
+	if (CONFIG(DEVICE_LOOKUP_INDEX)) {
+		result = dev_index_find_lapic(apic_id, &indexed);
+		if (indexed)
+			return result;
+	}
 
 	for (dev = all_devices; dev; dev = dev->next) {
 		if (dev->path.type == DEVICE_PATH_APIC &&
@@ -43,6 +50,15 @@ struct device *dev_find_lapic(unsigned int apic_id)
  */
 struct device *dev_find_device(u16 vendor, u16 device, struct device *from)
 {
+	struct device *result;
+	bool indexed;
+
+	if (CONFIG(DEVICE_LOOKUP_INDEX)) {
+		result = dev_index_find_device(vendor, device, from, &indexed);
+		if (indexed)
+			return result;
+	}
+
 	if (!from)
 		from = all_devices;
 	else
@@ -65,6 +81,15 @@ struct device *dev_find_device(u16 vendor, u16 device, struct device *from)
  */
 struct device *dev_find_class(unsigned int class, struct device *from)
 {
+	struct device *result;
+	bool indexed;
+
+	if (CONFIG(DEVICE_LOOKUP_INDEX)) {
+		result = dev_index_find_class(class, from, &indexed);
+		if (indexed)
+			return result;
+	}
+
 	if (!from)
 		from = all_devices;
 	else
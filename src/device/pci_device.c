@@ -1281,6 +1281,8 @@ struct device *pci_probe_dev(struct device *dev, struct bus *bus,
 	/* Class code, the upper 3 bytes of PCI_CLASS_REVISION. */
 	dev->class = class >> 8;
 
+	dev_index_invalidate();
+
 	/* Architectural/System devices always need to be bus masters. */
 	if ((dev->class >> 16) == PCI_BASE_CLASS_SYSTEM &&
 	    CONFIG(PCI_ALLOW_BUS_MASTER_ANY_DEVICE))
@@ -1508,6 +1510,7 @@ void pci_scan_bus(struct bus *bus, unsigned int min_devfn,
 
 		/* Unlink it from list. */
 		*prev = dev->sibling;
+		dev_index_invalidate();
 
 		if (!once++)
 			printk(BIOS_WARNING, "PCI: Leftover static devices:\n");
@@ -101,6 +101,93 @@ struct hob_resource *fsp_hob_header_to_resource(const struct hob_header *hob)
 
 static void *fsp_hob_list_ptr;
 
+/*
+ * Index of the HOBs that can be looked up by GUID, i.e. GUID extension and resource
+ * descriptor HOBs. The entries are sorted by the first 4 bytes of the GUID and then by
+ * the offset of the HOB in the list, so a binary search finds the first HOB at or after
+ * an iterator position that may match a GUID. The HOB list itself is left untouched.
+ */
+struct fsp_hob_index_entry {
+	uint32_t key;
+	uint32_t offset;
+};
+
+struct fsp_hob_index {
+	uint64_t hob_list;
+	uint32_t end_offset;
+	uint32_t count;
+	struct fsp_hob_index_entry entries[];
+};
+
+static const struct fsp_hob_index *fsp_hob_index_ptr;
+
+static const uint8_t *hob_owner_guid(const struct hob_header *hob)
+{
+	if (hob->type == HOB_TYPE_GUID_EXTENSION)
+		return hob_header_to_struct(hob);
+	if (hob->type == HOB_TYPE_RESOURCE_DESCRIPTOR)
+		return fsp_hob_header_to_resource(hob)->owner_guid;
+	return NULL;
+}
+
+static uint32_t hob_index_key(const uint8_t guid[16])
+{
+	uint32_t key;
+
+	memcpy(&key, guid, sizeof(key));
+	return key;
+}
+
+static void save_hob_index(const void *hob_list)
+{
+	const struct hob_header *hob;
+	const struct cbmem_entry *entry;
+	struct fsp_hob_index *index;
+	uint32_t key, offset;
+	size_t count = 0;
+	size_t size, i;
+
+	for (hob = hob_list; hob->type != HOB_TYPE_END_OF_HOB_LIST; hob = fsp_next_hob(hob)) {
+		if (hob_owner_guid(hob))
+			count++;
+	}
+	size = sizeof(*index) + count * sizeof(index->entries[0]);
+
+	/* On resume the entry of the previous boot is found again and may be too small. */
+	entry = cbmem_entry_find(CBMEM_ID_FSP_HOB_INDEX);
+	if (entry && cbmem_entry_size(entry) < size) {
+		index = cbmem_entry_start(entry);
+		index->hob_list = 0;
+		printk(BIOS_INFO, "FSP HOB index too small, using HOB list walks.\n");
+		return;
+	}
+
+	index = cbmem_add(CBMEM_ID_FSP_HOB_INDEX, size);
+	if (!index) {
+		printk(BIOS_ERR, "Could not add cbmem area for HOB index.\n");
+		return;
+	}
+
+	index->count = 0;
+	for (hob = hob_list; hob->type != HOB_TYPE_END_OF_HOB_LIST; hob = fsp_next_hob(hob)) {
+		if (!hob_owner_guid(hob))
+			continue;
+
+		key = hob_index_key(hob_owner_guid(hob));
+		offset = (uintptr_t)hob - (uintptr_t)hob_list;
+
+		/* Offsets are increasing, so stopping at equal keys keeps them sorted. */
+		for (i = index->count; i > 0 && index->entries[i - 1].key > key; i--)
+			index->entries[i] = index->entries[i - 1];
+		index->entries[i].key = key;
+		index->entries[i].offset = offset;
+		index->count++;
+	}
+
+	index->end_offset = (uintptr_t)hob - (uintptr_t)hob_list;
+	index->hob_list = (uintptr_t)hob_list;
+}
+
 static void save_hob_list(int is_recovery)
 {
 	uint32_t *cbmem_loc;
@@ -112,6 +199,9 @@ static void save_hob_list(int is_recovery)
 	if (!hob_list)
 		die("Error: Could not locate HOB list pointer.\n");
 	*cbmem_loc = (uintptr_t)hob_list;
+
+	if (CONFIG(FSP_HOB_INDEX))
+		save_hob_index(hob_list);
 }
 
 CBMEM_CREATION_HOOK(save_hob_list);
@@ -137,6 +227,88 @@ enum cb_err fsp_hob_iterator_init(const struct hob_header **hob_iterator)
 	return *hob_iterator ? CB_SUCCESS : CB_ERR;
 }
 
+static const struct fsp_hob_index *fsp_get_hob_index(const void *hob_list)
+{
+	const struct fsp_hob_index *index;
+	const struct hob_header *end;
+
+	if (!CONFIG(FSP_HOB_INDEX) || !hob_list)
+		return NULL;
+
+	/* Only ramstage keeps the pointer, earlier stages may look before cbmem is up. */
+	index = ENV_RAMSTAGE ? fsp_hob_index_ptr : NULL;
+	if (!index) {
+		index = cbmem_find(CBMEM_ID_FSP_HOB_INDEX);
+		if (ENV_RAMSTAGE)
+			fsp_hob_index_ptr = index;
+	}
+
+	if (!index || index->hob_list != (uintptr_t)hob_list)
+		return NULL;
+
+	/* HOBs appended to the list after the index was built move the end of the list. */
+	end = (const void *)((uintptr_t)hob_list + index->end_offset);
+	if (end->type != HOB_TYPE_END_OF_HOB_LIST)
+		return NULL;
+
+	return index;
+}
+
+/*
+ * Look up the next HOB of the given type and GUID using the index. *indexed is cleared
+ * when the index can't be used and the caller needs to walk the HOB list instead.
+ */
+static enum cb_err fsp_hob_index_get_next(const struct hob_header **hob_iterator,
+					  uint16_t hob_type, const uint8_t guid[16],
+					  const struct hob_header **hob, bool *indexed)
+{
+	const void *hob_list = fsp_get_hob_list();
+	const struct fsp_hob_index *index = fsp_get_hob_index(hob_list);
+	const struct fsp_hob_index_entry *entry;
+	const struct hob_header *current_hob;
+	uint32_t key = hob_index_key(guid);
+	uintptr_t offset;
+	size_t lo, hi, mid;
+
+	*indexed = false;
+	if (!index || (uintptr_t)*hob_iterator < (uintptr_t)hob_list)
+		return CB_ERR;
+
+	offset = (uintptr_t)*hob_iterator - (uintptr_t)hob_list;
+	if (offset > index->end_offset)
+		return CB_ERR;
+
+	*indexed = true;
+
+	/* Find the first entry not below (key, offset). */
+	lo = 0;
+	hi = index->count;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		entry = &index->entries[mid];
+		if (entry->key < key || (entry->key == key && entry->offset < offset))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	for (entry = &index->entries[lo]; entry < &index->entries[index->count]; entry++) {
+		if (entry->key != key)
+			break;
+		current_hob = (const void *)((uintptr_t)hob_list + entry->offset);
+		if (current_hob->type == hob_type &&
+		    fsp_guid_compare(hob_owner_guid(current_hob), guid)) {
+			*hob = current_hob;
+			*hob_iterator = fsp_next_hob(current_hob);
+			return CB_SUCCESS;
+		}
+	}
+
+	/* Leave the iterator at the end of the list like a walk would. */
+	*hob_iterator = (const void *)((uintptr_t)hob_list + index->end_offset);
+	return CB_ERR;
+}
+
 static enum cb_err fsp_hob_iterator_get_next(const struct hob_header **hob_iterator,
 					     uint16_t hob_type,
 					     const struct hob_header **hob)
@@ -169,6 +341,17 @@ enum cb_err fsp_hob_iterator_get_next_guid_resource(const struct hob_header **ho
 						    const struct hob_resource **res)
 {
 	const struct hob_resource *res_hob;
+	const struct hob_header *hob;
+	bool indexed;
+
+	if (fsp_hob_index_get_next(hob_iterator, HOB_TYPE_RESOURCE_DESCRIPTOR, guid, &hob,
+				   &indexed) == CB_SUCCESS) {
+		*res = fsp_hob_header_to_resource(hob);
+		return CB_SUCCESS;
+	}
+	if (indexed)
+		return CB_ERR;
+
 	while (fsp_hob_iterator_get_next_resource(hob_iterator, &res_hob) == CB_SUCCESS) {
 		if (fsp_guid_compare(res_hob->owner_guid, guid)) {
 			*res = res_hob;
@@ -184,6 +367,17 @@ enum cb_err fsp_hob_iterator_get_next_guid_extension(const struct hob_header **h
 {
 	const struct hob_header *hob;
 	const uint8_t *guid_hob;
+	bool indexed;
+
+	if (fsp_hob_index_get_next(hob_iterator, HOB_TYPE_GUID_EXTENSION, guid, &hob,
+				   &indexed) == CB_SUCCESS) {
+		*size = hob->length - (HOB_HEADER_LEN + 16);
+		*data = hob_header_to_extension_hob(hob);
+		return CB_SUCCESS;
+	}
+	if (indexed)
+		return CB_ERR;
+
 	while (fsp_hob_iterator_get_next(hob_iterator, HOB_TYPE_GUID_EXTENSION, &hob) == CB_SUCCESS) {
 		guid_hob = hob_header_to_struct(hob);
 		if (fsp_guid_compare(guid_hob, guid)) {
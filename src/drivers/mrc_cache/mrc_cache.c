@@ -35,6 +35,32 @@ struct mrc_metadata {
 	uint32_t version;
 } __packed;
 
+/*
+ * With MRC_CACHE_DELTA_UPDATES a slot may hold a delta instead of the full data. Its
+ * metadata carries MRC_DELTA_SIGNATURE and otherwise describes the rebuilt data. It is
+ * followed by struct mrc_delta and the contents of the listed blocks in ascending order.
+ * Deltas always refer to the latest full slot within the same region file, so rebuilding
+ * the data never needs more than two slots. All blocks are MRC_DELTA_BLOCK_SIZE in size
+ * except for the last block of the data, which may be shorter.
+ */
+#define MRC_DELTA_SIGNATURE	(('M'<<0)|('R'<<8)|('C'<<16)|('p'<<24))
+#define MRC_DELTA_BLOCK_SIZE	256
+#define MRC_DELTA_MAX_BLOCKS	32
+
+#if CONFIG(MRC_CACHE_DELTA_UPDATES)
+#define MRC_DELTA_BUFFER_SIZE	CONFIG_MRC_CACHE_DELTA_BUFFER_SIZE
+#else
+#define MRC_DELTA_BUFFER_SIZE	0
+#endif
+
+struct mrc_delta {
+	/* Location of the full slot relative to the start of the region */
+	uint32_t base_offset;
+	uint32_t base_size;
+	uint32_t block_count;
+	uint16_t blocks[MRC_DELTA_MAX_BLOCKS];
+} __packed;
+
 enum result {
 	UPDATE_FAILURE		= -1,
 	UPDATE_SUCCESS		= 0,
@@ -168,6 +194,37 @@ static const struct cache_region *lookup_region(struct region *r, int type)
 	return cr;
 }
 
+static bool mrc_is_delta(const struct mrc_metadata *md)
+{
+	return CONFIG(MRC_CACHE_DELTA_UPDATES) && md->signature == MRC_DELTA_SIGNATURE;
+}
+
+static size_t mrc_delta_block_size(size_t data_size, uint16_t block)
+{
+	return MIN(MRC_DELTA_BLOCK_SIZE, data_size - block * MRC_DELTA_BLOCK_SIZE);
+}
+
+/* Check the block list of a delta and return the size of its block contents. */
+static int mrc_delta_valid(const struct mrc_delta *delta, size_t data_size,
+			   size_t *payload_size)
+{
+	size_t i;
+
+	if (delta->block_count > MRC_DELTA_MAX_BLOCKS)
+		return -1;
+
+	*payload_size = 0;
+	for (i = 0; i < delta->block_count; i++) {
+		if (i > 0 && delta->blocks[i] <= delta->blocks[i - 1])
+			return -1;
+		if (delta->blocks[i] * MRC_DELTA_BLOCK_SIZE >= data_size)
+			return -1;
+		*payload_size += mrc_delta_block_size(data_size, delta->blocks[i]);
+	}
+
+	return 0;
+}
+
 static int mrc_header_valid(struct region_device *rdev, struct mrc_metadata *md)
 {
 	uint32_t hash;
@@ -187,7 +244,7 @@ static int mrc_header_valid(struct region_device *rdev, struct mrc_metadata *md)
 		return -1;
 	}
 
-	if (md->signature != MRC_DATA_SIGNATURE) {
+	if (md->signature != MRC_DATA_SIGNATURE && !mrc_is_delta(md)) {
 		printk(BIOS_ERR, "MRC: invalid header signature\n");
 		return -1;
 	}
@@ -209,6 +266,18 @@ static int mrc_header_valid(struct region_device *rdev, struct mrc_metadata *md)
 	/* Re-size the region device according to the metadata as a region_file
 	 * does block allocation. */
 	size = sizeof(*md) + md->data_size;
+	if (mrc_is_delta(md)) {
+		struct mrc_delta delta;
+		size_t payload_size;
+
+		if (rdev_readat(rdev, &delta, sizeof(*md), sizeof(delta)) < 0 ||
+		    mrc_delta_valid(&delta, md->data_size, &payload_size) < 0) {
+			printk(BIOS_ERR, "MRC: invalid delta\n");
+			return -1;
+		}
+		size = sizeof(*md) + sizeof(delta) + payload_size;
+	}
+
 	if (rdev_chain(rdev, rdev, 0, size) < 0) {
 		printk(BIOS_ERR, "MRC: size exceeds rdev size: %zx vs %zx\n",
 			size, region_device_sz(rdev));
@@ -279,8 +348,70 @@ static int mrc_cache_get_latest_slot_info(const char *name,
 	return 0;
 }
 
+/*
+ * Locate the full slot a delta slot refers to. On success base is resized to cover the
+ * data of the full slot only.
+ */
+static int mrc_delta_find_base(const struct region_device *backing_rdev,
+			       const struct region_device *delta_rdev,
+			       const struct mrc_metadata *md,
+			       struct region_device *base)
+{
+	struct mrc_metadata base_md;
+	struct mrc_delta delta;
+
+	if (rdev_readat(delta_rdev, &delta, sizeof(*md), sizeof(delta)) < 0)
+		return -1;
+
+	if (rdev_chain(base, backing_rdev, delta.base_offset, delta.base_size) < 0)
+		return -1;
+
+	if (mrc_header_valid(base, &base_md) < 0 || mrc_is_delta(&base_md) ||
+	    base_md.data_size != md->data_size) {
+		printk(BIOS_ERR, "MRC: invalid delta base\n");
+		return -1;
+	}
+
+	return rdev_chain(base, base, sizeof(base_md), base_md.data_size);
+}
+
+/* Patch the blocks stored in a delta slot into data rebuilt from its full slot. */
+static int mrc_delta_apply(const struct region_device *patch, void *data,
+			   size_t data_size)
+{
+	struct mrc_delta delta;
+	size_t payload_size;
+	size_t offset = sizeof(delta);
+	size_t i;
+
+	/* No delta to apply. */
+	if (region_device_sz(patch) == 0)
+		return 0;
+
+	if (rdev_readat(patch, &delta, 0, sizeof(delta)) < 0 ||
+	    mrc_delta_valid(&delta, data_size, &payload_size) < 0)
+		return -1;
+
+	for (i = 0; i < delta.block_count; i++) {
+		const size_t size = mrc_delta_block_size(data_size, delta.blocks[i]);
+		uint8_t *block = (uint8_t *)data + delta.blocks[i] * MRC_DELTA_BLOCK_SIZE;
+
+		if (rdev_readat(patch, block, offset, size) != size)
+			return -1;
+		offset += size;
+	}
+
+	return 0;
+}
+
+/*
+ * On success rdev covers the data of the current full slot. If the latest slot is a
+ * delta, patch covers the delta and its blocks which need to be applied on top of the
+ * data. Otherwise patch is 0 sized.
+ */
 static int mrc_cache_find_current(int type, uint32_t version,
 				  struct region_device *rdev,
+				  struct region_device *patch,
 				  struct mrc_metadata *md)
 {
 	const struct cache_region *cr;
@@ -321,6 +452,14 @@ static int mrc_cache_find_current(int type, uint32_t version,
 		return -1;
 	}
 
+	rdev_chain(patch, &read_rdev, 0, 0);
+
+	if (mrc_is_delta(md)) {
+		if (rdev_chain(patch, rdev, md_size, region_device_sz(rdev) - md_size) < 0)
+			return -1;
+		return mrc_delta_find_base(&read_rdev, rdev, md, rdev);
+	}
+
 	/* Re-size rdev to only contain the data. i.e. remove metadata. */
 	data_size = md->data_size;
 	return rdev_chain(rdev, rdev, md_size, data_size);
@@ -330,10 +469,11 @@ ssize_t mrc_cache_load_current(int type, uint32_t version, void *buffer,
 			      size_t buffer_size)
 {
 	struct region_device rdev;
+	struct region_device patch;
 	struct mrc_metadata md;
 	ssize_t data_size;
 
-	if (mrc_cache_find_current(type, version, &rdev, &md) < 0)
+	if (mrc_cache_find_current(type, version, &rdev, &patch, &md) < 0)
 		return -1;
 
 	data_size = region_device_sz(&rdev);
@@ -343,31 +483,71 @@ ssize_t mrc_cache_load_current(int type, uint32_t version, void *buffer,
 	if (rdev_readat(&rdev, buffer, 0, data_size) != data_size)
 		return -1;
 
+	if (mrc_delta_apply(&patch, buffer, data_size) < 0)
+		return -1;
+
 	if (mrc_data_valid(type, &md, buffer, data_size) < 0)
 		return -1;
 
 	return data_size;
 }
 
+/*
+ * The data of a delta slot can't be patched in a mapping of the boot device, which may be
+ * memory mapped flash. Before memory training there is no heap or CBMEM to rebuild it in,
+ * so it is carved out of this buffer. Like the mapping it replaces it is never released.
+ */
+static void *mrc_delta_buffer_alloc(size_t size)
+{
+	static uint8_t buffer[MRC_DELTA_BUFFER_SIZE] __aligned(16);
+	static size_t used;
+	void *data;
+
+	size = ALIGN_UP(size, 16);
+	if (size > sizeof(buffer) - used)
+		return NULL;
+
+	data = &buffer[used];
+	used += size;
+
+	return data;
+}
+
 void *mrc_cache_current_mmap_leak(int type, uint32_t version,
 				  size_t *data_size)
 {
 	struct region_device rdev;
+	struct region_device patch;
 	void *data;
 	size_t region_device_size;
 	struct mrc_metadata md;
 
-	if (mrc_cache_find_current(type, version, &rdev, &md) < 0)
+	if (mrc_cache_find_current(type, version, &rdev, &patch, &md) < 0)
 		return NULL;
 
 	region_device_size = region_device_sz(&rdev);
 	if (data_size)
 		*data_size = region_device_size;
-	data = rdev_mmap_full(&rdev);
 
-	if (data == NULL) {
-		printk(BIOS_INFO, "MRC: mmap failure.\n");
-		return NULL;
+	if (CONFIG(MRC_CACHE_DELTA_UPDATES) && region_device_sz(&patch) != 0) {
+		data = mrc_delta_buffer_alloc(region_device_size);
+		if (data == NULL) {
+			printk(BIOS_ERR, "MRC: no space to rebuild delta.\n");
+			return NULL;
+		}
+
+		if (rdev_readat(&rdev, data, 0, region_device_size) != region_device_size)
+			return NULL;
+
+		if (mrc_delta_apply(&patch, data, region_device_size) < 0)
+			return NULL;
+	} else {
+		data = rdev_mmap_full(&rdev);
+
+		if (data == NULL) {
+			printk(BIOS_INFO, "MRC: mmap failure.\n");
+			return NULL;
+		}
 	}
 
 	if (mrc_data_valid(type, &md, data, region_device_size) < 0)
@@ -381,13 +561,31 @@ static bool mrc_cache_needs_update(const struct region_device *rdev,
 				   size_t new_data_size)
 {
 	void *mapping;
+	struct mrc_metadata md;
+	struct mrc_metadata expected_md = *new_md;
 	size_t old_data_size = region_device_sz(rdev) - sizeof(struct mrc_metadata);
 	bool need_update = false;
 
+	/* A valid delta slot was resized to its own contents by mrc_header_valid(),
+	   so compare against the metadata a delta for the new data would carry. */
+	if (CONFIG(MRC_CACHE_DELTA_UPDATES) &&
+	    rdev_readat(rdev, &md, 0, sizeof(md)) == sizeof(md) && mrc_is_delta(&md)) {
+		struct region_device slot = *rdev;
+
+		if (mrc_header_valid(&slot, &md) < 0 ||
+		    region_device_sz(&slot) != region_device_sz(rdev))
+			return true;
+
+		old_data_size = md.data_size;
+		expected_md.signature = MRC_DELTA_SIGNATURE;
+		expected_md.header_hash = 0;
+		expected_md.header_hash = xxh32(&expected_md, sizeof(expected_md), 0);
+	}
+
 	if (new_data_size != old_data_size)
 		return true;
 
-	mapping = rdev_mmap_full(rdev);
+	mapping = rdev_mmap(rdev, 0, sizeof(struct mrc_metadata));
 	if (mapping == NULL) {
 		printk(BIOS_ERR, "MRC: cannot mmap existing cache.\n");
 		return true;
@@ -397,7 +595,7 @@ static bool mrc_cache_needs_update(const struct region_device *rdev,
 	 * Compare the old and new metadata only. If the data hashes don't
 	 * match, the comparison will fail.
 	 */
-	if (memcmp(new_md, mapping, sizeof(struct mrc_metadata)))
+	if (memcmp(&expected_md, mapping, sizeof(struct mrc_metadata)))
 		need_update = true;
 
 	rdev_munmap(rdev, mapping);
@@ -428,6 +626,112 @@ static void log_event_cache_update(uint8_t slot, enum result res)
 		printk(BIOS_ERR, "Failed to log mem cache update event.\n");
 }
 
+/*
+ * Write the new data as a delta against the latest full slot. Returns 0 on success,
+ * < 0 on error and > 0 if a full update needs to be written instead. That is the case
+ * when there is no valid full slot to refer to, too many blocks changed, or the delta
+ * doesn't fit without emptying the region file, which would erase the full slot.
+ */
+static int mrc_cache_update_delta(struct region_file *cache_file,
+				  const struct region_device *backing_rdev,
+				  const struct region_device *latest_rdev,
+				  const struct mrc_metadata *new_md,
+				  const void *new_data,
+				  size_t new_data_size)
+{
+	struct update_region_file_entry entries[2 + MRC_DELTA_MAX_BLOCKS];
+	struct region_device slot = *latest_rdev;
+	struct region_device base;
+	struct mrc_metadata md;
+	struct mrc_metadata delta_md;
+	struct mrc_delta delta = { 0 };
+	uint8_t block[MRC_DELTA_BLOCK_SIZE];
+	const uint8_t *data = new_data;
+	size_t num_entries = 2;
+	size_t payload_size = 0;
+	size_t offset;
+	ssize_t base_offset;
+
+	if (mrc_header_valid(&slot, &md) < 0)
+		return 1;
+
+	if (mrc_is_delta(&md)) {
+		if (mrc_delta_find_base(backing_rdev, &slot, &md, &base) < 0)
+			return 1;
+		/* Step back to the start of the full slot including its metadata. */
+		base_offset = rdev_relative_offset(backing_rdev, &base) - sizeof(md);
+		if (rdev_chain(&slot, backing_rdev, base_offset,
+			       region_device_sz(&base) + sizeof(md)) < 0)
+			return 1;
+	} else {
+		if (rdev_chain(&base, &slot, sizeof(md), md.data_size) < 0)
+			return 1;
+		base_offset = rdev_relative_offset(backing_rdev, &slot);
+	}
+
+	if (base_offset < 0 || region_device_sz(&base) != new_data_size)
+		return 1;
+
+	/* The loader couldn't rebuild the data from a delta. */
+	if (new_data_size > MRC_DELTA_BUFFER_SIZE)
+		return 1;
+
+	delta.base_offset = base_offset;
+	delta.base_size = region_device_sz(&slot);
+
+	for (offset = 0; offset < new_data_size; offset += MRC_DELTA_BLOCK_SIZE) {
+		const uint16_t index = offset / MRC_DELTA_BLOCK_SIZE;
+		const size_t size = mrc_delta_block_size(new_data_size, index);
+
+		if (rdev_readat(&base, block, offset, size) != size)
+			return 1;
+
+		if (!memcmp(block, &data[offset], size))
+			continue;
+
+		/* Too much changed. Compact the cache by writing the full data. */
+		if (delta.block_count == MRC_DELTA_MAX_BLOCKS)
+			return 1;
+
+		/* Contiguous blocks are contiguous in the new data, too. */
+		if (delta.block_count > 0 &&
+		    delta.blocks[delta.block_count - 1] + 1 == index)
+			entries[num_entries - 1].size += size;
+		else
+			entries[num_entries++] = (struct update_region_file_entry){
+				.size = size,
+				.data = &data[offset],
+			};
+
+		delta.blocks[delta.block_count++] = index;
+		payload_size += size;
+	}
+
+	if (sizeof(delta) + payload_size >= new_data_size)
+		return 1;
+
+	if (!region_file_can_append(cache_file, sizeof(md) + sizeof(delta) + payload_size))
+		return 1;
+
+	delta_md = *new_md;
+	delta_md.signature = MRC_DELTA_SIGNATURE;
+	delta_md.header_hash = 0;
+	delta_md.header_hash = xxh32(&delta_md, sizeof(delta_md), 0);
+
+	entries[0] = (struct update_region_file_entry){
+		.size = sizeof(delta_md),
+		.data = &delta_md,
+	};
+	entries[1] = (struct update_region_file_entry){
+		.size = sizeof(delta),
+		.data = &delta,
+	};
+
+	printk(BIOS_DEBUG, "MRC: writing delta of %u blocks.\n", delta.block_count);
+
+	return region_file_update_data_arr(cache_file, entries, num_entries);
+}
+
 /* During ramstage this code purposefully uses incoherent transactions between
  * read and write. The read assumes a memory-mapped boot device that can be used
  * to quickly locate and compare the up-to-date data. However, when an update
@@ -448,6 +752,7 @@ static void update_mrc_cache_by_type(int type,
 	struct region_device latest_rdev;
 	const bool fail_bad_data = false;
 	uint32_t hash_idx;
+	int ret = 1;
 
 	cr = lookup_region(&region, type);
 
@@ -500,7 +805,14 @@ static void update_mrc_cache_by_type(int type,
 			.data = new_data,
 		},
 	};
-	if (region_file_update_data_arr(&cache_file, entries, ARRAY_SIZE(entries)) < 0) {
+
+	if (CONFIG(MRC_CACHE_DELTA_UPDATES))
+		ret = mrc_cache_update_delta(&cache_file, backing_rdev, &latest_rdev,
+					     new_md, new_data, new_data_size);
+	if (ret > 0)
+		ret = region_file_update_data_arr(&cache_file, entries, ARRAY_SIZE(entries));
+
+	if (ret < 0) {
 		printk(BIOS_ERR, "MRC: failed to update '%s'.\n", cr->name);
 		log_event_cache_update(cr->elog_slot, UPDATE_FAILURE);
 	} else {
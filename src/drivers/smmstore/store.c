@@ -139,7 +139,8 @@ int smmstore_read_region(void *buf, ssize_t *bufsize)
 	return 0;
 }
 
-static enum cb_err scan_end(struct region_device *store)
+static enum cb_err scan_records(const struct region_device *cached,
+				struct region_device *store)
 {
 	/* scan for end */
 	ssize_t end = 0;
@@ -149,7 +150,7 @@ static enum cb_err scan_end(struct region_device *store)
 		/* make odd corner cases identifiable, eg. invalid v_sz */
 		k_sz = 0;
 
-		if (rdev_readat(store, &k_sz, end, sizeof(k_sz)) < 0) {
+		if (rdev_readat(cached, &k_sz, end, sizeof(k_sz)) < 0) {
 			printk(BIOS_WARNING, "failed reading key size\n");
 			return CB_ERR;
 		}
@@ -167,7 +168,7 @@ static enum cb_err scan_end(struct region_device *store)
 			return CB_ERR;
 		}
 
-		if (rdev_readat(store, &v_sz, end + sizeof(k_sz), sizeof(v_sz)) < 0) {
+		if (rdev_readat(cached, &v_sz, end + sizeof(k_sz), sizeof(v_sz)) < 0) {
 			printk(BIOS_WARNING, "failed reading value size\n");
 			return CB_ERR;
 		}
@@ -194,6 +195,33 @@ static enum cb_err scan_end(struct region_device *store)
 
 	return CB_SUCCESS;
 }
+
+/*
+ * Every record header costs two tiny reads. Route them through a small read-ahead
+ * cache so walking the store doesn't issue one SPI transaction per field.
+ */
+#define SCAN_CACHE_BLOCK_SIZE	512
+#define SCAN_CACHE_BLOCKS	4
+
+static enum cb_err scan_end(struct region_device *store)
+{
+	static uint8_t scan_cache_buf[SCAN_CACHE_BLOCK_SIZE * SCAN_CACHE_BLOCKS];
+	struct cached_rdev crdev;
+	const struct region_device *cached;
+	enum cb_err ret;
+
+	cached = cached_rdev_init(&crdev, store, scan_cache_buf, SCAN_CACHE_BLOCK_SIZE,
+				  SCAN_CACHE_BLOCKS);
+	if (cached == NULL)
+		return CB_ERR;
+
+	ret = scan_records(cached, store);
+
+	printk(BIOS_SPEW, "SMMSTORE: scan cache %zu hits, %zu misses\n",
+	       crdev.hits, crdev.misses);
+
+	return ret;
+}
 /*
  * Append data to region
  *
@@ -67,8 +67,12 @@ static int do_spi_flash_cmd(const struct spi_slave *spi, const u8 *dout,
 	return ret;
 }
 
-static int do_dual_output_cmd(const struct spi_slave *spi, const u8 *dout,
-			      size_t bytes_out, void *din, size_t bytes_in)
+typedef int (*spi_xfer_wide_fn)(const struct spi_slave *slave, const void *dout,
+				size_t bytesout, void *din, size_t bytesin);
+
+/* Send the whole command in single mode and receive the data in dual/quad mode. */
+static int do_wide_output_cmd(const struct spi_slave *spi, spi_xfer_wide_fn xfer_wide,
+			      const u8 *dout, size_t bytes_out, void *din, size_t bytes_in)
 {
 	int ret;
 
@@ -89,14 +93,15 @@ static int do_dual_output_cmd(const struct spi_slave *spi, const u8 *dout,
 	ret = spi_xfer_vector(spi, &vector, 1);
 
 	if (!ret)
-		ret = spi->ctrlr->xfer_dual(spi, NULL, 0, din, bytes_in);
+		ret = xfer_wide(spi, NULL, 0, din, bytes_in);
 
 	spi_release_bus(spi);
 	return ret;
 }
 
-static int do_dual_io_cmd(const struct spi_slave *spi, const u8 *dout,
-			  size_t bytes_out, void *din, size_t bytes_in)
+/* Send the opcode in single mode, everything after it in dual/quad mode. */
+static int do_wide_io_cmd(const struct spi_slave *spi, spi_xfer_wide_fn xfer_wide,
+			  const u8 *dout, size_t bytes_out, void *din, size_t bytes_in)
 {
 	int ret;
 
@@ -111,15 +116,41 @@ static int do_dual_io_cmd(const struct spi_slave *spi, const u8 *dout,
 	ret = spi_xfer_vector(spi, &vector, 1);
 
 	if (!ret)
-		ret = spi->ctrlr->xfer_dual(spi, &dout[1], bytes_out - 1, NULL, 0);
+		ret = xfer_wide(spi, &dout[1], bytes_out - 1, NULL, 0);
 
 	if (!ret)
-		ret = spi->ctrlr->xfer_dual(spi, NULL, 0, din, bytes_in);
+		ret = xfer_wide(spi, NULL, 0, din, bytes_in);
 
 	spi_release_bus(spi);
 	return ret;
 }
 
+static int do_dual_output_cmd(const struct spi_slave *spi, const u8 *dout,
+			      size_t bytes_out, void *din, size_t bytes_in)
+{
+	return do_wide_output_cmd(spi, spi->ctrlr->xfer_dual, dout, bytes_out, din,
+				  bytes_in);
+}
+
+static int do_dual_io_cmd(const struct spi_slave *spi, const u8 *dout,
+			  size_t bytes_out, void *din, size_t bytes_in)
+{
+	return do_wide_io_cmd(spi, spi->ctrlr->xfer_dual, dout, bytes_out, din, bytes_in);
+}
+
+static int do_quad_output_cmd(const struct spi_slave *spi, const u8 *dout,
+			      size_t bytes_out, void *din, size_t bytes_in)
+{
+	return do_wide_output_cmd(spi, spi->ctrlr->xfer_quad, dout, bytes_out, din,
+				  bytes_in);
+}
+
+static int do_quad_io_cmd(const struct spi_slave *spi, const u8 *dout,
+			  size_t bytes_out, void *din, size_t bytes_in)
+{
+	return do_wide_io_cmd(spi, spi->ctrlr->xfer_quad, dout, bytes_out, din, bytes_in);
+}
+
 int spi_flash_cmd(const struct spi_slave *spi, u8 cmd, void *response, size_t len)
 {
 	int ret = do_spi_flash_cmd(spi, &cmd, sizeof(cmd), response, len);
@@ -158,7 +189,7 @@ int spi_flash_cmd_write(const struct spi_slave *spi, const u8 *cmd,
 int spi_flash_cmd_read(const struct spi_flash *flash, u32 offset,
 				  size_t len, void *buf)
 {
-	u8 cmd[5 + ADDR_MOD];
+	u8 cmd[7 + ADDR_MOD];
 	int ret, cmd_len;
 	int (*do_cmd)(const struct spi_slave *spi, const u8 *din,
 		      size_t in_bytes, void *out, size_t out_bytes);
@@ -167,6 +198,19 @@ int spi_flash_cmd_read(const struct spi_flash *flash, u32 offset,
 		cmd_len = 4 + ADDR_MOD;
 		cmd[0] = CMD_READ_ARRAY_SLOW;
 		do_cmd = do_spi_flash_cmd;
+	} else if (flash->flags.quad_io && flash->spi.ctrlr->xfer_quad) {
+		/* Mode byte (no continuous read) followed by 4 dummy clocks. */
+		cmd_len = 7 + ADDR_MOD;
+		cmd[0] = CMD_READ_FAST_QUAD_IO;
+		cmd[4 + ADDR_MOD] = 0;
+		cmd[5 + ADDR_MOD] = 0;
+		cmd[6 + ADDR_MOD] = 0;
+		do_cmd = do_quad_io_cmd;
+	} else if (flash->flags.quad_output && flash->spi.ctrlr->xfer_quad) {
+		cmd_len = 5 + ADDR_MOD;
+		cmd[0] = CMD_READ_FAST_QUAD_OUTPUT;
+		cmd[4 + ADDR_MOD] = 0;
+		do_cmd = do_quad_output_cmd;
 	} else if (flash->flags.dual_io && flash->spi.ctrlr->xfer_dual) {
 		cmd_len = 5 + ADDR_MOD;
 		cmd[0] = CMD_READ_FAST_DUAL_IO;
@@ -418,6 +462,14 @@ static int fill_spi_flash(const struct spi_slave *spi, struct spi_flash *flash,
 
 	flash->flags.dual_output = part->fast_read_dual_output_support;
 	flash->flags.dual_io = part->fast_read_dual_io_support;
+	if (spi->ctrlr->xfer_quad && vi->quad_enabled && vi->quad_enabled(flash)) {
+		flash->flags.quad_output = part->fast_read_quad_output_support;
+		flash->flags.quad_io = part->fast_read_quad_io_support;
+	} else {
+		/* The flash struct may be reused from an earlier probe. */
+		flash->flags.quad_output = 0;
+		flash->flags.quad_io = 0;
+	}
 
 	flash->ops = &vi->desc->ops;
 	flash->prot_ops = vi->prot_ops;
@@ -537,7 +589,11 @@ int spi_flash_probe(unsigned int bus, unsigned int cs, struct spi_flash *flash)
 	}
 
 	const char *mode_string = "";
-	if (flash->flags.dual_io && spi.ctrlr->xfer_dual)
+	if (flash->flags.quad_io && spi.ctrlr->xfer_quad)
+		mode_string = " (Quad I/O mode)";
+	else if (flash->flags.quad_output && spi.ctrlr->xfer_quad)
+		mode_string = " (Quad Output mode)";
+	else if (flash->flags.dual_io && spi.ctrlr->xfer_dual)
 		mode_string = " (Dual I/O mode)";
 	else if (flash->flags.dual_output && spi.ctrlr->xfer_dual)
 		mode_string = " (Dual Output mode)";
@@ -16,6 +16,8 @@
 
 #define CMD_READ_FAST_DUAL_OUTPUT	0x3b
 #define CMD_READ_FAST_DUAL_IO		0xbb
+#define CMD_READ_FAST_QUAD_OUTPUT	0x6b
+#define CMD_READ_FAST_QUAD_IO		0xeb
 
 #define CMD_READ_STATUS			0x05
 #define CMD_WRITE_ENABLE		0x06
@@ -74,7 +76,8 @@ struct spi_flash_part_id {
 	uint16_t nr_sectors_shift: 4;
 	uint16_t fast_read_dual_output_support : 1;	/*  1-1-2 read */
 	uint16_t fast_read_dual_io_support : 1;		/*  1-2-2 read */
-	uint16_t _reserved_for_flags: 2;
+	uint16_t fast_read_quad_output_support : 1;	/*  1-1-4 read */
+	uint16_t fast_read_quad_io_support : 1;		/*  1-4-4 read */
 	/* Block protection. Currently used by Winbond. */
 	uint16_t protection_granularity_shift : 5;
 	uint16_t bp_bits : 3;
@@ -103,6 +106,12 @@ struct spi_flash_vendor_info {
 	const struct spi_flash_protection_ops *prot_ops;
 	/* Returns 0 on success. !0 otherwise. */
 	int (*after_probe)(const struct spi_flash *flash);
+	/*
+	 * Returns true if the part has its quad enable bit set. Quad reads are
+	 * only used if this is provided and returns true. The QE bit is never
+	 * changed by coreboot since it also repurposes the WP# and HOLD# pins.
+	 */
+	bool (*quad_enabled)(const struct spi_flash *flash);
 };
 
 /* Manufacturer-specific probe information */
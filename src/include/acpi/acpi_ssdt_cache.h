@@ -0,0 +1,27 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#ifndef __ACPI_ACPI_SSDT_CACHE_H__
+#define __ACPI_ACPI_SSDT_CACHE_H__
+
+#include <stddef.h>
+
+/*
+ * The SSDT cache keeps the AML emitted by the devices' acpi_fill_ssdt() handlers in the
+ * RW_ACPI_CACHE FMAP region. It is keyed by a hash of the firmware build, the devicetree
+ * state, fw_config and the board and SKU IDs, so it is only used on boots where the
+ * handlers would produce the same output.
+ */
+
+/*
+ * Copy the cached AML to dest if it matches the current boot and fits into dest_size bytes.
+ * Returns the size of the AML or 0 if it has to be generated.
+ */
+size_t acpi_ssdt_cache_load(void *dest, size_t dest_size);
+
+/* Store freshly generated AML for the next boot. */
+void acpi_ssdt_cache_save(const void *aml, size_t size);
+
+/* Drop the cached AML, e.g. when generating it overflowed the tables. */
+void acpi_ssdt_cache_invalidate(void);
+
+#endif /* __ACPI_ACPI_SSDT_CACHE_H__ */
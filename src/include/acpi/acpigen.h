@@ -368,6 +368,27 @@ struct cppc_config {
 
 #define ACPI_MUTEX_NO_TIMEOUT		0xffff
 
+/* Encoding of a package length as emitted by acpigen_write_len_f()/acpigen_pop_len(). */
+#define ACPIGEN_LEN_F(len)	(0x80 | ((len) & 0xf)), (((len) >> 4) & 0xff), \
+				(((len) >> 12) & 0xff)
+
+/* A little endian field of a template, filled in when the template is emitted. */
+struct acpigen_patch {
+	uint16_t offset;
+	uint8_t size;
+};
+
+/*
+ * Pre-encoded AML fragment. Repeated objects like _PSS entries are emitted
+ * with one copy instead of byte by byte.
+ */
+struct acpigen_template {
+	const uint8_t *aml;
+	size_t size;
+	const struct acpigen_patch *patches;
+	size_t num_patches;
+};
+
 void acpigen_write_return_integer(uint64_t arg);
 void acpigen_write_return_namestr(const char *arg);
 void acpigen_write_return_string(const char *arg);
@@ -375,6 +396,14 @@ void acpigen_write_len_f(void);
 void acpigen_pop_len(void);
 void acpigen_set_current(char *curr);
 char *acpigen_get_current(void);
+/*
+ * Stop emitting AML at limit, NULL removes the limit. Once the limit is hit
+ * acpigen_overflowed() returns true until the next acpigen_set_limit().
+ */
+void acpigen_set_limit(char *limit);
+bool acpigen_overflowed(void);
+/* Bytes left before the limit, SIZE_MAX if there is none. */
+size_t acpigen_get_remaining(void);
 char *acpigen_write_package(int nr_el);
 __always_inline void acpigen_write_package_end(void)
 {
@@ -392,6 +421,8 @@ void acpigen_emit_stream(const char *data, int size);
 void acpigen_emit_string(const char *string);
 void acpigen_emit_namestring(const char *namepath);
 void acpigen_emit_eisaid(const char *eisaid);
+/* Emit tmpl with values[i] patched in at tmpl->patches[i]. */
+void acpigen_emit_template(const struct acpigen_template *tmpl, const uint64_t *values);
 void acpigen_write_word(unsigned int data);
 void acpigen_write_dword(unsigned int data);
 void acpigen_write_qword(uint64_t data);
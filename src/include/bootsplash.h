@@ -3,17 +3,15 @@
 #ifndef __BOOTSPLASH_H__
 #define __BOOTSPLASH_H__
 
+#include <boot/coreboot_tables.h>
 #include <types.h>
 
 /**
- * Sets up the framebuffer with the bootsplash.jpg from cbfs.
- * Returns 0 on success
- * CB_ERR on cbfs errors
- * and >0 on jpeg errors.
+ * Sets up the framebuffer with the bootsplash.jpg from cbfs, centered and in
+ * the framebuffer's pixel format. Pictures with restart intervals are decoded
+ * on all CPUs.
  */
-void set_bootsplash(unsigned char *framebuffer, unsigned int x_resolution,
-		    unsigned int y_resolution, unsigned int bytes_per_line,
-		    unsigned int fb_resolution);
+void set_bootsplash(const struct lb_framebuffer *framebuffer);
 
 
 void bmp_load_logo(uint32_t *logo_ptr, uint32_t *logo_size);
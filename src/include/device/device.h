@@ -223,10 +223,51 @@ DEVTREE_CONST struct device *dev_find_path(
 		DEVTREE_CONST struct device *prev_match,
 		enum device_path_type path_type);
 struct device *dev_find_lapic(unsigned int apic_id);
+int dev_path_eq(const struct device_path *path1, const struct device_path *path2);
 int dev_count_cpu(void);
 struct device *add_cpu_device(struct bus *cpu_bus, unsigned int apic_id,
 				int enabled);
 void mp_init_cpus(DEVTREE_CONST struct bus *cpu_bus);
+
+/*
+ * Device lookup index (DEVICE_LOOKUP_INDEX). The lookups set *indexed to false when the
+ * index can't answer the query, in which case the caller needs to walk the device lists.
+ * Code that changes the IDs or path of a device after it was allocated, or unlinks a
+ * device from its bus, has to call dev_index_invalidate().
+ */
+void dev_index_add(struct device *dev);
+#if CONFIG(DEVICE_LOOKUP_INDEX)
+void dev_index_invalidate(void);
+#else
+static inline void dev_index_invalidate(void) {}
+#endif
+struct device *dev_index_find_lapic(unsigned int apic_id, bool *indexed);
+struct device *dev_index_find_device(u16 vendor, u16 device, struct device *from,
+				     bool *indexed);
+struct device *dev_index_find_class(unsigned int class, struct device *from, bool *indexed);
+struct device *dev_index_find_path(const struct bus *parent, const struct device_path *path,
+				   bool *indexed);
+
+/*
+ * Perfect hash table over the paths of the static devicetree (DEVTREE_LOOKUP_TABLE), which
+ * sconfig emits into static.c for the stages before ramstage. A slot points to the NULL
+ * terminated list of the devices whose path maps to its key, in all_devices order.
+ */
+struct devtree_lookup_slot {
+	uint32_t key;
+	uint16_t first;
+};
+
+struct devtree_lookup {
+	uint16_t buckets;
+	uint16_t size;
+	const uint16_t *disp;
+	const struct devtree_lookup_slot *slots;
+	DEVTREE_CONST struct device *const *devs;
+};
+
+extern const struct devtree_lookup devtree_lookup;
+
 static inline void mp_cpu_bus_init(struct device *dev)
 {
 	/*
@@ -0,0 +1,16 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#ifndef LZ4_PARALLEL_H
+#define LZ4_PARALLEL_H
+
+#include <stddef.h>
+
+/*
+ * Like ulz4fn(), but the blocks of the frame are decompressed by all CPUs at once. Frames
+ * which can't be split up that way, such as ones decompressed in-place, are handed to
+ * ulz4fn(). Block and content checksums are verified if the frame has them.
+ * Returns amount of decompressed bytes, or 0 on error.
+ */
+size_t ulz4fn_parallel(const void *src, size_t srcn, void *dst, size_t dstn);
+
+#endif /* LZ4_PARALLEL_H */
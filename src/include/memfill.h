@@ -0,0 +1,30 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#ifndef MEMFILL_H
+#define MEMFILL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum memfill_pattern {
+	/* All bits zero. */
+	MEMFILL_ZERO,
+	/* Every word holds its own address. */
+	MEMFILL_ADDRESS,
+};
+
+/*
+ * Write the pattern to [base, base + size). The range is split into chunks, which the APs
+ * help writing in ramstage when PARALLEL_MP_AP_WORK is selected. On x86 with SSE2 the
+ * words are written with non-temporal stores, so the range doesn't pass through the
+ * caches.
+ */
+void memfill(uintptr_t base, size_t size, enum memfill_pattern pattern);
+
+/*
+ * Check that [base, base + size) holds the pattern, using the APs like memfill().
+ * Returns the number of words that don't match.
+ */
+size_t memfill_verify(uintptr_t base, size_t size, enum memfill_pattern pattern);
+
+#endif /* MEMFILL_H */
@@ -48,6 +48,14 @@ int region_file_update_data_arr(struct region_file *f,
 				  size_t num_entries);
 int region_file_update_data(struct region_file *f, const void *buf, size_t size);
 
+/*
+ * Returns 1 if an update of the given size can be appended after the latest
+ * data without emptying the region file first, 0 otherwise. Emptying the file
+ * erases all previous updates, so callers storing data that refers to earlier
+ * updates need to check this before writing.
+ */
+int region_file_can_append(const struct region_file *f, size_t size);
+
 /* Declared here for easy object allocation. */
 struct region_file {
 	/* Region device covering file */
@@ -7,6 +7,7 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <program_loading.h>
+#include <xxhash.h>
 
 /* Types of stages that may be stored in stage cache */
 enum {
@@ -56,6 +57,19 @@ struct stage_cache {
 	uint64_t load_addr;
 	uint64_t entry_addr;
 	uint64_t arg;
+	/* xxh64 over the fields above and the cached image, checked before loading. */
+	uint64_t hash;
 };
 
+static inline uint64_t stage_cache_hash(const struct stage_cache *meta, const void *data,
+					size_t size)
+{
+	struct xxh64_state state;
+
+	xxh64_reset(&state, 0);
+	xxh64_update(&state, meta, offsetof(struct stage_cache, hash));
+	xxh64_update(&state, data, size);
+	return xxh64_digest(&state);
+}
+
 #endif /* _STAGE_CACHE_H_ */
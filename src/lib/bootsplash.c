@@ -5,42 +5,149 @@
 #include <console/console.h>
 #include <endian.h>
 #include <bootsplash.h>
+#include <smp/spinlock.h>
 #include <stdlib.h>
+#include <timer.h>
 
 #include "jpeg.h"
 
+#if ENV_X86 && ENV_RAMSTAGE
+#include <cpu/x86/mp.h>
+#endif
 
-void set_bootsplash(unsigned char *framebuffer, unsigned int x_resolution,
-		    unsigned int y_resolution, unsigned int bytes_per_line,
-		    unsigned int fb_resolution)
+/* The parts of the picture are handed out to the CPUs one at a time. */
+static struct {
+	const struct jpeg_decdata *decdata;
+	int parts;
+	int next_part;
+	int done_parts;
+	int error;
+	unsigned int active;
+} job;
+
+DECLARE_SPIN_LOCK(bootsplash_lock)
+
+/*
+ * mp_run_on_aps() only waits for the APs to accept the call, so an AP may enter after
+ * bootsplash_decode() returned and decdata was freed. Parts are therefore claimed while
+ * holding the lock only, against a copy of the part count, and the active count tells
+ * when all CPUs have left.
+ */
+static void bootsplash_worker(void *unused)
+{
+	const struct jpeg_decdata *decdata;
+	int part, ret;
+
+	spin_lock(&bootsplash_lock);
+	job.active++;
+
+	while (job.next_part < job.parts) {
+		part = job.next_part++;
+		decdata = job.decdata;
+		spin_unlock(&bootsplash_lock);
+
+		ret = jpeg_decode_part(decdata, part);
+
+		spin_lock(&bootsplash_lock);
+		if (ret && !job.error)
+			job.error = ret;
+		job.done_parts++;
+	}
+
+	job.active--;
+	spin_unlock(&bootsplash_lock);
+}
+
+static bool bootsplash_done(void)
 {
-	printk(BIOS_INFO, "Setting up bootsplash in %dx%d@%d\n", x_resolution, y_resolution,
-	       fb_resolution);
+	bool done;
+
+	spin_lock(&bootsplash_lock);
+	done = job.done_parts == job.parts && job.active == 0;
+	spin_unlock(&bootsplash_lock);
+
+	return done;
+}
+
+static int bootsplash_decode(const struct jpeg_decdata *decdata)
+{
+	spin_lock(&bootsplash_lock);
+	job.decdata = decdata;
+	job.parts = decdata->parts;
+	job.next_part = 0;
+	job.done_parts = 0;
+	job.error = 0;
+	spin_unlock(&bootsplash_lock);
+
+#if ENV_X86 && ENV_RAMSTAGE
+	/* The BSP takes part as well, so don't wait for the APs to finish. */
+	if (CONFIG(PARALLEL_MP_AP_WORK) && decdata->parts > 1)
+		mp_run_on_aps(bootsplash_worker, NULL, MP_RUN_ON_ALL_CPUS,
+			      1000 * USECS_PER_MSEC);
+#endif
+	bootsplash_worker(NULL);
+
+	while (!bootsplash_done())
+		;
+
+	return job.error;
+}
+
+void set_bootsplash(const struct lb_framebuffer *fb)
+{
+	const struct jpeg_pixel_format format = {
+		.bits_per_pixel = fb->bits_per_pixel,
+		.red_pos = fb->red_mask_pos,
+		.red_size = fb->red_mask_size,
+		.green_pos = fb->green_mask_pos,
+		.green_size = fb->green_mask_size,
+		.blue_pos = fb->blue_mask_pos,
+		.blue_size = fb->blue_mask_size,
+	};
+	unsigned char *framebuffer = (unsigned char *)(uintptr_t)fb->physical_address;
 	struct jpeg_decdata *decdata;
-	unsigned char *jpeg = cbfs_map("bootsplash.jpg", NULL);
+	struct stopwatch sw;
+	size_t size;
+	int ret;
+
+	printk(BIOS_INFO, "Setting up bootsplash in %ux%u@%u\n", fb->x_resolution,
+	       fb->y_resolution, fb->bits_per_pixel);
+	unsigned char *jpeg = cbfs_map("bootsplash.jpg", &size);
 	if (!jpeg) {
 		printk(BIOS_ERR, "Could not find bootsplash.jpg\n");
 		return;
 	}
 
 	int image_width, image_height;
-	jpeg_fetch_size(jpeg, &image_width, &image_height);
+	ret = jpeg_fetch_size(jpeg, size, &image_width, &image_height);
+	if (ret != 0) {
+		printk(BIOS_ERR, "Bootsplash has no valid JPEG header (%d).\n", ret);
+		cbfs_unmap(jpeg);
+		return;
+	}
 
 	printk(BIOS_DEBUG, "Bootsplash image resolution: %dx%d\n", image_width, image_height);
 
-	if (image_width > x_resolution || image_height > y_resolution) {
+	if (image_width > fb->x_resolution || image_height > fb->y_resolution) {
 		printk(BIOS_NOTICE, "Bootsplash image can't fit framebuffer.\n");
 		cbfs_unmap(jpeg);
 		return;
 	}
 
 	/* center image: */
-	framebuffer += (y_resolution - image_height) / 2 * bytes_per_line +
-			(x_resolution - image_width) / 2 * (fb_resolution / 8);
+	framebuffer += (fb->y_resolution - image_height) / 2 * fb->bytes_per_line +
+			(fb->x_resolution - image_width) / 2 * (fb->bits_per_pixel / 8);
 
 	decdata = malloc(sizeof(*decdata));
-	int ret = jpeg_decode(jpeg, framebuffer, image_width, image_height,
-			      bytes_per_line, fb_resolution, decdata);
+	stopwatch_init(&sw);
+	ret = jpeg_decode_init(jpeg, size, framebuffer, fb->bytes_per_line, &format, decdata);
+	if (ret == 0 && (decdata->width != image_width || decdata->height != image_height))
+		ret = ERR_BAD_WIDTH_OR_HEIGHT;
+	if (ret == 0)
+		ret = bootsplash_decode(decdata);
+	if (ret == 0)
+		printk(BIOS_DEBUG, "Bootsplash decoded in %lld ms, %d parts\n",
+		       stopwatch_duration_msecs(&sw), decdata->parts);
 	free(decdata);
 	cbfs_unmap(jpeg);
 	if (ret != 0) {
@@ -145,6 +145,22 @@ static inline bool cbfs_lzma_enabled(void)
 	return true;
 }
 
+static inline bool cbfs_zstd_enabled(void)
+{
+	if (!CONFIG(DECOMPRESS_ZSTD))
+		return false;
+	/* Like LZMA, only used for ramstage and what it loads. */
+	if (ENV_BOOTBLOCK || ENV_SEPARATE_VERSTAGE)
+		return false;
+	if (ENV_ROMSTAGE && CONFIG(POSTCAR_STAGE))
+		return false;
+	if ((ENV_ROMSTAGE || ENV_POSTCAR) && !CONFIG(COMPRESS_RAMSTAGE_ZSTD))
+		return false;
+	if (ENV_SMM)
+		return false;
+	return true;
+}
+
 static bool cbfs_file_hash_mismatch(const void *buffer, size_t size,
 				    const union cbfs_mdata *mdata, bool skip_verification)
 {
@@ -259,6 +275,23 @@ static size_t cbfs_load_and_decompress(const struct region_device *rdev, void *b
 
 		return out_size;
 
+	case CBFS_COMPRESS_ZSTD:
+		if (!cbfs_zstd_enabled())
+			return 0;
+		map = rdev_mmap_full(rdev);
+		if (map == NULL)
+			return 0;
+
+		if (!cbfs_file_hash_mismatch(map, in_size, mdata, skip_verification)) {
+			timestamp_add_now(TS_UZSTD_START);
+			out_size = uzstdn(map, in_size, buffer, buffer_size);
+			timestamp_add_now(TS_UZSTD_END);
+		}
+
+		rdev_munmap(rdev, map);
+
+		return out_size;
+
 	default:
 		return 0;
 	}
@@ -29,6 +29,7 @@ void stage_cache_add(int stage_id, const struct prog *stage)
 	}
 
 	memcpy(c, prog_start(stage), prog_size(stage));
+	meta->hash = stage_cache_hash(meta, c, prog_size(stage));
 }
 
 void stage_cache_add_raw(int stage_id, const void *base, const size_t size)
@@ -89,6 +90,12 @@ void stage_cache_load_stage(int stage_id, struct prog *stage)
 	size = cbmem_entry_size(e);
 	load_addr = (void *)(uintptr_t)meta->load_addr;
 
+	if (stage_cache_hash(meta, c, size) != meta->hash) {
+		printk(BIOS_ERR, "stage_cache %x is corrupted\n",
+				CBMEM_ID_STAGEx_CACHE + stage_id);
+		return;
+	}
+
 	memcpy(load_addr, c, size);
 
 	prog_set_area(stage, load_addr, size);
@@ -151,14 +151,8 @@ static void lb_framebuffer(struct lb_header *header)
 	framebuffer->tag = LB_TAG_FRAMEBUFFER;
 	framebuffer->size = sizeof(*framebuffer);
 
-	if (CONFIG(BOOTSPLASH)) {
-		uint8_t *fb_ptr = (uint8_t *)(uintptr_t)framebuffer->physical_address;
-		unsigned int width = framebuffer->x_resolution;
-		unsigned int height = framebuffer->y_resolution;
-		unsigned int bytes_per_line = framebuffer->bytes_per_line;
-		unsigned int depth = framebuffer->bits_per_pixel;
-		set_bootsplash(fb_ptr, width, height, bytes_per_line, depth);
-	}
+	if (CONFIG(BOOTSPLASH))
+		set_bootsplash(framebuffer);
 }
 
 void lb_add_gpios(struct lb_gpios *gpios, const struct lb_gpio *gpio_table,
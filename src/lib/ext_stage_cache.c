@@ -71,6 +71,7 @@ void stage_cache_add(int stage_id, const struct prog *stage)
 	c = imd_entry_at(imd, e);
 
 	memcpy(c, prog_start(stage), prog_size(stage));
+	meta->hash = stage_cache_hash(meta, c, prog_size(stage));
 }
 
 void stage_cache_add_raw(int stage_id, const void *base, const size_t size)
@@ -143,6 +144,12 @@ void stage_cache_load_stage(int stage_id, struct prog *stage)
 	c = imd_entry_at(imd, e);
 	size = imd_entry_size(e);
 
+	if (stage_cache_hash(meta, c, size) != meta->hash) {
+		printk(BIOS_DEBUG, "Error: stage_cache %x in imd is corrupted\n",
+				CBMEM_ID_STAGEx_CACHE + stage_id);
+		return;
+	}
+
 	memcpy((void *)(uintptr_t)meta->load_addr, c, size);
 
 	prog_set_area(stage, (void *)(uintptr_t)meta->load_addr, size);
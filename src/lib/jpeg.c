@@ -5,996 +5,948 @@
  *
  * written in August 2001 by Michael Schroeder <mls@suse.de>
  *
+ * Baseline sequential DCT only. The Huffman decoder looks up short codes in a
+ * table, the IDCT is the integer AAN one with the scale factors folded into
+ * the quantization tables, and the colors are converted straight into the
+ * pixel format of the output picture.
  */
 
-#define __LITTLE_ENDIAN
 #include <string.h>
 #include "jpeg.h"
-#define ISHIFT 11
-
-#define IFIX(a) ((int)((a) * (1 << ISHIFT) + .5))
-#define IMULT(a, b) (((a) * (b)) >> ISHIFT)
-#define ITOINT(a) ((a) >> ISHIFT)
-
-#ifndef __P
-# define __P(x) x
-#endif
-
-/* special markers */
-#define M_BADHUFF	-1
-#define M_EOF		0x80
-
-struct in {
-	unsigned char *p;
-	unsigned int bits;
-	int left;
-	int marker;
-
-	int (*func) __P((void *));
-	void *data;
-};
-
-/*********************************/
-struct dec_hufftbl;
-struct enc_hufftbl;
-
-union hufftblp {
-	struct dec_hufftbl *dhuff;
-	struct enc_hufftbl *ehuff;
-};
-
-struct scan {
-	int dc;			/* old dc value */
-
-	union hufftblp hudc;
-	union hufftblp huac;
-	int next;		/* when to switch to next scan */
-
-	int cid;		/* component id */
-	int hv;			/* horiz/vert, copied from comp */
-	int tq;			/* quant tbl, copied from comp */
-};
-
-/*********************************/
-
-#define DECBITS 10		/* seems to be the optimum */
-
-struct dec_hufftbl {
-	int maxcode[17];
-	int valptr[16];
-	unsigned char vals[256];
-	unsigned int llvals[1 << DECBITS];
-};
-
-static void decode_mcus __P((struct in *, int *, int, struct scan *, int *));
-static int dec_readmarker __P((struct in *));
-static void dec_makehuff __P((struct dec_hufftbl *, int *, unsigned char *));
-
-static void setinput __P((struct in *, unsigned char *));
-/*********************************/
-
-#undef PREC
-#define PREC int
-
-static void idctqtab __P((unsigned char *, PREC *));
-static void idct __P((int *, int *, PREC *, PREC, int));
-static void scaleidctqtab __P((PREC *, PREC));
-
-/*********************************/
-
-static void initcol __P((PREC[][64]));
-
-static void col221111 __P((int *, unsigned char *, int));
-static void col221111_16 __P((int *, unsigned char *, int));
-static void col221111_32 __P((int *, unsigned char *, int));
-
-/*********************************/
 
 #define M_SOI	0xd8
 #define M_APP0	0xe0
 #define M_DQT	0xdb
 #define M_SOF0	0xc0
+#define M_SOF1	0xc1
+#define M_SOF15	0xcf
 #define M_DHT   0xc4
+#define M_JPG	0xc8
+#define M_DAC	0xcc
 #define M_DRI	0xdd
 #define M_SOS	0xda
 #define M_RST0	0xd0
+#define M_RST7	0xd7
 #define M_EOI	0xd9
 #define M_COM	0xfe
 
-static unsigned char *datap;
+/****************************************************************/
+/**************          header parser            ***************/
+/****************************************************************/
+
+struct in {
+	const unsigned char *p;
+	const unsigned char *end;
+	int truncated;
+};
 
-static int getbyte(void)
+static int getbyte(struct in *in)
 {
-	return *datap++;
+	if (in->p >= in->end) {
+		in->truncated = 1;
+		return 0;
+	}
+	return *in->p++;
 }
 
-static int getword(void)
+static int getword(struct in *in)
 {
 	int c1, c2;
-	c1 = *datap++;
-	c2 = *datap++;
+	c1 = getbyte(in);
+	c2 = getbyte(in);
 	return c1 << 8 | c2;
 }
 
-struct comp {
-	int cid;
-	int hv;
-	int tq;
-};
-
-#define MAXCOMP 4
-struct jpginfo {
-	int nc;			/* number of components */
-	int ns;			/* number of scans */
-	int dri;		/* restart interval */
-	int nm;			/* mcus til next marker */
-	int rm;			/* next restart marker */
-};
-
-static struct jpginfo info;
-static struct comp comps[MAXCOMP];
-
-static struct scan dscans[MAXCOMP];
-
-static unsigned char quant[4][64];
+static void skip(struct in *in, int len)
+{
+	if (len < 0 || len > in->end - in->p) {
+		in->truncated = 1;
+		len = in->end - in->p;
+	}
+	in->p += len;
+}
 
-static struct dec_hufftbl dhuff[4];
+/* Return the next marker, skipping fill bytes. */
+static int getmarker(struct in *in)
+{
+	int m;
 
-#define dec_huffdc (dhuff + 0)
-#define dec_huffac (dhuff + 2)
+	if (getbyte(in) != 0xff)
+		return -1;
+	do
+		m = getbyte(in);
+	while (m == 0xff && !in->truncated);
+	return m;
+}
 
-static struct in glob_in;
+static int is_sof(int m)
+{
+	return m >= M_SOF0 && m <= M_SOF15 && m != M_DHT && m != M_JPG && m != M_DAC;
+}
 
-static int readtables(int till)
+int jpeg_fetch_size(const unsigned char *buf, size_t len, int *width, int *height)
 {
-	int m, l, i, j, lq, pq, tq;
-	int tc, th, tt;
+	struct in in = { buf, buf + len, 0 };
+	int m;
+
+	if (getbyte(&in) != 0xff || getbyte(&in) != M_SOI)
+		return ERR_NO_SOI;
 
 	for (;;) {
-		if (getbyte() != 0xff)
-			return -1;
-		m = getbyte();
-		if (m == till)
+		m = getmarker(&in);
+		if (m < 0 || m == M_SOS || m == M_EOI)
+			return ERR_BAD_TABLES;
+		if (is_sof(m))
 			break;
+		skip(&in, getword(&in) - 2);
+		if (in.truncated)
+			return ERR_TRUNCATED;
+	}
 
-		switch (m) {
-		case 0xc2:
-			return 0;
+	getword(&in);
+	getbyte(&in);
+	*height = getword(&in);
+	*width = getword(&in);
+	return in.truncated ? ERR_TRUNCATED : 0;
+}
 
-		case M_DQT:
-			lq = getword();
-			while (lq > 2) {
-				pq = getbyte();
-				tq = pq & 15;
-				if (tq > 3)
-					return -1;
-				pq >>= 4;
-				if (pq != 0)
-					return -1;
-				for (i = 0; i < 64; i++)
-					quant[tq][i] = getbyte();
-				lq -= 64 + 1;
-			}
-			break;
+static const unsigned char dezigzag[64] = {
+	0, 1, 8, 16, 9, 2, 3, 10,
+	17, 24, 32, 25, 18, 11, 4, 5,
+	12, 19, 26, 33, 40, 48, 41, 34,
+	27, 20, 13, 6, 7, 14, 21, 28,
+	35, 42, 49, 56, 57, 50, 43, 36,
+	29, 22, 15, 23, 30, 37, 44, 51,
+	58, 59, 52, 45, 38, 31, 39, 46,
+	53, 60, 61, 54, 47, 55, 62, 63
+};
 
-		case M_DHT:
-			l = getword();
-			while (l > 2) {
-				int hufflen[16], k;
-				unsigned char huffvals[256];
-
-				tc = getbyte();
-				th = tc & 15;
-				tc >>= 4;
-				tt = tc * 2 + th;
-				if (tc > 1 || th > 1)
-					return -1;
-				for (i = 0; i < 16; i++)
-					hufflen[i] = getbyte();
-				l -= 1 + 16;
-				k = 0;
-				for (i = 0; i < 16; i++) {
-					for (j = 0; j < hufflen[i]; j++)
-						huffvals[k++] = getbyte();
-					l -= hufflen[i];
-				}
-				dec_makehuff(dhuff + tt, hufflen,
-					     huffvals);
-			}
-			break;
+/*
+ * AAN scale factors, cos(k * pi / 16) * sqrt(2) for k > 0, of a row times the
+ * ones of a column. Scaled by 2^14.
+ */
+static const unsigned short aanscales[64] = {
+	16384, 22725, 21407, 19266, 16384, 12873, 8867, 4520,
+	22725, 31521, 29692, 26722, 22725, 17855, 12299, 6270,
+	21407, 29692, 27969, 25172, 21407, 16819, 11585, 5906,
+	19266, 26722, 25172, 22654, 19266, 15137, 10426, 5315,
+	16384, 22725, 21407, 19266, 16384, 12873, 8867, 4520,
+	12873, 17855, 16819, 15137, 12873, 10114, 6967, 3552,
+	8867, 12299, 11585, 10426, 8867, 6967, 4799, 2446,
+	4520, 6270, 5906, 5315, 4520, 3552, 2446, 1247
+};
 
-		case M_DRI:
-			l = getword();
-			info.dri = getword();
-			break;
+/*
+ * Fraction bits of the dequantized coefficients, kept through both IDCT
+ * passes. With fewer, the AAN scale factors of the high frequencies round
+ * away at the small quantizers of high quality pictures.
+ */
+#define PASS1_BITS 4
 
-		default:
-			l = getword();
-			while (l-- > 2)
-				getbyte();
-			break;
+static int read_dqt(struct in *in, struct jpeg_decdata *d)
+{
+	int l, pq, tq, i, q;
+
+	l = getword(in) - 2;
+	while (l > 0 && !in->truncated) {
+		pq = getbyte(in);
+		tq = pq & 15;
+		pq >>= 4;
+		if (tq > 3 || pq > 1)
+			return ERR_BAD_TABLES;
+		for (i = 0; i < 64; i++) {
+			q = pq ? getword(in) : getbyte(in);
+			/* Tables are in zigzag order, like the coefficients. */
+			d->dquant[tq][i] = (q * aanscales[dezigzag[i]] +
+					    (1 << (13 - PASS1_BITS))) >> (14 - PASS1_BITS);
 		}
+		l -= 1 + 64 * (pq + 1);
 	}
 	return 0;
 }
 
-static void dec_initscans(void)
+static int build_huffman(struct jpeg_huffman *hu, const unsigned char *counts,
+			 const unsigned char *vals, int total)
 {
-	int i;
+	int len, i, j, k, code, fill;
 
-	info.nm = info.dri + 1;
-	info.rm = M_RST0;
-	for (i = 0; i < info.ns; i++)
-		dscans[i].dc = 0;
-}
+	memset(hu->lookup, 0, sizeof(hu->lookup));
+	memcpy(hu->vals, vals, total);
 
-static int dec_checkmarker(void)
-{
-	int i;
-
-	if (dec_readmarker(&glob_in) != info.rm)
-		return -1;
-	info.nm = info.dri;
-	info.rm = (info.rm + 1) & ~0x08;
-	for (i = 0; i < info.ns; i++)
-		dscans[i].dc = 0;
+	code = 0;
+	k = 0;
+	for (len = 1; len <= 16; len++) {
+		hu->valoffset[len] = k - code;
+		for (i = 0; i < counts[len - 1]; i++, k++, code++) {
+			/* More codes than fit in len bits. */
+			if (code >= (1 << len))
+				return ERR_BAD_TABLES;
+			if (len > JPEG_HUFF_LOOKAHEAD)
+				continue;
+			fill = 1 << (JPEG_HUFF_LOOKAHEAD - len);
+			for (j = 0; j < fill; j++)
+				hu->lookup[code * fill + j] = len << 8 | vals[k];
+		}
+		hu->maxcode[len] = counts[len - 1] ? code - 1 : -1;
+		code <<= 1;
+	}
 	return 0;
 }
 
-void jpeg_fetch_size(unsigned char *buf, int *width, int *height)
+static int read_dht(struct in *in, struct jpeg_decdata *d)
 {
-	datap = buf;
-	getbyte();
-	getbyte();
-	readtables(M_SOF0);
-	getword();
-	getbyte();
-	*height = getword();
-	*width = getword();
-}
-
-int jpeg_check_size(unsigned char *buf, int width, int height)
-{
-	datap = buf;
-	getbyte();
-	getbyte();
-	readtables(M_SOF0);
-	getword();
-	getbyte();
-	if (height != getword() || width != getword())
-		return 0;
-	return 1;
+	unsigned char counts[16], vals[256];
+	int l, tc, th, i, total;
+
+	l = getword(in) - 2;
+	while (l > 0 && !in->truncated) {
+		tc = getbyte(in);
+		th = tc & 15;
+		tc >>= 4;
+		if (tc > 1 || th > 3)
+			return ERR_BAD_TABLES;
+		total = 0;
+		for (i = 0; i < 16; i++) {
+			counts[i] = getbyte(in);
+			total += counts[i];
+		}
+		if (total > 256)
+			return ERR_BAD_TABLES;
+		for (i = 0; i < total; i++)
+			vals[i] = getbyte(in);
+		if (build_huffman(tc ? &d->ac[th] : &d->dc[th], counts, vals, total))
+			return ERR_BAD_TABLES;
+		d->tables_defined |= 1 << (tc * 4 + th);
+		l -= 1 + 16 + total;
+	}
+	return 0;
 }
 
-int jpeg_decode(unsigned char *buf, unsigned char *pic,
-		int width, int height, int bytes_per_line, int depth,
-		struct jpeg_decdata *decdata)
+static int read_sof(struct in *in, struct jpeg_decdata *d)
 {
-	int i, j, m, tac, tdc;
-	int mcusx, mcusy, mx, my;
-	int max[6];
+	struct jpeg_component *c;
+	int i;
 
-	if (!decdata || !buf || !pic)
-		return -1;
-	datap = buf;
-	if (getbyte() != 0xff)
-		return ERR_NO_SOI;
-	if (getbyte() != M_SOI)
-		return ERR_NO_SOI;
-	if (readtables(M_SOF0))
-		return ERR_BAD_TABLES;
-	getword();
-	i = getbyte();
-	if (i != 8)
+	getword(in);
+	if (getbyte(in) != 8)
 		return ERR_NOT_8BIT;
-	if (((getword() + 15) & ~15) != height)
-		return ERR_HEIGHT_MISMATCH;
-	if (((getword() + 15) & ~15) != width)
-		return ERR_WIDTH_MISMATCH;
-	if ((height & 15) || (width & 15))
+	d->height = getword(in);
+	d->width = getword(in);
+	if (d->height <= 0 || d->width <= 0)
 		return ERR_BAD_WIDTH_OR_HEIGHT;
-	info.nc = getbyte();
-	if (info.nc > MAXCOMP)
+	d->nc = getbyte(in);
+	if (d->nc > JPEG_MAX_COMPS)
 		return ERR_TOO_MANY_COMPPS;
-	for (i = 0; i < info.nc; i++) {
-		int h, v;
-		comps[i].cid = getbyte();
-		comps[i].hv = getbyte();
-		v = comps[i].hv & 15;
-		h = comps[i].hv >> 4;
-		comps[i].tq = getbyte();
-		if (h > 3 || v > 3)
+	if (d->nc != 1 && d->nc != 3)
+		return ERR_UNSUPPORTED_SAMPLING;
+
+	d->hmax = d->vmax = 1;
+	for (i = 0; i < d->nc; i++) {
+		c = &d->comps[i];
+		c->cid = getbyte(in);
+		c->v = getbyte(in);
+		c->h = c->v >> 4;
+		c->v &= 15;
+		c->tq = getbyte(in);
+		if (c->h < 1 || c->h > 2 || c->v < 1 || c->v > 2)
 			return ERR_ILLEGAL_HV;
-		if (comps[i].tq > 3)
+		if (c->tq > 3)
 			return ERR_QUANT_TABLE_SELECTOR;
+		if (d->nc == 1)
+			c->h = c->v = 1;	/* Non-interleaved, one block per MCU. */
+		if (c->h > d->hmax)
+			d->hmax = c->h;
+		if (c->v > d->vmax)
+			d->vmax = c->v;
 	}
-	if (readtables(M_SOS))
-		return ERR_BAD_TABLES;
-	getword();
-	info.ns = getbyte();
-	if (info.ns != 3)
-		return ERR_NOT_YCBCR_221111;
-	for (i = 0; i < 3; i++) {
-		dscans[i].cid = getbyte();
-		tdc = getbyte();
-		tac = tdc & 15;
-		tdc >>= 4;
-		if (tdc > 1 || tac > 1)
-			return ERR_QUANT_TABLE_SELECTOR;
-		for (j = 0; j < info.nc; j++)
-			if (comps[j].cid == dscans[i].cid)
+	d->mcusx = (d->width + 8 * d->hmax - 1) / (8 * d->hmax);
+	d->mcusy = (d->height + 8 * d->vmax - 1) / (8 * d->vmax);
+	return 0;
+}
+
+static int read_sos(struct in *in, struct jpeg_decdata *d)
+{
+	struct jpeg_component *c;
+	int i, j, ns, cid, t;
+
+	getword(in);
+	ns = getbyte(in);
+	if (ns != d->nc)
+		return ERR_UNSUPPORTED_SAMPLING;
+	for (i = 0; i < ns; i++) {
+		cid = getbyte(in);
+		for (j = 0; j < d->nc; j++)
+			if (d->comps[j].cid == cid)
 				break;
-		if (j == info.nc)
+		if (j == d->nc)
 			return ERR_UNKNOWN_CID_IN_SCAN;
-		dscans[i].hv = comps[j].hv;
-		dscans[i].tq = comps[j].tq;
-		dscans[i].hudc.dhuff = dec_huffdc + tdc;
-		dscans[i].huac.dhuff = dec_huffac + tac;
+		d->scan_comp[i] = j;
+		c = &d->comps[j];
+		t = getbyte(in);
+		c->td = t >> 4;
+		c->ta = t & 15;
+		if (c->td > 3 || c->ta > 3)
+			return ERR_QUANT_TABLE_SELECTOR;
+		if (!(d->tables_defined & (1 << c->td)) ||
+		    !(d->tables_defined & (1 << (4 + c->ta))))
+			return ERR_BAD_TABLES;
 	}
 
-	i = getbyte();
-	j = getbyte();
-	m = getbyte();
-
-	if (i != 0 || j != 63 || m != 0)
+	/* Spectral selection and successive approximation */
+	i = getbyte(in);
+	j = getbyte(in);
+	t = getbyte(in);
+	if (i != 0 || j != 63 || t != 0)
 		return ERR_NOT_SEQUENTIAL_DCT;
+	return 0;
+}
 
-	if (dscans[0].cid != 1 || dscans[1].cid != 2 || dscans[2].cid != 3)
-		return ERR_NOT_YCBCR_221111;
-
-	if (dscans[0].hv != 0x22 || dscans[1].hv != 0x11
-		|| dscans[2].hv != 0x11)
-		return ERR_NOT_YCBCR_221111;
-
-	mcusx = width >> 4;
-	mcusy = height >> 4;
-
-
-	idctqtab(quant[dscans[0].tq], decdata->dquant[0]);
-	idctqtab(quant[dscans[1].tq], decdata->dquant[1]);
-	idctqtab(quant[dscans[2].tq], decdata->dquant[2]);
-	initcol(decdata->dquant);
-	setinput(&glob_in, datap);
-
-	dec_initscans();
-
-	dscans[0].next = 6 - 4;
-	dscans[1].next = 6 - 4 - 1;
-	dscans[2].next = 6 - 4 - 1 - 1;	/* 411 encoding */
-	for (my = 0; my < mcusy; my++) {
-		for (mx = 0; mx < mcusx; mx++) {
-			if (info.dri && !--info.nm)
-				if (dec_checkmarker())
-					return ERR_WRONG_MARKER;
-
-			decode_mcus(&glob_in, decdata->dcts, 6, dscans, max);
-			idct(decdata->dcts, decdata->out, decdata->dquant[0],
-				IFIX(128.5), max[0]);
-			idct(decdata->dcts + 64, decdata->out + 64,
-				decdata->dquant[0], IFIX(128.5), max[1]);
-			idct(decdata->dcts + 128, decdata->out + 128,
-				decdata->dquant[0], IFIX(128.5), max[2]);
-			idct(decdata->dcts + 192, decdata->out + 192,
-				decdata->dquant[0], IFIX(128.5), max[3]);
-			idct(decdata->dcts + 256, decdata->out + 256,
-				decdata->dquant[1], IFIX(0.5), max[4]);
-			idct(decdata->dcts + 320, decdata->out + 320,
-				decdata->dquant[2], IFIX(0.5), max[5]);
-
-			switch (depth) {
-			case 32:
-				col221111_32(decdata->out,
-					pic + my * 16 * bytes_per_line + mx * 16 * 4,
-					bytes_per_line);
-				break;
-			case 24:
-				col221111(decdata->out,
-					pic + my * 16 * bytes_per_line + mx * 16 * 3,
-					bytes_per_line);
-				break;
-			case 16:
-				col221111_16(decdata->out,
-					pic + my * 16 * bytes_per_line + mx * 16 * 2,
-					bytes_per_line);
-				break;
-			default:
-				return ERR_DEPTH_MISMATCH;
-			}
+/*
+ * Find the restart markers in the entropy coded data, and where each part
+ * starts. The data ends with the EOI marker.
+ */
+static int find_parts(const unsigned char *p, const unsigned char *end,
+		      struct jpeg_decdata *d)
+{
+	const int mcus = d->mcusx * d->mcusy;
+	const int intervals = d->dri ? (mcus + d->dri - 1) / d->dri : 1;
+	int interval = 0;
+
+	d->parts = intervals < JPEG_MAX_PARTS ? intervals : JPEG_MAX_PARTS;
+	d->intervals_per_part = (intervals + d->parts - 1) / d->parts;
+	d->parts = (intervals + d->intervals_per_part - 1) / d->intervals_per_part;
+	d->part_start[0] = p;
+
+	for (;;) {
+		p = memchr(p, 0xff, end - p);
+		if (!p || p + 1 >= end)
+			return ERR_NO_EOI;
+		if (p[1] == 0x00) {
+			p += 2;
+		} else if (p[1] == 0xff) {
+			p++;
+		} else if (p[1] >= M_RST0 && p[1] <= M_RST7) {
+			if (!d->dri || p[1] != M_RST0 + (interval & 7))
+				return ERR_WRONG_MARKER;
+			p += 2;
+			interval++;
+			if (interval >= intervals)
+				return ERR_WRONG_MARKER;
+			if (interval % d->intervals_per_part == 0)
+				d->part_start[interval / d->intervals_per_part] = p;
+		} else if (p[1] == M_EOI) {
+			break;
+		} else {
+			return ERR_NO_EOI;
 		}
 	}
 
-	m = dec_readmarker(&glob_in);
-	if (m != M_EOI)
-		return ERR_NO_EOI;
-
+	if (interval != intervals - 1)
+		return ERR_WRONG_MARKER;
+	d->scan_end = p;
 	return 0;
 }
 
 /****************************************************************/
-/**************       huffman decoder             ***************/
+/**************          color tables             ***************/
 /****************************************************************/
 
-static int fillbits __P((struct in *, int, unsigned int));
-static int dec_rec2
-__P((struct in *, struct dec_hufftbl *, int *, int, int));
+/*
+ * YCbCr Color transformation:
+ *
+ * y:0..255   Cb:-128..127   Cr:-128..127
+ *
+ *      R = Y                + 1.40200 * Cr
+ *      G = Y - 0.34414 * Cb - 0.71414 * Cr
+ *      B = Y + 1.77200 * Cb
+ *
+ * The products are kept in tables, scaled by 2^16 for G.
+ */
+#define COLOR_SHIFT 16
+#define FIX_1_40200 91881
+#define FIX_0_34414 22554
+#define FIX_0_71414 46802
+#define FIX_1_77200 116130
 
-static void setinput(struct in *in, unsigned char *p)
+static uint32_t channel_value(int value, unsigned int pos, unsigned int size)
 {
-	in->p = p;
-	in->left = 0;
-	in->bits = 0;
-	in->marker = 0;
+	if (value < 0)
+		value = 0;
+	if (value > 255)
+		value = 255;
+	if (size > 8)
+		size = 8;
+	return (uint32_t)(value >> (8 - size)) << pos;
 }
 
-static int fillbits(struct in *in, int le, unsigned int bi)
+static int init_colors(const struct jpeg_pixel_format *format, struct jpeg_decdata *d)
 {
-	int b, m;
-
-	if (in->marker) {
-		if (le <= 16)
-			in->bits = bi << 16, le += 16;
-		return le;
+	int i, c;
+
+	if (format->bits_per_pixel != 16 && format->bits_per_pixel != 24 &&
+	    format->bits_per_pixel != 32)
+		return ERR_DEPTH_MISMATCH;
+	if (format->red_pos + format->red_size > format->bits_per_pixel ||
+	    format->green_pos + format->green_size > format->bits_per_pixel ||
+	    format->blue_pos + format->blue_size > format->bits_per_pixel)
+		return ERR_DEPTH_MISMATCH;
+	d->bytes_per_pixel = format->bits_per_pixel / 8;
+
+	for (i = 0; i < 768; i++) {
+		d->red[i] = channel_value(i - 256, format->red_pos, format->red_size);
+		d->green[i] = channel_value(i - 256, format->green_pos, format->green_size);
+		d->blue[i] = channel_value(i - 256, format->blue_pos, format->blue_size);
 	}
-	while (le <= 24) {
-		b = *in->p++;
-		if (b == 0xff) {
-			m = *in->p++;
-			if (m != 0) {
-				if (m == M_EOF) {
-					if (in->func) {
-						m = in->func(in->data);
-						if (m == 0)
-							continue;
-					}
-				}
-				in->marker = m;
-				if (le <= 16)
-					bi = bi << 16, le += 16;
-				break;
-			}
-		}
-		bi = bi << 8 | b;
-		le += 8;
+
+	for (i = 0; i < 256; i++) {
+		c = i - 128;
+		d->cr_r[i] = (FIX_1_40200 * c + (1 << (COLOR_SHIFT - 1))) >> COLOR_SHIFT;
+		d->cb_b[i] = (FIX_1_77200 * c + (1 << (COLOR_SHIFT - 1))) >> COLOR_SHIFT;
+		d->cr_g[i] = -FIX_0_71414 * c;
+		d->cb_g[i] = -FIX_0_34414 * c + (1 << (COLOR_SHIFT - 1));
 	}
-	in->bits = bi;		/* tmp... 2 return values needed */
-	return le;
+	return 0;
 }
 
-static int dec_readmarker(struct in *in)
+int jpeg_decode_init(const unsigned char *buf, size_t len, unsigned char *pic,
+		     int bytes_per_line, const struct jpeg_pixel_format *format,
+		     struct jpeg_decdata *d)
 {
-	int m;
+	struct in in = { buf, buf + len, 0 };
+	int m, ret = 0, have_sof = 0;
 
-	in->left = fillbits(in, in->left, in->bits);
-	m = in->marker;
-	if (m == 0)
-		return 0;
-	in->left = 0;
-	in->marker = 0;
-	return m;
-}
+	if (!d || !buf || !pic || !format)
+		return -1;
 
-#define LEBI_DCL	int le, bi
-#define LEBI_GET(in)	(le = in->left, bi = in->bits)
-#define LEBI_PUT(in)	(in->left = le, in->bits = bi)
+	memset(d, 0, offsetof(struct jpeg_decdata, pic));
+	d->pic = pic;
+	d->bytes_per_line = bytes_per_line;
+	ret = init_colors(format, d);
+	if (ret)
+		return ret;
 
-#define GETBITS(in, n) (						\
-	(le < (n) ? le = fillbits(in, le, bi), bi = in->bits : 0),	\
-	(le -= (n)),							\
-	bi >> le & ((1 << (n)) - 1)					\
-	)
+	if (getbyte(&in) != 0xff || getbyte(&in) != M_SOI)
+		return ERR_NO_SOI;
 
-#define UNGETBITS(in, n) (	\
-	le += (n)			\
-)
+	for (;;) {
+		m = getmarker(&in);
+		if (in.truncated)
+			return ERR_TRUNCATED;
+
+		if (m == M_SOF0 || m == M_SOF1) {
+			/* Callers size the picture for the first SOF only. */
+			if (have_sof)
+				return ERR_BAD_TABLES;
+			ret = read_sof(&in, d);
+			have_sof = 1;
+		} else if (is_sof(m)) {
+			return ERR_NOT_SEQUENTIAL_DCT;
+		} else if (m == M_DQT) {
+			ret = read_dqt(&in, d);
+		} else if (m == M_DHT) {
+			ret = read_dht(&in, d);
+		} else if (m == M_DRI) {
+			getword(&in);
+			d->dri = getword(&in);
+		} else if (m == M_SOS) {
+			if (!have_sof)
+				return ERR_BAD_TABLES;
+			ret = read_sos(&in, d);
+			break;
+		} else if (m < 0 || m == M_EOI || m == M_SOI) {
+			return ERR_BAD_TABLES;
+		} else {
+			skip(&in, getword(&in) - 2);
+		}
+
+		if (ret)
+			return ret;
+	}
+
+	if (ret)
+		return ret;
+	if (in.truncated)
+		return ERR_TRUNCATED;
 
+	return find_parts(in.p, in.end, d);
+}
 
-static int dec_rec2(struct in *in, struct dec_hufftbl *hu, int *runp, int c,
-		int i)
+/****************************************************************/
+/**************       huffman decoder             ***************/
+/****************************************************************/
+
+/* Bits are read from the top of 'bits', which holds 'count' of them. */
+struct bitreader {
+	const unsigned char *p;
+	const unsigned char *end;
+	uint32_t bits;
+	int count;
+};
+
+static void setinput(struct bitreader *br, const unsigned char *p, const unsigned char *end)
 {
-	LEBI_DCL;
-
-	LEBI_GET(in);
-	if (i) {
-		UNGETBITS(in, i & 127);
-		*runp = i >> 8 & 15;
-		i >>= 16;
-	} else {
-		for (i = DECBITS; (c = ((c << 1) | GETBITS(in, 1)))
-			>= (hu->maxcode[i]); i++)
-			;
-		if (i >= 16) {
-			in->marker = M_BADHUFF;
-			return 0;
-		}
-		i = hu->vals[hu->valptr[i] + c - hu->maxcode[i - 1] * 2];
-		*runp = i >> 4;
-		i &= 15;
-	}
-	if (i == 0) {		/* sigh, 0xf0 is 11 bit */
-		LEBI_PUT(in);
-		return 0;
-	}
-	/* receive part */
-	c = GETBITS(in, i);
-	if (c < (1 << (i - 1)))
-		c += (-1 << i) + 1;
-	LEBI_PUT(in);
-	return c;
+	br->p = p;
+	br->end = end;
+	br->bits = 0;
+	br->count = 0;
 }
 
-#define DEC_REC(in, hu, r, i)	(		\
-	r = GETBITS(in, DECBITS),		\
-	i = hu->llvals[r],			\
-	i & 128 ?				\
-	(					\
-		UNGETBITS(in, i & 127),		\
-		r = i >> 8 & 15,		\
-		i >> 16				\
-	)					\
-	:					\
-	(					\
-		LEBI_PUT(in),			\
-		i = dec_rec2(in, hu, &r, r, i),	\
-		LEBI_GET(in),			\
-		i				\
-	)					\
-)
-
-static void decode_mcus(struct in *in, int *dct, int n, struct scan *sc,
-	int *maxp)
+/* Make sure there are at least 25 bits. At a marker, zeros are fed instead. */
+static inline void fillbits(struct bitreader *br)
 {
-	struct dec_hufftbl *hu;
-	int i, r, t;
-	LEBI_DCL;
-
-	memset(dct, 0, n * 64 * sizeof(*dct));
-	LEBI_GET(in);
-	while (n-- > 0) {
-		hu = sc->hudc.dhuff;
-		*dct++ = (sc->dc += DEC_REC(in, hu, r, t));
-
-		hu = sc->huac.dhuff;
-		i = 63;
-		while (i > 0) {
-			t = DEC_REC(in, hu, r, t);
-			if (t == 0 && r == 0) {
-				dct += i;
-				break;
+	uint32_t b;
+
+	while (br->count <= 24) {
+		b = 0;
+		if (br->p < br->end) {
+			b = *br->p;
+			if (b != 0xff) {
+				br->p++;
+			} else if (br->p[1] == 0) {
+				br->p += 2;
+			} else {
+				/* Stop at the marker. */
+				br->end = br->p;
+				b = 0;
 			}
-			dct += r;
-			*dct++ = t;
-			i -= r + 1;
 		}
-		*maxp++ = 64 - i;
-		if (n == sc->next)
-			sc++;
+		br->bits |= b << (24 - br->count);
+		br->count += 8;
 	}
-	LEBI_PUT(in);
 }
 
-static void dec_makehuff(struct dec_hufftbl *hu, int *hufflen,
-	unsigned char *huffvals)
+static inline uint32_t getbits(struct bitreader *br, int n)
+{
+	uint32_t v = br->bits >> (32 - n);
+
+	br->bits <<= n;
+	br->count -= n;
+	return v;
+}
+
+/* Read an n bit coefficient, and extend its sign. */
+static inline int receive_extend(struct bitreader *br, int n)
+{
+	int v;
+
+	if (!n)
+		return 0;
+	if (br->count < n)
+		fillbits(br);
+	v = getbits(br, n);
+	if (v < (1 << (n - 1)))
+		v += 1 - (1 << n);
+	return v;
+}
+
+/* Returns the symbol, or -1 for an invalid code. */
+static inline int decode_huffman(struct bitreader *br, const struct jpeg_huffman *hu)
 {
-	int code, k, i, j, d, x, c, v;
-	for (i = 0; i < (1 << DECBITS); i++)
-		hu->llvals[i] = 0;
+	uint32_t code;
+	int e, len;
+
+	fillbits(br);
+	e = hu->lookup[br->bits >> (32 - JPEG_HUFF_LOOKAHEAD)];
+	if (e) {
+		br->bits <<= e >> 8;
+		br->count -= e >> 8;
+		return e & 0xff;
+	}
+
+	for (len = JPEG_HUFF_LOOKAHEAD + 1; len <= 16; len++) {
+		code = br->bits >> (32 - len);
+		if ((int32_t)code <= hu->maxcode[len]) {
+			br->bits <<= len;
+			br->count -= len;
+			return hu->vals[hu->valoffset[len] + code];
+		}
+	}
+	return -1;
+}
 
 /*
- * llvals layout:
- *
- * value v already known, run r, backup u bits:
- *  vvvvvvvvvvvvvvvv 0000 rrrr 1 uuuuuuu
- * value unknown, size b bits, run r, backup u bits:
- *  000000000000bbbb 0000 rrrr 0 uuuuuuu
- * value and size unknown:
- *  0000000000000000 0000 0000 0 0000000
+ * Decode a block into dequantized coefficients, in natural order. Returns the
+ * number of coefficients up to the last one that isn't zero, or -1 on errors.
  */
-	code = 0;
-	k = 0;
-	for (i = 0; i < 16; i++, code <<= 1) {	/* sizes */
-		hu->valptr[i] = k;
-		for (j = 0; j < hufflen[i]; j++) {
-			hu->vals[k] = *huffvals++;
-			if (i < DECBITS) {
-				c = code << (DECBITS - 1 - i);
-				v = hu->vals[k] & 0x0f;	/* size */
-				for (d = 1 << (DECBITS - 1 - i); --d >= 0;) {
-					/* both fit in table */
-					if (v + i < DECBITS) {
-						x = d >> (DECBITS - 1 - v -
-							  i);
-						if (v && x < (1 << (v - 1)))
-							x += (-1 << v) + 1;
-						x = x << 16 | (hu->vals[k]
-							& 0xf0) << 4 |
-							(DECBITS - (i + 1 + v))
-							| 128;
-					} else
-						x = v << 16 | (hu->vals[k]
-							& 0xf0) << 4 |
-							(DECBITS - (i + 1));
-					hu->llvals[c | d] = x;
-				}
-			}
-			code++;
-			k++;
+static int decode_block(struct bitreader *br, const struct jpeg_huffman *dc,
+			const struct jpeg_huffman *ac, const int32_t *dquant,
+			int *pred, int32_t *coef)
+{
+	int k, s, r, last = 1;
+
+	s = decode_huffman(br, dc);
+	if (s < 0 || s > 11)
+		return -1;
+	*pred += receive_extend(br, s);
+	coef[0] = *pred * dquant[0];
+
+	for (k = 1; k < 64; k++) {
+		s = decode_huffman(br, ac);
+		if (s < 0)
+			return -1;
+		r = s >> 4;
+		s &= 15;
+		if (s > 10)
+			return -1;
+		if (!s) {
+			if (r != 15)
+				break;		/* EOB */
+			k += 15;		/* ZRL */
+			continue;
 		}
-		hu->maxcode[i] = code;
+		k += r;
+		if (k > 63)
+			return -1;
+		coef[dezigzag[k]] = receive_extend(br, s) * dquant[k];
+		last = k + 1;
 	}
-	hu->maxcode[16] = 0x20000;	/* always terminate decode */
+	return last;
 }
 
 /****************************************************************/
 /**************             idct                  ***************/
 /****************************************************************/
 
-#define ONE ((PREC)IFIX(1.))
-#define S2  ((PREC)IFIX(0.382683432))
-#define C2  ((PREC)IFIX(0.923879532))
-#define C4  ((PREC)IFIX(0.707106781))
-
-#define S22 ((PREC)IFIX(2 * 0.382683432))
-#define C22 ((PREC)IFIX(2 * 0.923879532))
-#define IC4 ((PREC)IFIX(1 / 0.707106781))
-
-#define C3IC1 ((PREC)IFIX(0.847759065))	/* c3/c1 */
-#define C5IC1 ((PREC)IFIX(0.566454497))	/* c5/c1 */
-#define C7IC1 ((PREC)IFIX(0.198912367))	/* c7/c1 */
-
-#define XPP(a, b) (t = a + b, b = a - b, a = t)
-#define XMP(a, b) (t = a - b, b = a + b, a = t)
-#define XPM(a, b) (t = a + b, b = b - a, a = t)
-
-#define ROT(a, b, s, c) (t = IMULT(a + b, s),	\
-			a = IMULT(a, c - s) + t,	\
-			b = IMULT(b, c + s) - t)
-
-#define IDCT				\
-(					\
-	XPP(t0, t1),			\
-	XMP(t2, t3),			\
-	t2 = IMULT(t2, IC4) - t3,	\
-	XPP(t0, t3),			\
-	XPP(t1, t2),			\
-	XMP(t4, t7),			\
-	XPP(t5, t6),			\
-	XMP(t5, t7),			\
-	t5 = IMULT(t5, IC4),		\
-	ROT(t4, t6, S22, C22),		\
-	t6 -= t7,			\
-	t5 -= t6,			\
-	t4 -= t5,			\
-	XPP(t0, t7),			\
-	XPP(t1, t6),			\
-	XPP(t2, t5),			\
-	XPP(t3, t4)			\
-)
-
-static unsigned char zig2[64] = {
-	0, 2, 3, 9, 10, 20, 21, 35,
-	14, 16, 25, 31, 39, 46, 50, 57,
-	5, 7, 12, 18, 23, 33, 37, 48,
-	27, 29, 41, 44, 52, 55, 59, 62,
-	15, 26, 30, 40, 45, 51, 56, 58,
-	1, 4, 8, 11, 19, 22, 34, 36,
-	28, 42, 43, 53, 54, 60, 61, 63,
-	6, 13, 17, 24, 32, 38, 47, 49
-};
+/*
+ * The integer AAN IDCT, with the scale factors already applied when
+ * dequantizing. The multipliers are scaled by 2^8.
+ */
+#define CONST_BITS	8
+#define FIX_1_082392200	277
+#define FIX_1_414213562	362
+#define FIX_1_847759065	473
+#define FIX_2_613125930	669
+
+#define MULTIPLY(v, c)	(((v) * (c) + (1 << (CONST_BITS - 1))) >> CONST_BITS)
+
+/* The 1D transform of in[0], in[stride] ... in[7 * stride], in place. */
+#define IDCT_1D(in, stride)						\
+	do {								\
+		int32_t x0 = in[0], x1 = in[stride];			\
+		int32_t x2 = in[2 * stride], x3 = in[3 * stride];	\
+		int32_t x4 = in[4 * stride], x5 = in[5 * stride];	\
+		int32_t x6 = in[6 * stride], x7 = in[7 * stride];	\
+		int32_t tmp0, tmp1, tmp2, tmp3, tmp4, tmp5, tmp6, tmp7;	\
+		int32_t tmp10, tmp11, tmp12, tmp13;			\
+		int32_t z5, z10, z11, z12, z13;				\
+									\
+		/* Even part */						\
+		tmp10 = x0 + x4;					\
+		tmp11 = x0 - x4;					\
+		tmp13 = x2 + x6;					\
+		tmp12 = MULTIPLY(x2 - x6, FIX_1_414213562) - tmp13;	\
+		tmp0 = tmp10 + tmp13;					\
+		tmp3 = tmp10 - tmp13;					\
+		tmp1 = tmp11 + tmp12;					\
+		tmp2 = tmp11 - tmp12;					\
+									\
+		/* Odd part */						\
+		z13 = x5 + x3;						\
+		z10 = x5 - x3;						\
+		z11 = x1 + x7;						\
+		z12 = x1 - x7;						\
+		tmp7 = z11 + z13;					\
+		tmp11 = MULTIPLY(z11 - z13, FIX_1_414213562);		\
+		z5 = MULTIPLY(z10 + z12, FIX_1_847759065);		\
+		tmp10 = MULTIPLY(z12, FIX_1_082392200) - z5;		\
+		tmp12 = z5 - MULTIPLY(z10, FIX_2_613125930);		\
+		tmp6 = tmp12 - tmp7;					\
+		tmp5 = tmp11 - tmp6;					\
+		tmp4 = tmp10 + tmp5;					\
+									\
+		in[0] = tmp0 + tmp7;					\
+		in[7 * stride] = tmp0 - tmp7;				\
+		in[1 * stride] = tmp1 + tmp6;				\
+		in[6 * stride] = tmp1 - tmp6;				\
+		in[2 * stride] = tmp2 + tmp5;				\
+		in[5 * stride] = tmp2 - tmp5;				\
+		in[4 * stride] = tmp3 + tmp4;				\
+		in[3 * stride] = tmp3 - tmp4;				\
+	} while (0)
+
+/* Clamp to 0..255 without branches, which mispredict on busy pictures. */
+static inline unsigned char clamp(int32_t x)
+{
+	x &= ~(x >> 31);
+	return x | ((255 - x) >> 31);
+}
 
-void idct(int *in, int *out, PREC *lquant, PREC off, int max)
+/*
+ * Transform the coefficients into samples, 8 per line of 'stride'. 'last' is
+ * the return value of decode_block(). The coefficients are clobbered.
+ */
+static void idct(int32_t *coef, int last, unsigned char *out, int stride)
 {
-	PREC t0, t1, t2, t3, t4, t5, t6, t7, t;
-	PREC tmp[64], *tmpp;
+	/* Level shift and rounding, added to the DC term of each row. */
+	const int32_t bias = (128 << (PASS1_BITS + 3)) + (1 << (PASS1_BITS + 2));
+	int32_t *in;
 	int i, j;
-	unsigned char *zig2p;
 
-	t0 = off;
-	if (max == 1) {
-		t0 += in[0] * lquant[0];
-		for (i = 0; i < 64; i++)
-			out[i] = ITOINT(t0);
+	if (last <= 1) {
+		unsigned char v = clamp((coef[0] + bias) >> (PASS1_BITS + 3));
+		for (i = 0; i < 8; i++)
+			memset(out + i * stride, v, 8);
 		return;
 	}
-	zig2p = zig2;
-	tmpp = tmp;
+
+	/* Columns */
 	for (i = 0; i < 8; i++) {
-		j = *zig2p++;
-		t0 += in[j] * lquant[j];
-		j = *zig2p++;
-		t5 = in[j] * lquant[j];
-		j = *zig2p++;
-		t2 = in[j] * lquant[j];
-		j = *zig2p++;
-		t7 = in[j] * lquant[j];
-		j = *zig2p++;
-		t1 = in[j] * lquant[j];
-		j = *zig2p++;
-		t4 = in[j] * lquant[j];
-		j = *zig2p++;
-		t3 = in[j] * lquant[j];
-		j = *zig2p++;
-		t6 = in[j] * lquant[j];
-		IDCT;
-		tmpp[0 * 8] = t0;
-		tmpp[1 * 8] = t1;
-		tmpp[2 * 8] = t2;
-		tmpp[3 * 8] = t3;
-		tmpp[4 * 8] = t4;
-		tmpp[5 * 8] = t5;
-		tmpp[6 * 8] = t6;
-		tmpp[7 * 8] = t7;
-		tmpp++;
-		t0 = 0;
+		in = coef + i;
+		if (!(in[8] | in[16] | in[24] | in[32] | in[40] | in[48] | in[56])) {
+			for (j = 1; j < 8; j++)
+				in[j * 8] = in[0];
+			continue;
+		}
+		IDCT_1D(in, 8);
 	}
-	for (i = 0; i < 8; i++) {
-		t0 = tmp[8 * i + 0];
-		t1 = tmp[8 * i + 1];
-		t2 = tmp[8 * i + 2];
-		t3 = tmp[8 * i + 3];
-		t4 = tmp[8 * i + 4];
-		t5 = tmp[8 * i + 5];
-		t6 = tmp[8 * i + 6];
-		t7 = tmp[8 * i + 7];
-		IDCT;
-		out[8 * i + 0] = ITOINT(t0);
-		out[8 * i + 1] = ITOINT(t1);
-		out[8 * i + 2] = ITOINT(t2);
-		out[8 * i + 3] = ITOINT(t3);
-		out[8 * i + 4] = ITOINT(t4);
-		out[8 * i + 5] = ITOINT(t5);
-		out[8 * i + 6] = ITOINT(t6);
-		out[8 * i + 7] = ITOINT(t7);
+
+	/* Rows */
+	for (i = 0; i < 8; i++, out += stride) {
+		in = coef + i * 8;
+		in[0] += bias;
+		IDCT_1D(in, 1);
+		for (j = 0; j < 8; j++)
+			out[j] = clamp(in[j] >> (PASS1_BITS + 3));
 	}
 }
 
-static unsigned char zig[64] = {
-	0, 1, 5, 6, 14, 15, 27, 28,
-	2, 4, 7, 13, 16, 26, 29, 42,
-	3, 8, 12, 17, 25, 30, 41, 43,
-	9, 11, 18, 24, 31, 40, 44, 53,
-	10, 19, 23, 32, 39, 45, 52, 54,
-	20, 22, 33, 38, 46, 51, 55, 60,
-	21, 34, 37, 47, 50, 56, 59, 61,
-	35, 36, 48, 49, 57, 58, 62, 63
-};
+/****************************************************************/
+/**************          color decoder            ***************/
+/****************************************************************/
 
-static PREC aaidct[8] = {
-	IFIX(0.3535533906), IFIX(0.4903926402),
-	IFIX(0.4619397663), IFIX(0.4157348062),
-	IFIX(0.3535533906), IFIX(0.2777851165),
-	IFIX(0.1913417162), IFIX(0.0975451610)
+/* Samples of one MCU, each component at 8 * hmax x 8 * vmax at most. */
+struct mcu_samples {
+	unsigned char s[JPEG_MAX_COMPS][16 * 16];
 };
 
-
-static void idctqtab(unsigned char *qin, PREC *qout)
+static void store_pixel(unsigned char *dst, int bytes, uint32_t pixel)
 {
-	int i, j;
-
-	for (i = 0; i < 8; i++)
-		for (j = 0; j < 8; j++)
-			qout[zig[i * 8 + j]] = qin[zig[i * 8 + j]] *
-						IMULT(aaidct[i], aaidct[j]);
+	switch (bytes) {
+	case 4:
+		*(uint32_t *)dst = pixel;
+		break;
+	case 3:
+		dst[0] = pixel;
+		dst[1] = pixel >> 8;
+		dst[2] = pixel >> 16;
+		break;
+	case 2:
+		*(uint16_t *)dst = pixel;
+		break;
+	}
 }
 
-static void scaleidctqtab(PREC *q, PREC sc)
+static inline uint32_t ycc_pixel(const struct jpeg_decdata *d, int luma, int cb, int cr)
 {
-	int i;
-
-	for (i = 0; i < 64; i++)
-		q[i] = IMULT(q[i], sc);
+	return d->red[256 + luma + d->cr_r[cr]] |
+	       d->green[256 + luma + ((d->cb_g[cb] + d->cr_g[cr]) >> COLOR_SHIFT)] |
+	       d->blue[256 + luma + d->cb_b[cb]];
 }
 
-/****************************************************************/
-/**************          color decoder            ***************/
-/****************************************************************/
+/*
+ * An MCU of blocks that have only a DC coefficient, with the chroma in one
+ * block each, is one color per luma block. This is most of a typical boot
+ * splash, which is a logo on a plain background.
+ */
+static int color_flat(const struct jpeg_decdata *d, const struct mcu_samples *ms,
+		      unsigned char *dst, int w, int h)
+{
+	const struct jpeg_component *c = d->comps;
+	const int bytes = d->bytes_per_pixel;
+	int bx, by, x, y, n, cb = 128, cr = 128;
+	unsigned char line[8 * 4], *p;
+	uint32_t pixel;
 
-#define ROUND
+	if (c[0].h != d->hmax || c[0].v != d->vmax)
+		return 0;
+	if (d->nc == 3) {
+		if (c[1].h != 1 || c[1].v != 1 || c[2].h != 1 || c[2].v != 1)
+			return 0;
+		cb = ms->s[1][0];
+		cr = ms->s[2][0];
+	}
+
+	for (by = 0; by < d->vmax && by * 8 < h; by++) {
+		for (bx = 0; bx < d->hmax && bx * 8 < w; bx++) {
+			pixel = ycc_pixel(d, ms->s[0][by * 64 * d->hmax + bx * 8], cb, cr);
+			n = w - bx * 8 < 8 ? w - bx * 8 : 8;
+			for (x = 0; x < n; x++)
+				store_pixel(line + x * bytes, bytes, pixel);
+			p = dst + by * 8 * d->bytes_per_line + bx * 8 * bytes;
+			for (y = by * 8; y < by * 8 + 8 && y < h; y++, p += d->bytes_per_line)
+				memcpy(p, line, n * bytes);
+		}
+	}
+	return 1;
+}
 
 /*
- * YCbCr Color transformation:
- *
- * y:0..255   Cb:-128..127   Cr:-128..127
- *
- *      R = Y                + 1.40200 * Cr
- *      G = Y - 0.34414 * Cb - 0.71414 * Cr
- *      B = Y + 1.77200 * Cb
- *
- * =>
- *      Cr *= 1.40200;
- *      Cb *= 1.77200;
- *      Cg = 0.19421 * Cb + .50937 * Cr;
- *      R = Y + Cr;
- *      G = Y - Cg;
- *      B = Y + Cb;
- *
- * =>
- *      Cg = (50 * Cb + 130 * Cr + 128) >> 8;
+ * The common case of a whole MCU at 32 bpp, with full resolution luma and
+ * both chroma components at the same resolution.
  */
-
-static void initcol(PREC q[][64])
+static void color_mcu_32(const struct jpeg_decdata *d, const struct mcu_samples *ms,
+			 unsigned char *dst)
 {
-	scaleidctqtab(q[1], IFIX(1.77200));
-	scaleidctqtab(q[2], IFIX(1.40200));
+	const uint32_t *red = d->red + 256;
+	const uint32_t *green = d->green + 256;
+	const uint32_t *blue = d->blue + 256;
+	const int sx = d->comps[1].h < d->hmax, sy = d->comps[1].v < d->vmax;
+	const int width = 8 * d->hmax, cstride = 8 * d->comps[1].h;
+	const unsigned char *yrow, *cbrow, *crrow;
+	int x, y, cb, cr, rd, gd, bd, luma;
+	uint32_t *p;
+
+	for (y = 0; y < 8 * d->vmax; y++, dst += d->bytes_per_line) {
+		p = (uint32_t *)dst;
+		yrow = ms->s[0] + y * width;
+		cbrow = ms->s[1] + (y >> sy) * cstride;
+		crrow = ms->s[2] + (y >> sy) * cstride;
+		for (x = 0; x < width; x += 1 + sx) {
+			cb = *cbrow++;
+			cr = *crrow++;
+			rd = d->cr_r[cr];
+			gd = (d->cb_g[cb] + d->cr_g[cr]) >> COLOR_SHIFT;
+			bd = d->cb_b[cb];
+			luma = yrow[x];
+			p[x] = red[luma + rd] | green[luma + gd] | blue[luma + bd];
+			if (sx) {
+				luma = yrow[x + 1];
+				p[x + 1] = red[luma + rd] | green[luma + gd] | blue[luma + bd];
+			}
+		}
+	}
 }
 
-/* This is optimized for the stupid sun SUNWspro compiler. */
-#define STORECLAMP(a, x)			\
-(						\
-	(a) = (x),				\
-	(unsigned int)(x) >= 256 ?		\
-	((a) = (x) < 0 ? 0 : 255)		\
-	:					\
-	0					\
-)
-
-#define CLAMP(x) ((unsigned int)(x) >= 256 ? ((x) < 0 ? 0 : 255) : (x))
-
-#ifdef ROUND
-
-#define CBCRCG(yin, xin)			\
-(						\
-	cb = outc[0  + yin * 8 + xin],		\
-	cr = outc[64 + yin * 8 + xin],		\
-	cg = (50 * cb + 130 * cr + 128) >> 8	\
-)
-
-#else
-
-#define CBCRCG(yin, xin)			\
-(						\
-	cb = outc[0  + yin*8 + xin],		\
-	cr = outc[64 + yin*8 + xin],		\
-	cg = (3 * cb + 8 * cr) >> 4		\
-)
-
-#endif
-
-#define PIC(yin, xin, p, xout)			\
-(						\
-	y = outy[(yin) * 8 + xin],		\
-	STORECLAMP(p[(xout) * 3 + 0], y + cr),	\
-	STORECLAMP(p[(xout) * 3 + 1], y - cg),	\
-	STORECLAMP(p[(xout) * 3 + 2], y + cb)	\
-)
-
-#ifdef __LITTLE_ENDIAN
-#define PIC_16(yin, xin, p, xout, add)				\
-(								\
-	y = outy[(yin) * 8 + xin],				\
-	y = ((CLAMP(y + cr + add*2+1) & 0xf8) <<  8) |		\
-		((CLAMP(y - cg + add)     & 0xfc) <<  3) |	\
-		((CLAMP(y + cb + add*2+1))        >>  3),	\
-	p[(xout) * 2 + 0] = y & 0xff,				\
-	p[(xout) * 2 + 1] = y >> 8				\
-)
-#else
-#ifdef CONFIG_PPC
-#define PIC_16(yin, xin, p, xout, add)				\
-(								\
-	y = outy[(yin) * 8 + xin],				\
-	y = ((CLAMP(y + cr + add*2+1) & 0xf8) <<  7) |		\
-		((CLAMP(y - cg + add*2+1) & 0xf8) <<  2) |	\
-		((CLAMP(y + cb + add*2+1))        >>  3),	\
-	p[(xout) * 2 + 0] = y >> 8,				\
-	p[(xout) * 2 + 1] = y & 0xff				\
-)
-#else
-#define PIC_16(yin, xin, p, xout, add)				\
-(								\
-	y = outy[(yin) * 8 + xin],				\
-	y = ((CLAMP(y + cr + add*2+1) & 0xf8) <<  8) |		\
-		((CLAMP(y - cg + add)     & 0xfc) <<  3) |	\
-		((CLAMP(y + cb + add*2+1))        >>  3),	\
-	p[(xout) * 2 + 0] = y >> 8,				\
-	p[(xout) * 2 + 1] = y & 0xff				\
-)
-#endif
-#endif
-
-#define PIC_32(yin, xin, p, xout)		\
-(						\
-	y = outy[(yin) * 8 + xin],		\
-	STORECLAMP(p[(xout) * 4 + 0], y + cr),	\
-	STORECLAMP(p[(xout) * 4 + 1], y - cg),	\
-	STORECLAMP(p[(xout) * 4 + 2], y + cb),	\
-	p[(xout) * 4 + 3] = 0			\
-)
-
-#define PIC221111(xin)							\
-(									\
-	CBCRCG(0, xin),							\
-	PIC(xin / 4 * 8 + 0, (xin & 3) * 2 + 0, pic0, xin * 2 + 0),	\
-	PIC(xin / 4 * 8 + 0, (xin & 3) * 2 + 1, pic0, xin * 2 + 1),	\
-	PIC(xin / 4 * 8 + 1, (xin & 3) * 2 + 0, pic1, xin * 2 + 0),	\
-	PIC(xin / 4 * 8 + 1, (xin & 3) * 2 + 1, pic1, xin * 2 + 1)	\
-)
-
-#define PIC221111_16(xin)						       \
-(									       \
-	CBCRCG(0, xin),							       \
-	PIC_16(xin / 4 * 8 + 0, (xin & 3) * 2 + 0, pic0, xin * 2 + 0, 3),      \
-	PIC_16(xin / 4 * 8 + 0, (xin & 3) * 2 + 1, pic0, xin * 2 + 1, 0),      \
-	PIC_16(xin / 4 * 8 + 1, (xin & 3) * 2 + 0, pic1, xin * 2 + 0, 1),      \
-	PIC_16(xin / 4 * 8 + 1, (xin & 3) * 2 + 1, pic1, xin * 2 + 1, 2)       \
-)
-
-#define PIC221111_32(xin)						\
-(									\
-	CBCRCG(0, xin),							\
-	PIC_32(xin / 4 * 8 + 0, (xin & 3) * 2 + 0, pic0, xin * 2 + 0),	\
-	PIC_32(xin / 4 * 8 + 0, (xin & 3) * 2 + 1, pic0, xin * 2 + 1),	\
-	PIC_32(xin / 4 * 8 + 1, (xin & 3) * 2 + 0, pic1, xin * 2 + 0),	\
-	PIC_32(xin / 4 * 8 + 1, (xin & 3) * 2 + 1, pic1, xin * 2 + 1)	\
-)
-
-static void col221111(int *out, unsigned char *pic, int width)
+/* Convert the samples of an MCU into w x h pixels at dst. */
+static void color_mcu(const struct jpeg_decdata *d, const struct mcu_samples *ms,
+		      unsigned char *dst, int w, int h)
 {
-	int i, j, k;
-	unsigned char *pic0, *pic1;
-	int *outy, *outc;
-	int cr, cg, cb, y;
-
-	pic0 = pic;
-	pic1 = pic + width;
-	outy = out;
-	outc = out + 64 * 4;
-	for (i = 2; i > 0; i--) {
-		for (j = 4; j > 0; j--) {
-			for (k = 0; k < 8; k++)
-				PIC221111(k);
-			outc += 8;
-			outy += 16;
-			pic0 += 2 * width;
-			pic1 += 2 * width;
+	const struct jpeg_component *c = d->comps;
+	const int bytes = d->bytes_per_pixel;
+	const unsigned char *yrow, *cbrow, *crrow;
+	int x, y;
+	unsigned char *p;
+
+	/* Components with fewer blocks than the MCU cover two pixels per sample. */
+	const int ysx = c[0].h < d->hmax, ysy = c[0].v < d->vmax;
+	const int cbsx = c[1].h < d->hmax, cbsy = c[1].v < d->vmax;
+	const int crsx = c[2].h < d->hmax, crsy = c[2].v < d->vmax;
+
+	if (d->nc == 1) {
+		for (y = 0; y < h; y++, dst += d->bytes_per_line) {
+			yrow = ms->s[0] + y * 8;
+			for (x = 0, p = dst; x < w; x++, p += bytes)
+				store_pixel(p, bytes, ycc_pixel(d, yrow[x], 128, 128));
 		}
-		outy += 64 * 2 - 16 * 4;
+		return;
+	}
+
+	if (bytes == 4 && w == 8 * d->hmax && h == 8 * d->vmax &&
+	    !ysx && !ysy && cbsx == crsx && cbsy == crsy) {
+		color_mcu_32(d, ms, dst);
+		return;
+	}
+
+	for (y = 0; y < h; y++, dst += d->bytes_per_line) {
+		yrow = ms->s[0] + (y >> ysy) * 8 * c[0].h;
+		cbrow = ms->s[1] + (y >> cbsy) * 8 * c[1].h;
+		crrow = ms->s[2] + (y >> crsy) * 8 * c[2].h;
+		for (x = 0, p = dst; x < w; x++, p += bytes)
+			store_pixel(p, bytes, ycc_pixel(d, yrow[x >> ysx], cbrow[x >> cbsx],
+							crrow[x >> crsx]));
 	}
 }
 
-static void col221111_16(int *out, unsigned char *pic, int width)
+/* Skip to the restart marker that ends the current interval, and past it. */
+static int restart(struct bitreader *br, const struct jpeg_decdata *d)
+{
+	const unsigned char *p = br->p;
+
+	while (p + 1 < d->scan_end && !(p[0] == 0xff && p[1] >= M_RST0 && p[1] <= M_RST7))
+		p++;
+	if (p + 1 >= d->scan_end)
+		return ERR_WRONG_MARKER;
+	setinput(br, p + 2, d->scan_end);
+	return 0;
+}
+
+int jpeg_decode_part(const struct jpeg_decdata *d, int part)
 {
-	int i, j, k;
-	unsigned char *pic0, *pic1;
-	int *outy, *outc;
-	int cr, cg, cb, y;
-
-	pic0 = pic;
-	pic1 = pic + width;
-	outy = out;
-	outc = out + 64 * 4;
-	for (i = 2; i > 0; i--) {
-		for (j = 4; j > 0; j--) {
-			for (k = 0; k < 8; k++)
-				PIC221111_16(k);
-			outc += 8;
-			outy += 16;
-			pic0 += 2 * width;
-			pic1 += 2 * width;
+	const int mcus = d->mcusx * d->mcusy;
+	const int interval = d->dri ? d->dri : mcus;
+	const int mcu_width = 8 * d->hmax, mcu_height = 8 * d->vmax;
+	const struct jpeg_component *c;
+	struct mcu_samples ms;
+	struct bitreader br;
+	unsigned char *dst;
+	int32_t coef[64];
+	int pred[JPEG_MAX_COMPS];
+	int mcu, first, last, i, bx, by, x0, y0, w, h, n, flat, dirty = 1;
+
+	if (part < 0 || part >= d->parts)
+		return -1;
+
+	first = part * d->intervals_per_part * interval;
+	last = first + d->intervals_per_part * interval;
+	if (last > mcus)
+		last = mcus;
+
+	setinput(&br, d->part_start[part], d->scan_end);
+	for (mcu = first; mcu < last; mcu++) {
+		if (mcu == first || mcu % interval == 0) {
+			if (mcu != first && restart(&br, d))
+				return ERR_WRONG_MARKER;
+			memset(pred, 0, sizeof(pred));
+		}
+
+		flat = 1;
+		for (i = 0; i < d->nc; i++) {
+			c = &d->comps[d->scan_comp[i]];
+			for (by = 0; by < c->v; by++) {
+				for (bx = 0; bx < c->h; bx++) {
+					/* The full IDCT leaves the coefficients clobbered. */
+					if (dirty)
+						memset(coef, 0, sizeof(coef));
+					n = decode_block(&br, &d->dc[c->td], &d->ac[c->ta],
+							 d->dquant[c->tq],
+							 &pred[d->scan_comp[i]], coef);
+					if (n < 0)
+						return ERR_BAD_HUFFMAN_CODE;
+					flat &= n <= 1;
+					dirty = n > 1;
+					idct(coef, n, ms.s[d->scan_comp[i]] +
+					     by * 8 * (8 * c->h) + bx * 8, 8 * c->h);
+				}
+			}
 		}
-		outy += 64 * 2 - 16 * 4;
+
+		x0 = mcu % d->mcusx * mcu_width;
+		y0 = mcu / d->mcusx * mcu_height;
+		w = d->width - x0 < mcu_width ? d->width - x0 : mcu_width;
+		h = d->height - y0 < mcu_height ? d->height - y0 : mcu_height;
+		dst = d->pic + y0 * d->bytes_per_line + x0 * d->bytes_per_pixel;
+		if (!flat || !color_flat(d, &ms, dst, w, h))
+			color_mcu(d, &ms, dst, w, h);
 	}
+
+	return 0;
 }
 
-static void col221111_32(int *out, unsigned char *pic, int width)
+int jpeg_decode(const unsigned char *buf, size_t len, unsigned char *pic,
+		int bytes_per_line, const struct jpeg_pixel_format *format,
+		struct jpeg_decdata *decdata)
 {
-	int i, j, k;
-	unsigned char *pic0, *pic1;
-	int *outy, *outc;
-	int cr, cg, cb, y;
-
-	pic0 = pic;
-	pic1 = pic + width;
-	outy = out;
-	outc = out + 64 * 4;
-	for (i = 2; i > 0; i--) {
-		for (j = 4; j > 0; j--) {
-			for (k = 0; k < 8; k++)
-				PIC221111_32(k);
-			outc += 8;
-			outy += 16;
-			pic0 += 2 * width;
-			pic1 += 2 * width;
-		}
-		outy += 64 * 2 - 16 * 4;
+	int i, ret;
+
+	ret = jpeg_decode_init(buf, len, pic, bytes_per_line, format, decdata);
+	if (ret)
+		return ret;
+
+	for (i = 0; i < decdata->parts; i++) {
+		ret = jpeg_decode_part(decdata, i);
+		if (ret)
+			return ret;
 	}
+
+	return 0;
 }
@@ -9,30 +9,105 @@
 #ifndef __JPEG_H
 #define __JPEG_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 #define ERR_NO_SOI 1
 #define ERR_NOT_8BIT 2
-#define ERR_HEIGHT_MISMATCH 3
-#define ERR_WIDTH_MISMATCH 4
 #define ERR_BAD_WIDTH_OR_HEIGHT 5
 #define ERR_TOO_MANY_COMPPS 6
 #define ERR_ILLEGAL_HV 7
 #define ERR_QUANT_TABLE_SELECTOR 8
-#define ERR_NOT_YCBCR_221111 9
+#define ERR_UNSUPPORTED_SAMPLING 9
 #define ERR_UNKNOWN_CID_IN_SCAN 10
 #define ERR_NOT_SEQUENTIAL_DCT 11
 #define ERR_WRONG_MARKER 12
 #define ERR_NO_EOI 13
 #define ERR_BAD_TABLES 14
 #define ERR_DEPTH_MISMATCH 15
+#define ERR_TRUNCATED 16
+#define ERR_BAD_HUFFMAN_CODE 17
+
+/* Components of a YCbCr or grayscale picture. */
+#define JPEG_MAX_COMPS 3
+
+/* Restart intervals are grouped into at most this many parts. */
+#define JPEG_MAX_PARTS 64
+
+#define JPEG_HUFF_LOOKAHEAD 9
+
+/* Where the color channels are in a pixel of the output picture. */
+struct jpeg_pixel_format {
+	unsigned int bits_per_pixel;	/* 16, 24 or 32 */
+	unsigned int red_pos, red_size;
+	unsigned int green_pos, green_size;
+	unsigned int blue_pos, blue_size;
+};
+
+struct jpeg_huffman {
+	/* Indexed by the next bits: code length << 8 | symbol, or 0 for longer codes. */
+	uint16_t lookup[1 << JPEG_HUFF_LOOKAHEAD];
+	/* The largest code of each length, or -1 if there is none. */
+	int32_t maxcode[17];
+	/* Index of the symbol of each length's codes in vals, minus its first code. */
+	int32_t valoffset[17];
+	uint8_t vals[256];
+};
+
+struct jpeg_component {
+	int cid;
+	int h, v;		/* blocks per MCU */
+	int tq;			/* quantization table */
+	int td, ta;		/* DC and AC Huffman tables */
+};
 
+/*
+ * Everything needed to decode a picture, filled in by jpeg_decode_init(). It
+ * isn't changed while decoding, so parts can be decoded on several CPUs.
+ */
 struct jpeg_decdata {
-	int dcts[6 * 64 + 16];
-	int out[64 * 6];
-	int dquant[3][64];
+	int width, height;
+	int nc;
+	struct jpeg_component comps[JPEG_MAX_COMPS];
+	/* Frame components in the order of the scan. */
+	int scan_comp[JPEG_MAX_COMPS];
+	int hmax, vmax;
+	int mcusx, mcusy;
+	int dri;
+
+	int32_t dquant[4][64];
+	struct jpeg_huffman dc[4];
+	struct jpeg_huffman ac[4];
+	unsigned int tables_defined;
+
+	/* Entropy coded data, up to the EOI marker. */
+	const unsigned char *scan_end;
+	int parts;
+	int intervals_per_part;
+	const unsigned char *part_start[JPEG_MAX_PARTS];
+
+	unsigned char *pic;
+	int bytes_per_line;
+	int bytes_per_pixel;
+	/* Pixel value for each color channel, indexed by value + 256 to clamp. */
+	uint32_t red[768], green[768], blue[768];
+	int32_t cr_r[256], cb_b[256], cr_g[256], cb_g[256];
 };
 
-int jpeg_decode(unsigned char *, unsigned char *, int, int, int, int, struct jpeg_decdata *);
-void jpeg_fetch_size(unsigned char *buf, int *width, int *height);
-int jpeg_check_size(unsigned char *, int, int);
+int jpeg_fetch_size(const unsigned char *buf, size_t len, int *width, int *height);
+
+/*
+ * Decode the picture in buf into pic. jpeg_decode() does it all at once, or
+ * jpeg_decode_init() prepares decdata and jpeg_decode_part() decodes each of
+ * its decdata->parts parts. Pictures without restart intervals have only one
+ * part. All return 0 or one of the ERR_* codes.
+ */
+int jpeg_decode(const unsigned char *buf, size_t len, unsigned char *pic,
+		int bytes_per_line, const struct jpeg_pixel_format *format,
+		struct jpeg_decdata *decdata);
+int jpeg_decode_init(const unsigned char *buf, size_t len, unsigned char *pic,
+		     int bytes_per_line, const struct jpeg_pixel_format *format,
+		     struct jpeg_decdata *decdata);
+int jpeg_decode_part(const struct jpeg_decdata *decdata, int part);
 
 #endif
@@ -0,0 +1,102 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#include <commonlib/bsd/compression.h>
+#include <console/console.h>
+#include <cpu/x86/mp.h>
+#include <lz4_parallel.h>
+#include <smp/spinlock.h>
+#include <timer.h>
+#include <types.h>
+
+/* The blocks are handed out to the CPUs one at a time in the order of the frame. */
+static struct {
+	struct lz4f_frame frame;
+	size_t done_blocks;
+	size_t out_size;
+	bool error;
+	unsigned int workers;
+	unsigned int active;
+} job;
+
+DECLARE_SPIN_LOCK(lz4_lock)
+
+/*
+ * mp_run_on_aps() only waits for the APs to accept the call, so an AP may enter after
+ * ulz4fn_parallel() returned. Blocks are only claimed while holding the lock, and the
+ * active count tells when all CPUs have left.
+ */
+static void lz4_worker(void *unused)
+{
+	struct lz4f_block block;
+	bool first = true;
+	size_t ret;
+
+	spin_lock(&lz4_lock);
+	job.active++;
+
+	while (!job.error && lz4f_next_block(&job.frame, &block)) {
+		if (first)
+			job.workers++;
+		first = false;
+		spin_unlock(&lz4_lock);
+
+		ret = lz4f_decode_block(&block);
+
+		spin_lock(&lz4_lock);
+		if (!ret)
+			job.error = true;
+		job.out_size += ret;
+		job.done_blocks++;
+	}
+
+	job.active--;
+	spin_unlock(&lz4_lock);
+}
+
+static bool lz4_done(void)
+{
+	bool done;
+
+	/* After an error no more blocks are handed out, so only wait for the busy ones. */
+	spin_lock(&lz4_lock);
+	done = job.done_blocks == job.frame.next_block && job.active == 0;
+	spin_unlock(&lz4_lock);
+
+	return done;
+}
+
+size_t ulz4fn_parallel(const void *src, size_t srcn, void *dst, size_t dstn)
+{
+	struct lz4f_frame frame;
+	struct stopwatch sw;
+
+	if (lz4f_frame_init(&frame, src, srcn, dst, dstn) || frame.blocks < 2)
+		return ulz4fn(src, srcn, dst, dstn);
+
+	spin_lock(&lz4_lock);
+	job.frame = frame;
+	job.done_blocks = 0;
+	job.out_size = 0;
+	job.error = false;
+	job.workers = 0;
+	spin_unlock(&lz4_lock);
+
+	stopwatch_init(&sw);
+
+	/* The BSP takes part as well, so don't wait for the APs to finish. */
+	mp_run_on_aps(lz4_worker, NULL, MP_RUN_ON_ALL_CPUS, 1000 * USECS_PER_MSEC);
+	lz4_worker(NULL);
+
+	while (!lz4_done())
+		;
+
+	if (job.error) {
+		printk(BIOS_ERR, "LZ4: Corrupted block\n");
+		return 0;
+	}
+
+	printk(BIOS_DEBUG, "LZ4: %zu blocks in %lld us on %u CPUs\n", job.frame.blocks,
+	       stopwatch_duration_usecs(&sw), job.workers);
+
+	return lz4f_frame_finish(&job.frame, job.out_size);
+}
@@ -97,6 +97,19 @@
 
 #define RC_GET_BIT(p, mi) RC_GET_BIT2(p, mi, ;, ;)
 
+/* Same as RC_GET_BIT, but without branching on the decoded bit, which is
+ * close to random for literals. mask is set to all ones for a 1 bit and to 0
+ * otherwise. The probability update relies on an arithmetic right shift. */
+#define RC_GET_BIT_MASK(p, mi, mask)					\
+	RC_NORMALIZE;							\
+	bound = (Range >> kNumBitModelTotalBits) * *(p);		\
+	mask = 0 - (UInt32)(Code >= bound);				\
+	Range = (bound & ~mask) | ((Range - bound) & mask);		\
+	Code -= bound & mask;						\
+	*(p) -= ((int)*(p) - (int)((kBitModelTotal - 31) & ~mask))	\
+		>> kNumMoveBits;					\
+	mi = (mi + mi) - mask
+
 #define RangeDecoderBitTreeDecode(probs, numLevels, res)	\
 {								\
 	int i = numLevels;					\
@@ -110,6 +123,34 @@
 }
 
 
+/*
+ * Copy a match of len bytes from rep0 bytes back. Overlapping matches repeat
+ * the last rep0 bytes, so they can only be copied in chunks of up to rep0
+ * bytes. spare is the number of bytes after the match which may be clobbered.
+ */
+static inline void lzma_copy_match(Byte *dest, const Byte *src, SizeT len,
+	UInt32 rep0, SizeT spare)
+{
+	Byte *end = dest + len;
+
+	/* Copy 8 bytes at a time and let the last chunk run over the end of
+	   the match, it is overwritten later anyway. */
+	if (CONFIG(DECOMPRESS_UNALIGNED_COPY) && rep0 >= 8 && spare >= 8) {
+		do {
+			/* Byte-wise semantics, so the compiler can't assume that
+			   a chunk doesn't read what the previous one wrote. */
+			__builtin_memcpy(dest, src, 8);
+			dest += 8;
+			src += 8;
+		} while (dest < end);
+		return;
+	}
+
+	do {
+		*dest++ = *src++;
+	} while (dest < end);
+}
+
 #define kNumPosBitsMax 4
 #define kNumPosStatesMax (1 << kNumPosBitsMax)
 
@@ -242,6 +283,32 @@ int LzmaDecode(CLzmaDecoderState *vs,
 				((((nowPos) & literalPosMask) << lc)
 				+ (previousByte >> (8 - lc))));
 
+#if CONFIG(DECOMPRESS_BRANCHLESS_LITERALS)
+			if (state >= kNumLitStates) {
+				/* offs drops to 0 at the first bit which
+				   differs from matchByte, after which the
+				   plain literal probabilities are used. */
+				UInt32 matchByte = outStream[nowPos - rep0];
+				UInt32 offs = 0x100;
+				int i;
+				for (i = 0; i < 8; i++) {
+					UInt32 bit, mask;
+					CProb *probLit;
+					matchByte <<= 1;
+					bit = matchByte & offs;
+					probLit = prob + offs + bit + symbol;
+					RC_GET_BIT_MASK(probLit, symbol, mask);
+					offs &= ~(bit ^ (mask & offs));
+				}
+			} else {
+				int i;
+				for (i = 0; i < 8; i++) {
+					UInt32 mask;
+					CProb *probLit = prob + symbol;
+					RC_GET_BIT_MASK(probLit, symbol, mask);
+				}
+			}
+#else
 			if (state >= kNumLitStates) {
 				int matchByte;
 				matchByte = outStream[nowPos - rep0];
@@ -262,6 +329,7 @@ int LzmaDecode(CLzmaDecoderState *vs,
 				CProb *probLit = prob + symbol;
 				RC_GET_BIT(probLit, symbol)
 			}
+#endif
 			previousByte = (Byte)symbol;
 
 			outStream[nowPos++] = previousByte;
@@ -421,11 +489,19 @@ int LzmaDecode(CLzmaDecoderState *vs,
 				return LZMA_RESULT_DATA_ERROR;
 
 
-			do {
-				previousByte = outStream[nowPos - rep0];
-				len--;
-				outStream[nowPos++] = previousByte;
-			} while (len != 0 && nowPos < outSize);
+			{
+				SizeT curLen = outSize - nowPos;
+				Byte *dest = outStream + nowPos;
+				const Byte *src = dest - rep0;
+
+				if (curLen > (SizeT)len)
+					curLen = len;
+				len -= curLen;
+				nowPos += curLen;
+				lzma_copy_match(dest, src, curLen, rep0,
+					outSize - nowPos);
+				previousByte = dest[curLen - 1];
+			}
 		}
 	}
 	RC_NORMALIZE;
@@ -0,0 +1,241 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#include <commonlib/helpers.h>
+#include <console/console.h>
+#include <memfill.h>
+#include <smp/spinlock.h>
+#include <string.h>
+#include <timer.h>
+#include <timestamp.h>
+#include <types.h>
+
+#if ENV_X86 && ENV_RAMSTAGE
+#include <cpu/x86/mp.h>
+#endif
+
+/* Chunks are handed out to the CPUs one at a time to balance the load. */
+#define MEMFILL_CHUNK_SIZE	(64 * MiB)
+
+/* Mismatches printed by memfill_verify(). */
+#define MEMFILL_MAX_REPORTED	16
+
+#if ENV_X86 && CONFIG(SSE2)
+static void write_word(uintptr_t addr, uintptr_t value)
+{
+	asm volatile (
+		"movnti %1, (%0)"
+		: /* outputs */
+		: "r" (addr), "r" (value) /* inputs */
+		: "memory"
+	);
+}
+
+static void write_barrier(void)
+{
+	/* Non-temporal stores are weakly ordered. */
+	asm volatile ("sfence" ::: "memory");
+}
+#else
+static void write_word(uintptr_t addr, uintptr_t value)
+{
+	*(volatile uintptr_t *)addr = value;
+}
+
+static void write_barrier(void)
+{
+	asm volatile ("" ::: "memory");
+}
+#endif
+
+static struct {
+	uintptr_t base;
+	uintptr_t end;
+	enum memfill_pattern pattern;
+	bool verify;
+	size_t chunks;
+	size_t next_chunk;
+	size_t done_chunks;
+	size_t errors;
+	unsigned int workers;
+	unsigned int active;
+} job;
+
+DECLARE_SPIN_LOCK(memfill_lock)
+
+static uintptr_t pattern_value(enum memfill_pattern pattern, uintptr_t addr)
+{
+	return pattern == MEMFILL_ADDRESS ? addr : 0;
+}
+
+static void fill_words(uintptr_t start, uintptr_t end, enum memfill_pattern pattern)
+{
+	uintptr_t addr;
+
+	for (addr = start; addr < end; addr += sizeof(uintptr_t))
+		write_word(addr, pattern_value(pattern, addr));
+
+	write_barrier();
+}
+
+static size_t verify_words(uintptr_t start, uintptr_t end, enum memfill_pattern pattern)
+{
+	const volatile uintptr_t *p = (const volatile uintptr_t *)start;
+	size_t errors = 0;
+	uintptr_t value;
+
+	for (; (uintptr_t)p < end; p++) {
+		value = *p;
+		if (value == pattern_value(pattern, (uintptr_t)p))
+			continue;
+
+		spin_lock(&memfill_lock);
+		if (job.errors + errors < MEMFILL_MAX_REPORTED)
+			printk(BIOS_ERR, "0x%08lx: got 0x%lx\n", (uintptr_t)p, value);
+		spin_unlock(&memfill_lock);
+		errors++;
+	}
+
+	return errors;
+}
+
+/*
+ * Runs on every participating CPU until all chunks have been handed out. mp_run_on_aps()
+ * only waits for the APs to accept the call, so an AP may enter after memfill_run()
+ * returned and the next job was set up. Chunks are therefore claimed and described
+ * while holding the lock only, and the active count tells when all CPUs have left.
+ */
+static void memfill_worker(void *unused)
+{
+	uintptr_t start, end;
+	enum memfill_pattern pattern;
+	size_t errors;
+	bool verify;
+	bool first = true;
+
+	spin_lock(&memfill_lock);
+	job.active++;
+
+	while (job.next_chunk < job.chunks) {
+		start = job.base + job.next_chunk++ * MEMFILL_CHUNK_SIZE;
+		end = MIN(start + MEMFILL_CHUNK_SIZE, job.end);
+		pattern = job.pattern;
+		verify = job.verify;
+		if (first)
+			job.workers++;
+		first = false;
+		spin_unlock(&memfill_lock);
+
+		if (verify) {
+			errors = verify_words(start, end, pattern);
+		} else {
+			errors = 0;
+			fill_words(start, end, pattern);
+		}
+
+		spin_lock(&memfill_lock);
+		job.errors += errors;
+		job.done_chunks++;
+	}
+
+	job.active--;
+	spin_unlock(&memfill_lock);
+}
+
+static bool memfill_done(void)
+{
+	bool done;
+
+	spin_lock(&memfill_lock);
+	done = job.done_chunks == job.chunks && job.active == 0;
+	spin_unlock(&memfill_lock);
+
+	return done;
+}
+
+static size_t memfill_run(uintptr_t base, uintptr_t end, enum memfill_pattern pattern,
+			  bool verify)
+{
+	struct stopwatch sw;
+	long msecs;
+
+	spin_lock(&memfill_lock);
+	job.base = base;
+	job.end = end;
+	job.pattern = pattern;
+	job.verify = verify;
+	job.chunks = DIV_ROUND_UP(end - base, MEMFILL_CHUNK_SIZE);
+	job.next_chunk = 0;
+	job.done_chunks = 0;
+	job.errors = 0;
+	job.workers = 0;
+	spin_unlock(&memfill_lock);
+
+	timestamp_add_now(TS_MEMFILL_START);
+	stopwatch_init(&sw);
+
+#if ENV_X86 && ENV_RAMSTAGE
+	/* The BSP takes part as well, so don't wait for the APs to finish. */
+	if (CONFIG(PARALLEL_MP_AP_WORK) && job.chunks > 1)
+		mp_run_on_aps(memfill_worker, NULL, MP_RUN_ON_ALL_CPUS, 1000 * USECS_PER_MSEC);
+#endif
+	memfill_worker(NULL);
+
+	while (!memfill_done())
+		;
+
+	timestamp_add_now(TS_MEMFILL_END);
+
+	msecs = MAX(stopwatch_duration_msecs(&sw), 1);
+	printk(BIOS_DEBUG, "memfill: %s 0x%lx-0x%lx, %lu MiB/s on %u CPUs\n",
+	       verify ? "verified" : "filled", base, end,
+	       (unsigned long)((end - base) / MiB * MSECS_PER_SEC / msecs), job.workers);
+
+	return job.errors;
+}
+
+void memfill(uintptr_t base, size_t size, enum memfill_pattern pattern)
+{
+	const uintptr_t end = base + size;
+	const uintptr_t start = ALIGN_UP(base, sizeof(uintptr_t));
+	const uintptr_t last = ALIGN_DOWN(end, sizeof(uintptr_t));
+
+	/* Only whole words can hold their address. */
+	if (start >= last) {
+		if (pattern == MEMFILL_ZERO)
+			memset((void *)base, 0, size);
+		return;
+	}
+
+	if (pattern == MEMFILL_ZERO) {
+		memset((void *)base, 0, start - base);
+		memset((void *)last, 0, end - last);
+	}
+
+	memfill_run(start, last, pattern, false);
+}
+
+static size_t count_nonzero_bytes(uintptr_t start, uintptr_t end)
+{
+	size_t errors = 0;
+
+	for (; start < end; start++)
+		errors += *(const volatile uint8_t *)start != 0;
+
+	return errors;
+}
+
+size_t memfill_verify(uintptr_t base, size_t size, enum memfill_pattern pattern)
+{
+	const uintptr_t end = base + size;
+	const uintptr_t start = ALIGN_UP(base, sizeof(uintptr_t));
+	const uintptr_t last = ALIGN_DOWN(end, sizeof(uintptr_t));
+
+	if (start >= last)
+		return pattern == MEMFILL_ZERO ? count_nonzero_bytes(base, end) : 0;
+
+	if (pattern == MEMFILL_ZERO)
+		return count_nonzero_bytes(base, start) + count_nonzero_bytes(last, end) +
+		       memfill_run(start, last, pattern, true);
+
+	return memfill_run(start, last, pattern, true);
+}
@@ -3,46 +3,21 @@
 #include <stdint.h>
 #include <lib.h>
 #include <console/console.h>
+#include <memfill.h>
 
 int primitive_memtest(uintptr_t base, uintptr_t size)
 {
-	uintptr_t *p;
-	uintptr_t i;
-	int bad = 0;
+	size_t bad;
 
 	printk(BIOS_SPEW, "Performing primitive memory test.\n");
-	printk(BIOS_SPEW, "DRAM start: 0x%08x, DRAM size: 0x%08x", base, size);
-	for (i = base; i < base + (size - 1) - sizeof(p); i += sizeof(p)) {
-		if (i % 0x100000 == 0) {
-			if ((i % 0x800000) == 0)
-				printk(BIOS_SPEW, "\n");
-			else if (i != 0)
-				printk(BIOS_SPEW, " ");
-			printk(BIOS_SPEW, "0x%08x", i);
-		}
-		p = (uintptr_t *)i;
-		*p = i;
-	}
+	printk(BIOS_SPEW, "DRAM start: 0x%08lx, DRAM size: 0x%08lx\n", base, size);
 
-	printk(BIOS_SPEW, "\n\nReading back DRAM content");
-	for (i = base; i < base + (size - 1) - sizeof(p); i += sizeof(p)) {
-		if (i % 0x100000 == 0) {
-			if ((i % 0x800000) == 0)
-				printk(BIOS_SPEW, "\n");
-			else if (i != 0)
-				printk(BIOS_SPEW, " ");
-			printk(BIOS_SPEW, "0x%08x", i);
-		}
+	memfill(base, size, MEMFILL_ADDRESS);
 
-		p = (uintptr_t *)i;
-		if (*p != i) {
-			printk(BIOS_SPEW, "\n0x%08zx: got 0x%zx\n", i, *p);
-			bad++;
-		}
-	}
+	printk(BIOS_SPEW, "Reading back DRAM content\n");
+	bad = memfill_verify(base, size, MEMFILL_ADDRESS);
 
-	printk(BIOS_SPEW, "\n");
-	printk(BIOS_SPEW, "%d errors\n", bad);
+	printk(BIOS_SPEW, "%zu errors\n", bad);
 
 	return bad;
 }
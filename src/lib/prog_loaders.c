@@ -7,7 +7,6 @@
 #include <halt.h>
 #include <lib.h>
 #include <program_loading.h>
-#include <reset.h>
 #include <rmodule.h>
 #include <security/vboot/vboot_common.h>
 #include <stage_cache.h>
@@ -55,12 +54,13 @@ static void run_ramstage_from_resume(struct prog *ramstage)
 	prog_set_arg(ramstage, cbmem_top());
 
 	if (prog_entry(ramstage) != NULL) {
+		timestamp_add_now(TS_COPYRAM_END);
 		printk(BIOS_DEBUG, "Jumping to image.\n");
 		prog_run(ramstage);
 	}
 
-	printk(BIOS_ERR, "ramstage cache invalid.\n");
-	board_reset();
+	/* Loading from CBFS still resumes, only slower. */
+	printk(BIOS_ERR, "ramstage cache invalid, loading from CBFS.\n");
 }
 
 static int load_relocatable_ramstage(struct prog *ramstage)
@@ -94,6 +94,8 @@ void __noreturn run_ramstage(void)
 
 	vboot_run_logic();
 
+	timestamp_add_now(TS_COPYRAM_START);
+
 	/*
 	 * Only x86 systems using ramstage stage cache currently take the same
 	 * firmware path on resume.
@@ -101,8 +103,6 @@ void __noreturn run_ramstage(void)
 	if (ENV_X86 && resume_from_stage_cache())
 		run_ramstage_from_resume(&ramstage);
 
-	timestamp_add_now(TS_COPYRAM_START);
-
 	if (ENV_X86) {
 		if (load_relocatable_ramstage(&ramstage))
 			goto fail;
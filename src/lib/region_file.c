@@ -348,6 +348,15 @@ static int update_can_fit(const struct region_file *f, size_t data_blks)
 	return 1;
 }
 
+int region_file_can_append(const struct region_file *f, size_t size)
+{
+	/* Empty or broken files need to be (re)initialized before any update. */
+	if (f->slot < RF_ONLY_METADATA)
+		return 0;
+
+	return update_can_fit(f, bytes_to_block(ALIGN_UP(size, REGF_BLOCK_GRANULARITY)));
+}
+
 static int commit_data_allocation(struct region_file *f, size_t data_blks)
 {
 	size_t offset;
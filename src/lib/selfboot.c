@@ -7,6 +7,7 @@
 #include <symbols.h>
 #include <cbfs.h>
 #include <lib.h>
+#include <lz4_parallel.h>
 #include <bootmem.h>
 #include <program_loading.h>
 #include <timestamp.h>
@@ -81,12 +82,26 @@ static int load_one_segment(uint8_t *dest,
 	case CBFS_COMPRESS_LZ4: {
 		printk(BIOS_DEBUG, "using LZ4\n");
 		timestamp_add_now(TS_ULZ4F_START);
-		len = ulz4fn(src, len, dest, memsz);
+		if (ENV_RAMSTAGE && CONFIG(DECOMPRESS_LZ4_PARALLEL))
+			len = ulz4fn_parallel(src, len, dest, memsz);
+		else
+			len = ulz4fn(src, len, dest, memsz);
 		timestamp_add_now(TS_ULZ4F_END);
 		if (!len) /* Decompression Error. */
 			return 0;
 		break;
 	}
+	case CBFS_COMPRESS_ZSTD: {
+		if (!CONFIG(DECOMPRESS_ZSTD))
+			return 0;
+		printk(BIOS_DEBUG, "using Zstandard\n");
+		timestamp_add_now(TS_UZSTD_START);
+		len = uzstdn(src, len, dest, memsz);
+		timestamp_add_now(TS_UZSTD_END);
+		if (!len) /* Decompression Error. */
+			return 0;
+		break;
+	}
 	case CBFS_COMPRESS_NONE: {
 		printk(BIOS_DEBUG, "it's not compressed!\n");
 		memcpy(dest, src, len);
@@ -16,6 +16,7 @@
 #include <symbols.h>
 #include <console/console.h>
 #include <arch/memory_clear.h>
+#include <memfill.h>
 #include <string.h>
 #include <security/memory/memory.h>
 #include <cbmem.h>
@@ -109,8 +110,8 @@ static void clear_memory(void *unused)
 		if (sizeof(resource_t) == sizeof(void *) ||
 		    !(range_entry_end(r) >> (sizeof(void *) * 8))) {
 			/* fastpath */
-			memset((void *)(uintptr_t)range_entry_base(r), 0,
-			       range_entry_size(r));
+			memfill((uintptr_t)range_entry_base(r), range_entry_size(r),
+				MEMFILL_ZERO);
 		}
 		/* Use PAE if available */
 		else if (ENV_X86) {
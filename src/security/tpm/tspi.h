@@ -13,6 +13,8 @@
 
 #define TPM_PCR_MAX_LEN 64
 #define HASH_DATA_CHUNK_SIZE 1024
+/* Chunk size used when the measured region can be hashed in place */
+#define HASH_DATA_MAP_SIZE (64 * KiB)
 #define MAX_TPM_LOG_ENTRIES 50
 /* Assumption of 2K TCPA log size reserved for CAR/SRAM */
 #define MAX_PRERAM_TPM_LOG_ENTRIES 15
@@ -141,6 +143,13 @@ tpm_result_t tpm_extend_pcr(int pcr, enum vb2_hash_algorithm digest_algo,
 			    const uint8_t *digest, size_t digest_len,
 			    const char *name);
 
+/**
+ * Extend all digests queued while TPM_MEASURED_BOOT_DEFER_EXTEND is enabled
+ * into their PCRs, in the order they were added to the TPM log.
+ * @return TPM_SUCCESS on success. If not a tpm error is returned
+ */
+tpm_result_t tpm_flush_deferred_extends(void);
+
 /**
  * Issue a TPM_Clear and re-enable/reactivate the TPM.
  * @return TPM_SUCCESS on success. If not a tpm error is returned
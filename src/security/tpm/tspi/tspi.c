@@ -6,7 +6,9 @@
 #include <security/tpm/tspi.h>
 #include <security/tpm/tss.h>
 #include <assert.h>
+#include <bootstate.h>
 #include <security/vboot/misc.h>
+#include <timestamp.h>
 #include <vb2_api.h>
 #include <vb2_sha.h>
 
@@ -216,15 +218,129 @@ tpm_result_t tpm_clear_and_reenable(void)
 	return TPM_SUCCESS;
 }
 
+/* Index of the first TPM log entry that has not been extended into its PCR yet. */
+static int deferred_log_start = -1;
+
+/*
+ * Queue a measurement for a later tpm_flush_deferred_extends() by only
+ * appending it to the TPM log. Sets *deferred to true if the measurement was
+ * queued, or to false if the caller has to extend the PCR right away.
+ */
+static tpm_result_t tpm_defer_extend(int pcr, enum vb2_hash_algorithm digest_algo,
+				     const uint8_t *digest, size_t digest_len,
+				     const char *name, bool *deferred)
+{
+	const void *log;
+	uint16_t entries;
+
+	*deferred = false;
+
+	if (!CONFIG(TPM_MEASURED_BOOT_DEFER_EXTEND) || !ENV_RAMSTAGE)
+		return TPM_SUCCESS;
+
+	log = tpm_log_init();
+	if (!log)
+		return TPM_SUCCESS;
+
+	entries = tpm_log_get_size(log);
+	tpm_log_add_table_entry(name, pcr, digest_algo, digest, digest_len);
+	if (tpm_log_get_size(log) != entries + 1) {
+		/*
+		 * The log is full, so there is no record to replay this digest
+		 * from. Flush what is queued to keep the PCR extend order in
+		 * line with the log and let the caller extend it directly.
+		 * If that fails, extending it now would break the order.
+		 */
+		return tpm_flush_deferred_extends();
+	}
+
+	if (deferred_log_start < 0)
+		deferred_log_start = entries;
+
+	printk(BIOS_DEBUG, "TPM: Digest of `%s` to PCR %d queued\n", name, pcr);
+	*deferred = true;
+	return TPM_SUCCESS;
+}
+
+tpm_result_t tpm_flush_deferred_extends(void)
+{
+	tpm_result_t rc;
+	int i, pcr;
+	const char *event_name;
+	const uint8_t *digest_data;
+	enum vb2_hash_algorithm digest_algo;
+
+	if (deferred_log_start < 0)
+		return TPM_SUCCESS;
+
+	timestamp_add_now(TS_TPM_DEFERRED_EXTEND_START);
+
+	rc = tlcl_lib_init();
+	if (rc != TPM_SUCCESS) {
+		printk(BIOS_ERR, "TPM Error (%#x): Can't initialize library.\n", rc);
+		goto out;
+	}
+
+	i = deferred_log_start;
+	while (!tpm_log_get(i, &pcr, &digest_data, &digest_algo, &event_name)) {
+		printk(BIOS_DEBUG, "TPM: Extending digest for `%s` into PCR %d\n",
+		       event_name, pcr);
+		rc = tlcl_extend(pcr, digest_data, digest_algo);
+		if (rc != TPM_SUCCESS) {
+			printk(BIOS_ERR, "TPM Error (%#x): Extending hash for `%s` into PCR %d failed.\n",
+			       rc, event_name, pcr);
+			/* Resume from the failed entry on the next flush attempt. */
+			deferred_log_start = i;
+			goto out;
+		}
+		i++;
+	}
+	printk(BIOS_INFO, "TPM: Extended %d deferred digests\n", i - deferred_log_start);
+	deferred_log_start = -1;
+
+out:
+	timestamp_add_now(TS_TPM_DEFERRED_EXTEND_END);
+
+	return rc;
+}
+
+static void flush_deferred_extends(void *unused)
+{
+	tpm_result_t rc = tpm_flush_deferred_extends();
+
+	if (rc == TPM_SUCCESS)
+		return;
+
+	/*
+	 * The PCRs don't cover the ramstage code that already ran. Never hand off to a
+	 * payload or OS which would trust them, like the non-deferred vboot path does.
+	 */
+	printk(BIOS_ERR, "TPM Error (%#x): Deferred PCR extends failed.\n", rc);
+	if (CONFIG(VBOOT) && vboot_logic_executed() && !vboot_recovery_mode_enabled())
+		vboot_fail_and_reboot(vboot_get_context(), VB2_RECOVERY_RO_TPM_U_ERROR, rc);
+	die("TPM: Deferred PCR extends failed.\n");
+}
+
+/* Flush before control is handed to the payload or the OS waking vector. */
+BOOT_STATE_INIT_ENTRY(BS_PAYLOAD_LOAD, BS_ON_EXIT, flush_deferred_extends, NULL);
+BOOT_STATE_INIT_ENTRY(BS_OS_RESUME, BS_ON_ENTRY, flush_deferred_extends, NULL);
+
 tpm_result_t tpm_extend_pcr(int pcr, enum vb2_hash_algorithm digest_algo,
 			const uint8_t *digest, size_t digest_len, const char *name)
 {
 	tpm_result_t rc;
+	bool deferred;
 
 	if (!digest)
 		return TPM_IOERROR;
 
 	if (tspi_tpm_is_setup()) {
+		rc = tpm_defer_extend(pcr, digest_algo, digest, digest_len, name, &deferred);
+		if (rc != TPM_SUCCESS)
+			return rc;
+		if (deferred)
+			return TPM_SUCCESS;
+
 		rc = tlcl_lib_init();
 		if (rc != TPM_SUCCESS) {
 			printk(BIOS_ERR, "TPM Error (%#x): Can't initialize library.\n", rc);
@@ -250,14 +366,55 @@ tpm_result_t tpm_extend_pcr(int pcr, enum vb2_hash_algorithm digest_algo,
 }
 
 #if CONFIG(VBOOT_LIB)
+/*
+ * Feed the next chunk of the region at the given offset into the digest and
+ * return the number of bytes hashed in *len.
+ */
+static tpm_result_t tpm_hash_region_chunk(struct vb2_digest_context *ctx,
+					  const struct region_device *rdev, size_t offset,
+					  size_t *len, const char *rname)
+{
+	uint8_t buf[HASH_DATA_CHUNK_SIZE];
+	vb2_error_t rv;
+
+	/*
+	 * A memory mapped boot device can be hashed in place, which saves copying
+	 * every byte through the stack buffer and lets the hash (and any hardware
+	 * acceleration behind it) run over large contiguous blocks.
+	 */
+	if (CONFIG(BOOT_DEVICE_MEMORY_MAPPED)) {
+		void *map;
+
+		*len = MIN(HASH_DATA_MAP_SIZE, region_device_sz(rdev) - offset);
+		map = rdev_mmap(rdev, offset, *len);
+		if (map) {
+			rv = vb2_digest_extend(ctx, map, *len);
+			rdev_munmap(rdev, map);
+			goto out;
+		}
+	}
+
+	*len = MIN(sizeof(buf), region_device_sz(rdev) - offset);
+	if (rdev_readat(rdev, buf, offset, *len) < 0) {
+		printk(BIOS_ERR, "TPM: Not able to read region %s.\n", rname);
+		return TPM_CB_READ_FAILURE;
+	}
+	rv = vb2_digest_extend(ctx, buf, *len);
+out:
+	if (rv) {
+		printk(BIOS_ERR, "TPM: Error extending hash.\n");
+		return TPM_CB_HASH_ERROR;
+	}
+	return TPM_SUCCESS;
+}
+
 tpm_result_t tpm_measure_region(const struct region_device *rdev, uint8_t pcr,
 			    const char *rname)
 {
 	uint8_t digest[TPM_PCR_MAX_LEN], digest_len;
-	uint8_t buf[HASH_DATA_CHUNK_SIZE];
-	uint32_t offset;
-	size_t len;
+	size_t offset, len;
 	struct vb2_digest_context ctx;
+	tpm_result_t rc;
 
 	if (!rdev || !rname)
 		return TPM_CB_INVALID_ARG;
@@ -272,19 +429,12 @@ tpm_result_t tpm_measure_region(const struct region_device *rdev, uint8_t pcr,
 	/*
 	 * Though one can mmap the full needed region on x86 this is not the
 	 * case for e.g. ARM. In order to make this code as universal as
-	 * possible across different platforms read the data to hash in chunks.
+	 * possible across different platforms hash the data in chunks.
 	 */
 	for (offset = 0; offset < region_device_sz(rdev); offset += len) {
-		len = MIN(sizeof(buf), region_device_sz(rdev) - offset);
-		if (rdev_readat(rdev, buf, offset, len) < 0) {
-			printk(BIOS_ERR, "TPM: Not able to read region %s.\n",
-			       rname);
-			return TPM_CB_READ_FAILURE;
-		}
-		if (vb2_digest_extend(&ctx, buf, len)) {
-			printk(BIOS_ERR, "TPM: Error extending hash.\n");
-			return TPM_CB_HASH_ERROR;
-		}
+		rc = tpm_hash_region_chunk(&ctx, rdev, offset, &len, rname);
+		if (rc != TPM_SUCCESS)
+			return rc;
 	}
 	if (vb2_digest_finalize(&ctx, digest, digest_len)) {
 		printk(BIOS_ERR, "TPM: Error finalizing hash.\n");
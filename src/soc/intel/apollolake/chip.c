@@ -268,6 +268,7 @@ static void pcie_update_device_tree(unsigned int devfn0, int num_funcs)
 		/* Found the first enabled device in given dev number */
 		func0->path.pci.devfn = dev->path.pci.devfn;
 		dev->path.pci.devfn = devfn0;
+		dev_index_invalidate();
 		break;
 	}
 }
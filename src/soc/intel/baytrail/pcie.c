@@ -165,6 +165,7 @@ static u8 all_ports_no_dev_present(struct device *dev)
 	}
 
 	dev->path.pci.devfn = temp;
+	dev_index_invalidate();
 	return device_not_present;
 }
 
@@ -124,6 +124,7 @@ static bool pcie_rp_update_dev(
 		       "Remapping PCIe Root Port #%u from %s to new function number %u.\n",
 		       rp_idx + 1, dev_path(dev), new_fn);
 		dev->path.pci.devfn = PCI_DEVFN(PCI_SLOT(dev->path.pci.devfn), new_fn);
+		dev_index_invalidate();
 	}
 	return false;
 }
@@ -165,6 +166,7 @@ void pcie_rp_update_devicetree(const struct pcie_rp_group *const groups)
 			/* Unlink vanished device. */
 			*link = dev->sibling;
 			dev->sibling = NULL;
+			dev_index_invalidate();
 			continue;
 		}
 
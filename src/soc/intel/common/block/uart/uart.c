@@ -424,6 +424,7 @@ static void uart_enable(struct device *dev)
 	struct soc_intel_common_block_uart_config *conf = dev->chip_info;
 	dev->ops = &uart_ops;
 	dev->device = conf ? conf->devid : 0;
+	dev_index_invalidate();
 }
 
 struct chip_operations soc_intel_common_block_uart_ops = {
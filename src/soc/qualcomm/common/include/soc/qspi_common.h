@@ -105,4 +105,6 @@ int qspi_xfer(const struct spi_slave *slave, const void *dout,
 		size_t out_bytes, void *din, size_t in_bytes);
 int qspi_xfer_dual(const struct spi_slave *slave, const void *dout,
 		     size_t out_bytes, void *din, size_t in_bytes);
+int qspi_xfer_quad(const struct spi_slave *slave, const void *dout,
+		     size_t out_bytes, void *din, size_t in_bytes);
 #endif /* __SOC_QUALCOMM_QSPI_H__ */
@@ -10,6 +10,7 @@ static const struct spi_ctrlr qspi_ctrlr = {
 	.release_bus = qspi_release_bus,
 	.xfer = qspi_xfer,
 	.xfer_dual = qspi_xfer_dual,
+	.xfer_quad = CONFIG(QC_QSPI_QUAD_IO) ? qspi_xfer_quad : NULL,
 	.max_xfer_size = QSPI_MAX_PACKET_COUNT,
 };
 
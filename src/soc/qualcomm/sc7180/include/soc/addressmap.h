@@ -50,10 +50,14 @@
 #define QSPI_CLK			GPIO(63)
 #define QSPI_DATA_0			GPIO(64)
 #define QSPI_DATA_1			GPIO(65)
+#define QSPI_DATA_2			GPIO(66)
+#define QSPI_DATA_3			GPIO(67)
 #define QSPI_CS				GPIO(68)
 
 #define GPIO_FUNC_QSPI_DATA_0		GPIO64_FUNC_QSPI_DATA_0
 #define GPIO_FUNC_QSPI_DATA_1		GPIO65_FUNC_QSPI_DATA_1
+#define GPIO_FUNC_QSPI_DATA_2		GPIO66_FUNC_QSPI_DATA_2
+#define GPIO_FUNC_QSPI_DATA_3		GPIO67_FUNC_QSPI_DATA_3
 #define GPIO_FUNC_QSPI_CLK		GPIO63_FUNC_QSPI_CLK
 
 /* SDHC TLMM Registers */
@@ -1,12 +1,17 @@
 /* SPDX-License-Identifier: GPL-2.0-only */
 
 #include <stdlib.h>
+#include <time.h>
 #include <types.h>
 #include <tests/test.h>
 #include <acpi/acpigen.h>
 
 #define ACPIGEN_TEST_BUFFER_SZ (16 * KiB)
 
+/* Number of CPUs in the generated SSDT of the benchmark. */
+#define ACPIGEN_BENCH_CPUS 512
+#define ACPIGEN_BENCH_BUFFER_SZ (2 * MiB)
+
 /* Returns AML package length. Works with normal and extended packages.
    This implementation is independent from acpigen.c implementation of package length. */
 static u32 decode_package_length(const char *ptr)
@@ -200,6 +205,138 @@ static void test_acpigen_scope_with_contents(void **state)
 	assert_int_equal(package_length, block_length);
 }
 
+static void test_acpigen_pss_template(void **state)
+{
+	char *acpigen_buf = *state;
+	char *expected = acpigen_buf + ACPIGEN_TEST_BUFFER_SZ / 2;
+	const u32 values[] = { 2400, 15000, 10, 0x12345678, 0x1800, 0xdeadbeef };
+	size_t size;
+
+	/* Encode the package element by element for reference. */
+	acpigen_set_current(expected);
+	acpigen_write_package(ARRAY_SIZE(values));
+	for (int i = 0; i < ARRAY_SIZE(values); ++i)
+		acpigen_write_dword(values[i]);
+	acpigen_pop_len();
+	size = acpigen_get_current() - expected;
+
+	acpigen_set_current(acpigen_buf);
+	acpigen_write_PSS_package(values[0], values[1], values[2], values[3], values[4],
+				  values[5]);
+
+	assert_int_equal(size, acpigen_get_current() - acpigen_buf);
+	assert_memory_equal(expected, acpigen_buf, size);
+	assert_int_equal(decode_package_length(acpigen_buf),
+			 get_current_block_length(acpigen_buf));
+}
+
+static void test_acpigen_limit(void **state)
+{
+	char *acpigen_buf = *state;
+	const size_t limit = 64;
+	char data[80];
+	char *pkg_count;
+	size_t i;
+
+	memset(acpigen_buf, 0xa5, ACPIGEN_TEST_BUFFER_SZ);
+	memset(data, 0x11, sizeof(data));
+
+	acpigen_set_current(acpigen_buf);
+	acpigen_set_limit(acpigen_buf + limit);
+
+	acpigen_emit_stream(data, limit - 8);
+	assert_false(acpigen_overflowed());
+
+	/* Doesn't fit, so nothing past the limit may be written. */
+	pkg_count = acpigen_write_package(2);
+	(*pkg_count)++;
+	acpigen_write_PSS_package(1, 2, 3, 4, 5, 6);
+	acpigen_write_qword(0x1122334455667788);
+	acpigen_pop_len();
+	acpigen_emit_stream(data, sizeof(data));
+	assert_true(acpigen_overflowed());
+	assert_true(acpigen_get_current() <= acpigen_buf + limit);
+
+	for (i = limit; i < ACPIGEN_TEST_BUFFER_SZ; i++)
+		assert_int_equal(0xa5, (u8)acpigen_buf[i]);
+
+	/* Packages started after the overflow don't hand out pointers past the limit. */
+	acpigen_set_limit(acpigen_buf + limit);
+	acpigen_set_current(acpigen_buf + limit - 1);
+	pkg_count = acpigen_write_package(1);
+	assert_true(acpigen_overflowed());
+	assert_true(pkg_count < acpigen_buf || pkg_count >= acpigen_buf +
+		    ACPIGEN_TEST_BUFFER_SZ);
+	*pkg_count = 3;
+	acpigen_pop_len();
+	for (i = limit; i < ACPIGEN_TEST_BUFFER_SZ; i++)
+		assert_int_equal(0xa5, (u8)acpigen_buf[i]);
+
+	acpigen_set_limit(NULL);
+	assert_false(acpigen_overflowed());
+}
+
+static void write_bench_cpu(unsigned int cpu, const struct acpi_sw_pstate *pstates,
+			    size_t num_pstates, acpi_tstate_t *tstates, size_t num_tstates)
+{
+	acpigen_write_processor(cpu, 0, 0);
+	acpigen_write_pss_object(pstates, num_pstates);
+	acpigen_write_PSD_package(cpu / 2, 2, HW_ALL);
+	acpigen_write_TSS_package(num_tstates, tstates);
+	acpigen_pop_len();
+}
+
+/* Generates the processor objects of a 512 CPU server and reports the time it took. */
+static void test_acpigen_cpu_ssdt_benchmark(void **state)
+{
+	struct acpi_sw_pstate pstates[16];
+	acpi_tstate_t tstates[8];
+	char *cpu_start[ACPIGEN_BENCH_CPUS];
+	char *buf = malloc(ACPIGEN_BENCH_BUFFER_SZ);
+	struct timespec start, end;
+	unsigned int cpu;
+	size_t size;
+	long nsecs;
+	int i;
+
+	assert_non_null(buf);
+
+	for (i = 0; i < ARRAY_SIZE(pstates); i++)
+		pstates[i] = (struct acpi_sw_pstate){ 3600 - 100 * i, 20000 - 500 * i, 10, 10,
+						      (36 - i) << 8, (36 - i) << 8 };
+	for (i = 0; i < ARRAY_SIZE(tstates); i++)
+		tstates[i] = (acpi_tstate_t){ 100 - 12 * i, 1000 - 120 * i, 0, i ? 0x10 | i : 0,
+					      0 };
+
+	acpigen_set_current(buf);
+	acpigen_set_limit(buf + ACPIGEN_BENCH_BUFFER_SZ);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (cpu = 0; cpu < ACPIGEN_BENCH_CPUS; cpu++) {
+		cpu_start[cpu] = acpigen_get_current();
+		write_bench_cpu(cpu, pstates, ARRAY_SIZE(pstates), tstates,
+				ARRAY_SIZE(tstates));
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	assert_false(acpigen_overflowed());
+	acpigen_set_limit(NULL);
+
+	size = acpigen_get_current() - buf;
+	for (cpu = 0; cpu < ACPIGEN_BENCH_CPUS; cpu++) {
+		const char *cpu_end = cpu + 1 < ACPIGEN_BENCH_CPUS ? cpu_start[cpu + 1] :
+								      buf + size;
+		assert_int_equal(decode_package_length(cpu_start[cpu]),
+				 cpu_end - cpu_start[cpu] - 2);
+	}
+
+	nsecs = (end.tv_sec - start.tv_sec) * 1000000000L + end.tv_nsec - start.tv_nsec;
+	print_message("%d CPUs: %zu bytes of AML in %ld us\n", ACPIGEN_BENCH_CPUS, size,
+		      nsecs / 1000);
+
+	free(buf);
+}
+
 int main(void)
 {
 	const struct CMUnitTest tests[] = {
@@ -211,6 +348,11 @@ int main(void)
 						teardown_acpigen),
 		cmocka_unit_test_setup_teardown(test_acpigen_scope_with_contents, setup_acpigen,
 						teardown_acpigen),
+		cmocka_unit_test_setup_teardown(test_acpigen_pss_template, setup_acpigen,
+						teardown_acpigen),
+		cmocka_unit_test_setup_teardown(test_acpigen_limit, setup_acpigen,
+						teardown_acpigen),
+		cmocka_unit_test(test_acpigen_cpu_ssdt_benchmark),
 	};
 
 	return cb_run_group_tests(tests, NULL, NULL);
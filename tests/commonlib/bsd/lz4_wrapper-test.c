@@ -0,0 +1,179 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#include <commonlib/bsd/compression.h>
+#include <commonlib/bsd/helpers.h>
+#include <string.h>
+#include <tests/lib/compression_test.h>
+#include <tests/test.h>
+
+/* Decompress each file this many bytes worth of times to measure throughput. */
+#define LZ4_BENCH_BYTES (16 * MiB)
+
+/* Space after the decompressed data which in-place decompression may need. */
+#define LZ4_INPLACE_MARGIN(comp_sz) ((comp_sz) / 256 + 64)
+
+#define LZ4_TEST_DIR "commonlib/bsd/lz4_wrapper-test"
+
+/* "data.N" refers to data.N.bin holding raw data and data.N.lz4.bin holding its LZ4 frame. */
+static int setup_lz4_file(void **state)
+{
+	return compression_test_setup(state, LZ4_TEST_DIR, ".lz4.bin");
+}
+
+static void test_ulz4fn_correct_file(void **state)
+{
+	compression_test_correct_file(*state, ulz4fn, LZ4_BENCH_BYTES);
+}
+
+/* The compressed data is placed at the end of the output buffer, like stages are loaded. */
+static void test_ulz4fn_in_place(void **state)
+{
+	const struct compression_test_state *s = *state;
+	const size_t buf_sz = s->raw_sz + LZ4_INPLACE_MARGIN(s->comp_sz);
+	uint8_t *buf = test_malloc(buf_sz);
+
+	memcpy(buf + buf_sz - s->comp_sz, s->comp_buf, s->comp_sz);
+	assert_int_equal(s->raw_sz, ulz4fn(buf + buf_sz - s->comp_sz, s->comp_sz, buf, buf_sz));
+	assert_memory_equal(s->raw_buf, buf, s->raw_sz);
+
+	test_free(buf);
+}
+
+static void test_ulz4fn_output_too_small(void **state)
+{
+	compression_test_output_too_small(*state, ulz4fn);
+}
+
+static void test_ulz4fn_truncated_input(void **state)
+{
+	compression_test_truncated_input(*state, ulz4fn);
+}
+
+static void test_ulz4fn_bad_magic(void **state)
+{
+	compression_test_bad_magic(*state, ulz4fn);
+}
+
+/* Decodes the blocks last to first, as CPUs working in parallel might finish them. */
+static size_t lz4f_decode_backwards(const void *src, size_t srcn, void *dst, size_t dstn)
+{
+	struct lz4f_block blocks[8];
+	struct lz4f_frame frame;
+	size_t i, n = 0, out_size = 0, ret;
+
+	if (lz4f_frame_init(&frame, src, srcn, dst, dstn))
+		return 0;
+	while (n < ARRAY_SIZE(blocks) && lz4f_next_block(&frame, &blocks[n]))
+		n++;
+	for (i = n; i-- > 0;) {
+		ret = lz4f_decode_block(&blocks[i]);
+		if (!ret)
+			return 0;
+		out_size += ret;
+	}
+
+	return lz4f_frame_finish(&frame, out_size);
+}
+
+static void test_lz4f_blocks_correct_file(void **state)
+{
+	const struct compression_test_state *s = *state;
+	uint8_t *decomp_buf = test_malloc(s->raw_sz);
+
+	assert_int_equal(s->raw_sz, lz4f_decode_backwards(s->comp_buf, s->comp_sz, decomp_buf,
+							  s->raw_sz));
+	assert_memory_equal(s->raw_buf, decomp_buf, s->raw_sz);
+
+	test_free(decomp_buf);
+}
+
+static void test_lz4f_blocks_in_place(void **state)
+{
+	const struct compression_test_state *s = *state;
+	const size_t buf_sz = s->raw_sz + LZ4_INPLACE_MARGIN(s->comp_sz);
+	uint8_t *buf = test_malloc(buf_sz);
+	struct lz4f_frame frame;
+
+	memcpy(buf + buf_sz - s->comp_sz, s->comp_buf, s->comp_sz);
+	assert_int_equal(-1, lz4f_frame_init(&frame, buf + buf_sz - s->comp_sz, s->comp_sz,
+					     buf, buf_sz));
+
+	test_free(buf);
+}
+
+/* data.1.lz4-64k.bin was made by the lz4 tool with 64K blocks, content size and block and
+   content checksums. */
+static void test_lz4f_blocks_checksums(void **state)
+{
+	size_t raw_sz, comp_sz;
+	uint8_t *raw_buf = compression_test_read_file(LZ4_TEST_DIR, "data.1", ".bin", &raw_sz);
+	uint8_t *comp_buf = compression_test_read_file(LZ4_TEST_DIR, "data.1", ".lz4-64k.bin",
+						       &comp_sz);
+	uint8_t *decomp_buf = test_malloc(raw_sz);
+	struct lz4f_frame frame;
+
+	assert_non_null(raw_buf);
+	assert_non_null(comp_buf);
+
+	assert_int_equal(0, lz4f_frame_init(&frame, comp_buf, comp_sz, decomp_buf, raw_sz));
+	assert_int_equal(64 * KiB, frame.block_size);
+	assert_int_equal(DIV_ROUND_UP(raw_sz, 64 * KiB), frame.blocks);
+	assert_true(frame.has_block_checksum);
+	assert_true(frame.has_content_checksum);
+
+	assert_int_equal(raw_sz, lz4f_decode_backwards(comp_buf, comp_sz, decomp_buf, raw_sz));
+	assert_memory_equal(raw_buf, decomp_buf, raw_sz);
+	assert_int_equal(raw_sz, ulz4fn(comp_buf, comp_sz, decomp_buf, raw_sz));
+	assert_memory_equal(raw_buf, decomp_buf, raw_sz);
+
+	/* The output buffer must hold the start of every block. */
+	assert_int_equal(-1, lz4f_frame_init(&frame, comp_buf, comp_sz, decomp_buf, 64 * KiB));
+
+	/* Somewhere in the middle of the block data. */
+	comp_buf[comp_sz / 2] ^= 0x01;
+	assert_int_equal(0, lz4f_decode_backwards(comp_buf, comp_sz, decomp_buf, raw_sz));
+	comp_buf[comp_sz / 2] ^= 0x01;
+
+	/* The content checksum, which comes last. */
+	comp_buf[comp_sz - 1] ^= 0x01;
+	assert_int_equal(0, lz4f_decode_backwards(comp_buf, comp_sz, decomp_buf, raw_sz));
+	comp_buf[comp_sz - 1] ^= 0x01;
+
+	assert_int_equal(raw_sz, lz4f_decode_backwards(comp_buf, comp_sz, decomp_buf, raw_sz));
+
+	test_free(decomp_buf);
+	test_free(comp_buf);
+	test_free(raw_buf);
+}
+
+#define LZ4_FILE_TEST(_test, _file_prefix) \
+	COMPRESSION_FILE_TEST(_test, setup_lz4_file, _file_prefix)
+
+#define LZ4_FILE_TESTS(_file_prefix)                                                           \
+	LZ4_FILE_TEST(test_ulz4fn_correct_file, _file_prefix),                                 \
+	LZ4_FILE_TEST(test_ulz4fn_in_place, _file_prefix),                                     \
+	LZ4_FILE_TEST(test_ulz4fn_output_too_small, _file_prefix),                             \
+	LZ4_FILE_TEST(test_ulz4fn_truncated_input, _file_prefix),                             \
+	LZ4_FILE_TEST(test_lz4f_blocks_correct_file, _file_prefix),                           \
+	LZ4_FILE_TEST(test_lz4f_blocks_in_place, _file_prefix)
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		/* The same files as in lzma-test, compressed by util/cbfs-compression-tool
+		   with the 8-byte header stripped. */
+		/* util/cbfs-compression-tool, an executable. */
+		LZ4_FILE_TESTS("data.1"),
+		/* README.md */
+		LZ4_FILE_TESTS("data.2"),
+		/* tests/lib/imd-test.c, a structured text file. */
+		LZ4_FILE_TESTS("data.3"),
+		/* libcmocka.so.0.7.0, a shared object. */
+		LZ4_FILE_TESTS("data.4"),
+
+		LZ4_FILE_TEST(test_ulz4fn_bad_magic, "data.2"),
+		cmocka_unit_test(test_lz4f_blocks_checksums),
+	};
+
+	return cb_run_group_tests(tests, NULL, NULL);
+}
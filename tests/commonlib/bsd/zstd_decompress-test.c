@@ -0,0 +1,196 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#include <commonlib/bsd/compression.h>
+#include <commonlib/bsd/helpers.h>
+#include <string.h>
+#include <tests/lib/compression_test.h>
+#include <tests/test.h>
+
+/* Decompress each file this many bytes worth of times to measure throughput. */
+#define ZSTD_BENCH_BYTES (16 * MiB)
+
+#define ZSTD_TEST_DIR "commonlib/bsd/zstd_decompress-test"
+
+/* Guard bytes after the output buffer, which the decoder must never write. */
+#define ZSTD_GUARD_SIZE 64
+
+/* "data.N" refers to data.N.bin holding raw data and data.N.zst.bin holding its zstd frame. */
+static int setup_zstd_file(void **state)
+{
+	return compression_test_setup(state, ZSTD_TEST_DIR, ".zst.bin");
+}
+
+static void test_uzstdn_correct_file(void **state)
+{
+	compression_test_correct_file(*state, uzstdn, ZSTD_BENCH_BYTES);
+}
+
+/* Literals are staged at the end of the output buffer, which may be far away. */
+static void test_uzstdn_large_buffer(void **state)
+{
+	const struct compression_test_state *s = *state;
+	const size_t buf_sz = s->raw_sz * 2 + 4096;
+	uint8_t *decomp_buf = test_malloc(buf_sz);
+
+	memset(decomp_buf, 0xa5, buf_sz);
+	assert_int_equal(s->raw_sz, uzstdn(s->comp_buf, s->comp_sz, decomp_buf, buf_sz));
+	assert_memory_equal(s->raw_buf, decomp_buf, s->raw_sz);
+
+	test_free(decomp_buf);
+}
+
+static void test_uzstdn_output_too_small(void **state)
+{
+	compression_test_output_too_small(*state, uzstdn);
+}
+
+static void test_uzstdn_truncated_input(void **state)
+{
+	compression_test_truncated_input(*state, uzstdn);
+}
+
+static void test_uzstdn_bad_magic(void **state)
+{
+	compression_test_bad_magic(*state, uzstdn);
+}
+
+/* Several frames and skippable frames in between decode to the concatenated data. */
+static void test_uzstdn_multiple_frames(void **state)
+{
+	const struct compression_test_state *s = *state;
+	const uint8_t skippable[] = { 0x50, 0x2a, 0x4d, 0x18, 3, 0, 0, 0, 'c', 'b', 'f' };
+	const size_t comp_sz = 2 * s->comp_sz + sizeof(skippable);
+	uint8_t *comp_buf = test_malloc(comp_sz);
+	uint8_t *decomp_buf = test_malloc(2 * s->raw_sz);
+
+	memcpy(comp_buf, s->comp_buf, s->comp_sz);
+	memcpy(comp_buf + s->comp_sz, skippable, sizeof(skippable));
+	memcpy(comp_buf + s->comp_sz + sizeof(skippable), s->comp_buf, s->comp_sz);
+
+	assert_int_equal(2 * s->raw_sz, uzstdn(comp_buf, comp_sz, decomp_buf, 2 * s->raw_sz));
+	assert_memory_equal(s->raw_buf, decomp_buf, s->raw_sz);
+	assert_memory_equal(s->raw_buf, decomp_buf + s->raw_sz, s->raw_sz);
+
+	test_free(decomp_buf);
+	test_free(comp_buf);
+}
+
+/* Returns the offset of the first block header, right after the frame header. */
+static size_t first_block(const struct compression_test_state *s)
+{
+	const uint8_t fhd = s->comp_buf[4];
+	const size_t did_size = (1 << (fhd & 3)) >> 1;
+	size_t fcs_size = fhd >> 6 ? 1 << (fhd >> 6) : 0;
+
+	if (!(fhd & 0x20))
+		return 4 + 1 + 1 + did_size + fcs_size;
+	return 4 + 1 + did_size + MAX(fcs_size, 1);
+}
+
+/* Decodes the corrupted frame and checks that nothing past the output buffer was written. */
+static size_t uzstdn_guarded(const struct compression_test_state *s, uint8_t *decomp_buf)
+{
+	size_t ret;
+
+	memset(decomp_buf + s->raw_sz, 0xa5, ZSTD_GUARD_SIZE);
+	ret = uzstdn(s->comp_buf, s->comp_sz, decomp_buf, s->raw_sz);
+	for (size_t i = 0; i < ZSTD_GUARD_SIZE; i++)
+		assert_int_equal(0xa5, decomp_buf[s->raw_sz + i]);
+	assert_true(ret <= s->raw_sz);
+
+	return ret;
+}
+
+/* The files hold a single compressed block with Huffman coded literals and sequences. */
+static void test_uzstdn_corrupt_block(void **state)
+{
+	struct compression_test_state *s = *state;
+	uint8_t *decomp_buf = test_malloc(s->raw_sz + ZSTD_GUARD_SIZE);
+	const size_t block = first_block(s);
+	const size_t lit = block + 3;
+	const uint32_t header = s->comp_buf[block] | s->comp_buf[block + 1] << 8 |
+				s->comp_buf[block + 2] << 16;
+	const size_t block_end = lit + (header >> 3);
+	uint8_t saved[3], last;
+	size_t i;
+
+	assert_int_equal(2, (header >> 1) & 3);
+	assert_int_equal(2, s->comp_buf[lit] & 3);
+	memcpy(saved, &s->comp_buf[lit], sizeof(saved));
+
+	/* Raw literals larger than the rest of the block. */
+	s->comp_buf[lit] = 0xfc;
+	s->comp_buf[lit + 1] = 0xff;
+	s->comp_buf[lit + 2] = 0xff;
+	assert_int_equal(0, uzstdn_guarded(s, decomp_buf));
+
+	/* RLE literals larger than the output buffer. */
+	s->comp_buf[lit] = 0xfd;
+	assert_int_equal(0, uzstdn_guarded(s, decomp_buf));
+
+	/* Huffman coded literals whose compressed size runs past the block. */
+	memcpy(&s->comp_buf[lit], saved, sizeof(saved));
+	s->comp_buf[lit + 2] |= 0xc0;
+	assert_int_equal(0, uzstdn_guarded(s, decomp_buf));
+	memcpy(&s->comp_buf[lit], saved, sizeof(saved));
+
+	/* The sequence bitstream has to end with a set padding bit. */
+	last = s->comp_buf[block_end - 1];
+	s->comp_buf[block_end - 1] = 0;
+	assert_int_equal(0, uzstdn_guarded(s, decomp_buf));
+	s->comp_buf[block_end - 1] = last;
+
+	/* A reserved block type. */
+	s->comp_buf[block] |= 3 << 1;
+	assert_int_equal(0, uzstdn_guarded(s, decomp_buf));
+	s->comp_buf[block] = header & 0xff;
+
+	/* A block running past the end of the input. */
+	s->comp_buf[block + 2] = 0xff;
+	assert_int_equal(0, uzstdn_guarded(s, decomp_buf));
+	s->comp_buf[block + 2] = header >> 16;
+
+	/*
+	 * Any flipped bit in the literals or sequences may at most give wrong output, which
+	 * has to stay within the buffer. Without a checksum not every flip is noticed.
+	 */
+	for (i = lit; i < block_end; i++) {
+		s->comp_buf[i] ^= 1 << (i % 8);
+		uzstdn_guarded(s, decomp_buf);
+		s->comp_buf[i] ^= 1 << (i % 8);
+	}
+
+	test_free(decomp_buf);
+}
+
+#define ZSTD_FILE_TEST(_test, _file_prefix) \
+	COMPRESSION_FILE_TEST(_test, setup_zstd_file, _file_prefix)
+
+#define ZSTD_FILE_TESTS(_file_prefix)                                                          \
+	ZSTD_FILE_TEST(test_uzstdn_correct_file, _file_prefix),                                \
+	ZSTD_FILE_TEST(test_uzstdn_large_buffer, _file_prefix),                                \
+	ZSTD_FILE_TEST(test_uzstdn_output_too_small, _file_prefix),                            \
+	ZSTD_FILE_TEST(test_uzstdn_truncated_input, _file_prefix)
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		/* The same files as in lzma-test, compressed by
+		   'util/cbfs-compression-tool rawcompress'. */
+		/* util/cbfs-compression-tool, an executable. */
+		ZSTD_FILE_TESTS("data.1"),
+		/* README.md */
+		ZSTD_FILE_TESTS("data.2"),
+		/* tests/lib/imd-test.c, a structured text file. */
+		ZSTD_FILE_TESTS("data.3"),
+		/* libcmocka.so.0.7.0, a shared object. */
+		ZSTD_FILE_TESTS("data.4"),
+
+		ZSTD_FILE_TEST(test_uzstdn_bad_magic, "data.2"),
+		ZSTD_FILE_TEST(test_uzstdn_multiple_frames, "data.3"),
+		ZSTD_FILE_TEST(test_uzstdn_corrupt_block, "data.3"),
+		ZSTD_FILE_TEST(test_uzstdn_corrupt_block, "data.4"),
+	};
+
+	return cb_run_group_tests(tests, NULL, NULL);
+}
@@ -391,6 +391,96 @@ static void test_mem_rdev(void **state)
 	assert_memory_equal(backing, scratch, size);
 }
 
+static void test_cached_rdev(void **state)
+{
+	const size_t size = 1024;
+	const size_t block_size = 64;
+	const size_t block_count = 4;
+	u8 backing[size];
+	u8 scratch[size];
+	u8 cache[block_size * block_count];
+	struct region_device mem;
+	struct cached_rdev crdev;
+	const struct region_device *rdev;
+	size_t i;
+
+	for (i = 0; i < size; i++)
+		backing[i] = i * 7;
+	rdev_chain_mem_rw(&mem, backing, size);
+
+	/* Invalid parameters. */
+	assert_null(cached_rdev_init(&crdev, &mem, NULL, block_size, block_count));
+	assert_null(cached_rdev_init(&crdev, &mem, cache, 0, block_count));
+	assert_null(cached_rdev_init(&crdev, &mem, cache, block_size,
+				     CACHED_RDEV_MAX_BLOCKS + 1));
+
+	rdev = cached_rdev_init(&crdev, &mem, cache, block_size, block_count);
+	assert_non_null(rdev);
+	assert_int_equal(region_device_sz(rdev), size);
+
+	/* Byte-wise walk only misses once per block. */
+	for (i = 0; i < 2 * block_size; i++) {
+		assert_int_equal(rdev_readat(rdev, scratch, i, 1), 1);
+		assert_int_equal(scratch[0], backing[i]);
+	}
+	assert_int_equal(crdev.misses, 2);
+	assert_int_equal(crdev.hits, 2 * block_size - 2);
+
+	/* Unaligned read spanning three blocks reads the middle one directly. */
+	crdev.hits = crdev.misses = 0;
+	assert_int_equal(rdev_readat(rdev, scratch, block_size - 3, block_size + 6),
+			 block_size + 6);
+	assert_memory_equal(scratch, backing + block_size - 3, block_size + 6);
+	assert_int_equal(crdev.hits, 1);
+	assert_int_equal(crdev.misses, 1);
+
+	/* Aligned full blocks bypass the cache. */
+	crdev.hits = crdev.misses = 0;
+	assert_int_equal(rdev_read_full(rdev, scratch), size);
+	assert_memory_equal(scratch, backing, size);
+	assert_int_equal(crdev.misses, 0);
+	assert_int_equal(crdev.hits, 0);
+
+	/* Least recently used block gets evicted. */
+	cached_rdev_invalidate(&crdev);
+	crdev.hits = crdev.misses = 0;
+	for (i = 0; i < block_count; i++)
+		assert_int_equal(rdev_readat(rdev, scratch, i * block_size, 1), 1);
+	assert_int_equal(rdev_readat(rdev, scratch, 0, 1), 1);
+	assert_int_equal(rdev_readat(rdev, scratch, block_count * block_size, 1), 1);
+	assert_int_equal(crdev.misses, block_count + 1);
+	crdev.hits = crdev.misses = 0;
+	assert_int_equal(rdev_readat(rdev, scratch, 0, 1), 1);
+	assert_int_equal(rdev_readat(rdev, scratch, block_size, 1), 1);
+	assert_int_equal(crdev.hits, 1);
+	assert_int_equal(crdev.misses, 1);
+
+	/* Writes and erases are visible to later reads. */
+	scratch[0] = 0xa5;
+	assert_int_equal(rdev_writeat(rdev, scratch, 5, 1), 1);
+	assert_int_equal(backing[5], 0xa5);
+	assert_int_equal(rdev_readat(rdev, scratch, 4, 2), 2);
+	assert_int_equal(scratch[0], backing[4]);
+	assert_int_equal(scratch[1], 0xa5);
+	assert_int_equal(rdev_eraseat(rdev, 4, 2), 2);
+	assert_int_equal(rdev_readat(rdev, scratch, 4, 2), 2);
+	assert_int_equal(scratch[0], 0);
+	assert_int_equal(scratch[1], 0);
+
+	/* Explicit invalidation picks up changes behind the cache's back. */
+	backing[6] = 0x5a;
+	cached_rdev_invalidate(&crdev);
+	assert_int_equal(rdev_readat(rdev, scratch, 6, 1), 1);
+	assert_int_equal(scratch[0], 0x5a);
+
+	/* Partial block at the end of the device. */
+	rdev_chain_mem_rw(&mem, backing, size - 10);
+	rdev = cached_rdev_init(&crdev, &mem, cache, block_size, block_count);
+	assert_int_equal(rdev_readat(rdev, scratch, size - 20, 10), 10);
+	assert_memory_equal(scratch, backing + size - 20, 10);
+	assert_int_equal(rdev_readat(rdev, scratch, size - 20, 11), -1);
+}
+
 int main(void)
 {
 	const struct CMUnitTest tests[] = {
@@ -402,6 +492,7 @@ int main(void)
 		cmocka_unit_test(test_rdev_chain),
 		cmocka_unit_test(test_rdev_double_chain),
 		cmocka_unit_test(test_mem_rdev),
+		cmocka_unit_test(test_cached_rdev),
 	};
 
 	return cb_run_group_tests(tests, NULL, NULL);
@@ -0,0 +1,342 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#include "../device/device_index.c"
+
+#include <device/device.h>
+#include <device/pci_def.h>
+#include <device/pci_ids.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tests/test.h>
+
+/* Topology of the test tree: CPUs on a cluster and PCI devices spread over domain buses. */
+#define NUM_CPUS		256
+#define NUM_ROOT_BUSES		16
+#define DEVS_PER_BUS		108
+#define NUM_DEVICES		(3 + NUM_CPUS + NUM_ROOT_BUSES * (1 + DEVS_PER_BUS))
+
+/* Generous bound for the longest hash chain walked by a single lookup. */
+#define MAX_CHAIN_LENGTH	32
+
+struct bus root_link;
+struct device dev_root = {
+	.path = { .type = DEVICE_PATH_ROOT },
+	.bus = &root_link,
+	.link_list = &root_link,
+};
+struct bus root_link = {
+	.dev = &dev_root,
+};
+
+static struct device *devices;
+static struct bus *buses;
+static struct device *last_device;
+static size_t num_devices;
+
+static struct device *add_device(struct bus *parent, const struct device_path *path)
+{
+	struct device *dev = &devices[num_devices++];
+	struct device *child;
+
+	memset(dev, 0, sizeof(*dev));
+	dev->path = *path;
+	dev->bus = parent;
+	dev->enabled = 1;
+
+	for (child = parent->children; child && child->sibling; child = child->sibling)
+		;
+	if (child)
+		child->sibling = dev;
+	else
+		parent->children = dev;
+
+	last_device->next = dev;
+	last_device = dev;
+
+	return dev;
+}
+
+static struct bus *add_link(struct device *dev, size_t index)
+{
+	struct bus *link = &buses[index];
+
+	link->dev = dev;
+	dev->link_list = link;
+	return link;
+}
+
+static int setup_device_tree(void **state)
+{
+	struct device_path path;
+	struct device *cluster, *domain, *bridge, *dev;
+	struct bus *cpu_bus, *domain_bus, *bus;
+	size_t i, j;
+
+	/* Leave room for the device added by test_dev_index_update(). */
+	devices = calloc(NUM_DEVICES + 1, sizeof(*devices));
+	buses = calloc(NUM_ROOT_BUSES + 2, sizeof(*buses));
+	if (!devices || !buses)
+		return -1;
+
+	last_device = &dev_root;
+
+	path = (struct device_path){ .type = DEVICE_PATH_CPU_CLUSTER };
+	cluster = add_device(&root_link, &path);
+	cpu_bus = add_link(cluster, 0);
+	for (i = 0; i < NUM_CPUS; i++) {
+		path = (struct device_path){ .type = DEVICE_PATH_APIC, .apic.apic_id = i * 2 };
+		add_device(cpu_bus, &path);
+	}
+
+	path = (struct device_path){ .type = DEVICE_PATH_DOMAIN };
+	domain = add_device(&root_link, &path);
+	domain_bus = add_link(domain, 1);
+
+	path = (struct device_path){ .type = DEVICE_PATH_PCI, .pci.devfn = PCI_DEVFN(0, 0) };
+	dev = add_device(domain_bus, &path);
+	dev->vendor = 0x8086;
+	dev->device = 0x09a2;
+	dev->class = PCI_CLASS_BRIDGE_HOST << 8;
+
+	for (i = 0; i < NUM_ROOT_BUSES; i++) {
+		path = (struct device_path){ .type = DEVICE_PATH_PCI,
+					     .pci.devfn = PCI_DEVFN(1 + i, 0) };
+		bridge = add_device(domain_bus, &path);
+		bridge->vendor = 0x8086;
+		bridge->device = 0x347a;
+		bridge->class = PCI_CLASS_BRIDGE_PCI << 8;
+		bus = add_link(bridge, 2 + i);
+
+		for (j = 0; j < DEVS_PER_BUS; j++) {
+			path = (struct device_path){ .type = DEVICE_PATH_PCI,
+						     .pci.devfn = PCI_DEVFN(j / 8, j % 8) };
+			dev = add_device(bus, &path);
+			dev->vendor = 0x8086;
+			dev->device = 0x2000 + j;
+			dev->class = (j % 4 == 0 ? PCI_CLASS_STORAGE_SATA : PCI_CLASS_NETWORK_ETHERNET)
+				<< 8;
+		}
+	}
+
+	return 0;
+}
+
+static int teardown_device_tree(void **state)
+{
+	free(devices);
+	free(buses);
+	return 0;
+}
+
+/* Reference implementations walking the device lists. */
+static struct device *walk_find_lapic(unsigned int apic_id)
+{
+	struct device *dev;
+
+	for (dev = all_devices; dev; dev = dev->next)
+		if (dev->path.type == DEVICE_PATH_APIC && dev->path.apic.apic_id == apic_id)
+			return dev;
+	return NULL;
+}
+
+static struct device *walk_find_device(u16 vendor, u16 device, struct device *from)
+{
+	for (from = from ? from->next : all_devices; from; from = from->next)
+		if (from->vendor == vendor && from->device == device)
+			return from;
+	return NULL;
+}
+
+static struct device *walk_find_class(unsigned int class, struct device *from)
+{
+	for (from = from ? from->next : all_devices; from; from = from->next)
+		if ((from->class & 0xffffff00) == class)
+			return from;
+	return NULL;
+}
+
+static struct device *walk_find_path(const struct bus *parent, const struct device_path *path)
+{
+	struct device *child;
+
+	for (child = parent->children; child; child = child->sibling)
+		if (dev_path_eq(path, &child->path))
+			return child;
+	return NULL;
+}
+
+static size_t max_chain_length(enum dev_index_table table)
+{
+	struct dev_index_entry *entry;
+	size_t i, length, max = 0;
+
+	for (i = 0; i < DEV_INDEX_BUCKETS; i++) {
+		length = 0;
+		for (entry = dev_index[table][i].head; entry; entry = entry->next)
+			length++;
+		max = MAX(max, length);
+	}
+
+	return max;
+}
+
+static void test_dev_index_early_lookup(void **state)
+{
+	struct device *cluster = &devices[0];
+	struct device *last_cpu = &devices[NUM_CPUS];
+	struct device *domain = cluster->sibling;
+	struct device *dev;
+	bool indexed;
+
+	/* A lookup before enumeration only sees the CPUs. */
+	cluster->sibling = NULL;
+	last_cpu->next = NULL;
+	assert_ptr_equal(last_cpu, dev_index_find_lapic(2 * (NUM_CPUS - 1), &indexed));
+	assert_true(indexed);
+
+	/* Enumeration then adds the rest of the devices one by one. */
+	cluster->sibling = domain;
+	last_cpu->next = domain;
+	for (dev = domain; dev; dev = dev->next)
+		dev_index_add(dev);
+
+	/* The index grows instead of giving up. */
+	assert_ptr_equal(walk_find_device(0x8086, 0x347a, NULL),
+			 dev_index_find_device(0x8086, 0x347a, NULL, &indexed));
+	assert_true(indexed);
+	assert_false(dev_index_disabled);
+	assert_in_range(entries_size, NUM_DEVICES * DEV_INDEX_TABLES,
+			4 * NUM_DEVICES * DEV_INDEX_TABLES);
+}
+
+static void test_dev_index_lapic(void **state)
+{
+	bool indexed;
+	unsigned int i;
+
+	for (i = 0; i < 2 * NUM_CPUS + 2; i++) {
+		assert_ptr_equal(walk_find_lapic(i), dev_index_find_lapic(i, &indexed));
+		assert_true(indexed);
+	}
+
+	assert_in_range(max_chain_length(DEV_INDEX_LAPIC), 1, MAX_CHAIN_LENGTH);
+}
+
+static void test_dev_index_device(void **state)
+{
+	struct device *from = NULL;
+	struct device *dev;
+	bool indexed;
+	size_t count = 0;
+	unsigned int j;
+
+	/* Iterate over all matches like SoC code looping over root ports does. */
+	do {
+		dev = dev_index_find_device(0x8086, 0x347a, from, &indexed);
+		assert_true(indexed);
+		assert_ptr_equal(walk_find_device(0x8086, 0x347a, from), dev);
+		from = dev;
+		count += dev != NULL;
+	} while (dev);
+	assert_int_equal(NUM_ROOT_BUSES, count);
+
+	for (j = 0; j < DEVS_PER_BUS; j++) {
+		dev = dev_index_find_device(0x8086, 0x2000 + j, NULL, &indexed);
+		assert_true(indexed);
+		assert_ptr_equal(walk_find_device(0x8086, 0x2000 + j, NULL), dev);
+	}
+
+	assert_null(dev_index_find_device(0x1022, 0x2000, NULL, &indexed));
+	assert_true(indexed);
+
+	/* A starting point that doesn't match can't be located in the index. */
+	dev_index_find_device(0x8086, 0x347a, &devices[0], &indexed);
+	assert_false(indexed);
+}
+
+static void test_dev_index_class(void **state)
+{
+	const unsigned int class = PCI_CLASS_STORAGE_SATA << 8;
+	struct device *from = NULL;
+	struct device *dev;
+	bool indexed;
+	size_t count = 0;
+
+	do {
+		dev = dev_index_find_class(class, from, &indexed);
+		assert_true(indexed);
+		assert_ptr_equal(walk_find_class(class, from), dev);
+		from = dev;
+		count += dev != NULL;
+	} while (dev);
+	assert_int_equal(NUM_ROOT_BUSES * DEVS_PER_BUS / 4, count);
+
+	/* Classes with the programming interface set never match. */
+	assert_null(dev_index_find_class(class | 1, NULL, &indexed));
+	assert_true(indexed);
+}
+
+static void test_dev_index_path(void **state)
+{
+	struct device_path path = { .type = DEVICE_PATH_PCI };
+	struct device *dev;
+	bool indexed;
+	size_t i, devfn;
+
+	for (i = 0; i < NUM_ROOT_BUSES + 2; i++) {
+		for (devfn = 0; devfn < 0x100; devfn++) {
+			path.pci.devfn = devfn;
+			dev = dev_index_find_path(&buses[i], &path, &indexed);
+			assert_true(indexed);
+			assert_ptr_equal(walk_find_path(&buses[i], &path), dev);
+		}
+	}
+
+	assert_in_range(max_chain_length(DEV_INDEX_PATH), 1, MAX_CHAIN_LENGTH);
+}
+
+static void test_dev_index_update(void **state)
+{
+	struct device_path path = {
+		.type = DEVICE_PATH_APIC,
+		.apic.apic_id = 2 * NUM_CPUS + 1,
+	};
+	struct bus *cpu_bus = &buses[0];
+	struct device *cpu;
+	bool indexed;
+
+	/* Devices added by alloc_dev() are appended to the index. */
+	assert_null(dev_index_find_lapic(path.apic.apic_id, &indexed));
+	cpu = add_device(cpu_bus, &path);
+	dev_index_add(cpu);
+	assert_ptr_equal(cpu, dev_index_find_lapic(path.apic.apic_id, &indexed));
+	assert_ptr_equal(cpu, dev_index_find_path(cpu_bus, &path, &indexed));
+
+	/* Changing IDs requires invalidating the index. */
+	cpu->path.apic.apic_id = 2 * NUM_CPUS + 3;
+	dev_index_invalidate();
+	assert_null(dev_index_find_lapic(2 * NUM_CPUS + 1, &indexed));
+	assert_ptr_equal(cpu, dev_index_find_lapic(2 * NUM_CPUS + 3, &indexed));
+	assert_true(indexed);
+
+	/* Unlinked devices are no longer found on their bus. */
+	devices[1].sibling = NULL;
+	dev_index_invalidate();
+	path.apic.apic_id = 2;
+	assert_null(dev_index_find_path(cpu_bus, &path, &indexed));
+	assert_true(indexed);
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_dev_index_early_lookup),
+		cmocka_unit_test(test_dev_index_lapic),
+		cmocka_unit_test(test_dev_index_device),
+		cmocka_unit_test(test_dev_index_class),
+		cmocka_unit_test(test_dev_index_path),
+		cmocka_unit_test(test_dev_index_update),
+	};
+
+	return cb_run_group_tests(tests, setup_device_tree, teardown_device_tree);
+}
@@ -0,0 +1,243 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#include "../drivers/mrc_cache/mrc_cache.c"
+
+#include <boot_device.h>
+#include <fmap.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tests/test.h>
+
+#define MRC_TEST_VERSION	0x42
+#define MRC_TEST_DATA_SIZE	(8 * MRC_DELTA_BLOCK_SIZE + 100)
+#define MRC_TEST_REGION_SIZE	(16 * KiB)
+
+static uint8_t flash_buffer[MRC_TEST_REGION_SIZE];
+static struct region_device flash_rdev_rw;
+
+int fmap_locate_area(const char *name, struct region *r)
+{
+	if (strcmp(name, DEFAULT_MRC_CACHE))
+		return -1;
+
+	r->offset = 0;
+	r->size = sizeof(flash_buffer);
+	return 0;
+}
+
+int boot_device_ro_subregion(const struct region *sub, struct region_device *subrd)
+{
+	return rdev_chain(subrd, &flash_rdev_rw, region_offset(sub), region_sz(sub));
+}
+
+int boot_device_rw_subregion(const struct region *sub, struct region_device *subrd)
+{
+	return rdev_chain(subrd, &flash_rdev_rw, region_offset(sub), region_sz(sub));
+}
+
+/* Like the memory backed rdev, but erasing sets bits as on real flash. */
+static void *flash_mmap(const struct region_device *rd, size_t offset, size_t size)
+{
+	return &flash_buffer[offset];
+}
+
+static int flash_munmap(const struct region_device *rd, void *mapping)
+{
+	return 0;
+}
+
+static ssize_t flash_readat(const struct region_device *rd, void *b, size_t offset,
+			    size_t size)
+{
+	memcpy(b, &flash_buffer[offset], size);
+	return size;
+}
+
+static ssize_t flash_writeat(const struct region_device *rd, const void *b, size_t offset,
+			     size_t size)
+{
+	memcpy(&flash_buffer[offset], b, size);
+	return size;
+}
+
+static ssize_t flash_eraseat(const struct region_device *rd, size_t offset, size_t size)
+{
+	memset(&flash_buffer[offset], 0xff, size);
+	return size;
+}
+
+static const struct region_device_ops flash_ops = {
+	.mmap = flash_mmap,
+	.munmap = flash_munmap,
+	.readat = flash_readat,
+	.writeat = flash_writeat,
+	.eraseat = flash_eraseat,
+};
+
+static int setup_mrc_cache_test(void **state)
+{
+	memset(flash_buffer, 0xff, sizeof(flash_buffer));
+	region_device_init(&flash_rdev_rw, &flash_ops, 0, sizeof(flash_buffer));
+	return 0;
+}
+
+static void fill_data(uint8_t *data, uint8_t seed)
+{
+	size_t i;
+
+	for (i = 0; i < MRC_TEST_DATA_SIZE; i++)
+		data[i] = seed + i * 7;
+}
+
+/* Read the metadata of the latest slot straight from the region file. */
+static void latest_slot_md(struct mrc_metadata *md)
+{
+	struct region_file cache_file;
+	struct region_device rdev;
+
+	assert_int_equal(0, region_file_init(&cache_file, &flash_rdev_rw));
+	assert_int_equal(0, region_file_data(&cache_file, &rdev));
+	assert_int_equal(sizeof(*md), rdev_readat(&rdev, md, 0, sizeof(*md)));
+}
+
+static void assert_data_current(const uint8_t *expected)
+{
+	uint8_t buffer[MRC_TEST_DATA_SIZE + 16];
+	const uint8_t *mapped;
+	size_t mapped_size;
+
+	assert_int_equal(MRC_TEST_DATA_SIZE,
+			 mrc_cache_load_current(MRC_TRAINING_DATA, MRC_TEST_VERSION, buffer,
+						sizeof(buffer)));
+	assert_memory_equal(expected, buffer, MRC_TEST_DATA_SIZE);
+
+	mapped = mrc_cache_current_mmap_leak(MRC_TRAINING_DATA, MRC_TEST_VERSION,
+					     &mapped_size);
+	assert_non_null(mapped);
+	assert_int_equal(MRC_TEST_DATA_SIZE, mapped_size);
+	assert_memory_equal(expected, mapped, MRC_TEST_DATA_SIZE);
+}
+
+static void test_mrc_cache_delta_write(void **state)
+{
+	uint8_t data[MRC_TEST_DATA_SIZE];
+	struct mrc_metadata md;
+	struct region_file cache_file;
+	struct region_device rdev;
+	struct mrc_delta delta;
+	size_t offset;
+
+	/* Without a full slot to refer to the first update is written in full. */
+	fill_data(data, 1);
+	assert_int_equal(0, mrc_cache_stash_data(MRC_TRAINING_DATA, MRC_TEST_VERSION, data,
+						 sizeof(data)));
+	latest_slot_md(&md);
+	assert_int_equal(MRC_DATA_SIGNATURE, md.signature);
+
+	/* Changes in two blocks, one of them the short last block. */
+	data[MRC_DELTA_BLOCK_SIZE + 3] ^= 0xff;
+	data[MRC_TEST_DATA_SIZE - 1] ^= 0xff;
+	assert_int_equal(0, mrc_cache_stash_data(MRC_TRAINING_DATA, MRC_TEST_VERSION, data,
+						 sizeof(data)));
+	latest_slot_md(&md);
+	assert_int_equal(MRC_DELTA_SIGNATURE, md.signature);
+	assert_int_equal(MRC_TEST_DATA_SIZE, md.data_size);
+
+	assert_int_equal(0, region_file_init(&cache_file, &flash_rdev_rw));
+	assert_int_equal(0, region_file_data(&cache_file, &rdev));
+	assert_int_equal(0, mrc_header_valid(&rdev, &md));
+	assert_int_equal(sizeof(delta), rdev_readat(&rdev, &delta, sizeof(md), sizeof(delta)));
+	assert_int_equal(2, delta.block_count);
+	assert_int_equal(1, delta.blocks[0]);
+	assert_int_equal(MRC_TEST_DATA_SIZE / MRC_DELTA_BLOCK_SIZE, delta.blocks[1]);
+	/* Only the changed blocks are stored. */
+	assert_int_equal(sizeof(md) + sizeof(delta) + MRC_DELTA_BLOCK_SIZE + 100,
+			 region_device_sz(&rdev));
+
+	/* Stashing the same data again doesn't add a slot. */
+	offset = region_device_offset(&rdev);
+	assert_int_equal(0, mrc_cache_stash_data(MRC_TRAINING_DATA, MRC_TEST_VERSION, data,
+						 sizeof(data)));
+	assert_int_equal(0, region_file_init(&cache_file, &flash_rdev_rw));
+	assert_int_equal(0, region_file_data(&cache_file, &rdev));
+	assert_int_equal(offset, region_device_offset(&rdev));
+}
+
+static void test_mrc_cache_delta_rebuild(void **state)
+{
+	uint8_t data[MRC_TEST_DATA_SIZE];
+	const uint8_t *mapped;
+	struct mrc_metadata md;
+	struct region_file cache_file;
+	struct region_device rdev;
+
+	fill_data(data, 2);
+	assert_int_equal(0, mrc_cache_stash_data(MRC_TRAINING_DATA, MRC_TEST_VERSION, data,
+						 sizeof(data)));
+
+	/* Every delta refers to the full slot, not to the previous delta. */
+	for (int i = 0; i < 4; i++) {
+		data[i * MRC_DELTA_BLOCK_SIZE] ^= 0x5a;
+		assert_int_equal(0, mrc_cache_stash_data(MRC_TRAINING_DATA, MRC_TEST_VERSION,
+							 data, sizeof(data)));
+		assert_data_current(data);
+	}
+
+	/* The rebuilt data isn't a mapping of the flash contents. */
+	mapped = mrc_cache_current_mmap_leak(MRC_TRAINING_DATA, MRC_TEST_VERSION, NULL);
+	assert_true(mapped < flash_buffer || mapped >= flash_buffer + sizeof(flash_buffer));
+
+	/* A corrupted delta block fails the data hash. */
+	assert_int_equal(0, region_file_init(&cache_file, &flash_rdev_rw));
+	assert_int_equal(0, region_file_data(&cache_file, &rdev));
+	assert_int_equal(0, mrc_header_valid(&rdev, &md));
+	flash_buffer[rdev_relative_offset(&flash_rdev_rw, &rdev) + region_device_sz(&rdev) - 1]
+		^= 0xff;
+	assert_int_equal(-1, mrc_cache_load_current(MRC_TRAINING_DATA, MRC_TEST_VERSION, data,
+						    sizeof(data)));
+	assert_null(mrc_cache_current_mmap_leak(MRC_TRAINING_DATA, MRC_TEST_VERSION, NULL));
+}
+
+static void test_mrc_cache_delta_compaction(void **state)
+{
+	uint8_t data[MRC_TEST_DATA_SIZE];
+	struct mrc_metadata md;
+	bool compacted = false;
+
+	fill_data(data, 3);
+	assert_int_equal(0, mrc_cache_stash_data(MRC_TRAINING_DATA, MRC_TEST_VERSION, data,
+						 sizeof(data)));
+
+	/* Changing most blocks makes a delta larger than the data itself. */
+	fill_data(data, 4);
+	assert_int_equal(0, mrc_cache_stash_data(MRC_TRAINING_DATA, MRC_TEST_VERSION, data,
+						 sizeof(data)));
+	latest_slot_md(&md);
+	assert_int_equal(MRC_DATA_SIGNATURE, md.signature);
+	assert_data_current(data);
+
+	/* Once the region file runs out of space a full copy is written instead of
+	   emptying the region file and losing the full slot deltas refer to. */
+	for (int i = 0; i < MRC_TEST_REGION_SIZE / MRC_DELTA_BLOCK_SIZE; i++) {
+		data[(i % 8) * MRC_DELTA_BLOCK_SIZE] ^= 0xa5;
+		assert_int_equal(0, mrc_cache_stash_data(MRC_TRAINING_DATA, MRC_TEST_VERSION,
+							 data, sizeof(data)));
+		assert_data_current(data);
+
+		latest_slot_md(&md);
+		if (md.signature == MRC_DATA_SIGNATURE)
+			compacted = true;
+	}
+	assert_true(compacted);
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup(test_mrc_cache_delta_write, setup_mrc_cache_test),
+		cmocka_unit_test_setup(test_mrc_cache_delta_rebuild, setup_mrc_cache_test),
+		cmocka_unit_test_setup(test_mrc_cache_delta_compaction, setup_mrc_cache_test),
+	};
+
+	return cb_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,127 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#include <commonlib/bsd/helpers.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <tests/lib/compression_test.h>
+#include <time.h>
+#include <unistd.h>
+
+uint8_t *compression_test_read_file(const char *dir, const char *name, const char *suffix,
+				    size_t *size)
+{
+	char path[256];
+	uint8_t *buf;
+	struct stat st;
+	int f;
+
+	snprintf(path, sizeof(path), "%s/%s/%s%s", __TEST_DATA_DIR__, dir, name, suffix);
+	f = open(path, O_RDONLY);
+	if (f == -1 || fstat(f, &st) == -1) {
+		print_error("Unable to open file: %s\n", path);
+		if (f != -1)
+			close(f);
+		return NULL;
+	}
+
+	buf = test_malloc(st.st_size);
+	if (read(f, buf, st.st_size) != st.st_size) {
+		print_error("Unable to read file: %s\n", path);
+		test_free(buf);
+		buf = NULL;
+	}
+	close(f);
+
+	*size = st.st_size;
+	return buf;
+}
+
+int compression_test_setup(void **state, const char *dir, const char *comp_suffix)
+{
+	struct compression_test_state *s = test_calloc(1, sizeof(*s));
+
+	if (!s)
+		return 1;
+
+	s->name = *state;
+	s->raw_buf = compression_test_read_file(dir, s->name, ".bin", &s->raw_sz);
+	s->comp_buf = compression_test_read_file(dir, s->name, comp_suffix, &s->comp_sz);
+	*state = s;
+
+	if (!s->raw_buf || !s->comp_buf)
+		return 2;
+
+	return 0;
+}
+
+int compression_test_teardown(void **state)
+{
+	struct compression_test_state *s = *state;
+
+	test_free(s->raw_buf);
+	test_free(s->comp_buf);
+	test_free(s);
+
+	return 0;
+}
+
+void compression_test_correct_file(const struct compression_test_state *s,
+				   compression_test_func decompress, size_t bench_bytes)
+{
+	uint8_t *decomp_buf = test_malloc(s->raw_sz);
+	const size_t iterations = DIV_ROUND_UP(bench_bytes, s->raw_sz);
+	struct timespec start, end;
+	long nsecs;
+	size_t i;
+
+	assert_int_equal(s->raw_sz, decompress(s->comp_buf, s->comp_sz, decomp_buf, s->raw_sz));
+	assert_memory_equal(s->raw_buf, decomp_buf, s->raw_sz);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < iterations; i++)
+		decompress(s->comp_buf, s->comp_sz, decomp_buf, s->raw_sz);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	nsecs = (end.tv_sec - start.tv_sec) * 1000000000L + end.tv_nsec - start.tv_nsec;
+	print_message("%s: %zu bytes, %ld MB/s\n", s->name, s->raw_sz,
+		      (long)(iterations * s->raw_sz * 1000 / MAX(nsecs, 1)));
+
+	test_free(decomp_buf);
+}
+
+void compression_test_output_too_small(const struct compression_test_state *s,
+				       compression_test_func decompress)
+{
+	uint8_t *decomp_buf = test_malloc(s->raw_sz);
+
+	assert_int_equal(0, decompress(s->comp_buf, s->comp_sz, decomp_buf, s->raw_sz - 1));
+
+	test_free(decomp_buf);
+}
+
+void compression_test_truncated_input(const struct compression_test_state *s,
+				      compression_test_func decompress)
+{
+	uint8_t *decomp_buf = test_malloc(s->raw_sz);
+	size_t comp_sz;
+
+	for (comp_sz = 0; comp_sz < s->comp_sz; comp_sz += MAX(s->comp_sz / 64, 1))
+		assert_int_equal(0, decompress(s->comp_buf, comp_sz, decomp_buf, s->raw_sz));
+
+	test_free(decomp_buf);
+}
+
+void compression_test_bad_magic(struct compression_test_state *s,
+				compression_test_func decompress)
+{
+	uint8_t *decomp_buf = test_malloc(s->raw_sz);
+
+	s->comp_buf[0] ^= 0xff;
+	assert_int_equal(0, decompress(s->comp_buf, s->comp_sz, decomp_buf, s->raw_sz));
+	s->comp_buf[0] ^= 0xff;
+
+	test_free(decomp_buf);
+}
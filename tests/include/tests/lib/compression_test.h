@@ -0,0 +1,51 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#ifndef TESTS_LIB_COMPRESSION_TEST_H
+#define TESTS_LIB_COMPRESSION_TEST_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <tests/test.h>
+
+/*
+ * Shared fixture for the decompressor tests. Each test case works on a pair of files in
+ * the test's data directory: "<name>.bin" holding the raw data and "<name><suffix>"
+ * holding it compressed.
+ */
+struct compression_test_state {
+	const char *name;
+	uint8_t *raw_buf;
+	size_t raw_sz;
+	uint8_t *comp_buf;
+	size_t comp_sz;
+};
+
+/* Signature shared by ulz4fn(), uzstdn() and friends. */
+typedef size_t (*compression_test_func)(const void *src, size_t srcn, void *dst, size_t dstn);
+
+/* Reads __TEST_DATA_DIR__/<dir>/<name><suffix> into a test_malloc()ed buffer. */
+uint8_t *compression_test_read_file(const char *dir, const char *name, const char *suffix,
+				    size_t *size);
+
+/* Setup for cases with the file name as initial state. */
+int compression_test_setup(void **state, const char *dir, const char *comp_suffix);
+int compression_test_teardown(void **state);
+
+/* Checks the decompressed data and prints the throughput over bench_bytes of output. */
+void compression_test_correct_file(const struct compression_test_state *s,
+				   compression_test_func decompress, size_t bench_bytes);
+void compression_test_output_too_small(const struct compression_test_state *s,
+				       compression_test_func decompress);
+void compression_test_truncated_input(const struct compression_test_state *s,
+				      compression_test_func decompress);
+void compression_test_bad_magic(struct compression_test_state *s,
+				compression_test_func decompress);
+
+#define COMPRESSION_FILE_TEST(_test, _setup, _file_prefix)                                     \
+	{                                                                                      \
+		.name = #_test "(" _file_prefix ")", .test_func = _test,                      \
+		.setup_func = _setup, .teardown_func = compression_test_teardown,             \
+		.initial_state = (_file_prefix)                                                \
+	}
+
+#endif /* TESTS_LIB_COMPRESSION_TEST_H */
@@ -177,6 +177,53 @@ void test_stage_cache_load_stage(void **state)
 	free(data);
 }
 
+/* This test checks if stage_cache_load_stage() refuses to load a cached stage whose data or
+   metadata changed after it was added, leaving the destination untouched. */
+void test_stage_cache_load_stage_corrupted(void **state)
+{
+	int id = 0x4A;
+	struct prog prog_out = PROG_INIT(PROG_RAMSTAGE, "test_prog");
+	const size_t data_sz = 5 * KiB;
+	uint8_t *data = malloc(data_sz);
+	uint8_t *cache_buf;
+	struct stage_cache *meta;
+	struct prog prog_data = {0};
+	int arg = 0x1234;
+
+	assert_non_null(data);
+	memset(data, 0x7e, data_sz);
+
+	prog_data = (struct prog)PROG_INIT(PROG_RAMSTAGE, "test_prog");
+	prog_set_area(&prog_data, data, data_sz);
+	prog_set_entry(&prog_data, prog_entry_mock, &arg);
+	stage_cache_add(id, &prog_data);
+
+	meta = cbmem_find(CBMEM_ID_STAGEx_META + id);
+	cache_buf = cbmem_find(CBMEM_ID_STAGEx_CACHE + id);
+	assert_non_null(meta);
+	assert_non_null(cache_buf);
+
+	/* Flip a single bit in the cached image. */
+	memset(data, 0, data_sz);
+	cache_buf[data_sz / 2] ^= 0x10;
+	stage_cache_load_stage(id, &prog_out);
+	assert_null(prog_entry(&prog_out));
+	assert_int_equal(0, data[data_sz / 2]);
+
+	/* Restore the image and redirect the entry point instead. */
+	cache_buf[data_sz / 2] ^= 0x10;
+	meta->entry_addr += 4;
+	stage_cache_load_stage(id, &prog_out);
+	assert_null(prog_entry(&prog_out));
+
+	meta->entry_addr -= 4;
+	stage_cache_load_stage(id, &prog_out);
+	assert_ptr_equal(prog_entry_mock, prog_entry(&prog_out));
+	assert_int_equal(0x7e, data[data_sz / 2]);
+
+	free(data);
+}
+
 int main(void)
 {
 	const struct CMUnitTest tests[] = {
@@ -188,6 +235,8 @@ int main(void)
 						teardown_test),
 		cmocka_unit_test_setup_teardown(test_stage_cache_load_stage, setup_test,
 						teardown_test),
+		cmocka_unit_test_setup_teardown(test_stage_cache_load_stage_corrupted, setup_test,
+						teardown_test),
 	};
 
 	return cb_run_group_tests(tests, NULL, NULL);
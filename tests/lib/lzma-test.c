@@ -8,8 +8,11 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <tests/test.h>
+#include <time.h>
 #include <unistd.h>
 
+/* Decompress each file this many bytes worth of times to measure throughput. */
+#define LZMA_BENCH_BYTES (4 * MiB)
 
 struct lzma_test_state {
 	char *raw_filename;
@@ -111,6 +114,10 @@ static void test_ulzman_correct_file(void **state)
 	uint8_t *raw_buf = test_malloc(s->raw_file_sz);
 	uint8_t *decomp_buf = test_malloc(s->raw_file_sz);
 	uint8_t *comp_buf = test_malloc(s->comp_file_sz);
+	const size_t iterations = DIV_ROUND_UP(LZMA_BENCH_BYTES, s->raw_file_sz);
+	struct timespec start, end;
+	long nsecs;
+	size_t i;
 
 	assert_non_null(raw_buf);
 	assert_non_null(decomp_buf);
@@ -123,6 +130,15 @@ static void test_ulzman_correct_file(void **state)
 			 ulzman(comp_buf, s->comp_file_sz, decomp_buf, s->raw_file_sz));
 	assert_memory_equal(raw_buf, decomp_buf, s->raw_file_sz);
 
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < iterations; i++)
+		ulzman(comp_buf, s->comp_file_sz, decomp_buf, s->raw_file_sz);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	nsecs = (end.tv_sec - start.tv_sec) * 1000000000L + end.tv_nsec - start.tv_nsec;
+	print_message("%s: %zu bytes, %ld MB/s\n", strrchr(s->comp_filename, '/') + 1,
+		      s->raw_file_sz, (long)(iterations * s->raw_file_sz * 1000 / MAX(nsecs, 1)));
+
 	test_free(raw_buf);
 	test_free(decomp_buf);
 	test_free(comp_buf);
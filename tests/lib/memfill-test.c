@@ -0,0 +1,124 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#include <commonlib/helpers.h>
+#include <memfill.h>
+#include <stdlib.h>
+#include <string.h>
+#include <tests/test.h>
+#include <timer.h>
+#include <timestamp.h>
+#include <types.h>
+
+/* Spans several chunks, and ends in a partial one. */
+#define MEMFILL_BUFFER_SZ	(2 * 64 * MiB + 4 * KiB + 24)
+#define GUARD_SZ		64
+#define GUARD_BYTE		0x5a
+
+void timestamp_add_now(enum timestamp_id id)
+{
+}
+
+void timer_monotonic_get(struct mono_time *mt)
+{
+	mt->microseconds = 0;
+}
+
+static int setup_buffer(void **state)
+{
+	uint8_t *buf = malloc(MEMFILL_BUFFER_SZ + 2 * GUARD_SZ);
+
+	if (!buf)
+		return -1;
+
+	memset(buf, GUARD_BYTE, MEMFILL_BUFFER_SZ + 2 * GUARD_SZ);
+	*state = buf;
+	return 0;
+}
+
+static int teardown_buffer(void **state)
+{
+	free(*state);
+	return 0;
+}
+
+static void assert_guards_intact(const uint8_t *buf, size_t offset, size_t size)
+{
+	size_t i;
+
+	for (i = 0; i < offset; i++)
+		assert_int_equal(GUARD_BYTE, buf[i]);
+	for (i = offset + size; i < MEMFILL_BUFFER_SZ + 2 * GUARD_SZ; i++)
+		assert_int_equal(GUARD_BYTE, buf[i]);
+}
+
+static void test_memfill_zero(void **state)
+{
+	uint8_t *buf = *state;
+	const size_t offsets[] = { GUARD_SZ, GUARD_SZ + 1, GUARD_SZ + 7 };
+	const size_t sizes[] = { 0, 1, 5, 4 * KiB + 3, MEMFILL_BUFFER_SZ - 7 };
+	size_t i, j;
+
+	for (i = 0; i < ARRAY_SIZE(offsets); i++) {
+		for (j = 0; j < ARRAY_SIZE(sizes); j++) {
+			memset(buf, GUARD_BYTE, MEMFILL_BUFFER_SZ + 2 * GUARD_SZ);
+
+			memfill((uintptr_t)buf + offsets[i], sizes[j], MEMFILL_ZERO);
+
+			assert_int_equal(0, memfill_verify((uintptr_t)buf + offsets[i], sizes[j],
+							  MEMFILL_ZERO));
+			assert_guards_intact(buf, offsets[i], sizes[j]);
+		}
+	}
+}
+
+static void test_memfill_address(void **state)
+{
+	uint8_t *buf = *state;
+	const uintptr_t base = (uintptr_t)buf + GUARD_SZ;
+	uintptr_t *words = (uintptr_t *)base;
+	size_t i;
+
+	memfill(base, MEMFILL_BUFFER_SZ, MEMFILL_ADDRESS);
+
+	for (i = 0; i < MEMFILL_BUFFER_SZ / sizeof(uintptr_t); i++) {
+		if (words[i] != (uintptr_t)&words[i])
+			fail_msg("Word %zu holds 0x%lx", i, (unsigned long)words[i]);
+	}
+	assert_guards_intact(buf, GUARD_SZ, MEMFILL_BUFFER_SZ);
+	assert_int_equal(0, memfill_verify(base, MEMFILL_BUFFER_SZ, MEMFILL_ADDRESS));
+}
+
+static void test_memfill_verify_errors(void **state)
+{
+	uint8_t *buf = *state;
+	const uintptr_t base = (uintptr_t)buf + GUARD_SZ;
+	uintptr_t *words = (uintptr_t *)base;
+	const size_t num_words = MEMFILL_BUFFER_SZ / sizeof(uintptr_t);
+
+	memfill(base, MEMFILL_BUFFER_SZ, MEMFILL_ADDRESS);
+
+	/* Corrupt the first and last words, and one in a later chunk. */
+	words[0] ^= 1;
+	words[num_words / 2 + 3] = 0;
+	words[num_words - 1] ^= 1UL << 31;
+	assert_int_equal(3, memfill_verify(base, MEMFILL_BUFFER_SZ, MEMFILL_ADDRESS));
+
+	memfill(base, MEMFILL_BUFFER_SZ, MEMFILL_ZERO);
+	buf[GUARD_SZ + MEMFILL_BUFFER_SZ - 1] = 1;
+	words[num_words / 3] = 2;
+	assert_int_equal(2, memfill_verify(base, MEMFILL_BUFFER_SZ, MEMFILL_ZERO));
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(test_memfill_zero, setup_buffer,
+						teardown_buffer),
+		cmocka_unit_test_setup_teardown(test_memfill_address, setup_buffer,
+						teardown_buffer),
+		cmocka_unit_test_setup_teardown(test_memfill_verify_errors, setup_buffer,
+						teardown_buffer),
+	};
+
+	return cb_run_group_tests(tests, NULL, NULL);
+}
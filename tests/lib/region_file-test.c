@@ -289,6 +289,42 @@ static void test_region_file_update_data_arr(void **state)
 	assert_memory_equal(&dummy_data[data3_offset], &output_buffer[data2_size], data3_size);
 }
 
+static void test_region_file_can_append(void **state)
+{
+	struct region_device *rdev = *state;
+	struct region_file regf;
+	const size_t dummy_data_size = 256;
+	uint8_t dummy_data[dummy_data_size];
+	int ret;
+
+	memset(dummy_data, 0xa5, dummy_data_size);
+
+	ret = region_file_init(&regf, rdev);
+	assert_int_equal(0, ret);
+
+	/* Empty region file has to be initialized by a regular update first. */
+	assert_int_equal(0, region_file_can_append(&regf, dummy_data_size));
+
+	ret = region_file_update_data(&regf, dummy_data, dummy_data_size);
+	assert_int_equal(0, ret);
+
+	/* Small updates fit behind the current data, the whole region never does. */
+	assert_int_equal(1, region_file_can_append(&regf, dummy_data_size));
+	assert_int_equal(0, region_file_can_append(&regf, REGION_FILE_BUFFER_SIZE));
+
+	/* Fill the region file until no further update fits without emptying it. */
+	while (region_file_can_append(&regf, dummy_data_size)) {
+		ret = region_file_update_data(&regf, dummy_data, dummy_data_size);
+		assert_int_equal(0, ret);
+	}
+
+	/* The next update empties the file and starts over. */
+	ret = region_file_update_data(&regf, dummy_data, dummy_data_size);
+	assert_int_equal(0, ret);
+	assert_int_equal(1, regf.slot);
+	assert_int_equal(1, region_file_can_append(&regf, dummy_data_size));
+}
+
 int main(void)
 {
 	const struct CMUnitTest tests[] = {
@@ -322,6 +358,9 @@ int main(void)
 		cmocka_unit_test_setup_teardown(test_region_file_update_data_arr,
 						setup_teardown_region_file_test,
 						setup_teardown_region_file_test),
+		cmocka_unit_test_setup_teardown(test_region_file_can_append,
+						setup_teardown_region_file_test,
+						setup_teardown_region_file_test),
 	};
 
 	return cb_run_group_tests(tests, setup_region_file_test_group,
@@ -1,17 +1,22 @@
 /* cbfs-compression-tool, CLI utility for dealing with CBFS compressed data */
 /* SPDX-License-Identifier: GPL-2.0-only */
 
+#include <dirent.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <sys/stat.h>
 #include <time.h>
 
 #include "cbfs.h"
 #include "common.h"
+#include "fw_shim/lib.h"
 
-const char *usage_text = "cbfs-compression-tool benchmark\n"
-	"  runs benchmarks for all implemented algorithms\n"
+const char *usage_text = "cbfs-compression-tool benchmark [-f text|csv|json] [FILE|DIR...]\n"
+	"  runs benchmarks for all implemented algorithms over the files, which\n"
+	"  are searched recursively in directories, or a built-in sample\n"
 	"cbfs-compression-tool compress inFile outFile algo\n"
 	"  compresses inFile with algo and stores in outFile\n"
 	"\n"
@@ -25,53 +30,380 @@ static void usage(void)
 	puts(usage_text);
 }
 
-static int benchmark(void)
+/* Each measurement is repeated until it took at least this long. */
+#define BENCH_MIN_NSECS 200000000L
+
+enum bench_format {
+	BENCH_TEXT,
+	BENCH_CSV,
+	BENCH_JSON,
+};
+
+struct bench_result {
+	const char *name;
+	const char *algo;
+	long size;
+	long compressed_size;	/* -1 if the data doesn't shrink */
+	double compress_mbps;
+	double decompress_mbps;
+};
+
+/* Indexed like types_cbfs_compression. */
+struct bench_algo {
+	/* Both NULL for algorithms which aren't measured. */
+	comp_func_ptr comp;
+	decomp_func_ptr decomp;
+	/* Sums over all files, for the text summary. */
+	long size;
+	long compressed_size;
+	long decompressed_size;
+	double compress_secs;
+	double decompress_secs;
+};
+
+static struct bench_algo bench_algos[ARRAY_SIZE(types_cbfs_compression)];
+static enum bench_format bench_format;
+static int bench_results;
+
+static long elapsed_nsecs(const struct timespec *start, const struct timespec *end)
 {
-	const int bufsize = 10*1024*1024;
-	char *data = malloc(bufsize);
-	if (!data) {
+	return (end->tv_sec - start->tv_sec) * 1000000000L + end->tv_nsec - start->tv_nsec;
+}
+
+/* File names are quoted, since they may contain commas. */
+static void print_name(const char *name)
+{
+	putchar('"');
+	for (; *name; name++) {
+		if (*name == '"')
+			putchar(bench_format == BENCH_JSON ? '\\' : '"');
+		else if (*name == '\\' && bench_format == BENCH_JSON)
+			putchar('\\');
+		putchar(*name);
+	}
+	putchar('"');
+}
+
+static void print_result(const struct bench_result *r)
+{
+	/* Files which don't shrink are stored uncompressed by cbfstool. */
+	long stored = r->compressed_size < 0 ? r->size : r->compressed_size;
+	double ratio = r->size ? (double)stored / r->size : 1.0;
+
+	switch (bench_format) {
+	case BENCH_TEXT:
+		if (!bench_results)
+			printf("%-8s %10s %10s %6s %10s %10s  %s\n", "algo", "size",
+			       "stored", "ratio", "comp MB/s", "dec MB/s", "file");
+		printf("%-8s %10ld %10ld %6.3f %10.1f ", r->algo, r->size, stored, ratio,
+		       r->compress_mbps);
+		if (r->compressed_size < 0)
+			printf("%10s  %s\n", "-", r->name);
+		else
+			printf("%10.1f  %s\n", r->decompress_mbps, r->name);
+		break;
+	case BENCH_CSV:
+		if (!bench_results)
+			puts("file,algorithm,size,compressed_size,ratio,compress_mbps,"
+			     "decompress_mbps");
+		print_name(r->name);
+		printf(",%s,%ld,%ld,%.4f,%.1f,", r->algo, r->size, stored, ratio,
+		       r->compress_mbps);
+		if (r->compressed_size >= 0)
+			printf("%.1f", r->decompress_mbps);
+		putchar('\n');
+		break;
+	case BENCH_JSON:
+		printf("%s\n  {\"file\": ", bench_results ? "," : "[");
+		print_name(r->name);
+		printf(", \"algorithm\": \"%s\", \"size\": %ld, \"compressed_size\": %ld, "
+		       "\"ratio\": %.4f, \"compress_mbps\": %.1f, \"decompress_mbps\": ",
+		       r->algo, r->size, stored, ratio, r->compress_mbps);
+		if (r->compressed_size < 0)
+			printf("null}");
+		else
+			printf("%.1f}", r->decompress_mbps);
+		break;
+	}
+	bench_results++;
+}
+
+static void print_totals(void)
+{
+	const struct typedesc_t *algo;
+	const struct bench_algo *t;
+
+	switch (bench_format) {
+	case BENCH_TEXT:
+		for (algo = &types_cbfs_compression[0], t = &bench_algos[0];
+		     algo->name != NULL; algo++, t++) {
+			if (!t->size)
+				continue;
+			printf("%-8s %10ld %10ld %6.3f %10.1f %10.1f  (total)\n", algo->name,
+			       t->size, t->compressed_size, (double)t->compressed_size / t->size,
+			       t->size / 1e6 / t->compress_secs,
+			       t->decompress_secs ? t->decompressed_size / 1e6 /
+						    t->decompress_secs : 0.0);
+		}
+		break;
+	case BENCH_CSV:
+		break;
+	case BENCH_JSON:
+		puts(bench_results ? "\n]" : "[]");
+		break;
+	}
+}
+
+/* Decompresses LZMA with the firmware's decoder instead of the LZMA SDK one. */
+static int fw_lzma_decompress(char *in, int in_len, char *out, int out_len,
+			      size_t *actual_size)
+{
+	size_t size = ulzman(in, in_len, out, out_len);
+
+	if (size == 0)
+		return -1;
+	if (actual_size != NULL)
+		*actual_size = size;
+	return 0;
+}
+
+/* Runs compression and decompression over data with every algorithm that has a handler. */
+static int benchmark_data(const char *name, char *data, int size)
+{
+	char *compressed_data = malloc(size);
+	char *decompressed_data = malloc(size);
+	const struct typedesc_t *algo;
+	struct timespec t_s, t_e;
+	struct bench_algo *t;
+	long nsecs, iterations;
+	int err = 0;
+
+	if (!compressed_data || !decompressed_data) {
 		fprintf(stderr, "out of memory\n");
+		free(compressed_data);
+		free(decompressed_data);
 		return 1;
 	}
-	char *compressed_data = malloc(bufsize);
-	if (!compressed_data) {
-		free(data);
+
+	for (algo = &types_cbfs_compression[0], t = &bench_algos[0];
+	     algo->name != NULL; algo++, t++) {
+		struct bench_result r = {
+			.name = name,
+			.algo = algo->name,
+			.size = size,
+		};
+		int outsize = size;
+		size_t actual_size;
+		int ret = 0;
+
+		if (t->comp == NULL)
+			continue;
+
+		iterations = 0;
+		clock_gettime(CLOCK_MONOTONIC, &t_s);
+		do {
+			outsize = size;
+			ret = t->comp(data, size, compressed_data, &outsize);
+			iterations++;
+			clock_gettime(CLOCK_MONOTONIC, &t_e);
+			nsecs = elapsed_nsecs(&t_s, &t_e);
+		} while (nsecs < BENCH_MIN_NSECS);
+		r.compress_mbps = (double)size * iterations * 1000 / MAX(nsecs, 1);
+		r.compressed_size = ret ? -1 : outsize;
+
+		t->size += size;
+		t->compressed_size += ret ? size : outsize;
+		t->compress_secs += nsecs / 1e9 / iterations;
+
+		if (!ret) {
+			iterations = 0;
+			clock_gettime(CLOCK_MONOTONIC, &t_s);
+			do {
+				ret = t->decomp(compressed_data, outsize, decompressed_data, size,
+					     &actual_size);
+				iterations++;
+				clock_gettime(CLOCK_MONOTONIC, &t_e);
+				nsecs = elapsed_nsecs(&t_s, &t_e);
+			} while (!ret && nsecs < BENCH_MIN_NSECS);
+
+			if (ret || actual_size != (size_t)size ||
+			    memcmp(data, decompressed_data, size)) {
+				fprintf(stderr, "%s: '%s' doesn't decompress to the original\n",
+					name, algo->name);
+				err = 1;
+				break;
+			}
+			r.decompress_mbps = (double)size * iterations * 1000 / MAX(nsecs, 1);
+			t->decompressed_size += size;
+			t->decompress_secs += nsecs / 1e9 / iterations;
+		}
+
+		print_result(&r);
+	}
+
+	free(compressed_data);
+	free(decompressed_data);
+	return err;
+}
+
+static int benchmark_file(const char *path)
+{
+	struct stat st;
+	char *data;
+	FILE *fin;
+	int err;
+
+	fin = fopen(path, "rb");
+	if (!fin || fstat(fileno(fin), &st)) {
+		fprintf(stderr, "could not open '%s'\n", path);
+		if (fin)
+			fclose(fin);
+		return 1;
+	}
+	/* The compression functions take int sizes. */
+	if (st.st_size == 0 || st.st_size > INT_MAX / 2) {
+		fclose(fin);
+		return 0;
+	}
+
+	data = malloc(st.st_size);
+	if (!data) {
 		fprintf(stderr, "out of memory\n");
+		fclose(fin);
+		return 1;
+	}
+	if (fread(data, st.st_size, 1, fin) != 1) {
+		fprintf(stderr, "could not read '%s'\n", path);
+		err = 1;
+	} else {
+		err = benchmark_data(path, data, st.st_size);
+	}
+
+	free(data);
+	fclose(fin);
+	return err;
+}
+
+static int compare_names(const void *a, const void *b)
+{
+	return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static int benchmark_path(const char *path)
+{
+	struct dirent *entry;
+	struct stat st;
+	char **names = NULL;
+	size_t count = 0, i;
+	int err = 0;
+	DIR *dir;
+
+	if (stat(path, &st)) {
+		fprintf(stderr, "could not find '%s'\n", path);
 		return 1;
 	}
-	int i, l = strlen(usage_text) + 1;
-	for (i = 0; i + l < bufsize; i += l) {
-		memcpy(data + i, usage_text, l);
+	if (!S_ISDIR(st.st_mode))
+		return S_ISREG(st.st_mode) ? benchmark_file(path) : 0;
+
+	dir = opendir(path);
+	if (!dir) {
+		fprintf(stderr, "could not open directory '%s'\n", path);
+		return 1;
 	}
-	memset(data + i, 0, bufsize - i);
+
+	/* Sorted, so that results of different runs can be compared line by line. */
+	while ((entry = readdir(dir)) != NULL) {
+		size_t len = strlen(path) + strlen(entry->d_name) + 2;
+		char **grown;
+
+		if (entry->d_name[0] == '.')
+			continue;
+		grown = realloc(names, (count + 1) * sizeof(*names));
+		if (grown)
+			names = grown;
+		if (!grown || !(names[count] = malloc(len))) {
+			fprintf(stderr, "out of memory\n");
+			err = 1;
+			break;
+		}
+		snprintf(names[count++], len, "%s/%s", path, entry->d_name);
+	}
+	closedir(dir);
+
+	qsort(names, count, sizeof(*names), compare_names);
+	for (i = 0; i < count; i++) {
+		if (!err)
+			err = benchmark_path(names[i]);
+		free(names[i]);
+	}
+	free(names);
+
+	return err;
+}
+
+static int benchmark(int argc, char **argv)
+{
 	const struct typedesc_t *algo;
-	for (algo = &types_cbfs_compression[0]; algo->name != NULL; algo++) {
-		int outsize = bufsize;
-		printf("measuring '%s'\n", algo->name);
-		comp_func_ptr comp = compression_function(algo->type);
-		if (comp == NULL) {
-			printf("no handler associated with algorithm\n");
-			free(data);
-			free(compressed_data);
+	struct bench_algo *t;
+	int err = 0;
+	int i;
+
+	if (argc >= 2 && strcmp(argv[0], "-f") == 0) {
+		if (strcmp(argv[1], "text") == 0) {
+			bench_format = BENCH_TEXT;
+		} else if (strcmp(argv[1], "csv") == 0) {
+			bench_format = BENCH_CSV;
+		} else if (strcmp(argv[1], "json") == 0) {
+			bench_format = BENCH_JSON;
+		} else {
+			usage();
 			return 1;
 		}
+		argc -= 2;
+		argv += 2;
+	}
 
-		struct timespec t_s, t_e;
-		clock_gettime(CLOCK_MONOTONIC, &t_s);
+	for (algo = &types_cbfs_compression[0], t = &bench_algos[0];
+	     algo->name != NULL; algo++, t++) {
+		if (algo->type == CBFS_COMPRESS_NONE)
+			continue;
 
-		if (comp(data, bufsize, compressed_data, &outsize)) {
-			printf("compression failed");
+		t->comp = compression_function(algo->type);
+		t->decomp = decompression_function(algo->type);
+		/* LZ4 and Zstandard are already handled by the commonlib decoders. */
+		if (algo->type == CBFS_COMPRESS_LZMA)
+			t->decomp = fw_lzma_decompress;
+		if (t->comp == NULL || t->decomp == NULL) {
+			t->comp = NULL;
+			/* Zstandard is optional, see compression_function(). */
+			if (algo->type == CBFS_COMPRESS_ZSTD)
+				continue;
+			fprintf(stderr, "no handler associated with algorithm\n");
 			return 1;
 		}
+	}
 
-		clock_gettime(CLOCK_MONOTONIC, &t_e);
-		printf("compressing %d bytes to %d took %ld seconds\n",
-			bufsize, outsize,
-			(long)(t_e.tv_sec - t_s.tv_sec));
+	if (argc == 0) {
+		const int bufsize = 10*1024*1024;
+		char *data = malloc(bufsize);
+		if (!data) {
+			fprintf(stderr, "out of memory\n");
+			return 1;
+		}
+		int l = strlen(usage_text) + 1;
+		for (i = 0; i + l < bufsize; i += l) {
+			memcpy(data + i, usage_text, l);
+		}
+		memset(data + i, 0, bufsize - i);
+		err = benchmark_data("(built-in)", data, bufsize);
+		free(data);
 	}
-	free(data);
-	free(compressed_data);
-	return 0;
+
+	for (i = 0; i < argc && !err; i++)
+		err = benchmark_path(argv[i]);
+
+	print_totals();
+	return err;
 }
 
 static int compress(char *infile, char *outfile, char *algoname,
@@ -180,8 +512,8 @@ out:
 
 int main(int argc, char **argv)
 {
-	if ((argc == 2) && (strcmp(argv[1], "benchmark") == 0))
-		return benchmark();
+	if ((argc >= 2) && (strcmp(argv[1], "benchmark") == 0))
+		return benchmark(argc - 2, argv + 2);
 	if ((argc == 5) && (strcmp(argv[1], "compress") == 0))
 		return compress(argv[2], argv[3], argv[4], 1);
 	if ((argc == 5) && (strcmp(argv[1], "rawcompress") == 0))
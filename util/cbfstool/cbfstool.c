@@ -1806,6 +1806,8 @@ enum {
 	LONGOPT_START = 256,
 	LONGOPT_IBB = LONGOPT_START,
 	LONGOPT_MMAP,
+	LONGOPT_CACHE_DIR,
+	LONGOPT_LZ4_BLOCK_SIZE,
 	LONGOPT_END,
 };
 
@@ -1848,6 +1850,8 @@ static struct option long_options[] = {
 	{"unprocessed",   no_argument,       0, 'U' },
 	{"ibb",           no_argument,       0, LONGOPT_IBB },
 	{"mmap",          required_argument, 0, LONGOPT_MMAP },
+	{"cache-dir",     required_argument, 0, LONGOPT_CACHE_DIR },
+	{"lz4-block-size", required_argument, 0, LONGOPT_LZ4_BLOCK_SIZE },
 	{NULL,            0,                 0,  0  }
 };
 
@@ -1954,6 +1958,11 @@ static void usage(char *name)
 	     "                   space(x86 only)\n"
 	     "  --ext-win-size   Size of extended decode window in host address\n"
 	     "                   space(x86 only)\n"
+	     "  --cache-dir DIR  Reuse compression results kept in DIR for\n"
+	     "                   identical input\n"
+	     "  --lz4-block-size SIZE  Split LZ4 compressed files into blocks\n"
+	     "                   of SIZE (64K|256K|1M|4M) which can be\n"
+	     "                   decompressed in parallel\n"
 	     "COMMANDs:\n"
 	     " add [-r image,regions] -f FILE -n NAME -t TYPE [-A hash] \\\n"
 	     "        [-c compression] [-b base-address | -a alignment] \\\n"
@@ -2293,6 +2302,29 @@ int main(int argc, char **argv)
 				if (decode_mmap_arg(optarg))
 					return 1;
 				break;
+			case LONGOPT_CACHE_DIR:
+				compression_cache_init(optarg);
+				break;
+			case LONGOPT_LZ4_BLOCK_SIZE: {
+				unsigned long size = strtoul(optarg, &suffix, 0);
+
+				switch (tolower((int)suffix[0])) {
+				case 'k':
+					size *= KiB;
+					break;
+				case 'm':
+					size *= MiB;
+					break;
+				case '\0':
+					break;
+				default:
+					size = 0;
+					break;
+				}
+				if (compression_set_lz4_block_size(size))
+					return 1;
+				break;
+			}
 			case 'h':
 			case '?':
 				usage(argv[0]);
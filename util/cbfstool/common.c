@@ -5,8 +5,12 @@
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <libgen.h>
 #include "common.h"
@@ -81,6 +85,70 @@ int buffer_from_file(struct buffer *buffer, const char *filename)
 	return buffer_from_file_aligned_size(buffer, filename, 1);
 }
 
+#ifdef _WIN32
+/* There is no mmap() on Windows, so read the whole file instead. */
+int buffer_from_file_mmap(struct buffer *buffer, const char *filename)
+{
+	return buffer_from_file(buffer, filename);
+}
+
+void buffer_unmap(struct buffer *buffer)
+{
+	buffer_delete(buffer);
+}
+#else
+int buffer_from_file_mmap(struct buffer *buffer, const char *filename)
+{
+	struct stat st;
+	void *data;
+	int fd;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		perror(filename);
+		return -1;
+	}
+	if (fstat(fd, &st) < 0) {
+		perror(filename);
+		close(fd);
+		return -1;
+	}
+	if (st.st_size == 0) {
+		fprintf(stderr, "%s is empty\n", filename);
+		close(fd);
+		return -1;
+	}
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		perror(filename);
+		return -1;
+	}
+
+	buffer->name = strdup(filename);
+	buffer->data = data;
+	buffer->offset = 0;
+	buffer->size = st.st_size;
+	return 0;
+}
+
+void buffer_unmap(struct buffer *buffer)
+{
+	assert(buffer);
+	if (buffer->name) {
+		free(buffer->name);
+		buffer->name = NULL;
+	}
+	if (buffer->data) {
+		munmap(buffer_get_original_backing(buffer),
+		       buffer->size + buffer->offset);
+		buffer->data = NULL;
+	}
+	buffer->offset = 0;
+	buffer->size = 0;
+}
+#endif
+
 int buffer_write_file(struct buffer *buffer, const char *filename)
 {
 	FILE *fp = fopen(filename, "wb");
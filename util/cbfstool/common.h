@@ -136,6 +136,14 @@ int buffer_from_file(struct buffer *buffer, const char *filename);
 int buffer_from_file_aligned_size(struct buffer *buffer, const char *filename,
 				  size_t size_granularity);
 
+/* Maps a file read-only into a memory buffer, so only the parts that get accessed
+ * are read. Returns 0 on success, otherwise non-zero. The buffer must not be written
+ * and has to be released with buffer_unmap() instead of buffer_delete(). */
+int buffer_from_file_mmap(struct buffer *buffer, const char *filename);
+
+/* Releases a memory buffer created by buffer_from_file_mmap(). */
+void buffer_unmap(struct buffer *buffer);
+
 /* Writes memory buffer content into file.
  * Returns 0 on success, otherwise non-zero. */
 int buffer_write_file(struct buffer *buffer, const char *filename);
@@ -164,6 +172,15 @@ typedef int (*decomp_func_ptr) (char *in, int in_len, char *out, int out_len,
 comp_func_ptr compression_function(enum cbfs_compression algo);
 decomp_func_ptr decompression_function(enum cbfs_compression algo);
 
+/* Keep the results of the compression functions returned from now on in the
+ * directory dir, which is created if needed, and reuse them for identical
+ * input. */
+void compression_cache_init(const char *dir);
+
+/* Split LZ4 compressed data into independent blocks of at most size bytes,
+ * which may be 64K, 256K, 1M or the default 4M. Returns 0 on success. */
+int compression_set_lz4_block_size(unsigned long size);
+
 uint64_t intfiletype(const char *name);
 
 /* cbfs-mkpayload.c */
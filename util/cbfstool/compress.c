@@ -1,19 +1,53 @@
 /* compression handling for cbfstool */
 /* SPDX-License-Identifier: GPL-2.0-only */
 
+#include <errno.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
 #include "common.h"
 #include "lz4/lib/lz4frame.h"
+#include "lz4/lib/xxhash.h"
 #include <commonlib/bsd/compression.h>
+#ifdef HAVE_LIBZSTD
+#include <zstd.h>
+#endif
+
+static LZ4F_blockSizeID_t lz4_block_size_id = LZ4F_max4MB;
+
+int compression_set_lz4_block_size(unsigned long size)
+{
+	switch (size) {
+	case 64 * KiB:
+		lz4_block_size_id = LZ4F_max64KB;
+		break;
+	case 256 * KiB:
+		lz4_block_size_id = LZ4F_max256KB;
+		break;
+	case 1 * MiB:
+		lz4_block_size_id = LZ4F_max1MB;
+		break;
+	case 4 * MiB:
+		lz4_block_size_id = LZ4F_max4MB;
+		break;
+	default:
+		ERROR("Invalid LZ4 block size %lu, it can be 64K|256K|1M|4M\n", size);
+		return -1;
+	}
+	return 0;
+}
 
 static int lz4_compress(char *in, int in_len, char *out, int *out_len)
 {
 	LZ4F_preferences_t prefs = {
 		.compressionLevel = 20,
 		.frameInfo = {
-			.blockSizeID = max4MB,
+			.blockSizeID = lz4_block_size_id,
 			.blockMode = blockIndependent,
 			.contentChecksumFlag = noContentChecksum,
 		},
@@ -53,6 +87,43 @@ static int lzma_decompress(char *in, int in_len, char *out, unused int out_len,
 {
 	return do_lzma_uncompress(out, out_len, in, in_len, actual_size);
 }
+#ifdef HAVE_LIBZSTD
+/* Higher levels need a larger window, which costs the decoder nothing since it
+   decodes straight into the destination, but take much longer to compress. */
+#define ZSTD_COMPRESSION_LEVEL 19
+
+static int zstd_compress(char *in, int in_len, char *out, int *out_len)
+{
+	size_t worst_size = ZSTD_compressBound(in_len);
+	void *bounce = malloc(worst_size);
+	size_t ret;
+
+	if (!bounce)
+		return -1;
+	/* The simple API stores the content size and leaves out the checksum. */
+	ret = ZSTD_compress(bounce, worst_size, in, in_len, ZSTD_COMPRESSION_LEVEL);
+	if (ZSTD_isError(ret) || ret >= (size_t)in_len) {
+		free(bounce);
+		return -1;
+	}
+	memcpy(out, bounce, ret);
+	*out_len = ret;
+	free(bounce);
+	return 0;
+}
+#endif
+
+static int zstd_decompress(char *in, int in_len, char *out, int out_len,
+			   size_t *actual_size)
+{
+	size_t result = uzstdn(in, in_len, out, out_len);
+	if (result == 0)
+		return -1;
+	if (actual_size != NULL)
+		*actual_size = result;
+	return 0;
+}
+
 static int none_compress(char *in, int in_len, char *out, int *out_len)
 {
 	memcpy(out, in, in_len);
@@ -69,6 +140,166 @@ static int none_decompress(char *in, int in_len, char *out, unused int out_len,
 	return 0;
 }
 
+/*
+ * Content addressed cache of compression results. Every build adds all files
+ * again, and compressing large payloads takes long, so the results are kept in
+ * files named after the algorithm and a hash of the input. A cache file holds
+ * a header followed by the compressed data. A negative size in the header
+ * records that compression failed, e.g. because it didn't pay off.
+ */
+
+/*
+ * Bump when changing the cache file format or the compressor settings. Results of
+ * an older compressor are only dropped when this changes, which is why the cache
+ * is opt-in.
+ */
+#define COMPRESSION_CACHE_VERSION 1
+
+struct compression_cache_header {
+	uint32_t version;
+	int32_t in_len;
+	int32_t out_len;
+};
+
+static const char *compression_cache_dir;
+
+static int compression_cache_mkdir(const char *dir)
+{
+#ifdef _WIN32
+	return _mkdir(dir);
+#else
+	return mkdir(dir, 0755);
+#endif
+}
+
+void compression_cache_init(const char *dir)
+{
+	if (compression_cache_mkdir(dir) && errno != EEXIST) {
+		WARN("Not caching compression results, can't create %s: %s\n",
+		     dir, strerror(errno));
+		return;
+	}
+	compression_cache_dir = dir;
+}
+
+static char *compression_cache_path(enum cbfs_compression algo, int variant,
+				    const char *in, int in_len)
+{
+	/* Two differently seeded hashes make for a 128-bit key. */
+	unsigned long long h1 = XXH64(in, in_len, 0);
+	unsigned long long h2 = XXH64(in, in_len, ~0ULL);
+	size_t len = strlen(compression_cache_dir) + 64;
+	char *path = malloc(len);
+
+	if (path)
+		snprintf(path, len, "%s/%d.%d-%016llx%016llx",
+			 compression_cache_dir, algo, variant, h1, h2);
+	return path;
+}
+
+static int compression_cache_load(const char *path, int in_len, char *out,
+				  int *out_len, int *result)
+{
+	struct compression_cache_header header;
+	FILE *fp = fopen(path, "rb");
+	int found = 0;
+
+	if (!fp)
+		return 0;
+
+	if (fread(&header, sizeof(header), 1, fp) != 1 ||
+	    header.version != COMPRESSION_CACHE_VERSION ||
+	    header.in_len != in_len || header.out_len > in_len)
+		goto out;
+
+	if (header.out_len < 0) {
+		*result = -1;
+		found = 1;
+	} else if (fread(out, 1, header.out_len, fp) == (size_t)header.out_len) {
+		*out_len = header.out_len;
+		*result = 0;
+		found = 1;
+	}
+
+out:
+	fclose(fp);
+	return found;
+}
+
+static void compression_cache_store(const char *path, int in_len,
+				    const char *out, int out_len, int result)
+{
+	struct compression_cache_header header = {
+		.version = COMPRESSION_CACHE_VERSION,
+		.in_len = in_len,
+		.out_len = result ? -1 : out_len,
+	};
+	size_t len = strlen(path) + 32;
+	char *tmp = malloc(len);
+	FILE *fp;
+
+	if (!tmp)
+		return;
+
+	/* Write to a private file first, parallel builds may add the same file. */
+	snprintf(tmp, len, "%s.%ld.tmp", path, (long)getpid());
+	fp = fopen(tmp, "wb");
+	if (!fp) {
+		free(tmp);
+		return;
+	}
+
+	if (fwrite(&header, sizeof(header), 1, fp) != 1 ||
+	    (!result && fwrite(out, 1, out_len, fp) != (size_t)out_len)) {
+		fclose(fp);
+		unlink(tmp);
+	} else if (fclose(fp) || rename(tmp, path)) {
+		unlink(tmp);
+	}
+
+	free(tmp);
+}
+
+/* Results of the same algorithm with different settings differ by variant. */
+static int cached_compress(enum cbfs_compression algo, int variant,
+			   comp_func_ptr compress, char *in, int in_len,
+			   char *out, int *out_len)
+{
+	char *path = compression_cache_path(algo, variant, in, in_len);
+	int result;
+
+	if (!path)
+		return compress(in, in_len, out, out_len);
+
+	if (!compression_cache_load(path, in_len, out, out_len, &result)) {
+		result = compress(in, in_len, out, out_len);
+		compression_cache_store(path, in_len, out, *out_len, result);
+	}
+
+	free(path);
+	return result;
+}
+
+static int lz4_compress_cached(char *in, int in_len, char *out, int *out_len)
+{
+	return cached_compress(CBFS_COMPRESS_LZ4, lz4_block_size_id,
+			       lz4_compress, in, in_len, out, out_len);
+}
+
+static int lzma_compress_cached(char *in, int in_len, char *out, int *out_len)
+{
+	return cached_compress(CBFS_COMPRESS_LZMA, 0, lzma_compress, in,
+			       in_len, out, out_len);
+}
+
+#ifdef HAVE_LIBZSTD
+static int zstd_compress_cached(char *in, int in_len, char *out, int *out_len)
+{
+	return cached_compress(CBFS_COMPRESS_ZSTD, 0, zstd_compress, in,
+			       in_len, out, out_len);
+}
+#endif
+
 comp_func_ptr compression_function(enum cbfs_compression algo)
 {
 	comp_func_ptr compress;
@@ -77,11 +308,22 @@ comp_func_ptr compression_function(enum cbfs_compression algo)
 		compress = none_compress;
 		break;
 	case CBFS_COMPRESS_LZMA:
-		compress = lzma_compress;
+		compress = compression_cache_dir ? lzma_compress_cached :
+						   lzma_compress;
 		break;
 	case CBFS_COMPRESS_LZ4:
-		compress = lz4_compress;
+		compress = compression_cache_dir ? lz4_compress_cached :
+						   lz4_compress;
+		break;
+	case CBFS_COMPRESS_ZSTD:
+#ifdef HAVE_LIBZSTD
+		compress = compression_cache_dir ? zstd_compress_cached :
+						   zstd_compress;
 		break;
+#else
+		ERROR("Zstandard compression needs cbfstool built with libzstd!\n");
+		return NULL;
+#endif
 	default:
 		ERROR("Unknown compression algorithm %d!\n", algo);
 		return NULL;
@@ -102,6 +344,9 @@ decomp_func_ptr decompression_function(enum cbfs_compression algo)
 	case CBFS_COMPRESS_LZ4:
 		decompress = lz4_decompress;
 		break;
+	case CBFS_COMPRESS_ZSTD:
+		decompress = zstd_decompress;
+		break;
 	default:
 		ERROR("Unknown compression algorithm %d!\n", algo);
 		return NULL;
@@ -345,6 +345,17 @@ reloc_read(const struct buffer *in, struct parsed_elf *pelf,
 			return -1;
 		}
 
+		/*
+		 * Relocations for sections not occupying memory at run time,
+		 * e.g. debug info, are of no interest and can make up most of
+		 * the relocations in the file.
+		 */
+		if (!(pelf->shdr[shdr->sh_info].sh_flags & SHF_ALLOC)) {
+			DEBUG("Skipping relocations for section %u\n",
+			      shdr->sh_info);
+			continue;
+		}
+
 		is_rela = shdr->sh_type == SHT_RELA;
 
 		/* Determine the number relocations in this section. */
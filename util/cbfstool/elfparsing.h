@@ -16,7 +16,8 @@ struct parsed_elf {
 	 * corresponding section index. i.e. if a section i is of type SHT_REL
 	 * or SHT_RELA then the corresponding index into the relocs array will
 	 * contain the associated relocations. Otherwise thee entry will be
-	 * NULL.
+	 * NULL. Relocations applying to sections without SHF_ALLOC, such as
+	 * debug info, are not parsed and leave the entry NULL as well.
 	 */
 	Elf64_Rela **relocs;
 	/*
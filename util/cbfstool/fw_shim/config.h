@@ -0,0 +1,19 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#ifndef _CBFSTOOL_FW_SHIM_CONFIG_H_
+#define _CBFSTOOL_FW_SHIM_CONFIG_H_
+
+/*
+ * Kconfig options of the firmware decoders built into cbfs-compression-tool, set
+ * like their defaults for a build targeting the host architecture.
+ */
+#if defined(__GNUC__) && !defined(__clang__)
+#define CONFIG_DECOMPRESS_OFAST 1
+#endif
+
+#if defined(__i386__) || defined(__x86_64__) || defined(__aarch64__)
+#define CONFIG_DECOMPRESS_BRANCHLESS_LITERALS 1
+#define CONFIG_DECOMPRESS_UNALIGNED_COPY 1
+#endif
+
+#endif
@@ -0,0 +1,11 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#ifndef _CBFSTOOL_FW_SHIM_LIB_H_
+#define _CBFSTOOL_FW_SHIM_LIB_H_
+
+#include <stddef.h>
+
+/* src/lib/lzma.c */
+size_t ulzman(const void *src, size_t srcn, void *dst, size_t dstn);
+
+#endif
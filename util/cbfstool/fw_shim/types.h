@@ -0,0 +1,11 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#ifndef _CBFSTOOL_FW_SHIM_TYPES_H_
+#define _CBFSTOOL_FW_SHIM_TYPES_H_
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#endif
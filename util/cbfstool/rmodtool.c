@@ -71,16 +71,20 @@ int main(int argc, char *argv[])
 		return 1;
 	}
 
-	if (buffer_from_file(&elfin, input_file)) {
+	/* Large parts of the input, like debug info, are never looked at. */
+	if (buffer_from_file_mmap(&elfin, input_file)) {
 		ERROR("Couldn't read in file '%s'.\n", input_file);
 		return 1;
 	}
 
 	if (rmodule_create(&elfin, &elfout)) {
 		ERROR("Unable to create rmodule from '%s'.\n", input_file);
+		buffer_unmap(&elfin);
 		return 1;
 	}
 
+	buffer_unmap(&elfin);
+
 	if (buffer_write_file(&elfout, output_file)) {
 		ERROR("Unable to write rmodule elf '%s'.\n", output_file);
 		return 1;
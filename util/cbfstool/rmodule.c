@@ -172,8 +172,7 @@ static int relocation_for_weak_extern_symbols(struct rmod_context *ctx, Elf64_Re
  * Relocation processing loops.
  */
 
-static int for_each_reloc(struct rmod_context *ctx, struct reloc_filter *f,
-				int do_emit)
+static int for_each_reloc(struct rmod_context *ctx, struct reloc_filter *f)
 {
 	Elf64_Half i;
 	struct parsed_elf *pelf = &ctx->pelf;
@@ -221,12 +220,8 @@ static int for_each_reloc(struct rmod_context *ctx, struct reloc_filter *f,
 					return filter_emit;
 			}
 
-			if (filter_emit && ctx->ops->should_emit(r)) {
-				int n = ctx->nrelocs;
-				if (do_emit)
-					ctx->emitted_relocs[n] = r->r_offset;
-				ctx->nrelocs++;
-			}
+			if (filter_emit && ctx->ops->should_emit(r))
+				ctx->emitted_relocs[ctx->nrelocs++] = r->r_offset;
 		}
 	}
 
@@ -306,6 +301,7 @@ filter_relocation_sections(struct rmod_context *ctx)
 
 		/* Do not process relocations for debug sections. */
 		if (strstr(section_name, ".debug") != NULL) {
+			free(pelf->relocs[i]);
 			pelf->relocs[i] = NULL;
 			continue;
 		}
@@ -315,6 +311,7 @@ filter_relocation_sections(struct rmod_context *ctx)
 		 * relocations for future processing.
 		 */
 		if (shdr->sh_type != SHT_PROGBITS) {
+			free(pelf->relocs[i]);
 			pelf->relocs[i] = NULL;
 			continue;
 		}
@@ -330,6 +327,7 @@ filter_relocation_sections(struct rmod_context *ctx)
 		if (j == pelf->ehdr.e_phnum) {
 			ERROR("Relocations being applied to section %d not "
 			      "within segments region.\n", sh_info);
+			free(pelf->relocs[i]);
 			pelf->relocs[i] = NULL;
 			return -1;
 		}
@@ -338,90 +336,122 @@ filter_relocation_sections(struct rmod_context *ctx)
 	return 0;
 }
 
-static int vaddr_cmp(const void *a, const void *b)
+/*
+ * Sort the relocation addresses with a least significant digit first radix
+ * sort. Only the bytes that differ between the addresses need a pass, which
+ * are few as all of them fall within the program.
+ */
+static int sort_relocs(Elf64_Addr *relocs, Elf64_Xword nrelocs)
 {
-	const Elf64_Addr *pa = a;
-	const Elf64_Addr *pb = b;
+	Elf64_Addr *src, *dst, *tmp;
+	Elf64_Addr diff = 0;
+	Elf64_Xword count[256];
+	Elf64_Xword i, pos, n;
+	unsigned int shift;
 
-	if (*pa < *pb)
-		return -1;
-	if (*pa > *pb)
-		return 1;
-	return 0;
-}
+	for (i = 1; i < nrelocs; i++)
+		diff |= relocs[i] ^ relocs[0];
 
-int rmodule_collect_relocations(struct rmod_context *ctx,
-				struct reloc_filter *f)
-{
-	Elf64_Xword nrelocs;
+	if (diff == 0)
+		return 0;
 
-	/*
-	 * The relocs array in the pelf should only contain relocations that
-	 * apply to the program. Count the number relocations. Then collect
-	 * them into the allocated buffer.
-	 */
-	if (for_each_reloc(ctx, f, 0))
+	tmp = malloc(nrelocs * sizeof(*tmp));
+	if (tmp == NULL) {
+		ERROR("Unable to allocate memory for sorting relocations.\n");
 		return -1;
+	}
 
-	nrelocs = ctx->nrelocs;
-	INFO("%" PRIu64 " relocations to be emitted.\n", nrelocs);
-	if (!nrelocs)
-		return 0;
+	src = relocs;
+	dst = tmp;
 
-	/* Reset the counter for indexing into the array. */
-	ctx->nrelocs = 0;
-	ctx->emitted_relocs = calloc(nrelocs, sizeof(Elf64_Addr));
-	/* Write out the relocations into the emitted_relocs array. */
-	if (for_each_reloc(ctx, f, 1))
-		return -1;
+	for (shift = 0; shift < 64; shift += 8) {
+		if (((diff >> shift) & 0xff) == 0)
+			continue;
 
-	if (ctx->nrelocs != nrelocs) {
-		ERROR("Mismatch counted and emitted relocations: %zu vs %zu.\n",
-		      (size_t)nrelocs, (size_t)ctx->nrelocs);
-		return -1;
+		memset(count, 0, sizeof(count));
+		for (i = 0; i < nrelocs; i++)
+			count[(src[i] >> shift) & 0xff]++;
+
+		/* Turn the counts into the start position of each bucket. */
+		pos = 0;
+		for (i = 0; i < ARRAY_SIZE(count); i++) {
+			n = count[i];
+			count[i] = pos;
+			pos += n;
+		}
+
+		for (i = 0; i < nrelocs; i++)
+			dst[count[(src[i] >> shift) & 0xff]++] = src[i];
+
+		tmp = src;
+		src = dst;
+		dst = tmp;
 	}
 
-	/* Sort the relocations by their address. */
-	qsort(ctx->emitted_relocs, nrelocs, sizeof(Elf64_Addr), vaddr_cmp);
+	if (src != relocs) {
+		memcpy(relocs, src, nrelocs * sizeof(*relocs));
+		free(src);
+	} else {
+		free(dst);
+	}
 
 	return 0;
 }
 
-static int
-populate_sym(struct rmod_context *ctx, const char *sym_name, Elf64_Addr *addr,
-	     int nsyms, int optional)
+int rmodule_collect_relocations(struct rmod_context *ctx,
+				struct reloc_filter *f)
 {
-	int i;
-	Elf64_Sym *syms;
+	struct parsed_elf *pelf = &ctx->pelf;
+	Elf64_Xword nrelocs = 0;
+	Elf64_Half i;
 
-	syms = ctx->pelf.syms;
+	/*
+	 * The relocs array in the pelf should only contain relocations that
+	 * apply to the program. Allocate room for all of them, then collect
+	 * the ones to be emitted in a single pass.
+	 */
+	for (i = 0; i < pelf->ehdr.e_shnum; i++) {
+		if (pelf->relocs[i] != NULL)
+			nrelocs += pelf->shdr[i].sh_size / pelf->shdr[i].sh_entsize;
+	}
 
-	for (i = 0; i < nsyms; i++) {
-		if (syms[i].st_name == 0)
-			continue;
-		if (strcmp(sym_name, &ctx->strtab[syms[i].st_name]))
-			continue;
-		DEBUG("%s -> 0x%llx\n", sym_name, (long long)syms[i].st_value);
-		*addr = syms[i].st_value;
-		return 0;
+	ctx->nrelocs = 0;
+	if (nrelocs) {
+		ctx->emitted_relocs = calloc(nrelocs, sizeof(Elf64_Addr));
+		if (ctx->emitted_relocs == NULL) {
+			ERROR("Unable to allocate memory for relocations.\n");
+			return -1;
+		}
+		if (for_each_reloc(ctx, f))
+			return -1;
 	}
 
-	if (optional) {
-		DEBUG("optional symbol '%s' not found.\n", sym_name);
-		*addr = 0;
+	INFO("%" PRIu64 " relocations to be emitted.\n", ctx->nrelocs);
+	if (!ctx->nrelocs)
 		return 0;
-	}
 
-	ERROR("symbol '%s' not found.\n", sym_name);
-	return -1;
+	/* Sort the relocations by their address. */
+	return sort_relocs(ctx->emitted_relocs, ctx->nrelocs);
 }
 
 static int populate_rmodule_info(struct rmod_context *ctx)
 {
-	int i;
+	struct {
+		const char *name;
+		Elf64_Addr *addr;
+		int optional;
+		int found;
+	} syms[] = {
+		{ "_rmodule_params", &ctx->parameters_begin, 1, 0 },
+		{ "_ermodule_params", &ctx->parameters_end, 1, 0 },
+		{ "_bss", &ctx->bss_begin, 0, 0 },
+		{ "_ebss", &ctx->bss_end, 0, 0 },
+	};
 	struct parsed_elf *pelf;
 	Elf64_Ehdr *ehdr;
-	int nsyms;
+	const char *name;
+	size_t i, j;
+	size_t nsyms;
 
 	pelf = &ctx->pelf;
 	ehdr = &pelf->ehdr;
@@ -436,17 +466,31 @@ static int populate_rmodule_info(struct rmod_context *ctx)
 		break;
 	}
 
-	if (populate_sym(ctx, "_rmodule_params", &ctx->parameters_begin, nsyms, 1))
-		return -1;
-
-	if (populate_sym(ctx, "_ermodule_params", &ctx->parameters_end, nsyms, 1))
-		return -1;
-
-	if (populate_sym(ctx, "_bss", &ctx->bss_begin, nsyms, 0))
-		return -1;
+	/* Look up all symbols in one pass, the first match of a name wins. */
+	for (i = 0; i < nsyms; i++) {
+		if (pelf->syms[i].st_name == 0)
+			continue;
+		name = &ctx->strtab[pelf->syms[i].st_name];
+		for (j = 0; j < ARRAY_SIZE(syms); j++) {
+			if (syms[j].found || strcmp(syms[j].name, name))
+				continue;
+			DEBUG("%s -> 0x%llx\n", name,
+			      (long long)pelf->syms[i].st_value);
+			*syms[j].addr = pelf->syms[i].st_value;
+			syms[j].found = 1;
+		}
+	}
 
-	if (populate_sym(ctx, "_ebss", &ctx->bss_end, nsyms, 0))
-		return -1;
+	for (j = 0; j < ARRAY_SIZE(syms); j++) {
+		if (syms[j].found)
+			continue;
+		if (!syms[j].optional) {
+			ERROR("symbol '%s' not found.\n", syms[j].name);
+			return -1;
+		}
+		DEBUG("optional symbol '%s' not found.\n", syms[j].name);
+		*syms[j].addr = 0;
+	}
 
 	return 0;
 }
@@ -68,9 +68,8 @@ int rmodule_init(struct rmod_context *ctx, const struct buffer *elfin);
 /*
  * Collect all the relocations that apply to the program in
  * nrelocs/emitted_relocs. One can optionally provide a reloc_filter object
- * to help in relocation filtering. The filter function will be called twice:
- * once for counting and once for emitting. The same response should be
- * provided for each call. Returns 0 on success, < 0 on error.
+ * to help in relocation filtering. The filter function will be called once
+ * for each relocation. Returns 0 on success, < 0 on error.
  */
 int rmodule_collect_relocations(struct rmod_context *c, struct reloc_filter *f);
 
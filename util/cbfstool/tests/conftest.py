@@ -10,3 +10,14 @@ def pytest_addoption(parser):
         type=pathlib.Path,
         default=(here / ".." / "elogtool").resolve(),
     )
+    parser.addoption(
+        "--rmodtool-path",
+        type=pathlib.Path,
+        default=(here / ".." / "rmodtool").resolve(),
+    )
+    parser.addoption(
+        "--ramstage-elf",
+        type=pathlib.Path,
+        default=None,
+        help="ELF to benchmark rmodtool with, e.g. build/cbfs/fallback/ramstage.debug",
+    )
@@ -0,0 +1,108 @@
+#!/usr/bin/python3
+# SPDX-License-Identifier: BSD-3-Clause
+
+import os
+import platform
+import pytest
+import random
+import shutil
+import struct
+import subprocess
+import time
+
+# Number of absolute relocations in the generated test program.
+NUM_RELOCS = 200000
+NUM_OBJECTS = 4096
+
+LINKER_SCRIPT = """
+ENTRY(_start)
+SECTIONS {
+	. = 0;
+	.payload : {
+		*(.text*) *(.rodata*) *(.data*)
+		_bss = .;
+		*(.bss*) *(COMMON)
+		_ebss = .;
+	}
+}
+"""
+
+
+def elf64_sections(data: bytes) -> dict:
+    """Return a dict mapping section names to their contents."""
+    e_shoff, = struct.unpack_from("<Q", data, 0x28)
+    e_shentsize, e_shnum, e_shstrndx = struct.unpack_from("<HHH", data, 0x3a)
+
+    headers = []
+    for i in range(e_shnum):
+        sh_name, _, _, _, sh_offset, sh_size = struct.unpack_from(
+            "<IIQQQQ", data, e_shoff + i * e_shentsize)
+        headers.append((sh_name, sh_offset, sh_size))
+
+    _, strtab_offset, _ = headers[e_shstrndx]
+    sections = {}
+    for sh_name, sh_offset, sh_size in headers:
+        end = data.index(b"\0", strtab_offset + sh_name)
+        name = data[strtab_offset + sh_name:end].decode()
+        sections[name] = data[sh_offset:sh_offset + sh_size]
+    return sections
+
+
+@pytest.fixture(scope="session")
+def rmodtool_path(request):
+    exe = request.config.option.rmodtool_path
+    assert os.path.exists(exe)
+    return exe
+
+
+@pytest.fixture(scope="session")
+def program_elf(tmp_path_factory):
+    """Link a program with NUM_RELOCS absolute relocations using the host toolchain."""
+    if platform.machine() != "x86_64" or not shutil.which("cc") or not shutil.which("ld"):
+        pytest.skip("requires an x86_64 host toolchain")
+
+    tmp_path = tmp_path_factory.mktemp("rmodtool")
+    rng = random.Random(0)
+    source = [f"int objects[{NUM_OBJECTS}];", "void _start(void) {}"]
+    source.append("void *table[] = {")
+    source += [f"&objects[{rng.randrange(NUM_OBJECTS)}]," for _ in range(NUM_RELOCS)]
+    source.append("};")
+
+    (tmp_path / "program.c").write_text("\n".join(source))
+    (tmp_path / "program.ld").write_text(LINKER_SCRIPT)
+
+    subprocess.run(["cc", "-g", "-O0", "-fno-pic", "-c", "-o", tmp_path / "program.o",
+                    tmp_path / "program.c"], check=True)
+    subprocess.run(["ld", "-static", "-nostdlib", "--emit-relocs", "--no-warn-rwx-segments",
+                    "-T", tmp_path / "program.ld", "-o", tmp_path / "program.elf",
+                    tmp_path / "program.o"], check=True)
+    return tmp_path / "program.elf"
+
+
+def run_rmodtool(rmodtool_path, elf, rmod) -> float:
+    start = time.perf_counter()
+    subprocess.run([rmodtool_path, "-i", elf, "-o", rmod], check=True)
+    return time.perf_counter() - start
+
+
+def test_relocations_sorted(rmodtool_path, program_elf, tmp_path):
+    rmod = tmp_path / "program.rmod"
+    run_rmodtool(rmodtool_path, program_elf, rmod)
+
+    relocs = elf64_sections(rmod.read_bytes())[".relocs"]
+    addrs = [addr for addr, in struct.iter_unpack("<Q", relocs)]
+
+    assert len(addrs) == NUM_RELOCS
+    assert addrs == sorted(addrs)
+    assert len(set(addrs)) == NUM_RELOCS
+
+
+def test_benchmark(rmodtool_path, program_elf, tmp_path, request):
+    """Time rmodtool on --ramstage-elf if given, or on the generated program."""
+    elf = request.config.option.ramstage_elf or program_elf
+    runs = 5
+
+    times = [run_rmodtool(rmodtool_path, elf, tmp_path / "out.rmod") for _ in range(runs)]
+
+    print(f"\nrmodtool on {elf}: best {min(times) * 1000:.1f} ms, "
+          f"mean {sum(times) / runs * 1000:.1f} ms over {runs} runs")
@@ -2,15 +2,37 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <time.h>
 #include "jpeg.h"
 
-const int depth = 16;
+/* 32bpp xRGB, like most framebuffers. */
+static const struct jpeg_pixel_format format = {
+	.bits_per_pixel = 32,
+	.red_pos = 16, .red_size = 8,
+	.green_pos = 8, .green_size = 8,
+	.blue_pos = 0, .blue_size = 8,
+};
 
+/*
+ * Usage: jpeg-test <file> [iterations]
+ *
+ * Decodes the file once, part by part. With an iteration count, it is decoded
+ * that many times and the average time is printed.
+ */
 int main(int argc, char **argv)
 {
-	FILE *f = fopen(argv[1], "rb");
+	FILE *f;
 	unsigned long len;
+	struct timespec start, end;
+	int iterations = 0;
+	int i;
 
+	if (argc < 2)
+		return 1;
+	if (argc > 2)
+		iterations = atoi(argv[2]);
+
+	f = fopen(argv[1], "rb");
 	if (!f)
 		return 1;
 	if (fseek(f, 0, SEEK_END) != 0)
@@ -19,7 +41,7 @@ int main(int argc, char **argv)
 	if (fseek(f, 0, SEEK_SET) != 0)
 		return 1;
 
-	char *buf = malloc(len);
+	unsigned char *buf = malloc(len);
 	struct jpeg_decdata *decdata = malloc(sizeof(*decdata));
 	if (fread(buf, len, 1, f) != 1)
 		return 1;
@@ -27,10 +49,27 @@ int main(int argc, char **argv)
 
 	int width;
 	int height;
-	jpeg_fetch_size(buf, &width, &height);
-	//printf("width: %d, height: %d\n", width, height);
-	char *pic = malloc(depth / 8 * width * height);
-	int ret = jpeg_decode(buf, pic, width, height, width * depth / 8, depth, decdata);
-	//printf("ret: %x\n", ret);
-	return ret;
+	int ret = jpeg_fetch_size(buf, len, &width, &height);
+	if (ret)
+		return ret;
+	if (width <= 0 || height <= 0 || width > 16384 || height > 16384)
+		return 1;
+	unsigned char *pic = malloc(format.bits_per_pixel / 8 * width * height);
+	ret = jpeg_decode_init(buf, len, pic, width * format.bits_per_pixel / 8, &format,
+			       decdata);
+	if (!ret && (decdata->width != width || decdata->height != height))
+		ret = ERR_BAD_WIDTH_OR_HEIGHT;
+	for (i = 0; !ret && i < decdata->parts; i++)
+		ret = jpeg_decode_part(decdata, i);
+	if (ret || !iterations)
+		return ret;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < iterations; i++)
+		jpeg_decode(buf, len, pic, width * format.bits_per_pixel / 8, &format, decdata);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	printf("%dx%d, %d parts: %.3f ms per decode\n", width, height, decdata->parts,
+	       ((end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6) /
+	       iterations);
+	return 0;
 }
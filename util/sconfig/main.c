@@ -1391,6 +1391,188 @@ static void walk_device_tree(FILE *fil, FILE *head, struct device *ptr,
 	}
 }
 
+/*
+ * Devicetree lookup table. Stages before ramstage find devices by walking the device lists
+ * of the static devicetree. Emit a perfect hash table mapping a key computed from the path
+ * values to the list of devices with that key, in all_devices order. Keys are placed with
+ * hash and displace: the keys are distributed into buckets, and every bucket gets the
+ * displacement that moves its keys to free slots. The key and the hash function need to
+ * match the ones in src/device/device_const.c.
+ */
+struct lookup_key {
+	uint32_t key;
+	unsigned int first;
+	unsigned int bucket;
+	unsigned int slot;
+};
+
+static struct device **lookup_devs;
+static size_t lookup_num_devs;
+
+static uint32_t lookup_hash(uint32_t key, uint32_t seed)
+{
+	key ^= seed * 0x9e3779b9;
+	key ^= key >> 16;
+	key *= 0x85ebca6b;
+	key ^= key >> 13;
+	key *= 0xc2b2ae35;
+	key ^= key >> 16;
+	return key;
+}
+
+static uint32_t lookup_path_key(const struct device *dev)
+{
+	uint32_t a = dev->path_a;
+	uint32_t b = dev->path_b;
+
+	if (dev->bustype == PCI) {
+		a = a << 3 | b;
+		b = 0;
+	}
+
+	return a ^ (b << 16 | b >> 16);
+}
+
+static void collect_lookup_devs(FILE *fil, FILE *head, struct device *ptr,
+				struct device *next)
+{
+	if (ptr == &base_root_dev)
+		return;
+
+	lookup_devs = realloc(lookup_devs, (lookup_num_devs + 1) * sizeof(*lookup_devs));
+	if (!lookup_devs) {
+		fprintf(stderr, "%s: Failed to alloc mem!\n", __func__);
+		exit(1);
+	}
+	lookup_devs[lookup_num_devs++] = ptr;
+}
+
+static int place_lookup_bucket(struct lookup_key *keys, size_t num_keys, unsigned int bucket,
+			       uint32_t disp, unsigned int *slot_used, unsigned int size)
+{
+	size_t i, j;
+
+	for (i = 0; i < num_keys; i++) {
+		if (keys[i].bucket != bucket)
+			continue;
+		keys[i].slot = lookup_hash(keys[i].key, disp + 1) % size;
+		if (slot_used[keys[i].slot])
+			return 0;
+		for (j = 0; j < i; j++) {
+			if (keys[j].bucket == bucket && keys[j].slot == keys[i].slot)
+				return 0;
+		}
+	}
+
+	for (i = 0; i < num_keys; i++) {
+		if (keys[i].bucket == bucket)
+			slot_used[keys[i].slot] = 1;
+	}
+
+	return 1;
+}
+
+static void emit_lookup_table(FILE *fil)
+{
+	struct lookup_key *keys;
+	size_t num_keys = 0;
+	unsigned int *bucket_size, *slot_used;
+	uint32_t *disp;
+	unsigned int buckets, size, max, b, pos;
+	size_t i, j, k;
+
+	walk_device_tree(NULL, NULL, &base_root_dev, collect_lookup_devs);
+	keys = S_ALLOC((lookup_num_devs + 1) * sizeof(*keys));
+
+	for (i = 0; i < lookup_num_devs; i++) {
+		uint32_t key = lookup_path_key(lookup_devs[i]);
+
+		for (j = 0; j < num_keys; j++) {
+			if (keys[j].key == key)
+				break;
+		}
+		if (j == num_keys)
+			keys[num_keys++].key = key;
+	}
+
+	buckets = num_keys / 2 + 1;
+	size = num_keys + num_keys / 4 + 1;
+	/* The device lists hold all devices plus one NULL per key and the empty one. */
+	if (lookup_num_devs + num_keys + 1 > UINT16_MAX) {
+		fprintf(stderr, "ERROR: Too many devices for the lookup table\n");
+		exit(1);
+	}
+
+	bucket_size = S_ALLOC(buckets * sizeof(*bucket_size));
+	slot_used = S_ALLOC(size * sizeof(*slot_used));
+	disp = S_ALLOC(buckets * sizeof(*disp));
+
+	for (i = 0; i < num_keys; i++) {
+		keys[i].bucket = lookup_hash(keys[i].key, 0) % buckets;
+		bucket_size[keys[i].bucket]++;
+	}
+
+	/* Place the largest buckets first, while most slots are still free. */
+	for (max = num_keys; max > 0; max--) {
+		for (b = 0; b < buckets; b++) {
+			if (bucket_size[b] != max)
+				continue;
+			while (!place_lookup_bucket(keys, num_keys, b, disp[b], slot_used, size)) {
+				if (++disp[b] == UINT16_MAX) {
+					fprintf(stderr, "ERROR: No perfect hash for the lookup table\n");
+					exit(1);
+				}
+			}
+		}
+	}
+
+	fprintf(fil, "\n/* lookup table */\n");
+	fprintf(fil, "#if DEVTREE_EARLY && CONFIG(DEVTREE_LOOKUP_TABLE)\n");
+
+	/* The list of devices for every key ends with NULL. Empty slots use the first one. */
+	fprintf(fil, "STORAGE struct device *const devtree_lookup_devs[] = {\n");
+	fprintf(fil, "\tNULL,\n");
+	pos = 1;
+	for (i = 0; i < num_keys; i++) {
+		keys[i].first = pos;
+		for (k = 0; k < lookup_num_devs; k++) {
+			if (lookup_path_key(lookup_devs[k]) != keys[i].key)
+				continue;
+			fprintf(fil, "\t&%s,\n", lookup_devs[k]->name);
+			pos++;
+		}
+		fprintf(fil, "\tNULL,\n");
+		pos++;
+	}
+	fprintf(fil, "};\n");
+
+	fprintf(fil, "static const uint16_t devtree_lookup_disp[] = {\n");
+	for (b = 0; b < buckets; b++)
+		fprintf(fil, "\t%u,\n", disp[b]);
+	fprintf(fil, "};\n");
+
+	fprintf(fil, "static const struct devtree_lookup_slot devtree_lookup_slots[%u] = {\n",
+		size);
+	for (i = 0; i < num_keys; i++)
+		fprintf(fil, "\t[%u] = { .key = 0x%08x, .first = %u },\n", keys[i].slot,
+			keys[i].key, keys[i].first);
+	fprintf(fil, "};\n");
+
+	fprintf(fil, "const struct devtree_lookup devtree_lookup = {\n");
+	fprintf(fil, "\t.buckets = %u,\n", buckets);
+	fprintf(fil, "\t.size = %u,\n", size);
+	fprintf(fil, "\t.disp = devtree_lookup_disp,\n");
+	fprintf(fil, "\t.slots = devtree_lookup_slots,\n");
+	fprintf(fil, "\t.devs = devtree_lookup_devs,\n");
+	fprintf(fil, "};\n");
+	fprintf(fil, "#endif\n");
+
+	free(disp);
+	free(slot_used);
+	free(bucket_size);
+	free(keys);
+}
+
 static void emit_chip_headers(FILE *fil, struct chip *chip)
 {
 	struct chip *tmp = chip;
@@ -1966,6 +2148,7 @@ static void generate_outputc(FILE *f, const char *static_header)
 	emit_chip_configs(f);
 	fprintf(f, "\n/* pass 1 */\n");
 	walk_device_tree(f, NULL, &base_root_dev, pass1);
+	emit_lookup_table(f);
 }
 
 static void generate_outputd(FILE *gen, FILE *dev)